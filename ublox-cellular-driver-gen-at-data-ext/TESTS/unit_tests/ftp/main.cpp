@@ -129,6 +129,14 @@ using namespace utest::v1;
 #  define MBED_CONF_APP_FTP_FILE_SIZE 42000
 #endif
 
+// Set this to the size of a buffer in which to record a transcript
+// of everything that passes between the driver and the module during
+// the test, printed at the end for replay on a PC with
+// ublox-cellular-driver-gen/host/transcript_replay; 0 for none.
+#ifndef MBED_CONF_APP_TRANSCRIPT_SIZE
+# define MBED_CONF_APP_TRANSCRIPT_SIZE 0
+#endif
+
 // ----------------------------------------------------------------
 // PRIVATE VARIABLES
 // ----------------------------------------------------------------
@@ -144,6 +152,14 @@ static UbloxATCellularInterfaceExt *pDriver =
 // A buffer for general use
 static char buf[MBED_CONF_APP_FTP_FILE_SIZE];
 
+#if MBED_CONF_APP_TRANSCRIPT_SIZE > 0
+// Where the transcript is recorded
+static char transcript[MBED_CONF_APP_TRANSCRIPT_SIZE];
+#endif
+
+// A cancel token for FTP commands
+static UbloxCancelToken cancelToken;
+
 // ----------------------------------------------------------------
 // PRIVATE FUNCTIONS
 // ----------------------------------------------------------------
@@ -159,6 +175,14 @@ static void unlock()
     mtx.unlock();
 }
 
+// Cancel the FTP command in progress, from another thread,
+// while it waits for the server
+static void cancelFtp()
+{
+    wait_ms(20);
+    cancelToken.cancel();
+}
+
 
 // Write a file to the module's file system with known contents
 void createFile(const char * filename) {
@@ -205,25 +229,23 @@ void test_ftp_login() {
     // Set a timeout for FTP commands
     TEST_ASSERT(pDriver->ftpSetTimeout(60000));
 
-    // Set up the FTP server parameters
-    TEST_ASSERT(pDriver->ftpSetPar(UbloxATCellularInterfaceExt::FTP_SERVER_NAME,
-                                   MBED_CONF_APP_FTP_SERVER));
-    TEST_ASSERT(pDriver->ftpSetPar(UbloxATCellularInterfaceExt::FTP_SERVER_PORT,
-                                   portString));
-    TEST_ASSERT(pDriver->ftpSetPar(UbloxATCellularInterfaceExt::FTP_USER_NAME,
-                                   MBED_CONF_APP_FTP_USERNAME));
-    TEST_ASSERT(pDriver->ftpSetPar(UbloxATCellularInterfaceExt::FTP_PASSWORD,
-                                   MBED_CONF_APP_FTP_PASSWORD));
+    // Set up the FTP server parameters, all in one go
+    UbloxATCellularInterfaceExt::FtpPar ftpPars[] = {
+        {UbloxATCellularInterfaceExt::FTP_SERVER_NAME, MBED_CONF_APP_FTP_SERVER},
+        {UbloxATCellularInterfaceExt::FTP_SERVER_PORT, portString},
+        {UbloxATCellularInterfaceExt::FTP_USER_NAME, MBED_CONF_APP_FTP_USERNAME},
+        {UbloxATCellularInterfaceExt::FTP_PASSWORD, MBED_CONF_APP_FTP_PASSWORD},
 #ifdef MBED_CONF_APP_FTP_ACCOUNT
-    TEST_ASSERT(pDriver->ftpSetPar(UbloxATCellularInterfaceExt::FTP_ACCOUNT,
-                                   MBED_CONF_APP_FTP_ACCOUNT));
+        {UbloxATCellularInterfaceExt::FTP_ACCOUNT, MBED_CONF_APP_FTP_ACCOUNT},
 #endif
 #if MBED_CONF_APP_FTP_SECURE
-    TEST_ASSERT(pDriver->ftpSetPar(UbloxATCellularInterfaceExt::FTP_SECURE, "1"));
+        {UbloxATCellularInterfaceExt::FTP_SECURE, "1"},
 #endif
 #if MBED_CONF_APP_FTP_USE_PASSIVE
-    TEST_ASSERT(pDriver->ftpSetPar(UbloxATCellularInterfaceExt::FTP_MODE, "1"));
+        {UbloxATCellularInterfaceExt::FTP_MODE, "1"},
 #endif
+    };
+    TEST_ASSERT(pDriver->ftpSetPars(ftpPars, sizeof (ftpPars) / sizeof (ftpPars[0])));
 
     // Now connect to the network
     TEST_ASSERT(pDriver->connect(MBED_CONF_APP_DEFAULT_PIN, MBED_CONF_APP_APN,
@@ -246,9 +268,9 @@ void test_ftp_dir() {
     tr_debug("Listing:\n%s", buf);
 
     // The file we will GET should appear in the directory listing
-    TEST_ASSERT(strstr(buf, MBED_CONF_APP_FTP_FILENAME) > NULL);
+    TEST_ASSERT(strstr(buf, MBED_CONF_APP_FTP_FILENAME) != NULL);
     // As should the directory name we will change to
-    TEST_ASSERT(strstr(buf, MBED_CONF_APP_FTP_DIRNAME) > NULL);
+    TEST_ASSERT(strstr(buf, MBED_CONF_APP_FTP_DIRNAME) != NULL);
 }
 
 // Test FTP file information
@@ -260,7 +282,7 @@ void test_ftp_fileinfo() {
     tr_debug("File info:\n%s", buf);
 
     // The file info string should at least include the file name
-    TEST_ASSERT(strstr(buf, MBED_CONF_APP_FTP_FILENAME) > NULL);
+    TEST_ASSERT(strstr(buf, MBED_CONF_APP_FTP_FILENAME) != NULL);
 }
 
 #if MBED_CONF_APP_FTP_SERVER_SUPPORTS_WRITE
@@ -318,7 +340,7 @@ void test_ftp_rename() {
     tr_debug("Listing:\n%s", buf);
 
     // The new file should now exist
-    TEST_ASSERT(strstr(buf,  MBED_CONF_APP_FTP_FILENAME "_2") > NULL);
+    TEST_ASSERT(strstr(buf,  MBED_CONF_APP_FTP_FILENAME "_2") != NULL);
 
 }
 
@@ -330,7 +352,7 @@ void test_ftp_delete() {
     tr_debug("Listing:\n%s", buf);
 
     // The file we are to delete should appear in the list
-    TEST_ASSERT(strstr(buf,  MBED_CONF_APP_FTP_FILENAME "_2") > NULL);
+    TEST_ASSERT(strstr(buf,  MBED_CONF_APP_FTP_FILENAME "_2") != NULL);
 
     // Delete the file
     TEST_ASSERT(pDriver->ftpCommand(UbloxATCellularInterfaceExt::FTP_DELETE_FILE,
@@ -365,7 +387,7 @@ void test_ftp_mkdir() {
     tr_debug("Listing:\n%s", buf);
 
     // The directory we created should now appear in the list
-    TEST_ASSERT(strstr(buf,  MBED_CONF_APP_FTP_DIRNAME) > NULL);
+    TEST_ASSERT(strstr(buf,  MBED_CONF_APP_FTP_DIRNAME) != NULL);
 }
 
 // Test FTP RMDIR
@@ -376,7 +398,7 @@ void test_ftp_rmdir() {
     tr_debug("Listing:\n%s", buf);
 
     // The directory we are to remove should appear in the list
-    TEST_ASSERT(strstr(buf,  MBED_CONF_APP_FTP_DIRNAME) > NULL);
+    TEST_ASSERT(strstr(buf,  MBED_CONF_APP_FTP_DIRNAME) != NULL);
 
     // Remove the directory
     TEST_ASSERT(pDriver->ftpCommand(UbloxATCellularInterfaceExt::FTP_RMDIR,
@@ -418,7 +440,7 @@ void test_ftp_cd() {
     tr_debug("Listing:\n%s", buf);
 
     // The listing should include the directory name we are going to move to
-    TEST_ASSERT(strstr(buf, MBED_CONF_APP_FTP_DIRNAME) > NULL);
+    TEST_ASSERT(strstr(buf, MBED_CONF_APP_FTP_DIRNAME) != NULL);
 
     // Change directories
     TEST_ASSERT(pDriver->ftpCommand(UbloxATCellularInterfaceExt::FTP_CD,
@@ -443,7 +465,7 @@ void test_ftp_cd() {
     tr_debug("Listing:\n%s", buf);
 
     // The listing should include the directory name we went to once more
-    TEST_ASSERT(strstr(buf, MBED_CONF_APP_FTP_DIRNAME) > NULL);
+    TEST_ASSERT(strstr(buf, MBED_CONF_APP_FTP_DIRNAME) != NULL);
 }
 
 #ifdef MBED_CONF_APP_FTP_FOTA_FILENAME
@@ -462,6 +484,36 @@ void test_ftp_fota() {
 }
 #endif
 
+// Test that an FTP command can be cancelled, from another thread or
+// by a deadline, and that FTP still works afterwards
+void test_ftp_cancel() {
+    Thread thread;
+
+    cancelToken.reset();
+    thread.start(callback(cancelFtp));
+    TEST_ASSERT(pDriver->ftpCommand(UbloxATCellularInterfaceExt::FTP_LS,
+                                    NULL, NULL, 0, buf, sizeof (buf), &cancelToken) != NULL);
+    thread.join();
+    TEST_ASSERT(cancelToken.isCancelled());
+    TEST_ASSERT(pDriver->getLastAtError().eType == UbloxCellularDriverGen::AT_ERROR_ABORTED);
+
+    *buf = 0;
+    TEST_ASSERT(pDriver->ftpCommand(UbloxATCellularInterfaceExt::FTP_LS,
+                                    NULL, NULL, 0, buf, sizeof (buf)) == NULL);
+    TEST_ASSERT(strlen(buf) > 0);
+
+    cancelToken.reset();
+    cancelToken.setTimeout(0);
+    TEST_ASSERT(cancelToken.isExpired());
+    TEST_ASSERT(!cancelToken.isCancelled());
+    TEST_ASSERT(pDriver->ftpCommand(UbloxATCellularInterfaceExt::FTP_LS,
+                                    NULL, NULL, 0, buf, sizeof (buf), &cancelToken) != NULL);
+    TEST_ASSERT(pDriver->getLastAtError().eType == UbloxCellularDriverGen::AT_ERROR_ABORTED);
+
+    TEST_ASSERT(pDriver->ftpCommand(UbloxATCellularInterfaceExt::FTP_LS,
+                                    NULL, NULL, 0, buf, sizeof (buf)) == NULL);
+}
+
 // Test logout and disconnect from an FTP session
 void test_ftp_logout() {
     // Log out from the FTP server
@@ -473,6 +525,14 @@ void test_ftp_logout() {
     wait_ms(500);
 }
 
+#if MBED_CONF_APP_TRANSCRIPT_SIZE > 0
+// Stop recording the transcript and print it
+void test_transcript() {
+    TEST_ASSERT(pDriver->transcriptStop());
+    pDriver->printTranscript();
+}
+#endif
+
 // ----------------------------------------------------------------
 // TEST ENVIRONMENT
 // ----------------------------------------------------------------
@@ -481,6 +541,9 @@ void test_ftp_logout() {
 utest::v1::status_t test_setup(const size_t number_of_cases) {
     // Setup Greentea with a timeout
     GREENTEA_SETUP(540, "default_auto");
+#if MBED_CONF_APP_TRANSCRIPT_SIZE > 0
+    pDriver->transcriptStart(transcript, sizeof (transcript));
+#endif
     return verbose_test_setup_handler(number_of_cases);
 }
 
@@ -506,7 +569,11 @@ Case cases[] = {
 #ifdef MBED_CONF_APP_FTP_FOTA_FILENAME
     Case("FTP FOTA", test_ftp_fota),
 #endif
-    Case("FTP log out", test_ftp_logout)
+    Case("FTP cancel", test_ftp_cancel),
+    Case("FTP log out", test_ftp_logout),
+#if MBED_CONF_APP_TRANSCRIPT_SIZE > 0
+    Case("Print transcript", test_transcript),
+#endif
 };
 
 Specification specification(test_setup, cases);
@@ -57,6 +57,14 @@ using namespace utest::v1;
 // The maximum number of HTTP profiles
 #define MAX_PROFILES 4
 
+// Set this to the size of a buffer in which to record a transcript
+// of everything that passes between the driver and the module during
+// the test, printed at the end for replay on a PC with
+// ublox-cellular-driver-gen/host/transcript_replay; 0 for none.
+#ifndef MBED_CONF_APP_TRANSCRIPT_SIZE
+# define MBED_CONF_APP_TRANSCRIPT_SIZE 0
+#endif
+
 // ----------------------------------------------------------------
 // PRIVATE VARIABLES
 // ----------------------------------------------------------------
@@ -73,6 +81,16 @@ static UbloxATCellularInterfaceExt *pDriver =
 static char buf[1024];
 static char buf1[sizeof(buf)];
 
+// A block for a response handed to a sink and where
+// the response has got to in buf1
+static char block[64];
+static int sinkCount;
+
+#if MBED_CONF_APP_TRANSCRIPT_SIZE > 0
+// Where the transcript is recorded
+static char transcript[MBED_CONF_APP_TRANSCRIPT_SIZE];
+#endif
+
 // ----------------------------------------------------------------
 // PRIVATE FUNCTIONS
 // ----------------------------------------------------------------
@@ -88,6 +106,17 @@ static void unlock()
     mtx.unlock();
 }
 
+// Sink for a response: append it to buf1
+static bool sink(const char *data, int size)
+{
+    if (sinkCount + size > (int) sizeof (buf1)) {
+        return false;
+    }
+    memcpy(buf1 + sinkCount, data, size);
+    sinkCount += size;
+    return true;
+}
+
 // ----------------------------------------------------------------
 // TESTS
 // ----------------------------------------------------------------
@@ -126,6 +155,17 @@ void test_http_cmd() {
     tr_debug("Received: %s", buf);
     TEST_ASSERT(strstr(buf, "\"http://httpbin.org/get\"") != NULL);
 
+    // Check that the same response can be handed to a sink,
+    // a small block at a time
+    sinkCount = 0;
+    memset(buf1, 0, sizeof (buf1));
+    TEST_ASSERT(pDriver->httpCommand(profile, UbloxATCellularInterfaceExt::HTTP_GET,
+                                     "/get",
+                                     NULL, NULL, 0, NULL,
+                                     callback(sink), block, sizeof (block)) == NULL);
+    TEST_ASSERT(sinkCount == (int) strlen(buf));
+    TEST_ASSERT(memcmp(buf1, buf, sinkCount) == 0);
+
     // Check HTTP delete request
     memset(buf, 0, sizeof (buf));
     TEST_ASSERT(pDriver->httpCommand(profile, UbloxATCellularInterfaceExt::HTTP_DELETE,
@@ -205,8 +245,11 @@ void test_http_tls() {
 
     // Set up the server to talk to and TLS, using the IP address this time just for variety
     TEST_ASSERT(pDriver->gethostbyname("amazon.com", &address) == 0);
-    TEST_ASSERT(pDriver->httpSetPar(profile, UbloxATCellularInterfaceExt::HTTP_IP_ADDRESS, address.get_ip_address()));
-    TEST_ASSERT(pDriver->httpSetPar(profile, UbloxATCellularInterfaceExt::HTTP_SECURE, "1"));
+    UbloxATCellularInterfaceExt::HttpPar httpPars[] = {
+        {UbloxATCellularInterfaceExt::HTTP_IP_ADDRESS, address.get_ip_address()},
+        {UbloxATCellularInterfaceExt::HTTP_SECURE, "1"}
+    };
+    TEST_ASSERT(pDriver->httpSetPars(profile, httpPars, sizeof (httpPars) / sizeof (httpPars[0])));
 
     // Check HTTP get request
     memset(buf, 0, sizeof (buf));
@@ -239,6 +282,7 @@ void test_http_tls() {
 // Allocate max profiles
 void test_alloc_profiles() {
     int profiles[MAX_PROFILES];
+    UbloxCellularDriverGen::Capabilities caps;
 
     TEST_ASSERT(pDriver->connect(MBED_CONF_APP_DEFAULT_PIN, MBED_CONF_APP_APN,
                                  MBED_CONF_APP_USERNAME, MBED_CONF_APP_PASSWORD) == 0);
@@ -264,6 +308,12 @@ void test_alloc_profiles() {
     }
     TEST_ASSERT(pDriver->httpAllocProfile() < 0);
 
+    // The module was probed when the first profile was allocated and
+    // the number of profiles given out is the number it has
+    TEST_ASSERT(pDriver->getCapabilities(&caps));
+    TEST_ASSERT(caps.flags & UbloxCellularDriverGen::CAP_HTTP);
+    TEST_ASSERT(caps.numHttpProfiles == MAX_PROFILES);
+
     // Now use the last one and check that it doesn't affect the first one
     TEST_ASSERT(pDriver->httpSetPar(profiles[sizeof (profiles) / sizeof (profiles[0]) - 1],
                                     UbloxATCellularInterfaceExt::HTTP_SERVER_NAME, HTTP_ECHO_SERVER));
@@ -297,6 +347,14 @@ void test_alloc_profiles() {
     wait_ms(500);
 }
 
+#if MBED_CONF_APP_TRANSCRIPT_SIZE > 0
+// Stop recording the transcript and print it
+void test_transcript() {
+    TEST_ASSERT(pDriver->transcriptStop());
+    pDriver->printTranscript();
+}
+#endif
+
 // ----------------------------------------------------------------
 // TEST ENVIRONMENT
 // ----------------------------------------------------------------
@@ -305,6 +363,9 @@ void test_alloc_profiles() {
 utest::v1::status_t test_setup(const size_t number_of_cases) {
     // Setup Greentea with a timeout
     GREENTEA_SETUP(540, "default_auto");
+#if MBED_CONF_APP_TRANSCRIPT_SIZE > 0
+    pDriver->transcriptStart(transcript, sizeof (transcript));
+#endif
     return verbose_test_setup_handler(number_of_cases);
 }
 
@@ -312,7 +373,10 @@ utest::v1::status_t test_setup(const size_t number_of_cases) {
 Case cases[] = {
     Case("HTTP commands", test_http_cmd),
     Case("HTTP with TLS", test_http_tls),
-    Case("Alloc max profiles", test_alloc_profiles)
+    Case("Alloc max profiles", test_alloc_profiles),
+#if MBED_CONF_APP_TRANSCRIPT_SIZE > 0
+    Case("Print transcript", test_transcript),
+#endif
 };
 
 Specification specification(test_setup, cases);
@@ -24,6 +24,46 @@
 #define tr_error(...) (void(0)) // dummies if feature common pal is not added
 #endif
 
+/**********************************************************************
+ * PROTECTED METHODS: Capabilities
+ **********************************************************************/
+
+// Add the HTTP, FTP and Cell Locate features of the module.
+void UbloxATCellularInterfaceExt::probeMoreCapabilities(Capabilities *caps)
+{
+    char info[64];
+    int first;
+    int last;
+
+    // The first range is that of the profile IDs, e.g. "+UHTTP: (0-3),..."
+    if (testCommand("+UHTTP", info, sizeof (info))) {
+        caps->flags |= CAP_HTTP;
+        caps->numHttpProfiles = sizeof (_httpProfiles) / sizeof (_httpProfiles[0]);
+        if ((sscanf(info, "+UHTTP: (%d-%d)", &first, &last) == 2) &&
+            (last - first + 1 < caps->numHttpProfiles)) {
+            caps->numHttpProfiles = last - first + 1;
+        }
+    }
+
+    // The first range is that of the FTP commands
+    if (testCommand("+UFTPC", info, sizeof (info))) {
+        caps->flags |= CAP_FTP;
+        if (inTestRange(info, FTP_GET_DIRECT) && inTestRange(info, FTP_PUT_DIRECT)) {
+            caps->flags |= CAP_FTP_DIRECT;
+        }
+    }
+
+    // Only these modules have a Cell Locate TCP aiding server,
+    // while TOBY-L2 has no UDP one
+    if (((_dev_info.dev == DEV_LISA_U2_03S) || (_dev_info.dev == DEV_SARA_U2)) &&
+        testCommand("+UGSRV")) {
+        caps->flags |= CAP_CELL_LOC_TCP;
+    }
+    if ((_dev_info.dev != DEV_TOBY_L2) && testCommand("+UGAOP")) {
+        caps->flags |= CAP_CELL_LOC_UDP;
+    }
+}
+
 /**********************************************************************
  * PROTECTED METHODS: HTTP
  **********************************************************************/
@@ -31,22 +71,25 @@
 // Callback for HTTP result code handling.
 void UbloxATCellularInterfaceExt::UUHTTPCR_URC()
 {
-    char buf[32];
+    UbloxUrcDispatcher::Scanner scanner(&_urcDispatcher);
     int a, b, c;
 
     // Note: not calling _at->recv() from here as we're
     // already in an _at->recv()
     // +UUHTTPCR: <profile_id>,<op_code>,<param_val>
-    if (read_at_to_char(buf, sizeof (buf), '\n') > 0) {
-        if (sscanf(buf, ": %d,%d,%d", &a, &b, &c) == 3) {
-            _httpProfiles[a].cmd = b;          // Command
-            _httpProfiles[a].result = c;       // Result
-            debug_if(_debug_trace_on, "%s on profile %d, result code is %d\n", getHttpCmd((HttpCmd) b), a, c);
-        }
+    if (scanner.getInt(&a) && scanner.getInt(&b) && scanner.getInt(&c) &&
+        (a >= 0) && (a < (int) (sizeof(_httpProfiles) / sizeof(_httpProfiles[0])))) {
+        stateLock(&_httpMtx);
+        _httpProfiles[a].cmd = b;          // Command
+        _httpProfiles[a].result = c;       // Result
+        stateUnlock(&_httpMtx);
+        _urcEvents.set(URC_EVENT_HTTP(a));
+        TRACE_EVENT(UBLOX_TRACE_HTTP_RESULT, a, b, c);
     }
+    scanner.finish();
 }
 
-// Find a given profile.  NOTE: LOCK() before calling.
+// Find a given profile.  NOTE: lock _httpMtx before calling.
 int UbloxATCellularInterfaceExt::findProfile(int modemHandle)
 {
     for (unsigned int profile = 0; profile < (sizeof(_httpProfiles)/sizeof(_httpProfiles[0]));
@@ -59,35 +102,213 @@ int UbloxATCellularInterfaceExt::findProfile(int modemHandle)
     return HTTP_PROF_UNUSED;
 }
 
-// Return a string representing an HTTP AT command.
-const char *UbloxATCellularInterfaceExt::getHttpCmd(HttpCmd httpCmd)
+// Check that a profile is in use.
+bool UbloxATCellularInterfaceExt::checkProfile(int profile, int *timeout)
 {
-    const char * str = "HTTP command not recognised";
+    bool inUse;
+    stateLock(&_httpMtx);
 
-    switch (httpCmd) {
-        case HTTP_HEAD:
-            str = "HTTP HEAD command";
-            break;
-        case HTTP_GET:
-            str = "HTTP GET command";
-            break;
-        case HTTP_DELETE:
-            str = "HTTP DELETE command";
-            break;
-        case HTTP_PUT:
-            str = "HTTP PUT command";
+    inUse = IS_PROFILE(profile);
+    if (inUse && (timeout != NULL)) {
+        *timeout = _httpProfiles[profile].timeout;
+    }
+
+    stateUnlock(&_httpMtx);
+    return inUse;
+}
+
+// Add the command that sets an HTTP parameter to a batch.
+bool UbloxATCellularInterfaceExt::httpAddPar(UbloxAtBatch *batch, int httpProfile,
+                                             HttpOpCode httpOpCode,
+                                             const char * httpInPar)
+{
+    bool success = false;
+    SocketAddress address;
+
+    switch(httpOpCode) {
+        case HTTP_IP_ADDRESS:   // 0
+            if (gethostbyname(httpInPar, &address) == NSAPI_ERROR_OK) {
+                // The address goes when this returns so the batch keeps a copy
+                batch->add().literal("+UHTTP=").number(httpProfile).literal(",").
+                        number(httpOpCode).literal(",").quotedCopy(address.get_ip_address());
+                success = !batch->overflowed();
+            }
             break;
-        case HTTP_POST_FILE:
-            str = "HTTP POST file command";
+        case HTTP_SERVER_NAME:  // 1
+        case HTTP_USER_NAME:    // 2
+        case HTTP_PASSWORD:     // 3
+            batch->add().literal("+UHTTP=").number(httpProfile).literal(",").
+                    number(httpOpCode).literal(",").quoted(httpInPar);
+            success = !batch->overflowed();
             break;
-        case HTTP_POST_DATA:
-            str = "HTTP POST data command";
+
+        case HTTP_AUTH_TYPE:    // 4
+        case HTTP_SERVER_PORT:  // 5
+        case HTTP_SECURE:       // 6
+            batch->add().literal("+UHTTP=").number(httpProfile).literal(",").
+                    number(httpOpCode).literal(",").number(atoi(httpInPar));
+            success = !batch->overflowed();
             break;
+
         default:
+            debug_if(_debug_trace_on, "httpSetPar: unknown httpOpCode %d\n", httpOpCode);
             break;
     }
 
-    return str;
+    return success;
+}
+
+// Perform an HTTP command and read or hand on the response.
+UbloxATCellularInterfaceExt::Error * UbloxATCellularInterfaceExt::httpRun(int httpProfile,
+                                                                          HttpCmd httpCmd,
+                                                                          const char *httpPath,
+                                                                          const char *rspFile,
+                                                                          const char *sendStr,
+                                                                          int httpContentType,
+                                                                          const char *httpCustomPar,
+                                                                          char *buf, int len,
+                                                                          Callback<bool(const char *, int)> sink,
+                                                                          UbloxCancelToken *token)
+{
+    bool atSuccess = false;
+    bool success = false;
+    bool cancelled = false;
+    int bytesRead = 0;
+    int profileTimeout = TIMEOUT_ADAPTIVE;
+    char defaultFilename[] = "http_last_response_x";
+
+    if (checkProfile(httpProfile, &profileTimeout)) {
+        TRACE_EVENT(UBLOX_TRACE_HTTP_COMMAND, httpProfile, httpCmd);
+        AT_LOCK(AT_PRIORITY_NORMAL);
+        clearAtError();
+        AT_STATS_START();
+
+        if (rspFile == NULL) {
+            sprintf(defaultFilename + sizeof (defaultFilename) - 2, "%1d", httpProfile);
+            rspFile = defaultFilename;
+        }
+
+        // Reset the result before the command goes out so that
+        // a quick +UUHTTPCR can't be missed
+        stateLock(&_httpMtx);
+        _httpProfiles[httpProfile].result = -1;
+        stateUnlock(&_httpMtx);
+        _urcEvents.clear(URC_EVENT_HTTP(httpProfile));
+
+        switch (httpCmd) {
+            case HTTP_HEAD:
+            case HTTP_GET:
+            case HTTP_DELETE:
+            case HTTP_PUT:
+            case HTTP_POST_FILE:
+            case HTTP_POST_DATA:
+                {
+                    UbloxAtCommand command = AT_COMMAND(AT_CHANNEL_CONTROL);
+                    command.literal("AT+UHTTPC=").number(httpProfile).literal(",").number(httpCmd).
+                            literal(",").quoted(httpPath).literal(",").quoted(rspFile);
+                    if (httpCmd == HTTP_PUT) {
+                        // In this case the parameter sendStr is a filename
+                        command.literal(",").quoted(sendStr);
+                    } else if ((httpCmd == HTTP_POST_FILE) || (httpCmd == HTTP_POST_DATA)) {
+                        // In these cases the parameter sendStr is a filename
+                        // or a string containing data respectively
+                        command.literal(",").quoted(sendStr).literal(",").number(httpContentType);
+                        if (httpContentType == 6) {
+                            command.literal(",").text(httpCustomPar);
+                        }
+                    }
+                    atSuccess = command.send() && _at->recv(AT_OK);
+                }
+                break;
+            default:
+                debug_if(_debug_trace_on, "HTTP command not recognised\n");
+                break;
+        }
+
+        if (atSuccess) {
+            Timer timer;
+            int timeout = profileTimeout;
+
+            if (timeout == TIMEOUT_ADAPTIVE) {
+                timeout = AT_TIMEOUT_MS(AT_FAMILY_UHTTPC, TIMEOUT_BLOCKING);
+            }
+            _httpProfiles[httpProfile].pending = true;
+
+            // Waiting for unsolicited result code
+            timer.start();
+            while (_httpProfiles[httpProfile].pending) {
+                if (_httpProfiles[httpProfile].result != -1) {
+                    // Received unsolicited: starting its analysis
+                    AT_TIMEOUT_MEASURED(AT_FAMILY_UHTTPC, timer.read_us());
+                    _httpProfiles[httpProfile].pending = false;
+                    if (_httpProfiles[httpProfile].result == 1) {
+                        // HTTP command successfully executed; the
+                        // response file is new, or at least a new size
+                        fileIndexSet(rspFile, -1);
+                        if (sink) {
+                            bytesRead = readFile(rspFile, sink, buf, len, token);
+                        } else {
+                            bytesRead = readFile(rspFile, buf, len, token);
+                        }
+                        if (bytesRead >= 0) {
+                            success = true;
+                        } else {
+                            cancelled = (bytesRead == AT_QUEUE_CANCELLED) ||
+                                        (bytesRead == AT_QUEUE_DEADLINE);
+                        }
+                    } else if (CANCEL_TOKEN_EXPIRED(token)) {
+                        cancelled = true;
+                    } else {
+                        // Retrieve the error class and code
+                        if (AT_COMMAND(AT_CHANNEL_CONTROL).literal("AT+UHTTPER=").
+                            number(httpProfile).send() &&
+                            _at->recv("AT+UHTTPER=%*d,%d,%d",
+                                      &(_httpProfiles[httpProfile].httpError.eClass),
+                                      &(_httpProfiles[httpProfile].httpError.eCode)) &&
+                            _at->recv(AT_OK)) {
+                            debug_if(_debug_trace_on, "HTTP error class %d, code %d\n",
+                                    _httpProfiles[httpProfile].httpError.eClass,
+                                    _httpProfiles[httpProfile].httpError.eCode);
+                        }
+                    }
+                } else if (CANCEL_TOKEN_EXPIRED(token)) {
+                    // The module has no abort for HTTP, so just stop waiting
+                    cancelled = true;
+                    _httpProfiles[httpProfile].pending = false;
+                } else if (!TIMEOUT(timer, timeout)) {
+                    // Wait for the URC, which the URC thread will pick up
+                    waitUrcEvents(URC_EVENT_HTTP(httpProfile), TIME_LEFT(timer, timeout), token);
+                } else  {
+                    if (profileTimeout == TIMEOUT_ADAPTIVE) {
+                        AT_TIMEOUT_EXPIRED(AT_FAMILY_UHTTPC);
+                    }
+                    _httpProfiles[httpProfile].pending = false;
+                }
+            }
+            timer.stop();
+
+            // Without a good result the module may or may not
+            // have written the response file
+            if (_httpProfiles[httpProfile].result != 1) {
+                fileIndexRemove(rspFile, false);
+            }
+
+            if (cancelled) {
+                TRACE_EVENT(UBLOX_TRACE_HTTP_CANCEL, httpProfile, httpCmd);
+                storeAtError(AT_ERROR_ABORTED, -1);
+            } else if (!success) {
+                TRACE_EVENT(UBLOX_TRACE_HTTP_ERROR, httpProfile, httpCmd);
+            }
+        }
+
+        // A timeout is either no answer to the command or no +UUHTTPCR
+        AT_STATS_END(AT_FAMILY_UHTTPC, success,
+                     atSuccess ? (_httpProfiles[httpProfile].result == -1) : AT_TIMED_OUT(),
+                     bytesRead);
+        AT_UNLOCK();
+    }
+
+    return success ? NULL : &(_httpProfiles[httpProfile].httpError);
 }
 
 /**********************************************************************
@@ -97,97 +318,102 @@ const char *UbloxATCellularInterfaceExt::getHttpCmd(HttpCmd httpCmd)
 // Callback for FTP result code handling.
 void UbloxATCellularInterfaceExt::UUFTPCR_URC()
 {
-    char buf[64];
-    char md5[32];
+    UbloxUrcDispatcher::Scanner scanner(&_urcDispatcher);
+    char md5[32 + 1];
+    int a, b;
 
     // Note: not calling _at->recv() from here as we're
     // already in an _at->recv()
     // +UUFTPCR: <op_code>,<ftp_result>[,<md5_sum>]
-    if (read_at_to_char(buf, sizeof (buf), '\n') > 0) {
-        if (sscanf(buf, ": %d,%d,%32[^\n]\n", &_lastFtpOpCodeResult, &_lastFtpResult, md5) == 3) {
+    if (scanner.getInt(&a) && scanner.getInt(&b)) {
+        _lastFtpOpCodeResult = a;
+        _lastFtpResult = b;
+        if (scanner.getString(md5, sizeof (md5)) == 32) {
             // Store the MD5 sum if we can
             if ((_ftpBuf != NULL) && (_ftpBufLen >= 32)) {
                 memcpy (_ftpBuf, md5, 32);
-                if (_ftpBufLen == 33) {
-                    *(buf + 32) = 0; // Add a terminator if there's room
+                if (_ftpBufLen >= 33) {
+                    *(_ftpBuf + 32) = 0; // Add a terminator if there's room
                 }
             }
         }
-        debug_if(_debug_trace_on, "%s result code is %d\n",
-                 getFtpCmd((FtpCmd) _lastFtpOpCodeResult), _lastFtpResult);
+        _urcEvents.set(URC_EVENT_FTP);
+        TRACE_EVENT(UBLOX_TRACE_FTP_RESULT, a, b);
     }
+    scanner.finish();
 }
 
 // Callback for FTP data handling.
 void UbloxATCellularInterfaceExt::UUFTPCD_URC()
 {
-    char buf[32];
+    UbloxUrcDispatcher::Scanner scanner(&_urcDispatcher);
     char *ftpBufPtr = _ftpBuf;
+    int a;
     int ftpDataLen;
+    int timeLimit;
+    int x;
 
     // Note: not calling _at->recv() from here as we're
     // already in an _at->recv()
     // +UUFTPCD: <op_code>,<ftp_data_len>,<ftp_data_in_quotes>
-    if (read_at_to_char(buf, sizeof(buf), '\"') > 0) {
-        if (sscanf(buf, ": %d,%d,\"", &_lastFtpOpCodeData, &ftpDataLen) == 2) {
-            if ((ftpBufPtr != NULL) && (_ftpBufLen > 0)) {
-                if (ftpDataLen + 1 > _ftpBufLen) { // +1 for terminator
-                    ftpDataLen = _ftpBufLen - 1;
-                }
-                ftpBufPtr += _at->read(ftpBufPtr, ftpDataLen);
-                *ftpBufPtr = 0; // Add terminator
+    // The data is read directly after the opening quote
+    // and the rest is left to the AT parser
+    if (scanner.getInt(&a) && scanner.getInt(&ftpDataLen) && scanner.openQuote()) {
+        _lastFtpOpCodeData = a;
+        // The data follows the fields at once so allow the time it
+        // takes at the working baud rate plus as long as the URC
+        // thread waits for the next character of a line
+        timeLimit = wireTimeMs(ftpDataLen) +
+                    MBED_CONF_UBLOX_CELL_DRIVER_GEN_URC_THREAD_READ_TIMEOUT_MS;
+        if ((ftpBufPtr != NULL) && (_ftpBufLen > 0)) {
+            x = ftpDataLen;
+            if (x + 1 > _ftpBufLen) { // +1 for terminator
+                x = _ftpBufLen - 1;
+            }
+            x = _urcDispatcher.read(ftpBufPtr, x, timeLimit);
+            if (x > 0) {
+                ftpBufPtr += x;
+                ftpDataLen -= x;
             }
+            *ftpBufPtr = 0; // Add terminator
+        }
+        // Throw away whatever didn't fit so that the AT parser
+        // doesn't go looking for responses in it; with flow control
+        // on none of it will have been lost so this is exact
+        if (ftpDataLen > 0) {
+            _urcDispatcher.discard(ftpDataLen, timeLimit);
         }
     }
 }
 
-// Return a string representing an FTP AT command.
-const char *UbloxATCellularInterfaceExt::getFtpCmd(FtpCmd ftpCmd)
+// Add the command that sets an FTP parameter to a batch.
+bool UbloxATCellularInterfaceExt::ftpAddPar(UbloxAtBatch *batch, FtpOpCode ftpOpCode,
+                                            const char * ftpInPar)
 {
-    const char * str = "FTP command not recognised";
+    bool success = false;
 
-    switch (ftpCmd) {
-        case FTP_LOGOUT:
-            str = "FTP log out command";
-            break;
-        case FTP_LOGIN:
-            str = "FTP log in command";
-            break;
-        case FTP_DELETE_FILE:
-            str = "FTP delete file command";
-            break;
-        case FTP_RENAME_FILE:
-            str = "FTP rename file command";
-            break;
-        case FTP_GET_FILE:
-            str = "FTP get file command";
-            break;
-        case FTP_PUT_FILE:
-            str = "FTP put file command";
-            break;
-        case FTP_CD:
-            str = "FTP change directory command";
-            break;
-        case FTP_MKDIR:
-            str = "FTP make directory command";
-            break;
-        case FTP_RMDIR:
-            str = "FTP remove directory command";
-            break;
-        case FTP_FILE_INFO:
-            str = "FTP file info command";
-            break;
-        case FTP_LS:
-            str = "FTP directory list command";
+    switch (ftpOpCode) {
+        case FTP_IP_ADDRESS:         // 0
+        case FTP_SERVER_NAME:        // 1
+        case FTP_USER_NAME:          // 2
+        case FTP_PASSWORD:           // 3
+        case FTP_ACCOUNT:            // 4
+            batch->add().literal("+UFTP=").number(ftpOpCode).literal(",").quoted(ftpInPar);
+            success = !batch->overflowed();
             break;
-        case FTP_FOTA_FILE:
-            str = "FTP FOTA file command";
+        case FTP_INACTIVITY_TIMEOUT: // 5
+        case FTP_MODE:               // 6
+        case FTP_SERVER_PORT:        // 7
+        case FTP_SECURE:             // 8
+            batch->add().literal("+UFTP=").number(ftpOpCode).literal(",").number(atoi(ftpInPar));
+            success = !batch->overflowed();
             break;
         default:
+            debug_if(_debug_trace_on, "ftpSetPar: unknown ftpOpCode %d\n", ftpOpCode);
             break;
     }
 
-    return str;
+    return success;
 }
 
 /**********************************************************************
@@ -197,166 +423,111 @@ const char *UbloxATCellularInterfaceExt::getFtpCmd(FtpCmd ftpCmd)
 // Callback for UULOCIND handling.
 void UbloxATCellularInterfaceExt::UULOCIND_URC()
 {
-    char buf[32];
+    UbloxUrcDispatcher::Scanner scanner(&_urcDispatcher);
     int a, b;
+    bool success;
 
     // Note: not calling _at->recv() from here as we're
     // already in an _at->recv()
     // +UULOCIND: <step>,<result>
-    if (read_at_to_char(buf, sizeof (buf), '\n') > 0) {
-        if (sscanf(buf, " %d,%d", &a, &b) == 2) {
-            switch (a) {
-                case 0:
-                    debug_if(_debug_trace_on, "Network scan start\n");
-                    break;
-                case 1:
-                    debug_if(_debug_trace_on, "Network scan end\n");
-                    break;
-                case 2:
-                    debug_if(_debug_trace_on, "Requesting data from server\n");
-                    break;
-                case 3:
-                    debug_if(_debug_trace_on, "Received data from server\n");
-                    break;
-                case 4:
-                    debug_if(_debug_trace_on, "Sending feedback to server\n");
-                    break;
-                default:
-                    debug_if(_debug_trace_on, "Unknown step\n");
-                    break;
-            }
-            switch (b) {
-                case 0:
-                    // No error
-                    break;
-                case 1:
-                    debug_if(_debug_trace_on, "Wrong URL!\n");
-                    break;
-                case 2:
-                    debug_if(_debug_trace_on, "HTTP error!\n");
-                    break;
-                case 3:
-                    debug_if(_debug_trace_on, "Create socket error!\n");
-                    break;
-                case 4:
-                    debug_if(_debug_trace_on, "Close socket error!\n");
-                    break;
-                case 5:
-                    debug_if(_debug_trace_on, "Write to socket error!\n");
-                    break;
-                case 6:
-                    debug_if(_debug_trace_on, "Read from socket error!\n");
-                    break;
-                case 7:
-                    debug_if(_debug_trace_on, "Connection/DNS error!\n");
-                    break;
-                case 8:
-                    debug_if(_debug_trace_on, "Authentication token problem!\n");
-                    break;
-                case 9:
-                    debug_if(_debug_trace_on, "Generic error!\n");
-                    break;
-                case 10:
-                    debug_if(_debug_trace_on, "User terminated!\n");
-                    break;
-                case 11:
-                    debug_if(_debug_trace_on, "No data from server!\n");
-                    break;
-                default:
-                    debug_if(_debug_trace_on, "Unknown result!\n");
-                    break;
-            }
-        }
+    success = scanner.getInt(&a) && scanner.getInt(&b);
+    scanner.finish();
+    if (success) {
+        TRACE_EVENT(UBLOX_TRACE_CELL_LOC_STEP, a, b);
     }
 }
 
 // Callback for UULOC URC handling.
 void UbloxATCellularInterfaceExt::UULOC_URC()
 {
-    int a, b;
+    UbloxUrcDispatcher::Scanner scanner(&_urcDispatcher);
+    char field[16];
+    int len;
+    int a = 1;
+    int b = 0;
+    int expPos = 1;
+    int day, month, year, hour, minute, second;
+    int32_t latitude, longitude, value;
+    int altitude, uncertainty;
+    int speed = 0;
+    int direction = 0;
+    int verticalAcc = 0;
+    int svUsed = 0;
+    bool hasFraction;
+    bool success = false;
 
     // Note: not calling _at->recv() from here as we're
     // already in an _at->recv()
 
-    // +UHTTPCR: <profile_id>,<op_code>,<param_val>
-    if (read_at_to_char(urcBuf, sizeof (urcBuf), '\n') > 0) {
+    // Only the first form starts with a date, so take the first
+    // field as a string and then see what it is
+    len = scanner.getString(field, sizeof (field));
+    if ((len > 0) && (memchr(field, '/', len) != NULL)) {
         // +UULOC: <date>,<time>,<lat>,<long>,<alt>,<uncertainty>,<speed>, <direction>,<vertical_acc>,<sensor_used>,<SV_used>,<antenna_status>, <jamming_status>
-        if (sscanf(urcBuf, ": %d/%d/%d,%d:%d:%d.%*d,%f,%f,%d,%d,%d,%d,%d,%d,%d,%*d,%*d",
-                   &_loc[0].time.tm_mday, &_loc[0].time.tm_mon,
-                   &_loc[0].time.tm_year, &_loc[0].time.tm_hour,
-                   &_loc[0].time.tm_min, &_loc[0].time.tm_sec,
-                   &_loc[0].latitude, &_loc[0].longitude, &_loc[0].altitude,
-                   &_loc[0].uncertainty, &_loc[0].speed, &_loc[0].direction,
-                   &_loc[0].verticalAcc,
-                   &b, &_loc[0].svUsed) == 15) {
-            debug_if(_debug_trace_on, "Position found at index 0\n");
-            _loc[0].sensor = (b == 0) ? CELL_LAST : (b == 1) ? CELL_GNSS :
-                             (b == 2) ? CELL_LOCATE : (b == 3) ? CELL_HYBRID : CELL_LAST;
-            _loc[0].time.tm_mon -= 1;
-            _loc[0].time.tm_wday = 0;
-            _loc[0].time.tm_yday = 0;
-            _loc[0].validData = true;
-            _locExpPos=1;
-            _locRcvPos++;
-        // +UULOC: <sol>,<num>,<sensor_used>,<date>,<time>,<lat>,<long>,<alt>,<uncertainty>,<speed>, <direction>,<vertical_acc>,,<SV_used>,<antenna_status>, <jamming_status>
-        } else if (sscanf(urcBuf, ": %d,%d,%d,%d/%d/%d,%d:%d:%d.%*d,%f,%f,%d,%d,%d,%d,%d,%d,%*d,%*d",
-                   &a, &_locExpPos, &b,
-                   &_loc[CELL_MAX_HYP - 1].time.tm_mday,
-                   &_loc[CELL_MAX_HYP - 1].time.tm_mon,
-                   &_loc[CELL_MAX_HYP - 1].time.tm_year,
-                   &_loc[CELL_MAX_HYP - 1].time.tm_hour,
-                   &_loc[CELL_MAX_HYP - 1].time.tm_min,
-                   &_loc[CELL_MAX_HYP - 1].time.tm_sec,
-                   &_loc[CELL_MAX_HYP - 1].latitude,
-                   &_loc[CELL_MAX_HYP - 1].longitude,
-                   &_loc[CELL_MAX_HYP - 1].altitude,
-                   &_loc[CELL_MAX_HYP - 1].uncertainty,
-                   &_loc[CELL_MAX_HYP - 1].speed,
-                   &_loc[CELL_MAX_HYP - 1].direction,
-                   &_loc[CELL_MAX_HYP - 1].verticalAcc,
-                   &_loc[CELL_MAX_HYP - 1].svUsed) == 17) {
-            if (--a >= 0) {
-                debug_if(_debug_trace_on, "Position found at index %d\n", a);
-
-                memcpy(&_loc[a], &_loc[CELL_MAX_HYP - 1], sizeof(*_loc));
-
-                _loc[a].sensor = (b == 0) ? CELL_LAST : (b == 1) ? CELL_GNSS :
-                                 (b == 2) ? CELL_LOCATE : (b == 3) ? CELL_HYBRID : CELL_LAST;
-                _loc[a].time.tm_mon -= 1;
-                _loc[a].time.tm_wday = 0;
-                _loc[a].time.tm_yday = 0;
-                _loc[a].validData = true;
-                _locRcvPos++;
-            }
-        //+UULOC: <sol>,<num>,<sensor_used>,<date>,<time>,<lat>,<long>,<alt>,<lat50>,<long50>,<major50>,<minor50>,<orientation50>,<confidence50>[,<lat95>,<long95>,<major95>,<minor95>,<orientation95>,<confidence95>]
-        } else if (sscanf(urcBuf, ": %d,%d,%d,%d/%d/%d,%d:%d:%d.%*d,%f,%f,%d,%*f,%*f,%d,%*d,%*d,%*d",
-                   &a, &_locExpPos, &b,
-                   &_loc[CELL_MAX_HYP - 1].time.tm_mday,
-                   &_loc[CELL_MAX_HYP - 1].time.tm_mon,
-                   &_loc[CELL_MAX_HYP - 1].time.tm_year,
-                   &_loc[CELL_MAX_HYP - 1].time.tm_hour,
-                   &_loc[CELL_MAX_HYP - 1].time.tm_min,
-                   &_loc[CELL_MAX_HYP - 1].time.tm_sec,
-                   &_loc[CELL_MAX_HYP - 1].latitude,
-                   &_loc[CELL_MAX_HYP - 1].longitude,
-                   &_loc[CELL_MAX_HYP - 1].altitude,
-                   &_loc[CELL_MAX_HYP - 1].uncertainty) == 13) {
-            if (--a >= 0) {
-
-                debug_if(_debug_trace_on, "Position found at index %d\n", a);
-
-                memcpy(&_loc[a], &_loc[CELL_MAX_HYP - 1], sizeof(*_loc));
-
-                _loc[a].sensor = (b == 0) ? CELL_LAST : (b == 1) ? CELL_GNSS :
-                                 (b == 2) ? CELL_LOCATE : (b == 3) ? CELL_HYBRID : CELL_LAST;
-                _loc[a].time.tm_mon -= 1;
-                _loc[a].time.tm_wday = 0;
-                _loc[a].time.tm_yday = 0;
-                _loc[a].validData = true;
-                _locRcvPos++;
+        UbloxUrcScanner fieldScanner(field, len);
+        success = fieldScanner.getDate(&day, &month, &year) &&
+                  scanner.getTime(&hour, &minute, &second) &&
+                  scanner.getFixed(&latitude, CELL_LOC_DECIMALS) &&
+                  scanner.getFixed(&longitude, CELL_LOC_DECIMALS) &&
+                  scanner.getInt(&altitude) && scanner.getInt(&uncertainty) &&
+                  scanner.getInt(&speed) && scanner.getInt(&direction) &&
+                  scanner.getInt(&verticalAcc) && scanner.getInt(&b) &&
+                  scanner.getInt(&svUsed);
+    } else if (len > 0) {
+        // +UULOC: <sol>,<num>,<sensor_used>,<date>,<time>,<lat>,<long>,<alt>,<uncertainty>,<speed>, <direction>,<vertical_acc>,<SV_used>,<antenna_status>, <jamming_status>
+        // or
+        // +UULOC: <sol>,<num>,<sensor_used>,<date>,<time>,<lat>,<long>,<alt>,<lat50>,<long50>,<major50>,<minor50>,<orientation50>,<confidence50>[,<lat95>,<long95>,<major95>,<minor95>,<orientation95>,<confidence95>]
+        UbloxUrcScanner fieldScanner(field, len);
+        success = fieldScanner.getInt(&a) &&
+                  scanner.getInt(&expPos) && scanner.getInt(&b) &&
+                  scanner.getDate(&day, &month, &year) &&
+                  scanner.getTime(&hour, &minute, &second) &&
+                  scanner.getFixed(&latitude, CELL_LOC_DECIMALS) &&
+                  scanner.getFixed(&longitude, CELL_LOC_DECIMALS) &&
+                  scanner.getInt(&altitude) &&
+                  scanner.getFixed(&value, 0, &hasFraction);
+        if (success) {
+            if (!hasFraction) {
+                // The field after <alt> is <uncertainty>
+                uncertainty = value;
+                success = scanner.getInt(&speed) && scanner.getInt(&direction) &&
+                          scanner.getInt(&verticalAcc) && scanner.getInt(&svUsed);
+            } else {
+                // The field after <alt> is <lat50>: skip <long50>
+                // and use <major50> as the uncertainty
+                success = scanner.skipField() && scanner.getInt(&uncertainty);
             }
         }
     }
+    scanner.finish();
+
+    if (success && (--a >= 0) && (a < CELL_MAX_HYP)) {
+        TRACE_EVENT(UBLOX_TRACE_CELL_LOC_FOUND, a);
+        stateLock(&_locMtx);
+        _loc[a].time.tm_mday = day;
+        _loc[a].time.tm_mon = month - 1;
+        _loc[a].time.tm_year = year;
+        _loc[a].time.tm_hour = hour;
+        _loc[a].time.tm_min = minute;
+        _loc[a].time.tm_sec = second;
+        _loc[a].time.tm_wday = 0;
+        _loc[a].time.tm_yday = 0;
+        _loc[a].latitude = (float) latitude / CELL_LOC_SCALE;
+        _loc[a].longitude = (float) longitude / CELL_LOC_SCALE;
+        _loc[a].altitude = altitude;
+        _loc[a].uncertainty = uncertainty;
+        _loc[a].speed = speed;
+        _loc[a].direction = direction;
+        _loc[a].verticalAcc = verticalAcc;
+        _loc[a].svUsed = svUsed;
+        _loc[a].sensor = (b == 0) ? CELL_LAST : (b == 1) ? CELL_GNSS :
+                         (b == 2) ? CELL_LOCATE : (b == 3) ? CELL_HYBRID : CELL_LAST;
+        _loc[a].validData = true;
+        _locExpPos = expPos;
+        _locRcvPos++;
+        stateUnlock(&_locMtx);
+        _urcEvents.set(URC_EVENT_CELL_LOCATE);
+    }
 }
 
 /**********************************************************************
@@ -378,7 +549,7 @@ UbloxATCellularInterfaceExt::UbloxATCellularInterfaceExt(PinName tx,
     }
 
     // Zero FTP stuff
-    _ftpTimeout = TIMEOUT_BLOCKING;
+    _ftpTimeout = TIMEOUT_ADAPTIVE;
     _lastFtpOpCodeResult = FTP_OP_CODE_UNUSED;
     _lastFtpResult = 0;
     _lastFtpOpCodeData = FTP_OP_CODE_UNUSED;
@@ -392,15 +563,16 @@ UbloxATCellularInterfaceExt::UbloxATCellularInterfaceExt(PinName tx,
     _locExpPos = 0;
 
     // URC handler for HTTP
-    _at->oob("+UUHTTPCR", callback(this, &UbloxATCellularInterfaceExt::UUHTTPCR_URC));
+    _urcDispatcher.add("+UUHTTPCR", callback(this, &UbloxATCellularInterfaceExt::UUHTTPCR_URC));
 
     // URC handlers for FTP
-    _at->oob("+UUFTPCR", callback(this, &UbloxATCellularInterfaceExt::UUFTPCR_URC));
-    _at->oob("+UUFTPCD", callback(this, &UbloxATCellularInterfaceExt::UUFTPCD_URC));
+    _urcDispatcher.add("+UUFTPCR", callback(this, &UbloxATCellularInterfaceExt::UUFTPCR_URC));
+    _urcDispatcher.add("+UUFTPCD", callback(this, &UbloxATCellularInterfaceExt::UUFTPCD_URC));
 
-    // URC handlers for Cell Locate
-    _at->oob("+UULOCIND", callback(this, &UbloxATCellularInterfaceExt::UULOCIND_URC));
-    _at->oob("+UULOC", callback(this, &UbloxATCellularInterfaceExt::UULOC_URC));
+    // URC handlers for Cell Locate: the dispatcher tells these two
+    // apart by reading on from "+UULOC" to see if "IND" follows
+    _urcDispatcher.add("+UULOC", callback(this, &UbloxATCellularInterfaceExt::UULOC_URC));
+    _urcDispatcher.add("+UULOCIND", callback(this, &UbloxATCellularInterfaceExt::UULOCIND_URC));
 }
 
 // Destructor.
@@ -416,21 +588,31 @@ UbloxATCellularInterfaceExt::~UbloxATCellularInterfaceExt()
 int UbloxATCellularInterfaceExt::httpAllocProfile()
 {
     int profile = HTTP_PROF_UNUSED;
-    LOCK();
+    Capabilities caps;
+
+    // Not under the state lock as this may probe the module
+    if (!hasCapability(CAP_HTTP)) {
+        return HTTP_PROF_UNUSED;
+    }
+    getCapabilities(&caps);
+    stateLock(&_httpMtx);
 
-    // Find a free HTTP profile
+    // Find a free HTTP profile, among those the module has
     profile = findProfile();
+    if (caps.probed && (profile >= caps.numHttpProfiles)) {
+        profile = HTTP_PROF_UNUSED;
+    }
     debug_if(_debug_trace_on, "httpFindProfile: profile is %d\n", profile);
 
     if (profile != HTTP_PROF_UNUSED) {
         _httpProfiles[profile].modemHandle = 1;
-        _httpProfiles[profile].timeout     = TIMEOUT_BLOCKING;
+        _httpProfiles[profile].timeout     = TIMEOUT_ADAPTIVE;
         _httpProfiles[profile].pending     = false;
         _httpProfiles[profile].cmd         = -1;
         _httpProfiles[profile].result      = -1;
     }
 
-    UNLOCK();
+    stateUnlock(&_httpMtx);
     return profile;
 }
 
@@ -438,19 +620,23 @@ int UbloxATCellularInterfaceExt::httpAllocProfile()
 bool UbloxATCellularInterfaceExt::httpFreeProfile(int profile)
 {
     bool success = false;
-    LOCK();
+    AT_LOCK(AT_PRIORITY_NORMAL);
+    clearAtError();
 
-    if (IS_PROFILE(profile)) {
+    if (checkProfile(profile)) {
         debug_if(_debug_trace_on, "httpFreeProfile(%d)\n", profile);
+        stateLock(&_httpMtx);
         _httpProfiles[profile].modemHandle = HTTP_PROF_UNUSED;
-        _httpProfiles[profile].timeout     = TIMEOUT_BLOCKING;
+        _httpProfiles[profile].timeout     = TIMEOUT_ADAPTIVE;
         _httpProfiles[profile].pending     = false;
         _httpProfiles[profile].cmd         = -1;
         _httpProfiles[profile].result      = -1;
-        success = _at->send("AT+UHTTP=%d", profile) && _at->recv("OK");
+        stateUnlock(&_httpMtx);
+        success = AT_COMMAND(AT_CHANNEL_CONTROL).literal("AT+UHTTP=").number(profile).send() &&
+                  _at->recv(AT_OK);
     }
 
-    UNLOCK();
+    AT_UNLOCK();
     return success;
 }
 
@@ -458,7 +644,7 @@ bool UbloxATCellularInterfaceExt::httpFreeProfile(int profile)
 bool UbloxATCellularInterfaceExt::httpSetTimeout(int profile, int timeout)
 {
     bool success = false;
-    LOCK();
+    stateLock(&_httpMtx);
 
     debug_if(_debug_trace_on, "httpSetTimeout(%d, %d)\n", profile, timeout);
 
@@ -467,7 +653,7 @@ bool UbloxATCellularInterfaceExt::httpSetTimeout(int profile, int timeout)
         success = true;
     }
 
-    UNLOCK();
+    stateUnlock(&_httpMtx);
     return success;
 }
 
@@ -475,12 +661,14 @@ bool UbloxATCellularInterfaceExt::httpSetTimeout(int profile, int timeout)
 bool UbloxATCellularInterfaceExt::httpResetProfile(int httpProfile)
 {
     bool success = false;
-    LOCK();
+    AT_LOCK(AT_PRIORITY_NORMAL);
+    clearAtError();
 
     debug_if(_debug_trace_on, "httpResetProfile(%d)\n", httpProfile);
-    success = _at->send("AT+UHTTP=%d", httpProfile) && _at->recv("OK");
+    success = AT_COMMAND(AT_CHANNEL_CONTROL).literal("AT+UHTTP=").number(httpProfile).send() &&
+              _at->recv(AT_OK);
 
-    UNLOCK();
+    AT_UNLOCK();
     return success;
 }
 
@@ -489,48 +677,38 @@ bool UbloxATCellularInterfaceExt::httpSetPar(int httpProfile,
                                              HttpOpCode httpOpCode,
                                              const char * httpInPar)
 {
-    bool success = false;
-    int httpInParNum = 0;
-    SocketAddress address;
+    HttpPar httpPar;
 
     debug_if(_debug_trace_on, "httpSetPar(%d, %d, \"%s\")\n", httpProfile, httpOpCode, httpInPar);
-    if (IS_PROFILE(httpProfile)) {
-        LOCK();
-
-        switch(httpOpCode) {
-            case HTTP_IP_ADDRESS:   // 0
-                if (gethostbyname(httpInPar, &address) == NSAPI_ERROR_OK) {
-                    success = _at->send("AT+UHTTP=%d,%d,\"%s\"",
-                                        httpProfile, httpOpCode, address.get_ip_address()) &&
-                              _at->recv("OK");
-                }
-                break;
-            case HTTP_SERVER_NAME:  // 1
-            case HTTP_USER_NAME:    // 2
-            case HTTP_PASSWORD:     // 3
-                success = _at->send("AT+UHTTP=%d,%d,\"%s\"", httpProfile, httpOpCode, httpInPar) &&
-                          _at->recv("OK");
-                break;
+    httpPar.httpOpCode = httpOpCode;
+    httpPar.httpInPar = httpInPar;
 
-            case HTTP_AUTH_TYPE:    // 4
-            case HTTP_SERVER_PORT:  // 5
-                httpInParNum = atoi(httpInPar);
-                success = _at->send("AT+UHTTP=%d,%d,%d", httpProfile, httpOpCode, httpInParNum) &&
-                          _at->recv("OK");
-                break;
+    return httpSetPars(httpProfile, &httpPar, 1);
+}
 
-            case HTTP_SECURE:       // 6
-                httpInParNum = atoi(httpInPar);
-                success = _at->send("AT+UHTTP=%d,%d,%d", httpProfile, httpOpCode, httpInParNum) &&
-                          _at->recv("OK");
-                break;
+// Set several HTTP parameters at once.
+bool UbloxATCellularInterfaceExt::httpSetPars(int httpProfile,
+                                              const HttpPar * httpPars,
+                                              int numPars)
+{
+    bool success = false;
+    UbloxAtBatch batch;
 
-            default:
-                debug_if(_debug_trace_on, "httpSetPar: unknown httpOpCode %d\n", httpOpCode);
-                break;
+    debug_if(_debug_trace_on, "httpSetPars(%d, %d parameters)\n", httpProfile, numPars);
+    if (checkProfile(httpProfile)) {
+        AT_LOCK(AT_PRIORITY_NORMAL);
+        clearAtError();
+
+        success = true;
+        for (int x = 0; success && (x < numPars); x++) {
+            success = httpAddPar(&batch, httpProfile,
+                                 httpPars[x].httpOpCode, httpPars[x].httpInPar);
+        }
+        if (success) {
+            success = atBatchSend(&batch);
         }
 
-        UNLOCK();
+        AT_UNLOCK();
     }
 
     return success;
@@ -544,132 +722,27 @@ UbloxATCellularInterfaceExt::Error * UbloxATCellularInterfaceExt::httpCommand(in
                                                                               const char *sendStr,
                                                                               int httpContentType,
                                                                               const char *httpCustomPar,
-                                                                              char *buf, int len)
+                                                                              char *buf, int len,
+                                                                              UbloxCancelToken *token)
 {
-    bool atSuccess = false;
-    bool success = false;
-    int at_timeout;
-    char defaultFilename[] = "http_last_response_x";
-
-    debug_if(_debug_trace_on, "%s\n", getHttpCmd(httpCmd));
-
-    if (IS_PROFILE(httpProfile)) {
-        LOCK();
-        at_timeout = _at_timeout; // Has to be inside LOCK()s
-
-        if (rspFile == NULL) {
-            sprintf(defaultFilename + sizeof (defaultFilename) - 2, "%1d", httpProfile);
-            rspFile = defaultFilename;
-        }
-
-        switch (httpCmd) {
-            case HTTP_HEAD:
-                atSuccess = _at->send("AT+UHTTPC=%d,%d,\"%s\",\"%s\"", httpProfile, httpCmd,
-                                      httpPath, rspFile) &&
-                            _at->recv("OK");
-                break;
-            case HTTP_GET:
-                atSuccess = _at->send("AT+UHTTPC=%d,%d,\"%s\",\"%s\"", httpProfile, httpCmd,
-                                      httpPath, rspFile) &&
-                            _at->recv("OK");
-                break;
-            case HTTP_DELETE:
-                atSuccess = _at->send("AT+UHTTPC=%d,%d,\"%s\",\"%s\"", httpProfile, httpCmd,
-                                      httpPath, rspFile) &&
-                            _at->recv("OK");
-                break;
-            case HTTP_PUT:
-                // In this case the parameter sendStr is a filename
-                atSuccess = _at->send("AT+UHTTPC=%d,%d,\"%s\",\"%s\",\"%s\"", httpProfile, httpCmd,
-                                      httpPath, rspFile, sendStr) &&
-                            _at->recv("OK");
-                break;
-            case HTTP_POST_FILE:
-                // In this case the parameter sendStr is a filename
-                if (httpContentType != 6) {
-                    atSuccess = _at->send("AT+UHTTPC=%d,%d,\"%s\",\"%s\",\"%s\",%d",
-                                          httpProfile, httpCmd, httpPath, rspFile, sendStr,
-                                          httpContentType) &&
-                                _at->recv("OK");
-                } else {
-                    atSuccess = _at->send("AT+UHTTPC=%d,%d,\"%s\",\"%s\",\"%s\",%d,%s",
-                                          httpProfile, httpCmd, httpPath, rspFile, sendStr,
-                                          httpContentType,
-                                          httpCustomPar) &&
-                                _at->recv("OK");
-                }
-                break;
-            case HTTP_POST_DATA:
-                // In this case the parameter sendStr is a string containing data
-                if (httpContentType != 6) {
-                    atSuccess = _at->send("AT+UHTTPC=%d,%d,\"%s\",\"%s\",\"%s\",%d",
-                                          httpProfile, httpCmd, httpPath, rspFile, sendStr,
-                                          httpContentType) &&
-                                _at->recv("OK");
-                } else {
-                    atSuccess = _at->send("AT+UHTTPC=%d,%d,\"%s\",\"%s\",\"%s\",%d,%s",
-                                          httpProfile, httpCmd, httpPath, rspFile, sendStr,
-                                          httpContentType,
-                                          httpCustomPar) &&
-                                _at->recv("OK");
-                }
-                break;
-            default:
-                debug_if(_debug_trace_on, "HTTP command not recognised\n");
-                break;
-        }
-
-        if (atSuccess) {
-            Timer timer;
-
-            at_set_timeout(1000);
-            _httpProfiles[httpProfile].pending = true;
-            _httpProfiles[httpProfile].result = -1;
-
-            // Waiting for unsolicited result code
-            timer.start();
-            while (_httpProfiles[httpProfile].pending) {
-                if (_httpProfiles[httpProfile].result != -1) {
-                    // Received unsolicited: starting its analysis
-                    _httpProfiles[httpProfile].pending = false;
-                    if (_httpProfiles[httpProfile].result == 1) {
-                        // HTTP command successfully executed
-                        if (readFile(rspFile, buf, len) >= 0) {
-                            success = true;
-                        }
-                    } else {
-                        // Retrieve the error class and code
-                        if (_at->send("AT+UHTTPER=%d", httpProfile) &&
-                            _at->recv("AT+UHTTPER=%*d,%d,%d",
-                                      &(_httpProfiles[httpProfile].httpError.eClass),
-                                      &(_httpProfiles[httpProfile].httpError.eCode)) &&
-                            _at->recv("OK")) {
-                            debug_if(_debug_trace_on, "HTTP error class %d, code %d\n",
-                                    _httpProfiles[httpProfile].httpError.eClass,
-                                    _httpProfiles[httpProfile].httpError.eCode);
-                        }
-                    }
-                } else if (!TIMEOUT(timer, _httpProfiles[httpProfile].timeout)) {
-                    // Wait for URCs
-                    _at->recv(UNNATURAL_STRING);
-                } else  {
-                    _httpProfiles[httpProfile].pending = false;
-                }
-            }
-            timer.stop();
-
-            at_set_timeout(at_timeout);
-
-            if (!success) {
-                debug_if(_debug_trace_on, "%s: ERROR\n", getHttpCmd(httpCmd));
-            }
-
-        }
-
-        UNLOCK();
-    }
+    return httpRun(httpProfile, httpCmd, httpPath, rspFile, sendStr,
+                   httpContentType, httpCustomPar, buf, len, NULL, token);
+}
 
-    return success ? NULL : &(_httpProfiles[httpProfile].httpError);
+// Perform an HTTP command, handing the response to a sink.
+UbloxATCellularInterfaceExt::Error * UbloxATCellularInterfaceExt::httpCommand(int httpProfile,
+                                                                              HttpCmd httpCmd,
+                                                                              const char *httpPath,
+                                                                              const char *rspFile,
+                                                                              const char *sendStr,
+                                                                              int httpContentType,
+                                                                              const char *httpCustomPar,
+                                                                              Callback<bool(const char *, int)> sink,
+                                                                              char *block, int blockSize,
+                                                                              UbloxCancelToken *token)
+{
+    return httpRun(httpProfile, httpCmd, httpPath, rspFile, sendStr,
+                   httpContentType, httpCustomPar, block, blockSize, sink, token);
 }
 
 /**********************************************************************
@@ -679,10 +752,10 @@ UbloxATCellularInterfaceExt::Error * UbloxATCellularInterfaceExt::httpCommand(in
 // Set the blocking/timeout for FTP.
 bool UbloxATCellularInterfaceExt::ftpSetTimeout(int timeout)
 {
-    LOCK();
+    stateLock(&_ftpMtx);
     debug_if(_debug_trace_on, "ftpSetTimeout(%d)\n", timeout);
     _ftpTimeout = timeout;
-    UNLOCK();
+    stateUnlock(&_ftpMtx);
 
     return true;
 }
@@ -691,14 +764,20 @@ bool UbloxATCellularInterfaceExt::ftpSetTimeout(int timeout)
 bool UbloxATCellularInterfaceExt::ftpResetPar()
 {
     bool success = true;
-    LOCK();
+    UbloxAtBatch batch;
+    AT_LOCK(AT_PRIORITY_NORMAL);
+    clearAtError();
 
     debug_if(_debug_trace_on, "ftpResetPar()\n");
     for (int x = 0; success && (x < NUM_FTP_OP_CODES); x++) {
-        success = _at->send("AT+UFTP=%d", x) && _at->recv("OK");
+        batch.add().literal("+UFTP=").number(x);
+        success = !batch.overflowed();
+    }
+    if (success) {
+        success = atBatchSend(&batch);
     }
 
-    UNLOCK();
+    AT_UNLOCK();
     return success;
 }
 
@@ -706,34 +785,32 @@ bool UbloxATCellularInterfaceExt::ftpResetPar()
 bool UbloxATCellularInterfaceExt::ftpSetPar(FtpOpCode ftpOpCode,
                                             const char * ftpInPar)
 {
-    bool success = false;
-    int ftpInParNum = 0;
-    LOCK();
+    FtpPar ftpPar;
 
     debug_if(_debug_trace_on, "ftpSetPar(%d, %s)\n", ftpOpCode, ftpInPar);
-    switch (ftpOpCode) {
-        case FTP_IP_ADDRESS:         // 0
-        case FTP_SERVER_NAME:        // 1
-        case FTP_USER_NAME:          // 2
-        case FTP_PASSWORD:           // 3
-        case FTP_ACCOUNT:            // 4
-            success = _at->send("AT+UFTP=%d,\"%s\"", ftpOpCode, ftpInPar) &&
-                      _at->recv("OK");
-            break;
-        case FTP_INACTIVITY_TIMEOUT: // 5
-        case FTP_MODE:               // 6
-        case FTP_SERVER_PORT:        // 7
-        case FTP_SECURE:             // 8
-            ftpInParNum = atoi(ftpInPar);
-            success = _at->send("AT+UFTP=%d,%d", ftpOpCode, ftpInParNum) &&
-                      _at->recv("OK");
-            break;
-        default:
-            debug_if(_debug_trace_on, "ftpSetPar: unknown ftpOpCode %d\n", ftpOpCode);
-            break;
+    ftpPar.ftpOpCode = ftpOpCode;
+    ftpPar.ftpInPar = ftpInPar;
+
+    return ftpSetPars(&ftpPar, 1);
+}
+
+// Set several FTP parameters at once.
+bool UbloxATCellularInterfaceExt::ftpSetPars(const FtpPar * ftpPars, int numPars)
+{
+    bool success = true;
+    UbloxAtBatch batch;
+    AT_LOCK(AT_PRIORITY_NORMAL);
+    clearAtError();
+
+    debug_if(_debug_trace_on, "ftpSetPars(%d parameters)\n", numPars);
+    for (int x = 0; success && (x < numPars); x++) {
+        success = ftpAddPar(&batch, ftpPars[x].ftpOpCode, ftpPars[x].ftpInPar);
+    }
+    if (success) {
+        success = atBatchSend(&batch);
     }
 
-    UNLOCK();
+    AT_UNLOCK();
     return success;
 }
 
@@ -742,41 +819,72 @@ UbloxATCellularInterfaceExt::Error * UbloxATCellularInterfaceExt::ftpCommand(Ftp
                                                                              const char* file1,
                                                                              const char* file2,
                                                                              int offset,
-                                                                             char* buf, int len)
+                                                                             char* buf, int len,
+                                                                             UbloxCancelToken *token)
 {
     bool atSuccess = false;
     bool success = false;
-    int at_timeout;
-    LOCK();
-    at_timeout = _at_timeout; // Has to be inside LOCK()s
+    bool cancelled = false;
+    int ftpTimeout;
+
+    if (!hasCapability(CAP_FTP) ||
+        (((ftpCmd == FTP_GET_DIRECT) || (ftpCmd == FTP_PUT_DIRECT)) &&
+         !hasCapability(CAP_FTP_DIRECT))) {
+        return &_ftpError;
+    }
+
+    stateLock(&_ftpMtx);
+    ftpTimeout = _ftpTimeout;
+    stateUnlock(&_ftpMtx);
+    // The FTP command lock first, since the AT
+    // channel lock is let go while waiting for +UUFTPCR
+    _ftpCmdMtx.lock();
+    AT_LOCK(AT_PRIORITY_NORMAL);
+    clearAtError();
+    AT_STATS_START();
+
+    // Reset the result before the command goes out so that
+    // a quick +UUFTPCR can't be missed
+    _lastFtpOpCodeData = FTP_OP_CODE_UNUSED;
+    _lastFtpOpCodeResult = FTP_OP_CODE_UNUSED;
+    _lastFtpResult = -1; // just for safety
+    _urcEvents.clear(URC_EVENT_FTP);
 
-    debug_if(_debug_trace_on, "%s\n", getFtpCmd(ftpCmd));
+    TRACE_EVENT(UBLOX_TRACE_FTP_COMMAND, ftpCmd);
     switch (ftpCmd) {
         case FTP_LOGOUT:
         case FTP_LOGIN:
-            atSuccess = _at->send("AT+UFTPC=%d", ftpCmd) && _at->recv("OK");
+            atSuccess = AT_COMMAND(AT_CHANNEL_CONTROL).literal("AT+UFTPC=").number(ftpCmd).send() &&
+                        _at->recv(AT_OK);
             break;
         case FTP_DELETE_FILE:
         case FTP_CD:
         case FTP_MKDIR:
         case FTP_RMDIR:
         case FTP_FOTA_FILE:
-            atSuccess = _at->send("AT+UFTPC=%d,\"%s\"", ftpCmd, file1) &&
-                        _at->recv("OK");
+            atSuccess = AT_COMMAND(AT_CHANNEL_CONTROL).literal("AT+UFTPC=").number(ftpCmd).literal(",").
+                        quoted(file1).send() &&
+                        _at->recv(AT_OK);
             break;
         case FTP_RENAME_FILE:
-            atSuccess = _at->send("AT+UFTPC=%d,\"%s\",\"%s\"",
-                                  ftpCmd, file1, file2) &&
-                        _at->recv("OK");
+            {
+                UbloxAtCommand command = AT_COMMAND(AT_CHANNEL_CONTROL);
+                command.literal("AT+UFTPC=").number(ftpCmd).literal(",").quoted(file1).
+                        literal(",").quoted(file2);
+                atSuccess = command.send() && _at->recv(AT_OK);
+            }
             break;
         case FTP_GET_FILE:
         case FTP_PUT_FILE:
             if (file2 == NULL) {
                 file2 = file1;
             }
-            atSuccess = _at->send("AT+UFTPC=%d,\"%s\",\"%s\",%d",
-                                  ftpCmd, file1, file2, offset) &&
-                        _at->recv("OK");
+            {
+                UbloxAtCommand command = AT_COMMAND(AT_CHANNEL_CONTROL);
+                command.literal("AT+UFTPC=").number(ftpCmd).literal(",").quoted(file1).
+                        literal(",").quoted(file2).literal(",").number(offset);
+                atSuccess = command.send() && _at->recv(AT_OK);
+            }
             break;
         case FTP_FILE_INFO:
         case FTP_LS:
@@ -787,11 +895,13 @@ UbloxATCellularInterfaceExt::Error * UbloxATCellularInterfaceExt::ftpCommand(Ftp
                 *_ftpBuf = 0;
             }
             if (file1 == NULL) {
-                atSuccess = _at->send("AT+UFTPC=%d", ftpCmd) &&
-                            _at->recv("OK");
+                atSuccess = AT_COMMAND(AT_CHANNEL_CONTROL).literal("AT+UFTPC=").
+                            number(ftpCmd).send() &&
+                            _at->recv(AT_OK);
             } else {
-                atSuccess = _at->send("AT+UFTPC=%d,\"%s\"", ftpCmd, file1) &&
-                            _at->recv("OK");
+                atSuccess = AT_COMMAND(AT_CHANNEL_CONTROL).literal("AT+UFTPC=").
+                            number(ftpCmd).literal(",").quoted(file1).send() &&
+                            _at->recv(AT_OK);
             }
             break;
         default:
@@ -802,36 +912,72 @@ UbloxATCellularInterfaceExt::Error * UbloxATCellularInterfaceExt::ftpCommand(Ftp
     // Wait for the result to arrive back
     if (atSuccess) {
         Timer timer;
+        int timeout = ftpTimeout;
 
-        at_set_timeout(1000);
-        _lastFtpOpCodeData = FTP_OP_CODE_UNUSED;
-        _lastFtpOpCodeResult = FTP_OP_CODE_UNUSED;
-        _lastFtpResult = -1; // just for safety
-        // Waiting for result to arrive
+        if (timeout == TIMEOUT_ADAPTIVE) {
+            timeout = AT_TIMEOUT_MS(AT_FAMILY_UFTPC, TIMEOUT_BLOCKING);
+        }
+
+        // Waiting for result to arrive, which the URC thread will pick up
         timer.start();
         while ((_lastFtpOpCodeResult == FTP_OP_CODE_UNUSED) &&
-                !TIMEOUT(timer, _ftpTimeout)) {
-            _at->recv(UNNATURAL_STRING);
+                !TIMEOUT(timer, timeout) && !CANCEL_TOKEN_EXPIRED(token)) {
+            waitUrcEvents(URC_EVENT_FTP, TIME_LEFT(timer, timeout), token);
         }
         timer.stop();
 
+        if (_lastFtpOpCodeResult != FTP_OP_CODE_UNUSED) {
+            AT_TIMEOUT_MEASURED(AT_FAMILY_UFTPC, timer.read_us());
+        } else if (CANCEL_TOKEN_EXPIRED(token)) {
+            cancelled = true;
+        } else if (ftpTimeout == TIMEOUT_ADAPTIVE) {
+            AT_TIMEOUT_EXPIRED(AT_FAMILY_UFTPC);
+        }
+
         if ((_lastFtpOpCodeResult == ftpCmd) && (_lastFtpResult == 1)) {
             // Got a result for our FTP op code and it is good
             success = true;
+        } else if (cancelled) {
+            // Abort the command on the module and give its result a
+            // chance to arrive, so that it isn't taken as the result
+            // of the next command
+            TRACE_EVENT(UBLOX_TRACE_FTP_ABORT, ftpCmd);
+            if ((FTP_ABORT_OP_CODE >= 0) &&
+                AT_COMMAND(AT_CHANNEL_CONTROL).literal("AT+UFTPC=").number(FTP_ABORT_OP_CODE).send() &&
+                _at->recv(AT_OK)) {
+                timer.reset();
+                timer.start();
+                while ((_lastFtpOpCodeResult == FTP_OP_CODE_UNUSED) &&
+                       !TIMEOUT(timer, FTP_ABORT_WAIT_MS)) {
+                    waitUrcEvents(URC_EVENT_FTP, TIME_LEFT(timer, FTP_ABORT_WAIT_MS));
+                }
+                timer.stop();
+            }
+            storeAtError(AT_ERROR_ABORTED, -1);
         } else {
             // Retrieve the error class and code
-            if (_at->send("AT+UFTPER") &&
+            if (AT_COMMAND(AT_CHANNEL_CONTROL).literal("AT+UFTPER").send() &&
                 _at->recv("+UFTPER:%d,%d", &(_ftpError.eClass), &(_ftpError.eCode)) &&
-                _at->recv("OK")) {
+                _at->recv(AT_OK)) {
                 debug_if(_debug_trace_on, "FTP Error class %d, code %d\n",
                          _ftpError.eClass, _ftpError.eCode);
             }
         }
 
-        at_set_timeout(at_timeout);
+        if (!success && !cancelled) {
+            TRACE_EVENT(UBLOX_TRACE_FTP_ERROR, ftpCmd);
+        }
 
-        if (!success) {
-            debug_if(_debug_trace_on, "%s: ERROR\n", getFtpCmd(ftpCmd));
+        // Keep the file index up to date with what the command
+        // wrote to the module's file system
+        if (ftpCmd == FTP_GET_FILE) {
+            if (success) {
+                fileIndexSet(file2, -1);
+            } else {
+                fileIndexRemove(file2, false);
+            }
+        } else if (ftpCmd == FTP_FOTA_FILE) {
+            invalidateFileIndex();
         }
     }
 
@@ -839,7 +985,12 @@ UbloxATCellularInterfaceExt::Error * UbloxATCellularInterfaceExt::ftpCommand(Ftp
     _ftpBuf = NULL;
     _ftpBufLen = 0;
 
-    UNLOCK();
+    // A timeout is either no answer to the command or no +UUFTPCR
+    AT_STATS_END(AT_FAMILY_UFTPC, success,
+                 atSuccess ? (_lastFtpOpCodeResult == FTP_OP_CODE_UNUSED) : AT_TIMED_OUT(),
+                 0);
+    AT_UNLOCK();
+    _ftpCmdMtx.unlock();
     return success ? NULL : &_ftpError;
 }
 
@@ -855,15 +1006,18 @@ bool UbloxATCellularInterfaceExt::cellLocSrvTcp(const char* token,
                                                 int resolution)
 {
     bool success = false;
-    LOCK();
-
-    if ((_dev_info.dev == DEV_LISA_U2_03S) || (_dev_info.dev  == DEV_SARA_U2)){
-        success = _at->send("AT+UGSRV=\"%s\",\"%s\",\"%s\",%d,%d,%d",
-                            server_1, server_2, token, days, period, resolution) &&
-                  _at->recv("OK");
+    AT_LOCK(AT_PRIORITY_NORMAL);
+    clearAtError();
+
+    if (hasCapability(CAP_CELL_LOC_TCP)) {
+        UbloxAtCommand command = AT_COMMAND(AT_CHANNEL_CONTROL);
+        command.literal("AT+UGSRV=").quoted(server_1).literal(",").quoted(server_2).
+                literal(",").quoted(token).literal(",").number(days).
+                literal(",").number(period).literal(",").number(resolution);
+        success = command.send() && _at->recv(AT_OK);
     }
 
-    UNLOCK();
+    AT_UNLOCK();
     return success;
 }
 
@@ -874,14 +1028,17 @@ bool UbloxATCellularInterfaceExt::cellLocSrvUdp(const char* server_1,
 {
 
     bool success = false;
-    LOCK();
-
-    if (_dev_info.dev != DEV_TOBY_L2) {
-        success = _at->send("AT+UGAOP=\"%s\",%d,%d,%d", server_1, port, latency, mode) &&
-                  _at->recv("OK");
+    AT_LOCK(AT_PRIORITY_NORMAL);
+    clearAtError();
+
+    if (hasCapability(CAP_CELL_LOC_UDP)) {
+        UbloxAtCommand command = AT_COMMAND(AT_CHANNEL_CONTROL);
+        command.literal("AT+UGAOP=").quoted(server_1).literal(",").number(port).
+                literal(",").number(latency).literal(",").number(mode);
+        success = command.send() && _at->recv(AT_OK);
     }
 
-    UNLOCK();
+    AT_UNLOCK();
     return success;
 }
 
@@ -889,12 +1046,13 @@ bool UbloxATCellularInterfaceExt::cellLocSrvUdp(const char* server_1,
 bool UbloxATCellularInterfaceExt::cellLocConfig(int scanMode)
 {
     bool success;
-    LOCK();
+    AT_LOCK(AT_PRIORITY_NORMAL);
+    clearAtError();
 
-    success = _at->send("AT+ULOCCELL=%d", scanMode) &&
-              _at->recv("OK");
+    success = AT_COMMAND(AT_CHANNEL_CONTROL).literal("AT+ULOCCELL=").number(scanMode).send() &&
+              _at->recv(AT_OK);
 
-    UNLOCK();
+    AT_UNLOCK();
     return success;
 }
 
@@ -910,24 +1068,32 @@ bool UbloxATCellularInterfaceExt::cellLocRequest(CellSensType sensor,
     if ((hypothesis <= CELL_MAX_HYP) &&
         !((hypothesis > 1) && (type != CELL_MULTIHYP))) {
 
-        LOCK();
+        AT_LOCK(AT_PRIORITY_NORMAL);
+        clearAtError();
+        AT_STATS_START();
 
+        stateLock(&_locMtx);
         _locRcvPos = 0;
         _locExpPos = 0;
-
         for (int i = 0; i < hypothesis; i++) {
             _loc[i].validData = false;
         }
+        stateUnlock(&_locMtx);
+        _urcEvents.clear(URC_EVENT_CELL_LOCATE);
 
         // Switch on the URC
-        if (_at->send("AT+ULOCIND=1") && _at->recv("OK")) {
+        if (AT_COMMAND(AT_CHANNEL_CONTROL).literal("AT+ULOCIND=1").send() && _at->recv(AT_OK)) {
             // Switch on Cell Locate
-            success = _at->send("AT+ULOC=2,%d,%d,%d,%d,%d", sensor, type, timeout, accuracy, hypothesis) &&
-                      _at->recv("OK");
+            UbloxAtCommand command = AT_COMMAND(AT_CHANNEL_CONTROL);
+            command.literal("AT+ULOC=2,").number(sensor).literal(",").number(type).
+                    literal(",").number(timeout).literal(",").number(accuracy).
+                    literal(",").number(hypothesis);
+            success = command.send() && _at->recv(AT_OK);
             // Answers are picked up by the URC
         }
 
-        UNLOCK();
+        AT_STATS_END(AT_FAMILY_ULOC, success, AT_TIMED_OUT(), 0);
+        AT_UNLOCK();
     }
 
     return success;
@@ -937,46 +1103,48 @@ bool UbloxATCellularInterfaceExt::cellLocRequest(CellSensType sensor,
 bool UbloxATCellularInterfaceExt::cellLocGetData(CellLocData *data, int index)
 {
     bool success = false;
+    stateLock(&_locMtx);
 
     if (_loc[index].validData) {
-        LOCK();
         memcpy(data, &_loc[index], sizeof(*_loc));
         success = true;
-        UNLOCK();
     }
 
+    stateUnlock(&_locMtx);
     return success;
 }
 
 // Get number of position records received.
 int UbloxATCellularInterfaceExt::cellLocGetRes()
 {
-    int at_timeout;
-    LOCK();
+    int numRecords;
 
-    at_timeout = _at_timeout; // Has to be inside LOCK()s
-    at_set_timeout(1000);
-    // Wait for URCs
-    _at->recv(UNNATURAL_STRING);
-    at_set_timeout(at_timeout);
+    // Wait for a position to arrive, returning at once if one
+    // has since the last call; the URC thread dispatches it
+    // so there is nothing to lock meanwhile
+    _urcEvents.wait_any(URC_EVENT_CELL_LOCATE, CELL_LOCATE_WAIT_MS);
 
-    UNLOCK();
-    return _locRcvPos;
+    stateLock(&_locMtx);
+    numRecords = _locRcvPos;
+    stateUnlock(&_locMtx);
+
+    return numRecords;
 }
 
 // Get number of positions records expected to be received.
 int UbloxATCellularInterfaceExt::cellLocGetExpRes()
 {
     int numRecords = 0;
-    LOCK();
 
-    _at->recv("OK");
+    // The URC thread dispatches +UULOC so there is
+    // nothing to read from the module here
+    stateLock(&_locMtx);
 
     if (_locRcvPos > 0) {
         numRecords = _locExpPos;
     }
 
-    UNLOCK();
+    stateUnlock(&_locMtx);
     return numRecords;
 }
 
@@ -57,6 +57,12 @@ public:
      */
     #define TIMEOUT_BLOCKING -1
 
+    /** A timeout learnt from how long operations have taken (see
+     * UbloxCellularDriverGen::getAtTimeout()), the default; blocking
+     * if adaptive timeouts have been compiled out.
+     */
+    #define TIMEOUT_ADAPTIVE -2
+
     /** A struct containing an HTTP or FTP error class and code
      */
      typedef struct {
@@ -84,6 +90,13 @@ public:
         HTTP_SECURE = 6
     } HttpOpCode;
 
+    /** An HTTP configuration parameter and its value, for httpSetPars().
+     */
+    typedef struct {
+        HttpOpCode httpOpCode;
+        const char * httpInPar;
+    } HttpPar;
+
     /** Type of HTTP Command.
      */
     typedef enum {
@@ -109,9 +122,11 @@ public:
 
     /** Find a free HTTP profile.
      *
-     * A profile will be blocking when first allocated.
+     * A profile will be blocking when first allocated.  Only as many
+     * profiles as the module has are given out (see probeCapabilities()).
      *
-     * @return the profile or negative if none are available.
+     * @return the profile or negative if none are available or the
+     *         module has no HTTP.
      */
     int httpAllocProfile();
     
@@ -125,7 +140,8 @@ public:
     /** Set the timeout for this profile.
      *
      * @param profile    the HTTP profile handle.
-     * @param timeout    -1 blocking, else non-blocking timeout in milliseconds.
+     * @param timeout    TIMEOUT_BLOCKING, TIMEOUT_ADAPTIVE (the default)
+     *                   or a timeout in milliseconds.
      * @return           true if successful, otherwise false.
      */
     bool httpSetTimeout(int profile, int timeout);
@@ -165,6 +181,19 @@ public:
      * @return            true if successful, false otherwise.
      */
     bool httpSetPar(int httpProfile, HttpOpCode httpOpCode, const char * httpInPar);
+
+    /** Set several HTTP parameters at once.
+     *
+     * This does the same as calling httpSetPar() for each parameter
+     * in turn but the parameters are sent to the module together,
+     * which takes a fraction of the time.
+     *
+     * @param httpProfile the HTTP profile identifier.
+     * @param httpPars    the parameters, see httpSetPar().
+     * @param numPars     the number of parameters at httpPars.
+     * @return            true if successful, false otherwise.
+     */
+    bool httpSetPars(int httpProfile, const HttpPar * httpPars, int numPars);
     
     /** Perform a HTTP command.
      *
@@ -189,6 +218,16 @@ public:
      * Alternatively, a rspFile may be given (e.g. "myresponse.txt") and this can
      * later be read from the modem file system using readFile().
      *
+     * While waiting for the server to respond, other threads may use
+     * this driver.
+     *
+     * If a cancel token is given, cancelling it or reaching its deadline
+     * ends the wait for the server, stops the fetching of the error or
+     * the reading of the response between blocks and makes
+     * getLastAtError() return AT_ERROR_ABORTED; the module has no
+     * abort for HTTP so it goes on with the request in the background
+     * and the profile should not be used again until it has finished.
+     *
      * @param httpProfile     the HTTP profile identifier.
      * @param httpCmd         the HTTP command.
      * @param httpPath        the path of resource on the HTTP server.
@@ -201,6 +240,7 @@ public:
      * @param httpCustomPar   the parameter for a user defined HTTP Content-Type.
      * @param buf             the buffer to read into.
      * @param len             the size of the buffer to read into.
+     * @param token           a cancel token, may be NULL.
      * @return                NULL if successful, otherwise a pointer to
      *                        a Error struct containing the error class and error
      *                        code, see section Appendix A.B of
@@ -209,7 +249,38 @@ public:
     Error * httpCommand(int httpProfile, HttpCmd httpCmd, const char* httpPath,
                         const char* rspFile, const char* sendStr,
                         int httpContentType, const char* httpCustomPar,
-                        char* buf, int len);
+                        char* buf, int len, UbloxCancelToken *token = NULL);
+
+    /** Perform an HTTP command, as above, but hand the server response
+     * to a sink a block at a time, as readFile() with a sink does, rather
+     * than reading all of it into a buffer, so that a response of any
+     * size can go straight to flash, a parser or a socket.  The sink
+     * is called while the AT interface is held for the command.
+     *
+     * @param httpProfile     the HTTP profile identifier.
+     * @param httpCmd         the HTTP command.
+     * @param httpPath        the path of resource on the HTTP server.
+     * @param rspFile         the local modem file where the server
+     *                        response will be stored, use NULL for
+     *                        don't care.
+     * @param sendStr         the filename or string to be sent
+     *                        to the HTTP server with the command request.
+     * @param httpContentType the HTTP Content-Type identifier.
+     * @param httpCustomPar   the parameter for a user defined HTTP Content-Type.
+     * @param sink            called with each block of the response and
+     *                        its length in turn; returns false to stop.
+     * @param block           a buffer to hold a block.
+     * @param blockSize       the size of block.
+     * @param token           a cancel token, may be NULL.
+     * @return                NULL if successful, otherwise a pointer to
+     *                        a Error struct containing the error class and
+     *                        error code, as above.
+     */
+    Error * httpCommand(int httpProfile, HttpCmd httpCmd, const char* httpPath,
+                        const char* rspFile, const char* sendStr,
+                        int httpContentType, const char* httpCustomPar,
+                        Callback<bool(const char *, int)> sink,
+                        char* block, int blockSize, UbloxCancelToken *token = NULL);
 
     /**********************************************************************
      * PUBLIC: FTP
@@ -230,6 +301,13 @@ public:
         NUM_FTP_OP_CODES
     } FtpOpCode;
 
+    /** An FTP configuration parameter and its value, for ftpSetPars().
+     */
+    typedef struct {
+        FtpOpCode ftpOpCode;
+        const char * ftpInPar;
+    } FtpPar;
+
     /** Type of FTP Command.
      */
     typedef enum {
@@ -251,7 +329,8 @@ public:
 
     /** Set the timeout for FTP operations.
      *
-     * @param timeout -1 blocking, else non-blocking timeout in milliseconds.
+     * @param timeout TIMEOUT_BLOCKING, TIMEOUT_ADAPTIVE (the default) or
+     *                a timeout in milliseconds.
      * @return         true if successful, otherwise false.
      */
     bool ftpSetTimeout(int timeout);
@@ -286,6 +365,19 @@ public:
      * @return           true if successful, false otherwise.
      */
     bool ftpSetPar(FtpOpCode ftpOpCode, const char * ftpInPar);
+
+    /** Set several FTP parameters at once, e.g. the server name,
+     * port, user name and password before logging in.
+     *
+     * This does the same as calling ftpSetPar() for each parameter
+     * in turn but the parameters are sent to the module together,
+     * which takes a fraction of the time.
+     *
+     * @param ftpPars  the parameters, see ftpSetPar().
+     * @param numPars  the number of parameters at ftpPars.
+     * @return         true if successful, false otherwise.
+     */
+    bool ftpSetPars(const FtpPar * ftpPars, int numPars);
     
     /** Perform an FTP command.
      *
@@ -323,6 +415,12 @@ public:
      * FTP_FOTA_FILE is not supported on SARA-U2.
      * Note 5: FTP_GET_DIRECT and FTP_PUT_DIRECT are not supported by
      * this driver.
+     * If the module has no FTP (see probeCapabilities()) this fails at once.
+     *
+     * If a cancel token is given, cancelling it or reaching its deadline
+     * ends the wait for the server, sends the module the +UFTPC abort
+     * (FTP_ABORT_OP_CODE) and makes getLastAtError() return
+     * AT_ERROR_ABORTED.
      *
      * @param ftpCmd     the FTP command.
      * @param file1      the first file name if required (NULL otherwise).
@@ -332,13 +430,15 @@ public:
      * @param buf        pointer to a buffer, required for FTP_DIRECT mode
      *                   and FTP_LS only.
      * @param len        the size of buf.
+     * @param token      a cancel token, may be NULL.
      * @return           NULL if successful, otherwise a pointer to
      *                   a Error struct containing the error class and error
      *                   code, see section Appendix A.B of
      *                   u-blox-ATCommands_Manual(UBX-13002752).pdf for details.
      */
     Error *ftpCommand(FtpCmd ftpCmd, const char* file1 = NULL, const char* file2 = NULL,
-                      int offset = 0, char* buf = NULL, int len = 0);
+                      int offset = 0, char* buf = NULL, int len = 0,
+                      UbloxCancelToken *token = NULL);
 
     /**********************************************************************
      * PUBLIC: Cell Locate
@@ -447,6 +547,9 @@ public:
     bool cellLocGetData(CellLocData *data, int index = 0);
     
     /** Get the number of position records received.
+     *
+     * If no position record has arrived since the last call, this
+     * waits for up to a second for one to do so.
      *
      * @return number of position records received.
      */
@@ -460,6 +563,17 @@ public:
     
 protected:
 
+    /**********************************************************************
+     * PROTECTED: Capabilities
+     **********************************************************************/
+
+    /** Add the HTTP, FTP and Cell Locate features of the module to
+     * its capabilities.  NOTE: LOCK() is held.
+     *
+     * @param caps the capabilities to add to.
+     */
+    virtual void probeMoreCapabilities(Capabilities *caps);
+
     /**********************************************************************
      * PROTECTED: HTTP
      **********************************************************************/
@@ -468,6 +582,15 @@ protected:
      */
     #define TIMEOUT(t, ms)  ((ms != TIMEOUT_BLOCKING) && (ms < t.read_ms()))
 
+    /** The time remaining before a timeout, for waitUrcEvents().
+     */
+    #define TIME_LEFT(t, ms) (((ms) == TIMEOUT_BLOCKING) ? TIMEOUT_BLOCKING : \
+                              ((ms) > t.read_ms()) ? (ms) - t.read_ms() : 0)
+
+    /** Event flag: a +UUHTTPCR has arrived for the given HTTP profile.
+     */
+    #define URC_EVENT_HTTP(p) (0x100 << (p))
+
     /** Check for a valid profile.
      */
     #define IS_PROFILE(p) (((p) >= 0) && (((unsigned int) p) < (sizeof(_httpProfiles)/sizeof(_httpProfiles[0]))) \
@@ -496,25 +619,69 @@ protected:
      */
     HttpProfCtrl _httpProfiles[4];
 
+    /** The state lock of the HTTP profiles: their handles and
+     * timeouts, which are set without talking to the module, and
+     * the command and result written by +UUHTTPCR.  The rest of a
+     * profile belongs to the command in progress and is covered by
+     * the AT channel lock.
+     */
+    Mutex _httpMtx;
+
     /** Callback to capture the response to an HTTP command.
      */
     void UUHTTPCR_URC();
 
     /** Find a profile with a given handle.  If no handle is given, find the next
-     * free profile.
+     * free profile.  NOTE: lock _httpMtx before calling.
      *
      * @param modemHandle the handle of the profile to find.
      * @return            the profile handle or negative if not found/created.
      */
     int findProfile(int modemHandle = HTTP_PROF_UNUSED);
 
-    /** Helper function to get a HTTP command as a text string, useful
-     * for debug purposes.
+    /** Check that a profile is in use, under the state lock.
+     *
+     * @param profile the profile.
+     * @param timeout a place to put the timeout of the profile,
+     *                may be NULL.
+     * @return        true if the profile is in use.
+     */
+    bool checkProfile(int profile, int *timeout = NULL);
+
+    /** Add the command that sets an HTTP parameter to a batch.
      *
-     * @param httpCmdCode the HTTP command.
-     * @return            HTTP command in string format.
+     * @param batch       the batch.
+     * @param httpProfile the HTTP profile identifier.
+     * @param httpOpCode  the HTTP operation code.
+     * @param httpInPar   the HTTP input parameter.
+     * @return            true if successful, false otherwise.
      */
-    const char* getHttpCmd(HttpCmd httpCmd);
+    bool httpAddPar(UbloxAtBatch *batch, int httpProfile,
+                    HttpOpCode httpOpCode, const char * httpInPar);
+
+    /** Perform an HTTP command and read the server response into
+     * a buffer or, given a sink, hand it to the sink a block at a time
+     * through the buffer.
+     *
+     * @param httpProfile     the HTTP profile identifier.
+     * @param httpCmd         the HTTP command.
+     * @param httpPath        the path of resource on the HTTP server.
+     * @param rspFile         the local modem file for the response,
+     *                        NULL for don't care.
+     * @param sendStr         the filename or string to be sent.
+     * @param httpContentType the HTTP Content-Type identifier.
+     * @param httpCustomPar   the parameter for a user defined HTTP Content-Type.
+     * @param buf             the buffer to read into.
+     * @param len             the size of buf.
+     * @param sink            the sink, NULL to read into buf.
+     * @param token           a cancel token, may be NULL.
+     * @return                NULL if successful, otherwise the error.
+     */
+    Error * httpRun(int httpProfile, HttpCmd httpCmd, const char* httpPath,
+                    const char* rspFile, const char* sendStr,
+                    int httpContentType, const char* httpCustomPar,
+                    char* buf, int len, Callback<bool(const char *, int)> sink,
+                    UbloxCancelToken *token);
 
     /**********************************************************************
      * PROTECTED: FTP
@@ -524,10 +691,39 @@ protected:
      */
     #define FTP_OP_CODE_UNUSED -1
 
+    /** Event flag: a +UUFTPCR has arrived.
+     */
+    #define URC_EVENT_FTP 0x04
+
+    /** The +UFTPC op code that aborts the FTP command in progress,
+     * sent when an FTP command is cancelled; define it as -1 for a
+     * module that has none.
+     */
+#ifndef FTP_ABORT_OP_CODE
+    #define FTP_ABORT_OP_CODE 20
+#endif
+
+    /** How long to wait, once an FTP command has been aborted, for
+     * its +UUFTPCR so that the URC can't be taken as the result of
+     * the next command.
+     */
+    #define FTP_ABORT_WAIT_MS 5000
+
     /** The FTP timeout in milliseconds.
      */
     int _ftpTimeout;
 
+    /** The state lock of _ftpTimeout.
+     */
+    Mutex _ftpMtx;
+
+    /** Held for the whole of an FTP command, taken before the AT
+     * channel lock: the command lets go of that while it waits for
+     * +UUFTPCR, and the rest of the FTP state below belongs to it
+     * until it returns.
+     */
+    Mutex _ftpCmdMtx;
+
     /** A place to store the FTP op code for the last result.
      */
     volatile int _lastFtpOpCodeResult;
@@ -560,13 +756,14 @@ protected:
      */
     void UUFTPCD_URC();
 
-    /** Helper function to get an FTP command as a text string, useful
-     * for debug purposes.
+    /** Add the command that sets an FTP parameter to a batch.
      *
-     * @param ftpCmdCode  the FTP command.
-     * @return            FTP command in string format.
+     * @param batch     the batch.
+     * @param ftpOpCode the FTP operation code.
+     * @param ftpInPar  the FTP input parameter.
+     * @return          true if successful, false otherwise.
      */
-    const char * getFtpCmd(FtpCmd ftpCmd);
+    bool ftpAddPar(UbloxAtBatch *batch, FtpOpCode ftpOpCode, const char * ftpInPar);
 
     /**********************************************************************
      * PROTECTED: Cell Locate
@@ -576,6 +773,14 @@ protected:
      */
     #define CELL_MAX_HYP    (16 + 1)
 
+    /** Event flag: a +UULOC position has arrived.
+     */
+    #define URC_EVENT_CELL_LOCATE 0x08
+
+    /** The time to wait for a position in cellLocGetRes().
+     */
+    #define CELL_LOCATE_WAIT_MS 1000
+
     /** Received positions.
      */
     volatile int _locRcvPos;
@@ -588,9 +793,20 @@ protected:
      */
     CellLocData _loc[CELL_MAX_HYP];
 
-    /** Buffer for the URC to work with
+    /** The state lock of the positions received: _loc[], _locRcvPos
+     * and _locExpPos, which +UULOC fills in and cellLocGetData(),
+     * cellLocGetRes() and cellLocGetExpRes() read.
+     */
+    Mutex _locMtx;
+
+    /** The number of decimal places of latitude and longitude
+     * kept from +UULOC.
+     */
+    #define CELL_LOC_DECIMALS 7
+
+    /** 10 to the power CELL_LOC_DECIMALS.
      */
-    char urcBuf[128];
+    #define CELL_LOC_SCALE 10000000.0f
 
     /** Callback to capture +UULOCIND.
      */
@@ -43,6 +43,36 @@ using namespace utest::v1;
 # define MBED_CONF_APP_FILE_NAME "test_file"
 #endif
 
+// The number of times to repeat each failing operation when
+// measuring how long it takes to fail.
+#ifndef MBED_CONF_APP_FAIL_FAST_ITERATIONS
+# define MBED_CONF_APP_FAIL_FAST_ITERATIONS 10
+#endif
+
+// The number of times to repeat a failing operation with fail fast
+// off, each of which waits out the AT timeout.
+#ifndef MBED_CONF_APP_FAIL_SLOW_ITERATIONS
+# define MBED_CONF_APP_FAIL_SLOW_ITERATIONS 1
+#endif
+
+// The longest that a failing operation may take with fail fast on,
+// in milliseconds.
+#ifndef MBED_CONF_APP_FAIL_FAST_LIMIT_MS
+# define MBED_CONF_APP_FAIL_FAST_LIMIT_MS 1000
+#endif
+
+// Set this to 0 if RTS/CTS are not connected between the MCU
+// and the module, in which case the flow control test is skipped.
+#ifndef MBED_CONF_APP_TEST_FLOW_CONTROL
+# define MBED_CONF_APP_TEST_FLOW_CONTROL 1
+#endif
+
+// How much of the file to read while the AT interface is kept busy
+#define MAX_WAIT_READ_SIZE 4096
+
+// The name of a second, short-lived, file
+#define FILE_INDEX_TEST_NAME "test_file_index"
+
 // ----------------------------------------------------------------
 // PRIVATE VARIABLES
 // ----------------------------------------------------------------
@@ -59,6 +89,17 @@ static UbloxCellularDriverGen *pDriver =
 // A general purpose buffer
 char buf[MBED_CONF_APP_FILE_SIZE];
 
+// Set to stop the threads that keep the AT interface busy
+static volatile bool busyStop = false;
+
+// A block for a file read to a sink, the size of those read without
+// flow control, what has been handed to the sink so far, the largest
+// piece and the point at which to stop
+static char block[FILE_BUFFER_SIZE];
+static int sinkCount;
+static int sinkMaxSize;
+static int sinkStop;
+
 // ----------------------------------------------------------------
 // PRIVATE FUNCTIONS
 // ----------------------------------------------------------------
@@ -74,13 +115,45 @@ static void unlock()
     mtx.unlock();
 }
 
+// Sink for a file read: check each piece against the contents
+// written and stop once sinkStop has been reached
+static bool sink(const char *data, int size)
+{
+    for (int x = 0; x < size; x++) {
+        if (data[x] != (char) (sinkCount + x)) {
+            return false;
+        }
+    }
+    sinkCount += size;
+    if (size > sinkMaxSize) {
+        sinkMaxSize = size;
+    }
+
+    return sinkCount < sinkStop;
+}
+
+// Keep the AT interface busy with short commands until told to stop;
+// not fileSize(), which the file index would answer
+static void busyThread()
+{
+    while (!busyStop) {
+        pDriver->smsList();
+    }
+}
+
 // ----------------------------------------------------------------
 // TESTS
 // ----------------------------------------------------------------
 
-// Initialise the module
+// Initialise the module and check that what it can do has been found
 void test_start() {
+    UbloxCellularDriverGen::Capabilities caps;
+
     TEST_ASSERT(pDriver->init(MBED_CONF_APP_DEFAULT_PIN));
+    TEST_ASSERT(pDriver->getCapabilities(&caps));
+    TEST_ASSERT(caps.flags & UbloxCellularDriverGen::CAP_FILE_BLOCK_READ);
+    TEST_ASSERT(strlen(caps.firmware) > 0);
+    tr_debug("Firmware \"%s\", capabilities 0x%02x", caps.firmware, (unsigned int) caps.flags);
 }
 
 // Write a file to the module's file system with known contents
@@ -108,12 +181,686 @@ void test_read() {
     }
 }
 
+// Check that a file read stops when its cancel token is cancelled,
+// before it starts or part way through, or reaches its deadline, and
+// that the file can be read as normal afterwards
+void test_read_cancel() {
+    UbloxCancelToken token;
+    UbloxAtQueue::Transaction transaction;
+
+    token.cancel();
+    TEST_ASSERT(pDriver->readFile(MBED_CONF_APP_FILE_NAME, buf, sizeof (buf), &token) ==
+                AT_QUEUE_CANCELLED);
+
+    token.reset();
+    token.setTimeout(0);
+    TEST_ASSERT(pDriver->readFile(MBED_CONF_APP_FILE_NAME, buf, sizeof (buf), &token) ==
+                AT_QUEUE_DEADLINE);
+
+    // The read has at least two steps, finding the size and reading
+    // a block, so cancelling straight after it is queued stops it
+    token.reset();
+    transaction.setCancelToken(&token);
+    TEST_ASSERT(pDriver->readFileAsync(&transaction, MBED_CONF_APP_FILE_NAME,
+                                       buf, sizeof (buf)));
+    token.cancel();
+    TEST_ASSERT(transaction.wait() == AT_QUEUE_CANCELLED);
+
+    test_read();
+}
+
+// Read the file to a sink a block at a time, all of it, then stopping
+// part way, in the foreground and in the background
+void test_read_sink() {
+    UbloxAtQueue::Transaction transaction;
+
+    sinkCount = 0;
+    sinkMaxSize = 0;
+    sinkStop = sizeof (buf);
+    TEST_ASSERT(pDriver->readFile(MBED_CONF_APP_FILE_NAME, callback(sink),
+                                  block, sizeof (block)) == sizeof (buf));
+    TEST_ASSERT(sinkCount == sizeof (buf));
+    TEST_ASSERT((sinkMaxSize > 0) && (sinkMaxSize <= (int) sizeof (block)));
+    tr_debug("%d bytes read from file \"%s\" to a sink in blocks of %d",
+             sinkCount, MBED_CONF_APP_FILE_NAME, sinkMaxSize);
+
+    // The sink stops the read at the end of the block
+    // in which sinkStop is reached
+    sinkCount = 0;
+    sinkStop = 1000;
+    TEST_ASSERT(pDriver->readFile(MBED_CONF_APP_FILE_NAME, callback(sink),
+                                  block, sizeof (block)) == sinkCount);
+    TEST_ASSERT((sinkCount >= sinkStop) && (sinkCount < sinkStop + (int) sizeof (block)));
+
+    sinkCount = 0;
+    TEST_ASSERT(pDriver->readFileAsync(&transaction, MBED_CONF_APP_FILE_NAME,
+                                       callback(sink), block, sizeof (block)));
+    TEST_ASSERT(transaction.wait() == sinkCount);
+    TEST_ASSERT((sinkCount >= sinkStop) && (sinkCount < sinkStop + (int) sizeof (block)));
+}
+
+// Read parts of the file from the middle and the end, then read
+// the last part of it in pieces with a cursor
+void test_read_range() {
+    UbloxCellularDriverGen::FileCursor cursor(pDriver, MBED_CONF_APP_FILE_NAME);
+    int offset;
+    int x;
+
+    memset(buf, 0, sizeof (buf));
+    TEST_ASSERT(pDriver->readFileRange(MBED_CONF_APP_FILE_NAME, 1000, buf, 300) == 300);
+    for (x = 0; x < 300; x++) {
+        TEST_ASSERT(buf[x] == (char) (1000 + x));
+    }
+
+    // Past the end the read stops short, or reads nothing
+    offset = sizeof (buf) - 100;
+    TEST_ASSERT(pDriver->readFileRange(MBED_CONF_APP_FILE_NAME, offset, buf, 1000) == 100);
+    for (x = 0; x < 100; x++) {
+        TEST_ASSERT(buf[x] == (char) (offset + x));
+    }
+    TEST_ASSERT(pDriver->readFileRange(MBED_CONF_APP_FILE_NAME, sizeof (buf), buf, 10) == 0);
+
+    TEST_ASSERT(cursor.size() == sizeof (buf));
+    TEST_ASSERT(!cursor.seek(-1));
+    offset = sizeof (buf) - 1000;
+    TEST_ASSERT(cursor.seek(offset));
+    do {
+        x = cursor.read(buf + cursor.tell() - offset, 300);
+        TEST_ASSERT(x >= 0);
+    } while (x > 0);
+    TEST_ASSERT(cursor.tell() == sizeof (buf));
+    for (x = 0; x < 1000; x++) {
+        TEST_ASSERT(buf[x] == (char) (offset + x));
+    }
+    tr_debug("Read 1000 bytes from offset %d of file \"%s\" with a cursor",
+             offset, MBED_CONF_APP_FILE_NAME);
+}
+
+// Read the file in the background at low priority and check that
+// a normal priority command gets in between the blocks of the read
+void test_read_async() {
+    UbloxAtQueue::Transaction transaction;
+    Timer timer;
+    int readTime;
+    int listTime;
+
+    memset(buf, 0, sizeof (buf));
+
+    timer.start();
+    TEST_ASSERT(pDriver->readFileAsync(&transaction, MBED_CONF_APP_FILE_NAME,
+                                       buf, sizeof (buf)));
+    // Let the read get going
+    wait_ms(500);
+    TEST_ASSERT(!transaction.isDone());
+    TEST_ASSERT(pDriver->smsList() >= 0);
+    listTime = timer.read_ms();
+    TEST_ASSERT(!transaction.isDone());
+
+    TEST_ASSERT(transaction.wait() == sizeof (buf));
+    readTime = timer.read_ms();
+    timer.stop();
+
+    tr_debug("smsList() completed after %d ms, in the middle of a %d ms read",
+             listTime, readTime);
+
+    for (int x = 0; x < sizeof (buf); x++) {
+        TEST_ASSERT(buf[x] == (char) x);
+    }
+}
+
+// Read the file back with and without flow control, checking
+// the contents and comparing the throughput of the two
+void test_read_flow_control() {
+    Timer timer;
+    int noFlowTime;
+    int flowTime;
+
+    TEST_ASSERT(!pDriver->isFlowControlOn());
+
+    memset(buf, 0, sizeof (buf));
+    timer.start();
+    TEST_ASSERT(pDriver->readFile(MBED_CONF_APP_FILE_NAME, buf, sizeof (buf)) == sizeof (buf));
+    noFlowTime = timer.read_ms();
+    for (int x = 0; x < sizeof (buf); x++) {
+        TEST_ASSERT(buf[x] == (char) x);
+    }
+
+    TEST_ASSERT(pDriver->setFlowControl(true));
+    TEST_ASSERT(pDriver->isFlowControlOn());
+
+    memset(buf, 0, sizeof (buf));
+    timer.reset();
+    TEST_ASSERT(pDriver->readFile(MBED_CONF_APP_FILE_NAME, buf, sizeof (buf)) == sizeof (buf));
+    flowTime = timer.read_ms();
+    timer.stop();
+    for (int x = 0; x < sizeof (buf); x++) {
+        TEST_ASSERT(buf[x] == (char) x);
+    }
+
+    TEST_ASSERT(pDriver->setFlowControl(false));
+    TEST_ASSERT(!pDriver->isFlowControlOn());
+
+    tr_debug("readFile() of %d bytes without flow control: %d ms, %d bytes/s",
+             sizeof (buf), noFlowTime, (int) (sizeof (buf) * 1000 / noFlowTime));
+    tr_debug("readFile() of %d bytes with flow control: %d ms, %d bytes/s",
+             sizeof (buf), flowTime, (int) (sizeof (buf) * 1000 / flowTime));
+
+    // Far fewer AT round trips so it should be quicker
+    TEST_ASSERT(flowTime < noFlowTime);
+}
+
+// Negotiate the fastest baud rate that works, read the file back
+// at that rate, checking the contents and comparing the throughput
+// with that at the default rate, then go back to the default rate
+void test_read_baud() {
+    Timer timer;
+    int defaultTime;
+    int fastTime;
+    int baud;
+
+    TEST_ASSERT(pDriver->getBaud() == MBED_CONF_UBLOX_CELL_BAUD_RATE);
+
+    memset(buf, 0, sizeof (buf));
+    timer.start();
+    TEST_ASSERT(pDriver->readFile(MBED_CONF_APP_FILE_NAME, buf, sizeof (buf)) == sizeof (buf));
+    defaultTime = timer.read_ms();
+
+    baud = pDriver->negotiateBaud();
+    TEST_ASSERT(baud == pDriver->getBaud());
+    tr_debug("Negotiated %d baud", baud);
+
+    memset(buf, 0, sizeof (buf));
+    timer.reset();
+    TEST_ASSERT(pDriver->readFile(MBED_CONF_APP_FILE_NAME, buf, sizeof (buf)) == sizeof (buf));
+    fastTime = timer.read_ms();
+    timer.stop();
+    for (int x = 0; x < sizeof (buf); x++) {
+        TEST_ASSERT(buf[x] == (char) x);
+    }
+
+    TEST_ASSERT(pDriver->setBaud(MBED_CONF_UBLOX_CELL_BAUD_RATE));
+    TEST_ASSERT(pDriver->getBaud() == MBED_CONF_UBLOX_CELL_BAUD_RATE);
+
+    tr_debug("readFile() of %d bytes at %d baud: %d ms", sizeof (buf),
+             MBED_CONF_UBLOX_CELL_BAUD_RATE, defaultTime);
+    tr_debug("readFile() of %d bytes at %d baud: %d ms", sizeof (buf),
+             baud, fastTime);
+
+    if (baud > MBED_CONF_UBLOX_CELL_BAUD_RATE) {
+        TEST_ASSERT(fastTime < defaultTime);
+    }
+}
+
+// Read the file in the background on the data channel of the
+// multiplexer while commands run on the control channel
+void test_read_cmux() {
+    UbloxAtQueue::Transaction transaction;
+    Timer timer;
+    int listTime;
+    int readTime;
+
+    TEST_ASSERT(!pDriver->isCmuxOn());
+    TEST_ASSERT(pDriver->cmuxStart());
+    TEST_ASSERT(pDriver->isCmuxOn());
+
+    memset(buf, 0, sizeof (buf));
+    timer.start();
+    TEST_ASSERT(pDriver->readFileAsync(&transaction, MBED_CONF_APP_FILE_NAME,
+                                       buf, sizeof (buf)));
+    // Let the read get going
+    wait_ms(500);
+    TEST_ASSERT(!transaction.isDone());
+    TEST_ASSERT(pDriver->smsList() >= 0);
+    TEST_ASSERT(pDriver->fileSize(MBED_CONF_APP_FILE_NAME) >= sizeof (buf));
+    listTime = timer.read_ms();
+
+    TEST_ASSERT(transaction.wait() == sizeof (buf));
+    readTime = timer.read_ms();
+    timer.stop();
+    for (int x = 0; x < sizeof (buf); x++) {
+        TEST_ASSERT(buf[x] == (char) x);
+    }
+
+    TEST_ASSERT(pDriver->cmuxStop());
+    TEST_ASSERT(!pDriver->isCmuxOn());
+
+    tr_debug("smsList() and fileSize() completed after %d ms, in the middle of a %d ms read",
+             listTime, readTime);
+}
+
+// Read the file with numeric result codes, directly and over the
+// multiplexer, check that an error still arrives with its number and
+// compare the time taken with that of verbose result codes
+void test_read_numeric() {
+    Timer timer;
+    int verboseTime;
+    int numericTime;
+    UbloxCellularDriverGen::AtError atError;
+
+    timer.start();
+    TEST_ASSERT(pDriver->readFile(MBED_CONF_APP_FILE_NAME, buf, sizeof (buf)) == sizeof (buf));
+    verboseTime = timer.read_ms();
+
+    TEST_ASSERT(!pDriver->isNumericResultCodesOn());
+    TEST_ASSERT(pDriver->setNumericResultCodes(true));
+    TEST_ASSERT(pDriver->isNumericResultCodesOn());
+
+    memset(buf, 0, sizeof (buf));
+    timer.reset();
+    TEST_ASSERT(pDriver->readFile(MBED_CONF_APP_FILE_NAME, buf, sizeof (buf)) == sizeof (buf));
+    numericTime = timer.read_ms();
+    for (int x = 0; x < sizeof (buf); x++) {
+        TEST_ASSERT(buf[x] == (char) x);
+    }
+    TEST_ASSERT(pDriver->fileSize("no_such_file") < 0);
+    atError = pDriver->getLastAtError();
+    TEST_ASSERT(atError.eType == UbloxCellularDriverGen::AT_ERROR_CME);
+    TEST_ASSERT(atError.eCode >= 0);
+
+    TEST_ASSERT(pDriver->cmuxStart());
+    memset(buf, 0, sizeof (buf));
+    TEST_ASSERT(pDriver->readFile(MBED_CONF_APP_FILE_NAME, buf, sizeof (buf)) == sizeof (buf));
+    for (int x = 0; x < sizeof (buf); x++) {
+        TEST_ASSERT(buf[x] == (char) x);
+    }
+    TEST_ASSERT(pDriver->smsList() >= 0);
+    TEST_ASSERT(pDriver->cmuxStop());
+
+    TEST_ASSERT(pDriver->setNumericResultCodes(false));
+    TEST_ASSERT(!pDriver->isNumericResultCodesOn());
+    TEST_ASSERT(pDriver->fileSize(MBED_CONF_APP_FILE_NAME) >= sizeof (buf));
+    timer.stop();
+
+    tr_debug("Read took %d ms with verbose result codes, %d ms with numeric ones",
+             verboseTime, numericTime);
+}
+
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_STATS
+// Check that the AT statistics have counted the file
+// operations so far, and the blocks of the file reads with their
+// retries and block sizes, and print them all out
+void test_stats() {
+    UbloxAtStats::Counters counters;
+    UbloxAtStats::FileReadCounters fileRead;
+    UbloxAtStats::AtFamily family;
+
+    TEST_ASSERT(pDriver->getAtStats(UbloxAtStats::AT_FAMILY_URDBLOCK, &counters));
+    TEST_ASSERT(counters.count > 0);
+    TEST_ASSERT(counters.bytes >= sizeof (buf));
+    TEST_ASSERT(pDriver->getAtStats(UbloxAtStats::AT_FAMILY_UDWNFILE, &counters));
+    TEST_ASSERT(counters.count > 0);
+    TEST_ASSERT(counters.bytes >= sizeof (buf));
+    TEST_ASSERT(pDriver->getAtStats(UbloxAtStats::AT_FAMILY_ULSTFILE, &counters));
+    TEST_ASSERT(counters.count > 0);
+    TEST_ASSERT(!pDriver->getAtStats(UbloxAtStats::MAX_NUM_AT_FAMILIES, &counters));
+
+    for (int x = 0; x < UbloxAtStats::MAX_NUM_AT_FAMILIES; x++) {
+        family = (UbloxAtStats::AtFamily) x;
+        TEST_ASSERT(pDriver->getAtStats(family, &counters));
+        if (counters.count > 0) {
+            tr_debug("%s: %d done, %d errors, %d timeouts, %d bytes, average %d us, max %d us",
+                     UbloxAtStats::familyName(family), (int) counters.count,
+                     (int) counters.numErrors, (int) counters.numTimeouts,
+                     (int) counters.bytes, (int) (counters.totalUs / counters.count),
+                     (int) counters.maxUs);
+            for (int y = 0; y < AT_STATS_NUM_BUCKETS; y++) {
+                if (counters.buckets[y] > 0) {
+                    tr_debug("    < %u ms: %d", (unsigned int) UbloxAtStats::bucketLimitMs(y),
+                             (int) counters.buckets[y]);
+                }
+            }
+        }
+    }
+
+    TEST_ASSERT(pDriver->getAtWaitStats(&counters));
+    TEST_ASSERT(counters.count > 0);
+    tr_debug("Waits for the AT interface: %d, average %d us, max %d us",
+             (int) counters.count, (int) (counters.totalUs / counters.count),
+             (int) counters.maxUs);
+
+    // Every retry follows a block that came up short
+    TEST_ASSERT(pDriver->getFileReadStats(&fileRead));
+    TEST_ASSERT(fileRead.numBlocks > 0);
+    TEST_ASSERT(fileRead.bytes >= sizeof (buf));
+    TEST_ASSERT(fileRead.totalUs > 0);
+    TEST_ASSERT(fileRead.numRetries + fileRead.numFailed <= fileRead.numShort);
+    TEST_ASSERT(fileRead.minBlockSize <= fileRead.maxBlockSize);
+    TEST_ASSERT(fileRead.blockSize >= MBED_CONF_UBLOX_CELL_DRIVER_GEN_FILE_BLOCK_MIN_SIZE);
+#if MBED_CONF_APP_TEST_FLOW_CONTROL
+    // With flow control on the block size grows beyond that without
+    TEST_ASSERT(fileRead.maxBlockSize > FILE_BUFFER_SIZE);
+#endif
+    tr_debug("File blocks: %d read, %d short, %d retries, %d reads failed, %d bytes/s",
+             (int) fileRead.numBlocks, (int) fileRead.numShort, (int) fileRead.numRetries,
+             (int) fileRead.numFailed, (int) ((uint64_t) fileRead.bytes * 1000000 / fileRead.totalUs));
+    tr_debug("File block size: %d now, %d to %d used, grown %d times, shrunk %d times",
+             (int) fileRead.blockSize, (int) fileRead.minBlockSize, (int) fileRead.maxBlockSize,
+             (int) fileRead.numGrows, (int) fileRead.numShrinks);
+
+    pDriver->resetAtStats();
+    TEST_ASSERT(pDriver->getAtStats(UbloxAtStats::AT_FAMILY_URDBLOCK, &counters));
+    TEST_ASSERT(counters.count == 0);
+}
+#endif
+
+// Check that driver state can be read while a file read holds the
+// AT channel lock, without waiting for the read to finish
+void test_state_locks() {
+    UbloxAtQueue::Transaction transaction;
+    UbloxAtStats::Counters counters;
+    Timer timer;
+    int maxMs = 0;
+    int x = 0;
+
+    memset(buf, 0, sizeof (buf));
+    TEST_ASSERT(pDriver->readFileAsync(&transaction, MBED_CONF_APP_FILE_NAME,
+                                       buf, sizeof (buf)));
+    // Let the read get going
+    wait_ms(500);
+    while (!transaction.isDone()) {
+        timer.reset();
+        timer.start();
+        pDriver->getLastAtError();
+        TEST_ASSERT(!pDriver->isCmuxOn());
+        TEST_ASSERT(pDriver->getBaud() > 0);
+        timer.stop();
+        if (timer.read_ms() > maxMs) {
+            maxMs = timer.read_ms();
+        }
+        x++;
+        wait_ms(10);
+    }
+    TEST_ASSERT(transaction.wait() == sizeof (buf));
+    TEST_ASSERT(x > 0);
+    TEST_ASSERT(maxMs < 100);
+
+    TEST_ASSERT(pDriver->getStateWaitStats(&counters));
+    tr_debug("%d state reads during the file read, longest %d ms; %d waits for"
+             " a state lock, max %d us", x, maxMs, (int) counters.count,
+             (int) counters.maxUs);
+}
+
+// Check that once the file list has been read whether the file exists,
+// and its size once found, come from the file index without a round
+// trip to the module, and that writing and deleting a file keep the
+// index up to date
+void test_file_index() {
+    UbloxAtStats::Counters counters;
+    int size;
+    uint32_t count;
+    bool complete;
+
+    pDriver->invalidateFileIndex();
+    pDriver->resetAtStats();
+    TEST_ASSERT(pDriver->fileExists(MBED_CONF_APP_FILE_NAME));
+    size = pDriver->fileSize(MBED_CONF_APP_FILE_NAME);
+    TEST_ASSERT(size >= (int) sizeof (buf));
+    TEST_ASSERT(pDriver->getAtStats(UbloxAtStats::AT_FAMILY_ULSTFILE, &counters));
+    count = counters.count;
+    TEST_ASSERT(count <= 2);
+    for (int x = 0; x < 10; x++) {
+        TEST_ASSERT(pDriver->fileExists(MBED_CONF_APP_FILE_NAME));
+        TEST_ASSERT(pDriver->fileSize(MBED_CONF_APP_FILE_NAME) == size);
+    }
+    TEST_ASSERT(pDriver->getAtStats(UbloxAtStats::AT_FAMILY_ULSTFILE, &counters));
+    TEST_ASSERT(counters.count == count);
+
+    // Asking about a missing file costs nothing either, unless
+    // there are too many files for the index to hold them all
+    TEST_ASSERT(!pDriver->fileExists("no_such_file"));
+    TEST_ASSERT(pDriver->fileSize("no_such_file") < 0);
+    TEST_ASSERT(pDriver->getAtStats(UbloxAtStats::AT_FAMILY_ULSTFILE, &counters));
+    complete = (counters.count == count);
+    tr_debug("%d AT+ULSTFILE round trip(s) for 22 lookups", (int) counters.count);
+    count = counters.count;
+
+    // Of a file that is written then deleted only the size
+    // need be asked for
+    TEST_ASSERT(pDriver->writeFile(FILE_INDEX_TEST_NAME, "index", 5) == 5);
+    TEST_ASSERT(pDriver->fileExists(FILE_INDEX_TEST_NAME));
+    TEST_ASSERT(pDriver->fileSize(FILE_INDEX_TEST_NAME) >= 5);
+    TEST_ASSERT(pDriver->delFile(FILE_INDEX_TEST_NAME));
+    TEST_ASSERT(!pDriver->fileExists(FILE_INDEX_TEST_NAME));
+    TEST_ASSERT(pDriver->fileSize(FILE_INDEX_TEST_NAME) < 0);
+    TEST_ASSERT(pDriver->getAtStats(UbloxAtStats::AT_FAMILY_ULSTFILE, &counters));
+    TEST_ASSERT(!complete || (counters.count == count + 1));
+}
+
+// Read the file at low priority while two threads keep the AT interface
+// busy at normal priority, so that there is always a normal priority
+// waiter when a turn is released; the read must still finish because
+// its steps go first once they have waited for longer than the
+// maximum wait; only the start of the file is read as each block
+// waits that long
+void test_read_max_wait() {
+    UbloxAtQueue::Transaction transaction;
+    Thread thread1;
+    Thread thread2;
+    Timer timer;
+    int result;
+
+    pDriver->setAtQueueLimits(200, MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_QUEUE_MAX_HOLD_MS);
+    memset(buf, 0, sizeof (buf));
+    busyStop = false;
+    thread1.start(busyThread);
+    thread2.start(busyThread);
+
+    timer.start();
+    TEST_ASSERT(pDriver->readFileAsync(&transaction, MBED_CONF_APP_FILE_NAME,
+                                       buf, MAX_WAIT_READ_SIZE,
+                                       UbloxAtQueue::AT_PRIORITY_LOW));
+    result = transaction.wait(60000);
+    timer.stop();
+
+    busyStop = true;
+    thread1.join();
+    thread2.join();
+    pDriver->setAtQueueLimits(MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_QUEUE_MAX_WAIT_MS,
+                              MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_QUEUE_MAX_HOLD_MS);
+
+    TEST_ASSERT(result == MAX_WAIT_READ_SIZE);
+    tr_debug("Low priority read of %d bytes took %d ms against two busy threads",
+             MAX_WAIT_READ_SIZE, timer.read_ms());
+    for (int x = 0; x < MAX_WAIT_READ_SIZE; x++) {
+        TEST_ASSERT(buf[x] == (char) x);
+    }
+}
+
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_ADAPTIVE_TIMEOUTS
+// Check that the timeout of a block read has been learnt from the
+// file reads so far and is kept within its bounds
+void test_timeouts() {
+    UbloxAtTimeouts::Estimate estimate;
+    int minMs;
+    int maxMs;
+
+    TEST_ASSERT(pDriver->getAtTimeout(UbloxAtStats::AT_FAMILY_URDBLOCK, &estimate));
+    TEST_ASSERT(estimate.count > 0);
+    TEST_ASSERT(estimate.timeoutMs >= estimate.minMs);
+    TEST_ASSERT(estimate.timeoutMs <= estimate.maxMs);
+    TEST_ASSERT(!pDriver->getAtTimeout(UbloxAtStats::MAX_NUM_AT_FAMILIES, &estimate));
+    tr_debug("URDBLOCK: %d measured, %d timeouts, latency %d us +/- %d us, timeout %d ms",
+             (int) estimate.count, (int) estimate.numTimeouts, (int) estimate.srttUs,
+             (int) estimate.rttvarUs, estimate.timeoutMs);
+
+    // Hold the timeout at a fixed value and check that reading still works
+    minMs = estimate.minMs;
+    maxMs = estimate.maxMs;
+    TEST_ASSERT(!pDriver->setAtTimeoutBounds(UbloxAtStats::AT_FAMILY_URDBLOCK, 0, 1000));
+    TEST_ASSERT(!pDriver->setAtTimeoutBounds(UbloxAtStats::AT_FAMILY_URDBLOCK, 1000, 999));
+    TEST_ASSERT(pDriver->setAtTimeoutBounds(UbloxAtStats::AT_FAMILY_URDBLOCK, 2000, 2000));
+    TEST_ASSERT(pDriver->getAtTimeout(UbloxAtStats::AT_FAMILY_URDBLOCK, &estimate));
+    TEST_ASSERT(estimate.timeoutMs == 2000);
+    memset(buf, 0, sizeof (buf));
+    TEST_ASSERT(pDriver->readFile(MBED_CONF_APP_FILE_NAME, buf, sizeof (buf)) == sizeof (buf));
+    for (int x = 0; x < sizeof (buf); x++) {
+        TEST_ASSERT(buf[x] == (char) x);
+    }
+    TEST_ASSERT(pDriver->setAtTimeoutBounds(UbloxAtStats::AT_FAMILY_URDBLOCK, minMs, maxMs));
+
+    pDriver->resetAtTimeouts();
+    TEST_ASSERT(pDriver->getAtTimeout(UbloxAtStats::AT_FAMILY_URDBLOCK, &estimate));
+    TEST_ASSERT(estimate.count == 0);
+    TEST_ASSERT(estimate.timeoutMs == -1);
+    TEST_ASSERT(estimate.minMs == minMs);
+}
+#endif
+
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_TRACE
+// Check that a file read is logged to the event trace,
+// then print the trace for the host decoder
+void test_trace() {
+    UbloxTrace::Entry entries[MBED_CONF_UBLOX_CELL_DRIVER_GEN_TRACE_RING_SIZE];
+    int numEntries;
+    bool found = false;
+
+    pDriver->clearTrace();
+    TEST_ASSERT(pDriver->getTrace(entries, sizeof (entries) / sizeof (entries[0])) == 0);
+
+    memset(buf, 0, sizeof (buf));
+    TEST_ASSERT(pDriver->readFile(MBED_CONF_APP_FILE_NAME, buf, sizeof (buf)) == sizeof (buf));
+
+    numEntries = pDriver->getTrace(entries, sizeof (entries) / sizeof (entries[0]));
+    TEST_ASSERT(numEntries > 0);
+    for (int x = 0; x < numEntries; x++) {
+        if (x > 0) {
+            TEST_ASSERT(entries[x].seq > entries[x - 1].seq);
+        }
+        if ((entries[x].id == UBLOX_TRACE_FILE_READ_START) &&
+            (entries[x].args[0] == sizeof (buf))) {
+            found = true;
+        }
+    }
+    TEST_ASSERT(found);
+
+    pDriver->printTrace();
+}
+#endif
+
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_TRANSCRIPT
+// Record a transcript of part of a file read, check that it holds
+// the command and the file contents, then print it for the host
+void test_transcript() {
+    static char transcript[4096];
+    UbloxTranscript::Record records[64];
+    int numRecords;
+    int rxBytes = 0;
+    bool found = false;
+
+    TEST_ASSERT(pDriver->transcriptStart(transcript, sizeof (transcript)));
+    TEST_ASSERT(pDriver->isTranscriptOn());
+    TEST_ASSERT(!pDriver->transcriptStart(transcript, sizeof (transcript)));
+
+    memset(buf, 0, sizeof (buf));
+    TEST_ASSERT(pDriver->readFile(MBED_CONF_APP_FILE_NAME, buf, 1024) == 1024);
+    for (int x = 0; x < 1024; x++) {
+        TEST_ASSERT(buf[x] == (char) x);
+    }
+
+    TEST_ASSERT(pDriver->transcriptStop());
+    TEST_ASSERT(!pDriver->isTranscriptOn());
+    TEST_ASSERT(!pDriver->transcriptStop());
+
+    numRecords = pDriver->getTranscript(records, sizeof (records) / sizeof (records[0]));
+    TEST_ASSERT(numRecords > 1);
+    for (int x = 0; x < numRecords; x++) {
+        TEST_ASSERT(records[x].size > 0);
+        TEST_ASSERT(records[x].endUs >= records[x].startUs);
+        if (x > 0) {
+            TEST_ASSERT(records[x].startUs >= records[x - 1].endUs);
+        }
+        if (records[x].direction == UbloxTranscript::TRANSCRIPT_TX) {
+            if ((records[x].size >= 11) && (memcmp(records[x].data, "AT+URDBLOCK", 11) == 0)) {
+                found = true;
+            }
+        } else {
+            rxBytes += records[x].size;
+        }
+    }
+    TEST_ASSERT(found);
+    TEST_ASSERT(rxBytes > 1024);
+
+    pDriver->printTranscript();
+}
+#endif
+
 // Delete a file from the module's file system
 void test_delete() {
     TEST_ASSERT(pDriver->delFile(MBED_CONF_APP_FILE_NAME));
     tr_debug("File \"%s\" deleted", MBED_CONF_APP_FILE_NAME);
 }
 
+// Check that operations on the now non-existent file fail as soon as
+// the module says so, and report how long that takes compared with an
+// operation that succeeds
+void test_fail_fast() {
+    Timer timer;
+    int okTime;
+    int slowTime;
+    int delTime;
+    int sizeTime;
+    int readTime;
+    UbloxCellularDriverGen::AtError atError;
+
+    // The baseline: a successful command round trip
+    timer.start();
+    for (int x = 0; x < MBED_CONF_APP_FAIL_FAST_ITERATIONS; x++) {
+        TEST_ASSERT(pDriver->smsList() >= 0);
+    }
+    okTime = timer.read_ms();
+
+    // The old behaviour: the error final result code is ignored
+    // and the command waits out the AT timeout
+    pDriver->setFailFast(false);
+    TEST_ASSERT(!pDriver->isFailFastOn());
+    timer.reset();
+    for (int x = 0; x < MBED_CONF_APP_FAIL_SLOW_ITERATIONS; x++) {
+        TEST_ASSERT(!pDriver->delFile(MBED_CONF_APP_FILE_NAME));
+    }
+    slowTime = timer.read_ms();
+    TEST_ASSERT(pDriver->getLastAtError().eType == UbloxCellularDriverGen::AT_ERROR_NONE);
+    pDriver->setFailFast(true);
+    TEST_ASSERT(pDriver->isFailFastOn());
+
+    timer.reset();
+    for (int x = 0; x < MBED_CONF_APP_FAIL_FAST_ITERATIONS; x++) {
+        TEST_ASSERT(!pDriver->delFile(MBED_CONF_APP_FILE_NAME));
+    }
+    delTime = timer.read_ms();
+    atError = pDriver->getLastAtError();
+    TEST_ASSERT(atError.eType != UbloxCellularDriverGen::AT_ERROR_NONE);
+    tr_debug("delFile() failed with error type %d, code %d", atError.eType, atError.eCode);
+
+    timer.reset();
+    for (int x = 0; x < MBED_CONF_APP_FAIL_FAST_ITERATIONS; x++) {
+        TEST_ASSERT(pDriver->fileSize(MBED_CONF_APP_FILE_NAME) < 0);
+    }
+    sizeTime = timer.read_ms();
+
+    timer.reset();
+    for (int x = 0; x < MBED_CONF_APP_FAIL_FAST_ITERATIONS; x++) {
+        TEST_ASSERT(pDriver->readFile(MBED_CONF_APP_FILE_NAME, buf, sizeof (buf)) < 0);
+    }
+    readTime = timer.read_ms();
+    timer.stop();
+
+    tr_debug("Average time for a successful command: %d ms",
+             okTime / MBED_CONF_APP_FAIL_FAST_ITERATIONS);
+    tr_debug("Average time for delFile() of a missing file without fail fast: %d ms",
+             slowTime / MBED_CONF_APP_FAIL_SLOW_ITERATIONS);
+    tr_debug("Average time for delFile() of a missing file with fail fast: %d ms",
+             delTime / MBED_CONF_APP_FAIL_FAST_ITERATIONS);
+    tr_debug("Average time for fileSize() of a missing file: %d ms",
+             sizeTime / MBED_CONF_APP_FAIL_FAST_ITERATIONS);
+    tr_debug("Average time for readFile() of a missing file: %d ms",
+             readTime / MBED_CONF_APP_FAIL_FAST_ITERATIONS);
+
+    TEST_ASSERT(slowTime / MBED_CONF_APP_FAIL_SLOW_ITERATIONS >= MBED_CONF_APP_FAIL_FAST_LIMIT_MS);
+    TEST_ASSERT(delTime / MBED_CONF_APP_FAIL_FAST_ITERATIONS < MBED_CONF_APP_FAIL_FAST_LIMIT_MS);
+    TEST_ASSERT(sizeTime / MBED_CONF_APP_FAIL_FAST_ITERATIONS < MBED_CONF_APP_FAIL_FAST_LIMIT_MS);
+    TEST_ASSERT(readTime / MBED_CONF_APP_FAIL_FAST_ITERATIONS < MBED_CONF_APP_FAIL_FAST_LIMIT_MS);
+}
+
 // ----------------------------------------------------------------
 // TEST ENVIRONMENT
 // ----------------------------------------------------------------
@@ -130,7 +877,33 @@ Case cases[] = {
     Case("Start", test_start),
     Case("Write file", test_write),
     Case("Read file", test_read),
-    Case("Delete file", test_delete)
+    Case("Read file in the background", test_read_async),
+    Case("Read file to a sink", test_read_sink),
+    Case("Read file ranges", test_read_range),
+    Case("Cancel file read", test_read_cancel),
+#if MBED_CONF_APP_TEST_FLOW_CONTROL
+    Case("Read file with flow control", test_read_flow_control),
+#endif
+    Case("Read file at a negotiated baud rate", test_read_baud),
+    Case("Read file over the multiplexer", test_read_cmux),
+    Case("Read file with numeric result codes", test_read_numeric),
+    Case("Read file at low priority while busy", test_read_max_wait),
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_STATS
+    Case("AT statistics", test_stats),
+    Case("State locks", test_state_locks),
+    Case("File index", test_file_index),
+#endif
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_ADAPTIVE_TIMEOUTS
+    Case("Adaptive timeouts", test_timeouts),
+#endif
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_TRACE
+    Case("Event trace", test_trace),
+#endif
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_TRANSCRIPT
+    Case("Transcript", test_transcript),
+#endif
+    Case("Delete file", test_delete),
+    Case("Fail fast", test_fail_fast)
 };
 
 Specification specification(test_setup, cases);
@@ -55,6 +55,14 @@ using namespace utest::v1;
 # define MBED_CONF_APP_SMS_RECEIVE_CONTENTS "ACK"
 #endif
 
+// Set this to the size of a buffer in which to record a transcript
+// of everything that passes between the driver and the module during
+// the test, printed at the end for replay on a PC with
+// ublox-cellular-driver-gen/host/transcript_replay; 0 for none.
+#ifndef MBED_CONF_APP_TRANSCRIPT_SIZE
+# define MBED_CONF_APP_TRANSCRIPT_SIZE 0
+#endif
+
 // ----------------------------------------------------------------
 // PRIVATE VARIABLES
 // ----------------------------------------------------------------
@@ -68,6 +76,11 @@ static UbloxCellularDriverGen *pDriver =
                                   MBED_CONF_UBLOX_CELL_BAUD_RATE,
                                   true);
 
+#if MBED_CONF_APP_TRANSCRIPT_SIZE > 0
+// Where the transcript is recorded
+static char transcript[MBED_CONF_APP_TRANSCRIPT_SIZE];
+#endif
+
 // ----------------------------------------------------------------
 // PRIVATE FUNCTIONS
 // ----------------------------------------------------------------
@@ -137,6 +150,14 @@ void test_end() {
     TEST_ASSERT(pDriver->nwk_deregistration());
 }
 
+#if MBED_CONF_APP_TRANSCRIPT_SIZE > 0
+// Stop recording the transcript and print it
+void test_transcript() {
+    TEST_ASSERT(pDriver->transcriptStop());
+    pDriver->printTranscript();
+}
+#endif
+
 // ----------------------------------------------------------------
 // TEST ENVIRONMENT
 // ----------------------------------------------------------------
@@ -145,6 +166,9 @@ void test_end() {
 utest::v1::status_t test_setup(const size_t number_of_cases) {
     // Setup Greentea with a timeout
     GREENTEA_SETUP(180, "default_auto");
+#if MBED_CONF_APP_TRANSCRIPT_SIZE > 0
+    pDriver->transcriptStart(transcript, sizeof (transcript));
+#endif
     return verbose_test_setup_handler(number_of_cases);
 }
 
@@ -153,7 +177,10 @@ Case cases[] = {
     Case("Register", test_start),
     Case("SMS send", test_send),
     Case("SMS receive and delete", test_receive),
-    Case("Deregister", test_end)
+    Case("Deregister", test_end),
+#if MBED_CONF_APP_TRANSCRIPT_SIZE > 0
+    Case("Print transcript", test_transcript),
+#endif
 };
 
 Specification specification(test_setup, cases);
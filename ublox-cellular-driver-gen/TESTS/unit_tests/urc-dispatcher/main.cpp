@@ -0,0 +1,235 @@
+#include "mbed.h"
+#include "greentea-client/test_env.h"
+#include "unity.h"
+#include "utest.h"
+#include "UbloxUrcDispatcher.h"
+#include "mbed_trace.h"
+#define TRACE_GROUP "TEST"
+
+using namespace utest::v1;
+
+// Note: these tests do not need a modem, the URC dispatcher
+// is exercised stand-alone.
+
+// ----------------------------------------------------------------
+// COMPILE-TIME MACROS
+// ----------------------------------------------------------------
+
+// These macros can be overridden with an mbed_app.json file and
+// contents of the following form:
+//
+//{
+//    "config": {
+//        "benchmark-iterations": {
+//            "value": 1000
+//        }
+//}
+
+// The number of times to match the test lines when
+// measuring the cost of matching.
+#ifndef MBED_CONF_APP_BENCHMARK_ITERATIONS
+# define MBED_CONF_APP_BENCHMARK_ITERATIONS 1000
+#endif
+
+// ----------------------------------------------------------------
+// PRIVATE VARIABLES
+// ----------------------------------------------------------------
+
+// Lock for debug prints
+static Mutex mtx;
+
+// The URC prefixes used by the driver and by UbloxATCellularInterface,
+// followed by made-up ones to take the number up to 32
+static const char *prefixes[] = {"ERROR", "+CME ERROR", "+CMS ERROR", "ABORTED",
+                                 "+CMGL", "+CMTI:", "+CCWA", "+CCFC",
+                                 "+CLIR", "+CLIP", "+COLP", "+COLR",
+                                 "+CUSD:", "+UUHTTPCR", "+UUFTPCR", "+UUFTPCD",
+                                 "+UULOC", "+UULOCIND", "+UUSORD", "+UUSORF",
+                                 "+UUSOCL", "+UUPSDD", "+CREG:", "+CGREG:",
+                                 "+CEREG:", "+UUSIMSTAT", "+UUPSDA", "+UUSTKA",
+                                 "+UUCPSI", "+UUTEST1", "+UUTEST2", "+UUTEST3"};
+
+// The lines to match: URCs and the ordinary responses
+// that arrive in between them
+static const char *lines[] = {"+UUHTTPCR: 0,4,1",
+                              "+UULOC: 17/07/2017,10:00:00.000,52.2,0.1,0,5",
+                              "+UULOCIND: 2,0",
+                              "+CMTI: \"SM\",1",
+                              "+URDBLOCK: \"test_file\",192,\"",
+                              "+CCID: 8944501104169548380",
+                              "OK"};
+
+// The dispatcher under test
+static UbloxUrcDispatcher *pDispatcher = NULL;
+
+// A handler that does nothing
+static void nullHandler()
+{
+}
+
+// ----------------------------------------------------------------
+// PRIVATE FUNCTIONS
+// ----------------------------------------------------------------
+
+// Locks for debug prints
+static void lock()
+{
+    mtx.lock();
+}
+
+static void unlock()
+{
+    mtx.unlock();
+}
+
+// A model of the way the AT parser matches out of band prefixes:
+// after each character is received, every prefix is compared with
+// the characters received so far.
+static int linearMatch(const char *buf, int len, int numPrefixes)
+{
+    int handler = -1;
+
+    for (int x = 1; (x <= len) && (handler < 0); x++) {
+        for (int y = 0; (y < numPrefixes) && (handler < 0); y++) {
+            if ((x == (int) strlen(prefixes[y])) &&
+                (memcmp(prefixes[y], buf, x) == 0)) {
+                handler = y;
+            }
+        }
+    }
+
+    return handler;
+}
+
+// Fill the dispatcher with the first numPrefixes prefixes.
+static void fillDispatcher(int numPrefixes)
+{
+    delete pDispatcher;
+    pDispatcher = new UbloxUrcDispatcher();
+    for (int x = 0; x < numPrefixes; x++) {
+        TEST_ASSERT(pDispatcher->add(prefixes[x], callback(nullHandler)));
+    }
+    TEST_ASSERT(pDispatcher->numPrefixes() == numPrefixes);
+}
+
+// Return the index of a prefix.
+static int prefixIndex(const char *prefix)
+{
+    for (unsigned int x = 0; x < sizeof (prefixes) / sizeof (prefixes[0]); x++) {
+        if (strcmp(prefixes[x], prefix) == 0) {
+            return x;
+        }
+    }
+
+    return -1;
+}
+
+// ----------------------------------------------------------------
+// TESTS
+// ----------------------------------------------------------------
+
+// Check that the longest matching prefix is found
+void test_match() {
+    int numPrefixes = sizeof (prefixes) / sizeof (prefixes[0]);
+
+    fillDispatcher(numPrefixes);
+    tr_debug("%d prefixes use %d trie nodes", numPrefixes, pDispatcher->numNodes());
+
+    TEST_ASSERT(pDispatcher->match(lines[0], strlen(lines[0])) == prefixIndex("+UUHTTPCR"));
+    TEST_ASSERT(pDispatcher->match(lines[1], strlen(lines[1])) == prefixIndex("+UULOC"));
+    TEST_ASSERT(pDispatcher->match(lines[2], strlen(lines[2])) == prefixIndex("+UULOCIND"));
+    TEST_ASSERT(pDispatcher->match(lines[3], strlen(lines[3])) == prefixIndex("+CMTI:"));
+    TEST_ASSERT(pDispatcher->match(lines[4], strlen(lines[4])) < 0);
+    TEST_ASSERT(pDispatcher->match(lines[5], strlen(lines[5])) < 0);
+    TEST_ASSERT(pDispatcher->match(lines[6], strlen(lines[6])) < 0);
+
+    // A partial prefix is not a match
+    TEST_ASSERT(pDispatcher->match("+UULO", 5) < 0);
+    TEST_ASSERT(pDispatcher->match("+UULOCIN", 8) == prefixIndex("+UULOC"));
+
+    // Adding a prefix again replaces its handler
+    TEST_ASSERT(pDispatcher->add("+UULOC", callback(nullHandler)));
+    TEST_ASSERT(pDispatcher->numPrefixes() == numPrefixes);
+}
+
+// Print the cost per character of matching with a model of the AT
+// parser's method against the trie as the number of prefixes grows.
+// Note that the AT parser still makes its own scan of the entry
+// points, the prefixes not covered by a shorter one, during recv()
+void test_benchmark() {
+    int numLines = sizeof (lines) / sizeof (lines[0]);
+    int numChars = 0;
+    int linearTime;
+    int trieTime;
+    volatile int result = 0;
+    Timer timer;
+
+    for (int x = 0; x < numLines; x++) {
+        numChars += strlen(lines[x]);
+    }
+
+    for (int numPrefixes = 4; numPrefixes <= (int) (sizeof (prefixes) / sizeof (prefixes[0]));
+         numPrefixes *= 2) {
+        fillDispatcher(numPrefixes);
+
+        timer.reset();
+        timer.start();
+        for (int x = 0; x < MBED_CONF_APP_BENCHMARK_ITERATIONS; x++) {
+            for (int y = 0; y < numLines; y++) {
+                result += linearMatch(lines[y], strlen(lines[y]), numPrefixes);
+            }
+        }
+        linearTime = timer.read_us();
+
+        timer.reset();
+        for (int x = 0; x < MBED_CONF_APP_BENCHMARK_ITERATIONS; x++) {
+            for (int y = 0; y < numLines; y++) {
+                result += pDispatcher->match(lines[y], strlen(lines[y]));
+            }
+        }
+        trieTime = timer.read_us();
+        timer.stop();
+
+        // Timings only, nothing asserted on them: they depend on
+        // how busy the machine running the test is
+        tr_debug("%d prefixes: %d ps per character linear, %d ps per character trie",
+                 numPrefixes,
+                 (int) (((int64_t) linearTime * 1000000) / ((int64_t) numChars * MBED_CONF_APP_BENCHMARK_ITERATIONS)),
+                 (int) (((int64_t) trieTime * 1000000) / ((int64_t) numChars * MBED_CONF_APP_BENCHMARK_ITERATIONS)));
+    }
+}
+
+// ----------------------------------------------------------------
+// TEST ENVIRONMENT
+// ----------------------------------------------------------------
+
+// Setup the test environment
+utest::v1::status_t test_setup(const size_t number_of_cases) {
+    // Setup Greentea with a timeout
+    GREENTEA_SETUP(60, "default_auto");
+    return verbose_test_setup_handler(number_of_cases);
+}
+
+// Test cases
+Case cases[] = {
+    Case("Match", test_match),
+    Case("Benchmark", test_benchmark)
+};
+
+Specification specification(test_setup, cases);
+
+// ----------------------------------------------------------------
+// MAIN
+// ----------------------------------------------------------------
+
+int main() {
+    mbed_trace_init();
+
+    mbed_trace_mutex_wait_function_set(lock);
+    mbed_trace_mutex_release_function_set(unlock);
+
+    // Run tests
+    return !Harness::run(specification);
+}
+
+// End Of File
@@ -0,0 +1,203 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "UbloxAtBatch.h"
+
+/**********************************************************************
+ * PROTECTED METHODS
+ **********************************************************************/
+
+// Append a piece to the command being added.
+UbloxAtBatch &UbloxAtBatch::addPiece(PieceType type, const char *text, int value)
+{
+    Piece *piece;
+
+    // A piece with no command to go in, or no room for it, spoils
+    // the batch; the command stays in so that the batch isn't sent
+    if ((_numCommands == 0) || (_numPieces >= (int) (sizeof (_pieces) / sizeof (_pieces[0])))) {
+        _overflowed = true;
+        return *this;
+    }
+
+    piece = &_pieces[_numPieces];
+    piece->type = type;
+    piece->start = _starting;
+    if (type == PIECE_NUMBER) {
+        piece->value = value;
+    } else {
+        piece->text = text;
+    }
+    _numPieces++;
+    _starting = false;
+
+    return *this;
+}
+
+// Find the first piece of a command.
+int UbloxAtBatch::firstPiece(int index)
+{
+    int count = -1;
+
+    if ((index < 0) || (index >= _numCommands)) {
+        return -1;
+    }
+    for (int x = 0; x < _numPieces; x++) {
+        if (_pieces[x].start) {
+            count++;
+            if (count == index) {
+                return x;
+            }
+        }
+    }
+
+    return -1;
+}
+
+/**********************************************************************
+ * PUBLIC METHODS
+ **********************************************************************/
+
+// Constructor.
+UbloxAtBatch::UbloxAtBatch()
+{
+    clear();
+}
+
+// Start a new command.
+UbloxAtBatch &UbloxAtBatch::add()
+{
+    if (_starting) {
+        // The last command had no pieces
+        _overflowed = true;
+    }
+    _numCommands++;
+    _starting = true;
+
+    return *this;
+}
+
+// Append an integer.
+UbloxAtBatch &UbloxAtBatch::number(int value)
+{
+    return addPiece(PIECE_NUMBER, NULL, value);
+}
+
+// Append a string in quotes.
+UbloxAtBatch &UbloxAtBatch::quoted(const char *text)
+{
+    return addPiece(PIECE_QUOTED, (text != NULL) ? text : "", 0);
+}
+
+// Append a copy of a string in quotes.
+UbloxAtBatch &UbloxAtBatch::quotedCopy(const char *text)
+{
+    int len = (text != NULL) ? strlen(text) : 0;
+    char *copy = _copies + _copiesLen;
+
+    if (_copiesLen + len + 1 > (int) sizeof (_copies)) {
+        _overflowed = true;
+        return *this;
+    }
+    memcpy(copy, text, len);
+    copy[len] = 0;
+    _copiesLen += len + 1;
+
+    return addPiece(PIECE_QUOTED, copy, 0);
+}
+
+// Empty the batch.
+void UbloxAtBatch::clear()
+{
+    _numPieces = 0;
+    _numCommands = 0;
+    _starting = false;
+    _copiesLen = 0;
+    _overflowed = false;
+}
+
+// Return the number of commands in the batch.
+int UbloxAtBatch::numCommands()
+{
+    return _numCommands;
+}
+
+// Return the length of a command on the line.
+int UbloxAtBatch::length(int index)
+{
+    int first = firstPiece(index);
+    int len = 0;
+    unsigned int magnitude;
+
+    for (int x = first; (x >= 0) && (x < _numPieces) && ((x == first) || !_pieces[x].start); x++) {
+        switch (_pieces[x].type) {
+            case PIECE_TEXT:
+                len += strlen(_pieces[x].text);
+                break;
+            case PIECE_NUMBER:
+                magnitude = (_pieces[x].value < 0) ? 0U - (unsigned int) _pieces[x].value :
+                                                     (unsigned int) _pieces[x].value;
+                if (_pieces[x].value < 0) {
+                    len++;
+                }
+                do {
+                    len++;
+                    magnitude /= 10;
+                } while (magnitude > 0);
+                break;
+            case PIECE_QUOTED:
+                len += 2;
+                for (const char *p = _pieces[x].text; *p != 0; p++) {
+                    // Quotes and backslashes go as \22 and \5C
+                    len += ((*p == '"') || (*p == '\\')) ? 3 : 1;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    return len;
+}
+
+// Append a command to an AT command.
+void UbloxAtBatch::appendTo(int index, UbloxAtCommand *command)
+{
+    int first = firstPiece(index);
+
+    for (int x = first; (x >= 0) && (x < _numPieces) && ((x == first) || !_pieces[x].start); x++) {
+        switch (_pieces[x].type) {
+            case PIECE_TEXT:
+                command->text(_pieces[x].text);
+                break;
+            case PIECE_NUMBER:
+                command->number(_pieces[x].value);
+                break;
+            case PIECE_QUOTED:
+                command->quoted(_pieces[x].text);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// Return whether a command could not be added.
+bool UbloxAtBatch::overflowed()
+{
+    return _overflowed || _starting;
+}
+
+// End of file
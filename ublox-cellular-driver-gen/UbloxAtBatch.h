@@ -0,0 +1,215 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _UBLOX_AT_BATCH_
+#define _UBLOX_AT_BATCH_
+
+#include "UbloxAtCommand.h"
+
+/** The number of pieces, i.e. literals, numbers and quoted strings,
+ * that the commands of a batch may be made of.
+ */
+#ifndef MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_BATCH_MAX_PIECES
+# define MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_BATCH_MAX_PIECES 64
+#endif
+
+/** The space for strings that a batch keeps copies of, with
+ * quotedCopy(), including a terminator for each.
+ */
+#ifndef MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_BATCH_COPY_SIZE
+# define MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_BATCH_COPY_SIZE 64
+#endif
+
+/** The longest line, excluding the "AT" prefix, into which
+ * a batch is put when it is sent.
+ */
+#ifndef MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_BATCH_MAX_LINE_LENGTH
+# define MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_BATCH_MAX_LINE_LENGTH 200
+#endif
+
+/** UbloxAtBatch class.
+ *
+ * Accumulates AT commands that set parameters so that they can be
+ * sent to the module as one line, e.g. "AT+UFTP=0;+UFTP=1;+UFTP=2",
+ * rather than paying a command/response turnaround for each of them.
+ * Commands are added without the "AT" prefix and the batch is sent
+ * with UbloxCellularDriverGen::atBatchSend(), which falls back to
+ * sending the commands one at a time if the module rejects the line.
+ *
+ * A command is built from pieces as an UbloxAtCommand is, e.g.
+ * add().literal("+UFTP=").number(1).literal(",").quoted(name), and
+ * the pieces are only written out when the batch is sent, so strings
+ * are kept by reference, not copied, and must remain valid until
+ * then; they may be of any length.  quotedCopy() is there for short
+ * strings that won't last, e.g. an address in a local buffer.
+ *
+ * Only commands that the module answers with a plain final result
+ * code belong in a batch: nothing that prompts for data, returns an
+ * information response or takes a long time to complete.  Since a
+ * batch may be sent more than once, each command must have the same
+ * effect no matter how many times it is sent.
+ */
+class UbloxAtBatch {
+
+public:
+    /** Constructor.
+     */
+    UbloxAtBatch();
+
+    /** Start a new command in the batch; its pieces follow.
+     *
+     * @return this batch.
+     */
+    UbloxAtBatch &add();
+
+    /** Append a string literal to the command.
+     *
+     * @param text the literal.
+     * @return     this batch.
+     */
+    template <size_t N>
+    UbloxAtBatch &literal(const char (&text)[N])
+    {
+        return addPiece(PIECE_TEXT, text, 0);
+    }
+
+    /** Append an integer in decimal to the command.
+     *
+     * @param value the integer.
+     * @return      this batch.
+     */
+    UbloxAtBatch &number(int value);
+
+    /** Append a string in quotes to the command, escaped as
+     * UbloxAtCommand::quoted() does.
+     *
+     * @param text the null-terminated string, which must remain
+     *             valid until the batch is sent; NULL for an
+     *             empty one.
+     * @return     this batch.
+     */
+    UbloxAtBatch &quoted(const char *text);
+
+    /** Append a copy of a string in quotes to the command, as
+     * quoted() does, for a string that won't remain valid.
+     *
+     * @param text the null-terminated string.
+     * @return     this batch.
+     */
+    UbloxAtBatch &quotedCopy(const char *text);
+
+    /** Empty the batch.
+     */
+    void clear();
+
+    /** Return the number of commands in the batch.
+     *
+     * @return the number of commands.
+     */
+    int numCommands();
+
+    /** Return the number of characters that a command in the batch
+     * takes on the line, once its strings have been escaped.
+     *
+     * @param index the index of the command, from 0.
+     * @return      the number of characters, 0 if there is no
+     *              such command.
+     */
+    int length(int index);
+
+    /** Append a command in the batch to an AT command.
+     *
+     * @param index   the index of the command, from 0.
+     * @param command the AT command to append it to.
+     */
+    void appendTo(int index, UbloxAtCommand *command);
+
+    /** Return whether an error occurred while adding commands,
+     * in which case the batch should not be sent.
+     *
+     * @return true if a command could not be added.
+     */
+    bool overflowed();
+
+protected:
+
+    /** The kinds of piece.
+     */
+    typedef enum {
+        PIECE_TEXT,   //!< A string as it is.
+        PIECE_NUMBER, //!< An integer in decimal.
+        PIECE_QUOTED  //!< A string in quotes.
+    } PieceType;
+
+    /** A piece of a command.
+     */
+    typedef struct {
+        uint8_t type;
+        bool start;     //!< True for the first piece of a command.
+        union {
+            const char *text;
+            int value;
+        };
+    } Piece;
+
+    /** The pieces of the commands, in order.
+     */
+    Piece _pieces[MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_BATCH_MAX_PIECES];
+
+    /** The number of pieces in use.
+     */
+    int _numPieces;
+
+    /** The number of commands in the batch.
+     */
+    int _numCommands;
+
+    /** True once add() has started a command that
+     * has yet to be given a piece.
+     */
+    bool _starting;
+
+    /** Copies of strings, each null terminated.
+     */
+    char _copies[MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_BATCH_COPY_SIZE];
+
+    /** The number of characters used in _copies.
+     */
+    int _copiesLen;
+
+    /** True if a command could not be added.
+     */
+    bool _overflowed;
+
+    /** Append a piece to the command being added.
+     *
+     * @param type  the kind of piece.
+     * @param text  the string, for PIECE_TEXT and PIECE_QUOTED.
+     * @param value the integer, for PIECE_NUMBER.
+     * @return      this batch.
+     */
+    UbloxAtBatch &addPiece(PieceType type, const char *text, int value);
+
+    /** Find the first piece of a command.
+     *
+     * @param index the index of the command, from 0.
+     * @return      the index of its first piece, negative
+     *              if there is no such command.
+     */
+    int firstPiece(int index);
+};
+
+#endif // _UBLOX_AT_BATCH_
@@ -0,0 +1,170 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "UbloxAtCommand.h"
+
+/**********************************************************************
+ * PROTECTED METHODS
+ **********************************************************************/
+
+// Write the chunk to the file handle and empty it.
+bool UbloxAtCommand::flushChunk()
+{
+    pollfh fhs;
+    ssize_t written;
+    int x = 0;
+
+    if (_ok && (_count > 0)) {
+        debug_if(_debugOn, "%s%.*s", (_length == _count) ? "AT> " : "", _count, _chunk);
+    }
+    while (_ok && (x < _count)) {
+        fhs.fh = _fh;
+        fhs.events = POLLOUT;
+        if ((mbed::poll(&fhs, 1, _timeoutMs) > 0) && (fhs.revents & POLLOUT)) {
+            written = _fh->write(_chunk + x, _count - x);
+            if (written > 0) {
+                x += written;
+            } else if (written != -EAGAIN) {
+                _ok = false;
+            }
+        } else {
+            _ok = false;
+        }
+    }
+    _count = 0;
+
+    return _ok;
+}
+
+/**********************************************************************
+ * PUBLIC METHODS
+ **********************************************************************/
+
+// Constructor.
+UbloxAtCommand::UbloxAtCommand(FileHandle *fh, int timeoutMs, bool debugOn)
+{
+    _fh = fh;
+    _timeoutMs = timeoutMs;
+    _debugOn = debugOn;
+    _ok = true;
+    _count = 0;
+    _length = 0;
+}
+
+// Append a string as it is.
+UbloxAtCommand &UbloxAtCommand::text(const char *text)
+{
+    if (text == NULL) {
+        return *this;
+    }
+    while (*text != 0) {
+        if (_count >= (int) sizeof (_chunk)) {
+            flushChunk();
+        }
+        _chunk[_count++] = *text++;
+        _length++;
+    }
+
+    return *this;
+}
+
+// Append a string in quotes.
+UbloxAtCommand &UbloxAtCommand::quoted(const char *text)
+{
+    append("\"", 1);
+    for (; (text != NULL) && (*text != 0); text++) {
+        // Room for an escape
+        if (_count + 3 > (int) sizeof (_chunk)) {
+            flushChunk();
+        }
+        if (*text == '"') {
+            append("\\22", 3);
+        } else if (*text == '\\') {
+            append("\\5C", 3);
+        } else {
+            _chunk[_count++] = *text;
+            _length++;
+        }
+    }
+
+    return append("\"", 1);
+}
+
+// Append an integer in decimal.
+UbloxAtCommand &UbloxAtCommand::number(int value)
+{
+    char digits[11];
+    unsigned int magnitude = (value < 0) ? 0U - (unsigned int) value : (unsigned int) value;
+    int x = sizeof (digits);
+
+    // Digits from the right
+    do {
+        digits[--x] = '0' + (magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    if (value < 0) {
+        digits[--x] = '-';
+    }
+
+    return append(digits + x, sizeof (digits) - x);
+}
+
+// Append characters as they are.
+UbloxAtCommand &UbloxAtCommand::append(const char *data, int size)
+{
+    int count;
+
+    while (size > 0) {
+        if (_count >= (int) sizeof (_chunk)) {
+            flushChunk();
+        }
+        count = sizeof (_chunk) - _count;
+        if (count > size) {
+            count = size;
+        }
+        memcpy(_chunk + _count, data, count);
+        _count += count;
+        _length += count;
+        data += count;
+        size -= count;
+    }
+
+    return *this;
+}
+
+// Finish the command and write it.
+bool UbloxAtCommand::send()
+{
+    append("\r", 1);
+    write();
+    debug_if(_debugOn, "\n");
+
+    return _ok;
+}
+
+// Write what is left of the command.
+bool UbloxAtCommand::write()
+{
+    return flushChunk();
+}
+
+// Return the length of the command so far.
+int UbloxAtCommand::length()
+{
+    return _length;
+}
+
+// End of file
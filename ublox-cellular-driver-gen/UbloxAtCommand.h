@@ -0,0 +1,156 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _UBLOX_AT_COMMAND_
+#define _UBLOX_AT_COMMAND_
+
+#include "mbed.h"
+
+/** The number of characters of a command that are gathered
+ * before they are written to the file handle; this limits
+ * only the size of each write, not the length of a command.
+ */
+#ifndef MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_COMMAND_CHUNK_SIZE
+# define MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_COMMAND_CHUNK_SIZE 64
+#endif
+
+/** UbloxAtCommand class.
+ *
+ * Builds an AT command from typed pieces, each copied straight into
+ * a small chunk that is written to the file handle under an AT parser
+ * whenever it fills, so that there is no printf() format to parse,
+ * no intermediate buffer holding the whole command and no limit on
+ * its length, e.g.:
+ *
+ *     UbloxAtCommand(fh, timeout).literal("AT+UDELFILE=").quoted(filename).send()
+ *
+ * The length of a literal is worked out by the compiler.  Once built
+ * a command must be finished with send() or write(), otherwise the
+ * module may be left with part of it.  A command is built and sent by
+ * one thread, under whatever lock guards the AT parser.
+ */
+class UbloxAtCommand {
+
+public:
+    /** Constructor.
+     *
+     * @param fh        the file handle to write to.
+     * @param timeoutMs how long to wait for room to write, as
+     *                  the AT parser would.
+     * @param debugOn   true to print the command as it is written.
+     */
+    UbloxAtCommand(FileHandle *fh, int timeoutMs, bool debugOn = false);
+
+    /** Append a string literal.
+     *
+     * @param text the literal.
+     * @return     this command.
+     */
+    template <size_t N>
+    UbloxAtCommand &literal(const char (&text)[N])
+    {
+        return append(text, N - 1);
+    }
+
+    /** Append a string as it is.
+     *
+     * @param text the null-terminated string, NULL for none.
+     * @return     this command.
+     */
+    UbloxAtCommand &text(const char *text);
+
+    /** Append a string in quotes, with any quote or backslash in
+     * it written as \22 or \5C (3GPP TS 27.007, clause 4.1).
+     *
+     * @param text the null-terminated string, NULL for an empty one.
+     * @return     this command.
+     */
+    UbloxAtCommand &quoted(const char *text);
+
+    /** Append an integer in decimal.
+     *
+     * @param value the integer.
+     * @return      this command.
+     */
+    UbloxAtCommand &number(int value);
+
+    /** Append characters as they are, e.g. data that follows
+     * a prompt.
+     *
+     * @param data the characters.
+     * @param size the number of characters.
+     * @return     this command.
+     */
+    UbloxAtCommand &append(const char *data, int size);
+
+    /** Finish the command with a carriage return and write what
+     * is left of it.
+     *
+     * @return true if all of the command was written.
+     */
+    bool send();
+
+    /** Write what is left of the command as it is, without
+     * a carriage return.
+     *
+     * @return true if all of the command was written.
+     */
+    bool write();
+
+    /** Return the number of characters in the command so far.
+     *
+     * @return the number of characters.
+     */
+    int length();
+
+protected:
+
+    /** The file handle to write to.
+     */
+    FileHandle *_fh;
+
+    /** How long to wait for room to write.
+     */
+    int _timeoutMs;
+
+    /** True to print the command.
+     */
+    bool _debugOn;
+
+    /** False once a write has failed.
+     */
+    bool _ok;
+
+    /** The number of characters in the chunk.
+     */
+    int _count;
+
+    /** The number of characters in the command so far.
+     */
+    int _length;
+
+    /** The part of the command not yet written.
+     */
+    char _chunk[MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_COMMAND_CHUNK_SIZE];
+
+    /** Write the chunk to the file handle and empty it.
+     *
+     * @return true if all of the chunk was written.
+     */
+    bool flushChunk();
+};
+
+#endif // _UBLOX_AT_COMMAND_
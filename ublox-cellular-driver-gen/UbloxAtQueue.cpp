@@ -0,0 +1,500 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "UbloxAtQueue.h"
+
+// An absolute deadline that never arrives
+#define NEVER 0x7FFFFFFFFFFFFFFFLL
+
+/**********************************************************************
+ * PUBLIC METHODS: Transaction
+ **********************************************************************/
+
+// Constructor.
+UbloxAtQueue::Transaction::Transaction()
+{
+    memset(&op, 0, sizeof (op));
+    _queue = NULL;
+    _token = NULL;
+    _priority = AT_PRIORITY_NORMAL;
+    _deadline = NEVER;
+    _since = 0;
+    _seq = 0;
+    _next = NULL;
+    _queued = false;
+    _done = false;
+    _result = AT_QUEUE_PENDING;
+}
+
+// Return whether the transaction has completed.
+bool UbloxAtQueue::Transaction::isDone()
+{
+    bool done;
+
+    if (_queue != NULL) {
+        _queue->_mtx.lock();
+    }
+    done = _done;
+    if (_queue != NULL) {
+        _queue->_mtx.unlock();
+    }
+
+    return done;
+}
+
+// Wait for the transaction to complete.
+int UbloxAtQueue::Transaction::wait(int timeoutMs)
+{
+    if (!isDone() && _queued) {
+        _events.wait_any(AT_QUEUE_EVENT_DONE,
+                         (timeoutMs < 0) ? osWaitForever : timeoutMs);
+    }
+
+    // isDone() locks the queue, which the queue's thread holds
+    // while it marks the transaction done, so once this returns
+    // true the queue has finished with the transaction
+    return isDone() ? (int) _result : AT_QUEUE_PENDING;
+}
+
+// Give the transaction a cancel token.
+void UbloxAtQueue::Transaction::setCancelToken(UbloxCancelToken *token)
+{
+    _token = token;
+}
+
+/**********************************************************************
+ * PROTECTED METHODS
+ **********************************************************************/
+
+// Return the time now in milliseconds.
+int64_t UbloxAtQueue::now()
+{
+    return (int64_t) (_clock.read_high_resolution_us() / 1000);
+}
+
+// Convert a relative deadline to an absolute one.
+int64_t UbloxAtQueue::deadline(int deadlineMs)
+{
+    return (deadlineMs < 0) ? NEVER : now() + deadlineMs;
+}
+
+// Convert an absolute deadline to a relative one.
+int UbloxAtQueue::timeLeft(int64_t deadline)
+{
+    int64_t left;
+
+    if (deadline == NEVER) {
+        return AT_QUEUE_NO_DEADLINE;
+    }
+    left = deadline - now();
+    if (left < 0) {
+        left = 0;
+    }
+
+    return (int) left;
+}
+
+// Return the class in which a piece of work is ordered.
+int UbloxAtQueue::rank(AtPriority priority, int64_t since, int64_t now)
+{
+    if ((_maxWaitMs > 0) && (now - since >= _maxWaitMs)) {
+        return -1;
+    }
+
+    return (int) priority;
+}
+
+// Return whether one piece of work should go before another.
+bool UbloxAtQueue::before(int r1, int64_t d1, uint32_t s1,
+                          int r2, int64_t d2, uint32_t s2)
+{
+    if (r1 != r2) {
+        return r1 < r2;
+    }
+    if ((r1 >= 0) && (d1 != d2)) {
+        return d1 < d2;
+    }
+
+    return (int32_t) (s1 - s2) < 0;
+}
+
+// Grant the turn to the best waiter.  NOTE: _mtx must be locked.
+void UbloxAtQueue::grant()
+{
+    Waiter *best = NULL;
+    Waiter **bestLink = NULL;
+    int64_t timeNow = now();
+    int bestRank = 0;
+    int r;
+
+    for (Waiter **link = &_waiters; *link != NULL; link = &((*link)->next)) {
+        r = rank((*link)->priority, (*link)->since, timeNow);
+        if ((best == NULL) ||
+            before(r, (*link)->deadline, (*link)->seq,
+                   bestRank, best->deadline, best->seq)) {
+            best = *link;
+            bestLink = link;
+            bestRank = r;
+        }
+    }
+
+    if (best != NULL) {
+        *bestLink = best->next;
+        _owner = best->thread;
+        _depth = best->depth;
+        _ownerPriority = best->priority;
+        _ownerSince = timeNow;
+        best->granted = true;
+        best->semaphore->release();
+    }
+}
+
+// Run one step of a transaction, taking a turn for it.
+int UbloxAtQueue::step(Transaction *transaction)
+{
+    int result = AT_QUEUE_DEADLINE;
+    int left = timeLeft(transaction->_deadline);
+
+    if (transaction->_token != NULL) {
+        if (transaction->_token->isCancelled()) {
+            return AT_QUEUE_CANCELLED;
+        }
+        left = transaction->_token->timeLeft(left);
+    }
+
+    if ((left != 0) && acquire(transaction->_priority, left)) {
+        // The token is checked again as the wait may have been long
+        if (CANCEL_TOKEN_EXPIRED(transaction->_token)) {
+            result = transaction->_token->isCancelled() ? AT_QUEUE_CANCELLED : AT_QUEUE_DEADLINE;
+        } else {
+            result = transaction->_step(transaction);
+        }
+        release();
+    }
+
+    return result;
+}
+
+// Complete a transaction.
+void UbloxAtQueue::complete(Transaction *transaction, int result)
+{
+    transaction->_result = result;
+    if (transaction->_callback) {
+        transaction->_callback(result);
+    }
+
+    // Once this is done the transaction must not be touched
+    _mtx.lock();
+    transaction->_queued = false;
+    transaction->_done = true;
+    transaction->_events.set(AT_QUEUE_EVENT_DONE);
+    _mtx.unlock();
+}
+
+// The body of the queue's thread.
+void UbloxAtQueue::threadMain()
+{
+    Transaction *transaction;
+    Transaction **bestLink;
+    int64_t timeNow;
+    int bestRank = 0;
+    int r;
+    int result;
+
+    while (_running) {
+        _events.wait_any(AT_QUEUE_EVENT_WORK);
+        do {
+            // Take the best transaction off the queue
+            transaction = NULL;
+            bestLink = NULL;
+            _mtx.lock();
+            timeNow = now();
+            for (Transaction **link = &_transactions; *link != NULL; link = &((*link)->_next)) {
+                r = rank((*link)->_priority, (*link)->_since, timeNow);
+                if ((transaction == NULL) ||
+                    before(r, (*link)->_deadline, (*link)->_seq,
+                           bestRank, transaction->_deadline, transaction->_seq)) {
+                    transaction = *link;
+                    bestLink = link;
+                    bestRank = r;
+                }
+            }
+            if (transaction != NULL) {
+                *bestLink = transaction->_next;
+            }
+            _mtx.unlock();
+
+            if (transaction != NULL) {
+                result = step(transaction);
+                if ((result == AT_QUEUE_MORE) && _running) {
+                    // Back in the queue, behind anything else of the
+                    // same priority class and deadline
+                    _mtx.lock();
+                    transaction->_seq = _seq++;
+                    transaction->_since = now();
+                    transaction->_next = _transactions;
+                    _transactions = transaction;
+                    _mtx.unlock();
+                } else {
+                    complete(transaction, (result == AT_QUEUE_MORE) ? AT_QUEUE_DEADLINE : result);
+                }
+            }
+        } while ((transaction != NULL) && _running);
+    }
+}
+
+/**********************************************************************
+ * PUBLIC METHODS
+ **********************************************************************/
+
+// Constructor.
+UbloxAtQueue::UbloxAtQueue()
+{
+    _owner = NULL;
+    _depth = 0;
+    _ownerPriority = AT_PRIORITY_NORMAL;
+    _ownerSince = 0;
+    _maxWaitMs = MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_QUEUE_MAX_WAIT_MS;
+    _maxHoldMs = MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_QUEUE_MAX_HOLD_MS;
+    _waiters = NULL;
+    _transactions = NULL;
+    _seq = 0;
+    _thread = NULL;
+    _running = false;
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_STATS
+    _stats = NULL;
+#endif
+    _clock.start();
+}
+
+// Destructor.
+UbloxAtQueue::~UbloxAtQueue()
+{
+    Transaction *transaction;
+
+    if (_thread != NULL) {
+        _running = false;
+        _events.set(AT_QUEUE_EVENT_WORK);
+        _thread->join();
+        delete _thread;
+    }
+
+    while ((transaction = _transactions) != NULL) {
+        _transactions = transaction->_next;
+        complete(transaction, AT_QUEUE_DEADLINE);
+    }
+}
+
+// Acquire a turn on the AT interface.
+bool UbloxAtQueue::acquire(AtPriority priority, int deadlineMs)
+{
+    osThreadId thread = Thread::gettid();
+    bool success = true;
+    Waiter waiter;
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_STATS
+    uint32_t startUs = (_stats != NULL) ? _stats->now() : 0;
+    bool nested = false;
+#endif
+
+    _mtx.lock();
+    if (_owner == thread) {
+        _depth++;
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_STATS
+        nested = true;
+#endif
+    } else if (_owner == NULL) {
+        _owner = thread;
+        _depth = 1;
+        _ownerPriority = priority;
+        _ownerSince = now();
+    } else {
+        Semaphore semaphore(0);
+
+        waiter.thread = thread;
+        waiter.priority = priority;
+        waiter.deadline = deadline(deadlineMs);
+        waiter.since = now();
+        waiter.seq = _seq++;
+        waiter.depth = 1;
+        waiter.granted = false;
+        waiter.semaphore = &semaphore;
+        waiter.next = _waiters;
+        _waiters = &waiter;
+        _mtx.unlock();
+
+        semaphore.wait((deadlineMs < 0) ? osWaitForever : deadlineMs);
+
+        _mtx.lock();
+        if (!waiter.granted) {
+            // Timed out: remove ourselves from the waiters
+            for (Waiter **link = &_waiters; *link != NULL; link = &((*link)->next)) {
+                if (*link == &waiter) {
+                    *link = waiter.next;
+                    break;
+                }
+            }
+            success = false;
+        }
+    }
+    _mtx.unlock();
+
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_STATS
+    if (!nested && (_stats != NULL)) {
+        _stats->recordWait(startUs);
+    }
+#endif
+
+    return success;
+}
+
+// Release a turn on the AT interface.
+void UbloxAtQueue::release()
+{
+    _mtx.lock();
+    if ((_owner == Thread::gettid()) && (_depth > 0)) {
+        _depth--;
+        if (_depth == 0) {
+            _owner = NULL;
+            grant();
+        }
+    }
+    _mtx.unlock();
+}
+
+// Return whether the calling thread has held its turn for too long.
+bool UbloxAtQueue::holdExpired(int depth)
+{
+    bool expired = false;
+
+    _mtx.lock();
+    if ((_owner == Thread::gettid()) && (_depth > depth) &&
+        (_waiters != NULL) && (_maxHoldMs > 0)) {
+        expired = (now() - _ownerSince >= _maxHoldMs);
+    }
+    _mtx.unlock();
+
+    return expired;
+}
+
+// Set the maximum wait and hold times.
+void UbloxAtQueue::setLimits(int maxWaitMs, int maxHoldMs)
+{
+    _mtx.lock();
+    _maxWaitMs = maxWaitMs;
+    _maxHoldMs = maxHoldMs;
+    _mtx.unlock();
+}
+
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_STATS
+// Set where to record waits for a turn.
+void UbloxAtQueue::setStats(UbloxAtStats *stats)
+{
+    _mtx.lock();
+    _stats = stats;
+    _mtx.unlock();
+}
+#endif
+
+// Give up the calling thread's turn.
+int UbloxAtQueue::suspend(AtPriority *priority)
+{
+    int depth = 0;
+
+    _mtx.lock();
+    if (_owner == Thread::gettid()) {
+        depth = _depth;
+        *priority = _ownerPriority;
+        _depth = 0;
+        _owner = NULL;
+        grant();
+    }
+    _mtx.unlock();
+
+    return depth;
+}
+
+// Take back a turn given up with suspend().
+void UbloxAtQueue::resume(int depth, AtPriority priority)
+{
+    if (depth > 0) {
+        acquire(priority);
+        _mtx.lock();
+        _depth = depth;
+        _mtx.unlock();
+    }
+}
+
+// Run a transaction in the calling thread.
+int UbloxAtQueue::run(Transaction *transaction, Callback<int(Transaction *)> step,
+                      AtPriority priority, int deadlineMs)
+{
+    int result;
+
+    transaction->_step = step;
+    transaction->_callback = NULL;
+    transaction->_priority = priority;
+    transaction->_deadline = deadline(deadlineMs);
+    transaction->_done = false;
+
+    do {
+        result = this->step(transaction);
+    } while (result == AT_QUEUE_MORE);
+
+    transaction->_result = result;
+    transaction->_done = true;
+
+    return result;
+}
+
+// Queue a transaction to be run by the queue's thread.
+bool UbloxAtQueue::submit(Transaction *transaction, Callback<int(Transaction *)> step,
+                          AtPriority priority, int deadlineMs,
+                          Callback<void(int)> done)
+{
+    bool success = false;
+
+    _mtx.lock();
+    if (!transaction->_queued) {
+        if (_thread == NULL) {
+            _thread = new Thread(osPriorityNormal,
+                                 MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_QUEUE_THREAD_STACK_SIZE);
+            _running = true;
+            _thread->start(callback(this, &UbloxAtQueue::threadMain));
+        }
+        transaction->_queue = this;
+        transaction->_step = step;
+        transaction->_callback = done;
+        transaction->_priority = priority;
+        transaction->_deadline = deadline(deadlineMs);
+        transaction->_since = now();
+        transaction->_seq = _seq++;
+        transaction->_queued = true;
+        transaction->_done = false;
+        transaction->_result = AT_QUEUE_PENDING;
+        transaction->_events.clear(AT_QUEUE_EVENT_DONE);
+        transaction->_next = _transactions;
+        _transactions = transaction;
+        success = true;
+    }
+    _mtx.unlock();
+
+    if (success) {
+        _events.set(AT_QUEUE_EVENT_WORK);
+    }
+
+    return success;
+}
+
+// End of file
@@ -0,0 +1,434 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _UBLOX_AT_QUEUE_
+#define _UBLOX_AT_QUEUE_
+
+#include "mbed.h"
+#include "UbloxAtStats.h"
+#include "UbloxCancelToken.h"
+
+/** The stack size of the thread that runs queued transactions.
+ */
+#ifndef MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_QUEUE_THREAD_STACK_SIZE
+# define MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_QUEUE_THREAD_STACK_SIZE 2048
+#endif
+
+/** How long, in milliseconds, a thread or transaction may wait for
+ * a turn before it goes ahead of all priority classes, 0 for no limit.
+ */
+#ifndef MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_QUEUE_MAX_WAIT_MS
+# define MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_QUEUE_MAX_WAIT_MS 2000
+#endif
+
+/** How long, in milliseconds, a thread may keep a turn across the
+ * steps of a transaction run inside it, e.g. the blocks of a file read
+ * done by an HTTP command, before it must let waiting threads go first;
+ * 0 for no limit.
+ */
+#ifndef MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_QUEUE_MAX_HOLD_MS
+# define MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_QUEUE_MAX_HOLD_MS 500
+#endif
+
+/** UbloxAtQueue class.
+ *
+ * Schedules use of the AT interface by priority class and deadline.
+ *
+ * Work on the AT interface is done in turns: a thread must acquire()
+ * a turn before it takes the AT channel lock and release() it afterwards.
+ * When a turn is released it is handed to the waiting thread with
+ * the highest priority class and, within a class, the earliest
+ * deadline, then the one that has waited longest, so a thread that
+ * releases a turn and asks again goes behind those already waiting.
+ * Anything that has waited longer than the maximum wait goes first,
+ * in order of arrival, so no wait is unbounded.  Turns may be nested
+ * by the thread that holds one; a thread that has held a nested turn
+ * for longer than the maximum hold should check holdExpired() between
+ * steps and, if it is, suspend() and resume() its turn.
+ *
+ * A transaction is a unit of work made up of steps, each of which is
+ * a short AT exchange, e.g. one block of a file read.  A transaction
+ * may be run() in the calling thread or submit()ted to be run by the
+ * queue's own thread, in which case the caller gets the result through
+ * a callback or by waiting on the transaction, which acts as a future.
+ * Either way a turn is taken for each step, so short high priority
+ * transactions interleave between the steps of long ones.  A
+ * transaction may also be given a UbloxCancelToken, which is checked
+ * before each step.
+ */
+class UbloxAtQueue {
+
+public:
+    /** The priority classes, highest first.
+     */
+    typedef enum {
+        AT_PRIORITY_HIGH = 0, //!< Latency sensitive, e.g. control traffic.
+        AT_PRIORITY_NORMAL,   //!< The default.
+        AT_PRIORITY_LOW,      //!< Bulk transfers, e.g. telemetry uploads.
+        MAX_NUM_AT_PRIORITIES
+    } AtPriority;
+
+    /** Deadline value meaning "no deadline".
+     */
+    #define AT_QUEUE_NO_DEADLINE -1
+
+    /** Returned by a step to ask to be called again.
+     */
+    #define AT_QUEUE_MORE -1000
+
+    /** Result of a transaction that missed its deadline.
+     */
+    #define AT_QUEUE_DEADLINE -1001
+
+    /** Returned by Transaction::wait() if the transaction
+     * has not completed.
+     */
+    #define AT_QUEUE_PENDING -1002
+
+    /** Result of a transaction whose cancel token was cancelled.
+     */
+    #define AT_QUEUE_CANCELLED -1003
+
+    /** A transaction: owned by the caller, it must remain valid
+     * until it has completed.
+     */
+    class Transaction {
+        friend class UbloxAtQueue;
+
+    public:
+        /** Constructor.
+         */
+        Transaction();
+
+        /** Return whether the transaction has completed.
+         *
+         * @return true if the transaction has completed.
+         */
+        bool isDone();
+
+        /** Wait for the transaction to complete.
+         *
+         * @param timeoutMs how long to wait, AT_QUEUE_NO_DEADLINE
+         *                  to wait until it completes.
+         * @return          the result of the transaction, AT_QUEUE_PENDING
+         *                  if it did not complete in time.
+         */
+        int wait(int timeoutMs = AT_QUEUE_NO_DEADLINE);
+
+        /** Give the transaction a cancel token, checked before each
+         * step; the transaction ends with AT_QUEUE_CANCELLED if the
+         * token is cancelled or AT_QUEUE_DEADLINE if its deadline
+         * passes.  Call before the transaction is run or submitted.
+         *
+         * @param token the token, which must remain valid until the
+         *              transaction has completed, NULL for none.
+         */
+        void setCancelToken(UbloxCancelToken *token);
+
+        /** Working state of a multi-step operation, for use
+         * by its step function.
+         */
+        struct {
+            const char *str;
+            const char *data;
+            char *buf;
+            int len;
+            int start;
+            int offset;
+            int size;
+            int retries;
+        } op;
+
+        /** Where a multi-step operation that streams hands on each
+         * piece of data it reads, rather than filling op.buf: called
+         * with the data and its length, it returns false to stop the
+         * operation.  NULL for none.
+         */
+        Callback<bool(const char *, int)> sink;
+
+    protected:
+        #define AT_QUEUE_EVENT_DONE 0x01
+
+        UbloxAtQueue *_queue;
+        Callback<int(Transaction *)> _step;
+        Callback<void(int)> _callback;
+        UbloxCancelToken *_token;
+        AtPriority _priority;
+        int64_t _deadline;
+        int64_t _since;
+        uint32_t _seq;
+        Transaction *_next;
+        volatile bool _queued;
+        volatile bool _done;
+        volatile int _result;
+        EventFlags _events;
+    };
+
+    /** Constructor.
+     */
+    UbloxAtQueue();
+
+    /** Destructor: stops the queue's thread, failing any
+     * transactions that have not completed.
+     */
+    ~UbloxAtQueue();
+
+    /** Acquire a turn on the AT interface, waiting if another
+     * thread has one.
+     *
+     * @param priority   the priority class of the work.
+     * @param deadlineMs how long to wait, AT_QUEUE_NO_DEADLINE
+     *                   to wait for as long as it takes.
+     * @return           true if the turn was acquired, false if
+     *                   the deadline passed first.
+     */
+    bool acquire(AtPriority priority = AT_PRIORITY_NORMAL,
+                 int deadlineMs = AT_QUEUE_NO_DEADLINE);
+
+    /** Release a turn on the AT interface.
+     */
+    void release();
+
+    /** Return whether the calling thread has held its turn for
+     * longer than the maximum hold while another thread waits.
+     *
+     * @param depth the nesting depth that the calling thread is
+     *              allowed to hold, e.g. 1 for the turn taken by
+     *              the current step of a transaction.
+     * @return      true if the turn is nested deeper than depth,
+     *              has been held for longer than the maximum hold
+     *              and another thread is waiting for it.
+     */
+    bool holdExpired(int depth);
+
+    /** Set the maximum wait and hold times.
+     *
+     * @param maxWaitMs how long a thread or transaction may wait for
+     *                  a turn before going ahead of all priority
+     *                  classes, 0 for no limit.
+     * @param maxHoldMs how long a thread may hold a nested turn
+     *                  before holdExpired() returns true, 0 for
+     *                  no limit.
+     */
+    void setLimits(int maxWaitMs, int maxHoldMs);
+
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_STATS
+    /** Set where to record how long each wait for a turn took.
+     *
+     * @param stats the statistics, NULL for none.
+     */
+    void setStats(UbloxAtStats *stats);
+#endif
+
+    /** Give up the calling thread's turn, however deeply nested,
+     * e.g. while waiting for a URC; does nothing if the calling
+     * thread does not have a turn.
+     *
+     * @param priority pointer to a place to put the priority
+     *                 class of the turn.
+     * @return         the nesting depth to pass to resume().
+     */
+    int suspend(AtPriority *priority);
+
+    /** Take back a turn given up with suspend().
+     *
+     * @param depth    the value returned by suspend().
+     * @param priority the priority class returned by suspend().
+     */
+    void resume(int depth, AtPriority priority);
+
+    /** Run a transaction in the calling thread, taking a turn
+     * for each step.
+     *
+     * @param transaction the transaction.
+     * @param step        the step function, returning AT_QUEUE_MORE
+     *                    to be called again, otherwise the result.
+     * @param priority    the priority class.
+     * @param deadlineMs  the time by which the transaction must
+     *                    complete, AT_QUEUE_NO_DEADLINE for none.
+     * @return            the result of the transaction.
+     */
+    int run(Transaction *transaction, Callback<int(Transaction *)> step,
+            AtPriority priority = AT_PRIORITY_NORMAL,
+            int deadlineMs = AT_QUEUE_NO_DEADLINE);
+
+    /** Queue a transaction to be run by the queue's thread.
+     *
+     * @param transaction the transaction, which must not already
+     *                    be queued.
+     * @param step        the step function, as for run().
+     * @param priority    the priority class.
+     * @param deadlineMs  the time by which the transaction must
+     *                    complete, AT_QUEUE_NO_DEADLINE for none.
+     * @param done        called with the result when the transaction
+     *                    completes, from the queue's thread; it must
+     *                    not wait for another queued transaction.
+     * @return            true if the transaction was queued.
+     */
+    bool submit(Transaction *transaction, Callback<int(Transaction *)> step,
+                AtPriority priority = AT_PRIORITY_NORMAL,
+                int deadlineMs = AT_QUEUE_NO_DEADLINE,
+                Callback<void(int)> done = NULL);
+
+protected:
+
+    /** Event flag: there is work for the queue's thread.
+     */
+    #define AT_QUEUE_EVENT_WORK 0x01
+
+    /** A thread waiting for a turn.
+     */
+    typedef struct Waiter {
+        osThreadId thread;
+        AtPriority priority;
+        int64_t deadline;
+        int64_t since;
+        uint32_t seq;
+        int depth;
+        bool granted;
+        Semaphore *semaphore;
+        struct Waiter *next;
+    } Waiter;
+
+    /** Protects everything below.
+     */
+    Mutex _mtx;
+
+    /** Provides the time for deadlines.
+     */
+    Timer _clock;
+
+    /** The thread with the turn, NULL if there is none.
+     */
+    osThreadId _owner;
+
+    /** The nesting depth of the turn.
+     */
+    int _depth;
+
+    /** The priority class of the turn.
+     */
+    AtPriority _ownerPriority;
+
+    /** When the turn was taken.
+     */
+    int64_t _ownerSince;
+
+    /** The maximum wait, 0 for no limit.
+     */
+    int _maxWaitMs;
+
+    /** The maximum hold, 0 for no limit.
+     */
+    int _maxHoldMs;
+
+    /** The threads waiting for a turn.
+     */
+    Waiter *_waiters;
+
+    /** The queued transactions.
+     */
+    Transaction *_transactions;
+
+    /** Sequence number, giving the order of arrival.
+     */
+    uint32_t _seq;
+
+    /** The thread that runs queued transactions,
+     * started when the first one is submitted.
+     */
+    Thread *_thread;
+
+    /** Set to stop the queue's thread.
+     */
+    volatile bool _running;
+
+    /** Wakes the queue's thread.
+     */
+    EventFlags _events;
+
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_STATS
+    /** Where to record waits for a turn.
+     */
+    UbloxAtStats *_stats;
+#endif
+
+    /** Return the time now in milliseconds.
+     *
+     * @return the time now.
+     */
+    int64_t now();
+
+    /** Convert a relative deadline to an absolute one.
+     *
+     * @param deadlineMs the relative deadline, may be
+     *                   AT_QUEUE_NO_DEADLINE.
+     * @return           the absolute deadline.
+     */
+    int64_t deadline(int deadlineMs);
+
+    /** Convert an absolute deadline to a relative one.
+     *
+     * @param deadline the absolute deadline.
+     * @return         the time left, AT_QUEUE_NO_DEADLINE if
+     *                 there is no deadline, 0 if it has passed.
+     */
+    int timeLeft(int64_t deadline);
+
+    /** Return the class in which a piece of work is ordered: its
+     * priority class or, once it has waited longer than the maximum
+     * wait, -1, ahead of them all.
+     *
+     * @param priority the priority class.
+     * @param since    when the wait began.
+     * @param now      the time now.
+     * @return         the class.
+     */
+    int rank(AtPriority priority, int64_t since, int64_t now);
+
+    /** Return whether one piece of work should go before another:
+     * by class, then deadline, then order of arrival; work that
+     * has waited too long goes by order of arrival alone.
+     *
+     * @return true if the first should go before the second.
+     */
+    bool before(int r1, int64_t d1, uint32_t s1,
+                int r2, int64_t d2, uint32_t s2);
+
+    /** Grant the turn to the best waiter, if there is one.
+     * NOTE: _mtx must be locked.
+     */
+    void grant();
+
+    /** Run one step of a transaction, taking a turn for it.
+     *
+     * @param transaction the transaction.
+     * @return            the step's result.
+     */
+    int step(Transaction *transaction);
+
+    /** Complete a transaction.
+     *
+     * @param transaction the transaction.
+     * @param result      the result.
+     */
+    void complete(Transaction *transaction, int result);
+
+    /** The body of the queue's thread.
+     */
+    void threadMain();
+};
+
+#endif // _UBLOX_AT_QUEUE_
@@ -0,0 +1,90 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "UbloxAtReader.h"
+
+/**********************************************************************
+ * PROTECTED METHODS
+ **********************************************************************/
+
+// Return how long is left until the deadline.
+int UbloxAtReader::timeLeftMs()
+{
+    int x = _timeoutMs - _timer.read_ms();
+
+    return (x > 0) ? x : 0;
+}
+
+/**********************************************************************
+ * PUBLIC METHODS
+ **********************************************************************/
+
+// Constructor.
+UbloxAtReader::UbloxAtReader(FileHandle *fh, int timeoutMs)
+{
+    _fh = fh;
+    _timeoutMs = timeoutMs;
+    _timer.start();
+}
+
+// Read characters into a buffer.
+int UbloxAtReader::read(char *buf, int len)
+{
+    pollfh fhs;
+    ssize_t got;
+    int count = 0;
+
+    while (count < len) {
+        // poll() returns at once when something is buffered, so
+        // a file handle that blocks, as a UARTSerial does by
+        // default, returns from read() with whatever is there
+        fhs.fh = _fh;
+        fhs.events = POLLIN;
+        if ((mbed::poll(&fhs, 1, timeLeftMs()) <= 0) || !(fhs.revents & POLLIN)) {
+            break;
+        }
+        got = _fh->read(buf + count, len - count);
+        if (got > 0) {
+            count += got;
+        } else if (got != -EAGAIN) {
+            break;
+        }
+    }
+
+    return count;
+}
+
+// Read characters and throw them away.
+int UbloxAtReader::discard(int len)
+{
+    char buf[32];
+    int count = 0;
+    int size;
+    int x;
+
+    while (count < len) {
+        size = ((len - count) < (int) sizeof (buf)) ? len - count : (int) sizeof (buf);
+        x = read(buf, size);
+        count += x;
+        if (x < size) {
+            break;
+        }
+    }
+
+    return count;
+}
+
+// End of file
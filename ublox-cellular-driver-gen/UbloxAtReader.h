@@ -0,0 +1,90 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _UBLOX_AT_READER_
+#define _UBLOX_AT_READER_
+
+#include "mbed.h"
+
+/** UbloxAtReader class.
+ *
+ * Reads a known number of characters, e.g. the binary data of a
+ * +URDBLOCK response, from the file handle under an AT parser: each
+ * read copies whatever the file handle has buffered straight into
+ * the caller's buffer and, when it has nothing, waits in poll()
+ * until more arrives or the deadline passes, e.g.:
+ *
+ *     got = UbloxAtReader(fh, timeLimit).read(buf, blockSize);
+ *
+ * This replaces a loop of ATCmdParser::getc(), which polls and reads
+ * once per character, and ATCmdParser::read(), which loses the count
+ * of characters already read when it runs ahead of the serial stream.
+ * The deadline runs from construction and covers every read made
+ * through the reader.  Characters are read by one thread, under
+ * whatever lock guards the AT parser, and only where the AT parser
+ * has nothing left over from what it has parsed.
+ */
+class UbloxAtReader {
+
+public:
+    /** Constructor.
+     *
+     * @param fh        the file handle to read from.
+     * @param timeoutMs how long, from now, to wait for all the
+     *                  characters to arrive.
+     */
+    UbloxAtReader(FileHandle *fh, int timeoutMs);
+
+    /** Read characters into a buffer.
+     *
+     * @param buf the buffer to read into.
+     * @param len the number of characters to read.
+     * @return    the number of characters read, fewer than len
+     *            if the deadline passed first.
+     */
+    int read(char *buf, int len);
+
+    /** Read characters and throw them away, e.g. data that
+     * doesn't fit the caller's buffer.
+     *
+     * @param len the number of characters to throw away.
+     * @return    the number of characters thrown away, fewer
+     *            than len if the deadline passed first.
+     */
+    int discard(int len);
+
+protected:
+
+    /** The file handle to read from.
+     */
+    FileHandle *_fh;
+
+    /** How long to wait for all the characters.
+     */
+    int _timeoutMs;
+
+    /** Measures the time since construction.
+     */
+    Timer _timer;
+
+    /** Return how long is left until the deadline.
+     *
+     * @return the time left in milliseconds, 0 once it has passed.
+     */
+    int timeLeftMs();
+};
+
+#endif // _UBLOX_AT_READER_
@@ -0,0 +1,221 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "UbloxAtStats.h"
+
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_STATS
+
+// The upper limits of the histogram buckets in milliseconds
+static const uint32_t gBucketLimitsMs[AT_STATS_NUM_BUCKETS] = {1, 2, 5, 10, 20, 50, 100,
+                                                               200, 500, 1000, 5000,
+                                                               0xFFFFFFFF};
+
+// The names of the AT command families, in the order of AtFamily
+static const char *gFamilyNames[UbloxAtStats::MAX_NUM_AT_FAMILIES] = {"CMGL", "CMGS", "CMGR",
+                                                                     "CMGD", "CUSD", "UDWNFILE",
+                                                                     "URDBLOCK", "UDELFILE",
+                                                                     "ULSTFILE", "BATCH", "UHTTPC",
+                                                                     "UFTPC", "ULOC"};
+
+/**********************************************************************
+ * PROTECTED METHODS
+ **********************************************************************/
+
+// Add a time to a set of counters.
+void UbloxAtStats::addTime(Counters *counters, uint32_t startUs)
+{
+    uint32_t us = now() - startUs;
+    uint32_t ms = us / 1000;
+    int bucket = 0;
+
+    while ((bucket < AT_STATS_NUM_BUCKETS - 1) && (ms >= gBucketLimitsMs[bucket])) {
+        bucket++;
+    }
+    counters->buckets[bucket]++;
+    counters->count++;
+    counters->totalUs += us;
+    if (us > counters->maxUs) {
+        counters->maxUs = us;
+    }
+}
+
+/**********************************************************************
+ * PUBLIC METHODS
+ **********************************************************************/
+
+// Constructor.
+UbloxAtStats::UbloxAtStats()
+{
+    memset(&_fileRead, 0, sizeof (_fileRead));
+    reset();
+    _timer.start();
+}
+
+// Return the time now.
+uint32_t UbloxAtStats::now()
+{
+    return (uint32_t) _timer.read_high_resolution_us();
+}
+
+// Record an operation.
+void UbloxAtStats::record(AtFamily family, uint32_t startUs, bool success,
+                          bool timedOut, int bytes)
+{
+    Counters *counters;
+
+    if ((family >= 0) && (family < MAX_NUM_AT_FAMILIES)) {
+        _mtx.lock();
+        counters = &(_families[family]);
+        addTime(counters, startUs);
+        if (!success) {
+            if (timedOut) {
+                counters->numTimeouts++;
+            } else {
+                counters->numErrors++;
+            }
+        }
+        if (bytes > 0) {
+            counters->bytes += bytes;
+        }
+        _mtx.unlock();
+    }
+}
+
+// Record a wait for the AT interface.
+void UbloxAtStats::recordWait(uint32_t startUs)
+{
+    _mtx.lock();
+    addTime(&_wait, startUs);
+    _mtx.unlock();
+}
+
+// Record a wait for a state lock.
+void UbloxAtStats::recordStateWait(uint32_t startUs)
+{
+    _mtx.lock();
+    addTime(&_stateWait, startUs);
+    _mtx.unlock();
+}
+
+// Record a block of a file read.
+void UbloxAtStats::recordFileBlock(uint32_t startUs, int blockSize, bool intact,
+                                   bool retry, bool failed, int nextBlockSize)
+{
+    _mtx.lock();
+    _fileRead.numBlocks++;
+    _fileRead.totalUs += now() - startUs;
+    if (intact) {
+        _fileRead.bytes += blockSize;
+    } else {
+        _fileRead.numShort++;
+    }
+    if (retry) {
+        _fileRead.numRetries++;
+    }
+    if (failed) {
+        _fileRead.numFailed++;
+    }
+    if ((_fileRead.minBlockSize == 0) || ((uint32_t) blockSize < _fileRead.minBlockSize)) {
+        _fileRead.minBlockSize = blockSize;
+    }
+    if ((uint32_t) blockSize > _fileRead.maxBlockSize) {
+        _fileRead.maxBlockSize = blockSize;
+    }
+    if ((_fileRead.blockSize > 0) && ((uint32_t) nextBlockSize > _fileRead.blockSize)) {
+        _fileRead.numGrows++;
+    } else if ((uint32_t) nextBlockSize < _fileRead.blockSize) {
+        _fileRead.numShrinks++;
+    }
+    _fileRead.blockSize = nextBlockSize;
+    _mtx.unlock();
+}
+
+// Get the counters for a family.
+bool UbloxAtStats::get(AtFamily family, Counters *counters)
+{
+    if ((family < 0) || (family >= MAX_NUM_AT_FAMILIES)) {
+        return false;
+    }
+
+    _mtx.lock();
+    *counters = _families[family];
+    _mtx.unlock();
+
+    return true;
+}
+
+// Get the counters for waits for the AT interface.
+void UbloxAtStats::getWait(Counters *counters)
+{
+    _mtx.lock();
+    *counters = _wait;
+    _mtx.unlock();
+}
+
+// Get the counters for waits for a state lock.
+void UbloxAtStats::getStateWait(Counters *counters)
+{
+    _mtx.lock();
+    *counters = _stateWait;
+    _mtx.unlock();
+}
+
+// Get the counters for the blocks of file reads.
+void UbloxAtStats::getFileRead(FileReadCounters *counters)
+{
+    _mtx.lock();
+    *counters = _fileRead;
+    _mtx.unlock();
+}
+
+// Set all counters back to zero.
+void UbloxAtStats::reset()
+{
+    uint32_t blockSize;
+
+    _mtx.lock();
+    memset(_families, 0, sizeof (_families));
+    memset(&_wait, 0, sizeof (_wait));
+    memset(&_stateWait, 0, sizeof (_stateWait));
+    blockSize = _fileRead.blockSize;
+    memset(&_fileRead, 0, sizeof (_fileRead));
+    _fileRead.blockSize = blockSize;
+    _mtx.unlock();
+}
+
+// Return the name of a family.
+const char *UbloxAtStats::familyName(AtFamily family)
+{
+    if ((family < 0) || (family >= MAX_NUM_AT_FAMILIES)) {
+        return "?";
+    }
+
+    return gFamilyNames[family];
+}
+
+// Return the upper limit of a histogram bucket.
+uint32_t UbloxAtStats::bucketLimitMs(int bucket)
+{
+    if ((bucket < 0) || (bucket >= AT_STATS_NUM_BUCKETS)) {
+        return 0;
+    }
+
+    return gBucketLimitsMs[bucket];
+}
+
+#endif // MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_STATS
+
+// End of file
@@ -0,0 +1,230 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _UBLOX_AT_STATS_
+#define _UBLOX_AT_STATS_
+
+#include "mbed.h"
+
+/** Set to 0 to compile the AT statistics out of the driver.
+ */
+#ifndef MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_STATS
+# define MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_STATS 1
+#endif
+
+/** UbloxAtStats class.
+ *
+ * Counters and fixed-bucket latency histograms for each family of
+ * AT command the driver sends, e.g. +URDBLOCK, and for the time
+ * callers wait for their turn on the AT interface.  For each family
+ * the number of operations, errors and timeouts is counted, along
+ * with the bytes of payload moved over the UART (file data, SMS
+ * text, HTTP responses, etc.) and the distribution of the time from
+ * sending the command to the final result, including any wait for
+ * a URC that carries the result.  Waits for the state locks of the
+ * driver are counted separately from waits for the AT interface, and
+ * the blocks of file reads are counted again, with their retries and
+ * the block sizes used, for tuning the block size.
+ *
+ * The class is thread safe.  If MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_STATS
+ * is 0 the driver contains no instance of it and no calls to it.
+ */
+class UbloxAtStats {
+
+public:
+    /** The AT command families.
+     */
+    typedef enum {
+        AT_FAMILY_CMGL = 0, //!< +CMGL, list SMS.
+        AT_FAMILY_CMGS,     //!< +CMGS, send SMS.
+        AT_FAMILY_CMGR,     //!< +CMGR, read SMS.
+        AT_FAMILY_CMGD,     //!< +CMGD, delete SMS.
+        AT_FAMILY_CUSD,     //!< +CUSD, USSD.
+        AT_FAMILY_UDWNFILE, //!< +UDWNFILE, write file.
+        AT_FAMILY_URDBLOCK, //!< +URDBLOCK, read a block of a file.
+        AT_FAMILY_UDELFILE, //!< +UDELFILE, delete file.
+        AT_FAMILY_ULSTFILE, //!< +ULSTFILE, file size.
+        AT_FAMILY_BATCH,    //!< Batched configuration, e.g. +UHTTP, +UFTP.
+        AT_FAMILY_UHTTPC,   //!< +UHTTPC, HTTP command to +UUHTTPCR.
+        AT_FAMILY_UFTPC,    //!< +UFTPC, FTP command to +UUFTPCR.
+        AT_FAMILY_ULOC,     //!< +ULOC, Cell Locate request.
+        MAX_NUM_AT_FAMILIES
+    } AtFamily;
+
+    /** The number of latency histogram buckets.
+     */
+    #define AT_STATS_NUM_BUCKETS 12
+
+    /** The counters for one family, or for waits for the AT interface.
+     */
+    typedef struct {
+        uint32_t count;       //!< Number of operations.
+        uint32_t numErrors;   //!< Number that the module failed.
+        uint32_t numTimeouts; //!< Number that got no answer in time.
+        uint32_t bytes;       //!< Payload bytes moved over the UART.
+        uint64_t totalUs;     //!< Total time taken in microseconds.
+        uint32_t maxUs;       //!< Longest time taken in microseconds.
+        uint32_t buckets[AT_STATS_NUM_BUCKETS]; //!< See bucketLimitMs().
+    } Counters;
+
+    /** The counters for the blocks of file reads.
+     */
+    typedef struct {
+        uint32_t numBlocks;    //!< Blocks asked for, retries included.
+        uint32_t numShort;     //!< Blocks that came up short or not at all.
+        uint32_t numRetries;   //!< Blocks asked for again at the same offset.
+        uint32_t numFailed;    //!< Reads given up once out of retries.
+        uint32_t numGrows;     //!< Times the block size grew.
+        uint32_t numShrinks;   //!< Times the block size shrank.
+        uint32_t blockSize;    //!< The block size to be used next.
+        uint32_t minBlockSize; //!< The smallest block size used.
+        uint32_t maxBlockSize; //!< The largest block size used.
+        uint32_t bytes;        //!< Bytes of the blocks that arrived intact.
+        uint64_t totalUs;      //!< Time taken by all blocks in microseconds;
+                               //!< bytes over this is the throughput.
+    } FileReadCounters;
+
+    /** Constructor.
+     */
+    UbloxAtStats();
+
+    /** Return a timestamp to pass to record() or recordWait().
+     *
+     * @return the time now in microseconds.
+     */
+    uint32_t now();
+
+    /** Record an operation.
+     *
+     * @param family   the AT command family.
+     * @param startUs  the value of now() when the operation began.
+     * @param success  true if the operation succeeded.
+     * @param timedOut if it failed, true if that was because there
+     *                 was no answer in time, false if the module
+     *                 reported an error.
+     * @param bytes    the payload bytes moved.
+     */
+    void record(AtFamily family, uint32_t startUs, bool success,
+                bool timedOut, int bytes);
+
+    /** Record a wait for a turn on the AT interface.
+     *
+     * @param startUs the value of now() when the wait began.
+     */
+    void recordWait(uint32_t startUs);
+
+    /** Record a wait for a state lock.
+     *
+     * @param startUs the value of now() when the wait began.
+     */
+    void recordStateWait(uint32_t startUs);
+
+    /** Record a block of a file read.
+     *
+     * @param startUs       the value of now() when the block was
+     *                      asked for.
+     * @param blockSize     the size of the block.
+     * @param intact        true if all of the block arrived.
+     * @param retry         true if the block had been asked for before.
+     * @param failed        true if the read has been given up.
+     * @param nextBlockSize the block size to be used next.
+     */
+    void recordFileBlock(uint32_t startUs, int blockSize, bool intact,
+                         bool retry, bool failed, int nextBlockSize);
+
+    /** Get the counters for an AT command family.
+     *
+     * @param family   the AT command family.
+     * @param counters a place to put the counters.
+     * @return         true if family is valid, otherwise false.
+     */
+    bool get(AtFamily family, Counters *counters);
+
+    /** Get the counters for waits for the AT interface; only
+     * count, totalUs, maxUs and buckets are used.
+     *
+     * @param counters a place to put the counters.
+     */
+    void getWait(Counters *counters);
+
+    /** Get the counters for waits for a state lock; only count,
+     * totalUs, maxUs and buckets are used.
+     *
+     * @param counters a place to put the counters.
+     */
+    void getStateWait(Counters *counters);
+
+    /** Get the counters for the blocks of file reads.
+     *
+     * @param counters a place to put the counters.
+     */
+    void getFileRead(FileReadCounters *counters);
+
+    /** Set all counters back to zero; the block size to be used next
+     * is kept.
+     */
+    void reset();
+
+    /** Return the name of an AT command family, e.g. "URDBLOCK".
+     *
+     * @param family the AT command family.
+     * @return       the name.
+     */
+    static const char *familyName(AtFamily family);
+
+    /** Return the upper limit of a histogram bucket: bucket n counts
+     * times less than bucketLimitMs(n) and at least bucketLimitMs(n - 1).
+     *
+     * @param bucket the bucket.
+     * @return       the limit in milliseconds, 0xFFFFFFFF for the last.
+     */
+    static uint32_t bucketLimitMs(int bucket);
+
+protected:
+
+    /** Protects the counters.
+     */
+    Mutex _mtx;
+
+    /** Provides the time.
+     */
+    Timer _timer;
+
+    /** The counters for each family.
+     */
+    Counters _families[MAX_NUM_AT_FAMILIES];
+
+    /** The counters for waits for the AT interface.
+     */
+    Counters _wait;
+
+    /** The counters for waits for a state lock.
+     */
+    Counters _stateWait;
+
+    /** The counters for the blocks of file reads.
+     */
+    FileReadCounters _fileRead;
+
+    /** Add a time to a set of counters.  NOTE: _mtx must be locked.
+     *
+     * @param counters the counters.
+     * @param startUs  the start time.
+     */
+    void addTime(Counters *counters, uint32_t startUs);
+};
+
+#endif // _UBLOX_AT_STATS_
@@ -0,0 +1,190 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "UbloxAtTimeouts.h"
+
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_ADAPTIVE_TIMEOUTS
+
+// The default bounds of the timeout of each family in milliseconds,
+// in the order of UbloxAtStats::AtFamily; those that wait on the
+// network have long lower bounds as their latency varies with
+// what is asked for as well as with the network
+static const int gDefaultBoundsMs[UbloxAtStats::MAX_NUM_AT_FAMILIES][2] = {{1000, 60000},    // CMGL
+                                                                           {1000, 60000},    // CMGS
+                                                                           {1000, 60000},    // CMGR
+                                                                           {1000, 60000},    // CMGD
+                                                                           {5000, 60000},    // CUSD
+                                                                           {1000, 60000},    // UDWNFILE
+                                                                           {100, 10000},     // URDBLOCK
+                                                                           {1000, 60000},    // UDELFILE
+                                                                           {1000, 60000},    // ULSTFILE
+                                                                           {1000, 60000},    // BATCH
+                                                                           {30000, 300000},  // UHTTPC
+                                                                           {30000, 300000},  // UFTPC
+                                                                           {10000, 300000}}; // ULOC
+
+/**********************************************************************
+ * PROTECTED METHODS
+ **********************************************************************/
+
+// Work out the timeout of a family.
+int UbloxAtTimeouts::calculate(const Estimate *estimate, int initialMs)
+{
+    uint64_t timeoutUs;
+    uint32_t deviationUs;
+
+    if (estimate->count > 0) {
+        deviationUs = estimate->rttvarUs * 4;
+        if (deviationUs < AT_TIMEOUTS_MIN_DEVIATION_US) {
+            deviationUs = AT_TIMEOUTS_MIN_DEVIATION_US;
+        }
+        timeoutUs = (uint64_t) estimate->srttUs + deviationUs;
+    } else if (initialMs >= 0) {
+        timeoutUs = (uint64_t) initialMs * 1000;
+    } else {
+        timeoutUs = (uint64_t) estimate->maxMs * 1000;
+    }
+    timeoutUs <<= estimate->backoff;
+
+    if (timeoutUs < (uint64_t) estimate->minMs * 1000) {
+        return estimate->minMs;
+    }
+    if (timeoutUs > (uint64_t) estimate->maxMs * 1000) {
+        return estimate->maxMs;
+    }
+
+    return (int) ((timeoutUs + 999) / 1000);
+}
+
+/**********************************************************************
+ * PUBLIC METHODS
+ **********************************************************************/
+
+// Constructor.
+UbloxAtTimeouts::UbloxAtTimeouts()
+{
+    for (int x = 0; x < UbloxAtStats::MAX_NUM_AT_FAMILIES; x++) {
+        _families[x].minMs = gDefaultBoundsMs[x][0];
+        _families[x].maxMs = gDefaultBoundsMs[x][1];
+    }
+    reset();
+}
+
+// Return the timeout to use for an operation.
+int UbloxAtTimeouts::timeoutMs(UbloxAtStats::AtFamily family, int initialMs)
+{
+    int timeout = initialMs;
+
+    if ((family >= 0) && (family < UbloxAtStats::MAX_NUM_AT_FAMILIES)) {
+        _mtx.lock();
+        timeout = calculate(&(_families[family]), initialMs);
+        _mtx.unlock();
+    }
+
+    return timeout;
+}
+
+// Add the latency of an operation that was answered in time.
+void UbloxAtTimeouts::measured(UbloxAtStats::AtFamily family, uint32_t latencyUs)
+{
+    Estimate *estimate;
+    uint32_t differenceUs;
+
+    if ((family >= 0) && (family < UbloxAtStats::MAX_NUM_AT_FAMILIES)) {
+        _mtx.lock();
+        estimate = &(_families[family]);
+        if (estimate->count == 0) {
+            estimate->srttUs = latencyUs;
+            estimate->rttvarUs = latencyUs / 2;
+        } else {
+            differenceUs = (estimate->srttUs > latencyUs) ? estimate->srttUs - latencyUs :
+                                                            latencyUs - estimate->srttUs;
+            estimate->rttvarUs = (uint32_t) (((uint64_t) estimate->rttvarUs * 3 + differenceUs) / 4);
+            estimate->srttUs = (uint32_t) (((uint64_t) estimate->srttUs * 7 + latencyUs) / 8);
+        }
+        estimate->count++;
+        estimate->backoff = 0;
+        _mtx.unlock();
+    }
+}
+
+// Note that an operation timed out.
+void UbloxAtTimeouts::timedOut(UbloxAtStats::AtFamily family)
+{
+    Estimate *estimate;
+
+    if ((family >= 0) && (family < UbloxAtStats::MAX_NUM_AT_FAMILIES)) {
+        _mtx.lock();
+        estimate = &(_families[family]);
+        estimate->numTimeouts++;
+        if (estimate->backoff < AT_TIMEOUTS_MAX_BACKOFF) {
+            estimate->backoff++;
+        }
+        _mtx.unlock();
+    }
+}
+
+// Set the bounds of the timeout of a family.
+bool UbloxAtTimeouts::setBounds(UbloxAtStats::AtFamily family, int minMs, int maxMs)
+{
+    if ((family < 0) || (family >= UbloxAtStats::MAX_NUM_AT_FAMILIES) ||
+        (minMs < 1) || (maxMs < minMs)) {
+        return false;
+    }
+
+    _mtx.lock();
+    _families[family].minMs = minMs;
+    _families[family].maxMs = maxMs;
+    _mtx.unlock();
+
+    return true;
+}
+
+// Get the estimate for a family.
+bool UbloxAtTimeouts::get(UbloxAtStats::AtFamily family, Estimate *estimate)
+{
+    if ((family < 0) || (family >= UbloxAtStats::MAX_NUM_AT_FAMILIES)) {
+        return false;
+    }
+
+    _mtx.lock();
+    *estimate = _families[family];
+    if (estimate->count > 0) {
+        estimate->timeoutMs = calculate(estimate, -1);
+    }
+    _mtx.unlock();
+
+    return true;
+}
+
+// Forget all that has been measured.
+void UbloxAtTimeouts::reset()
+{
+    _mtx.lock();
+    for (int x = 0; x < UbloxAtStats::MAX_NUM_AT_FAMILIES; x++) {
+        _families[x].count = 0;
+        _families[x].numTimeouts = 0;
+        _families[x].srttUs = 0;
+        _families[x].rttvarUs = 0;
+        _families[x].backoff = 0;
+        _families[x].timeoutMs = -1;
+    }
+    _mtx.unlock();
+}
+
+#endif // MBED_CONF_UBLOX_CELL_DRIVER_GEN_ADAPTIVE_TIMEOUTS
+
+// End of file
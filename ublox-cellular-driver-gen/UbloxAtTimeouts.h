@@ -0,0 +1,136 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _UBLOX_AT_TIMEOUTS_
+#define _UBLOX_AT_TIMEOUTS_
+
+#include "mbed.h"
+#include "UbloxAtStats.h"
+
+/** Set to 0 to compile adaptive timeouts out of the driver, which
+ * then uses fixed timeouts as it used to.
+ */
+#ifndef MBED_CONF_UBLOX_CELL_DRIVER_GEN_ADAPTIVE_TIMEOUTS
+# define MBED_CONF_UBLOX_CELL_DRIVER_GEN_ADAPTIVE_TIMEOUTS 1
+#endif
+
+/** UbloxAtTimeouts class.
+ *
+ * Timeouts learnt from the latency observed for each family of AT
+ * command (see UbloxAtStats::AtFamily), in the way that TCP works out
+ * its retransmission timeout (RFC 6298): a smoothed latency and its
+ * mean deviation are kept for each family and the timeout is the
+ * smoothed latency plus four times the deviation, doubled for each
+ * timeout in a row and held within bounds that can be set for each
+ * family.  Until a family has been measured the timeout given by the
+ * caller is used, doubled and bounded in the same way.
+ *
+ * The class is thread safe.  If
+ * MBED_CONF_UBLOX_CELL_DRIVER_GEN_ADAPTIVE_TIMEOUTS is 0 the driver
+ * contains no instance of it and no calls to it.
+ */
+class UbloxAtTimeouts {
+
+public:
+    /** The estimate for one family.
+     */
+    typedef struct {
+        uint32_t count;       //!< Number of latencies measured.
+        uint32_t numTimeouts; //!< Number of timeouts.
+        uint32_t srttUs;      //!< Smoothed latency in microseconds.
+        uint32_t rttvarUs;    //!< Mean deviation of the latency in microseconds.
+        int backoff;          //!< Timeouts in a row, each doubling the timeout.
+        int timeoutMs;        //!< The timeout now, -1 until measured.
+        int minMs;            //!< The lower bound of the timeout.
+        int maxMs;            //!< The upper bound of the timeout.
+    } Estimate;
+
+    /** Constructor.
+     */
+    UbloxAtTimeouts();
+
+    /** Return the timeout to use for an operation.
+     *
+     * @param family    the AT command family.
+     * @param initialMs the timeout to use while the family has not
+     *                  been measured, -1 for its upper bound.
+     * @return          the timeout in milliseconds.
+     */
+    int timeoutMs(UbloxAtStats::AtFamily family, int initialMs);
+
+    /** Add the latency of an operation that was answered in time.
+     *
+     * @param family    the AT command family.
+     * @param latencyUs how long the answer took in microseconds.
+     */
+    void measured(UbloxAtStats::AtFamily family, uint32_t latencyUs);
+
+    /** Note that an operation timed out.
+     *
+     * @param family the AT command family.
+     */
+    void timedOut(UbloxAtStats::AtFamily family);
+
+    /** Set the bounds of the timeout of a family.
+     *
+     * @param family the AT command family.
+     * @param minMs  the shortest timeout, at least 1.
+     * @param maxMs  the longest timeout, at least minMs.
+     * @return       true if the parameters are valid, otherwise false.
+     */
+    bool setBounds(UbloxAtStats::AtFamily family, int minMs, int maxMs);
+
+    /** Get the estimate for a family.
+     *
+     * @param family   the AT command family.
+     * @param estimate a place to put the estimate.
+     * @return         true if family is valid, otherwise false.
+     */
+    bool get(UbloxAtStats::AtFamily family, Estimate *estimate);
+
+    /** Forget all that has been measured, keeping the bounds.
+     */
+    void reset();
+
+protected:
+
+    /** The most times a timeout is doubled.
+     */
+    #define AT_TIMEOUTS_MAX_BACKOFF 6
+
+    /** The least that is added to the smoothed latency for its
+     * deviation, in microseconds.
+     */
+    #define AT_TIMEOUTS_MIN_DEVIATION_US 1000
+
+    /** Protects the estimates.
+     */
+    Mutex _mtx;
+
+    /** The estimates for each family.
+     */
+    Estimate _families[UbloxAtStats::MAX_NUM_AT_FAMILIES];
+
+    /** Work out the timeout of a family.  NOTE: _mtx must be locked.
+     *
+     * @param estimate  the estimate for the family.
+     * @param initialMs the timeout to use if not measured.
+     * @return          the timeout in milliseconds.
+     */
+    static int calculate(const Estimate *estimate, int initialMs);
+};
+
+#endif // _UBLOX_AT_TIMEOUTS_
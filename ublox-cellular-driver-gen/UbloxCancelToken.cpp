@@ -0,0 +1,114 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "UbloxCancelToken.h"
+
+/**********************************************************************
+ * PUBLIC METHODS
+ **********************************************************************/
+
+// Constructor.
+UbloxCancelToken::UbloxCancelToken()
+{
+    _cancelled = false;
+    _deadlineMs = CANCEL_TOKEN_NO_DEADLINE;
+    _flags = NULL;
+    _events = 0;
+}
+
+// Cancel.
+void UbloxCancelToken::cancel()
+{
+    // In a critical section so that a waiter either sees the
+    // cancellation or has its flags set, never neither
+    core_util_critical_section_enter();
+    _cancelled = true;
+    if (_flags != NULL) {
+        _flags->set(_events);
+    }
+    core_util_critical_section_exit();
+}
+
+// Set an absolute deadline.
+void UbloxCancelToken::setDeadline(uint64_t deadlineMs)
+{
+    _deadlineMs = deadlineMs;
+}
+
+// Set the deadline to a time from now.
+void UbloxCancelToken::setTimeout(int timeoutMs)
+{
+    _deadlineMs = (timeoutMs < 0) ? CANCEL_TOKEN_NO_DEADLINE :
+                                    Kernel::get_ms_count() + timeoutMs;
+}
+
+// Return the deadline.
+uint64_t UbloxCancelToken::getDeadline()
+{
+    return _deadlineMs;
+}
+
+// Clear the cancellation and the deadline.
+void UbloxCancelToken::reset()
+{
+    _cancelled = false;
+    _deadlineMs = CANCEL_TOKEN_NO_DEADLINE;
+}
+
+// Return whether cancel() has been called.
+bool UbloxCancelToken::isCancelled()
+{
+    return _cancelled;
+}
+
+// Return whether an operation should stop.
+bool UbloxCancelToken::isExpired()
+{
+    return _cancelled ||
+           ((_deadlineMs != CANCEL_TOKEN_NO_DEADLINE) && (Kernel::get_ms_count() >= _deadlineMs));
+}
+
+// Shorten a timeout so that it ends at the deadline.
+int UbloxCancelToken::timeLeft(int timeoutMs)
+{
+    uint64_t now;
+
+    if (_cancelled) {
+        return 0;
+    }
+    if (_deadlineMs != CANCEL_TOKEN_NO_DEADLINE) {
+        now = Kernel::get_ms_count();
+        if (now >= _deadlineMs) {
+            return 0;
+        }
+        if ((timeoutMs < 0) || (_deadlineMs - now < (uint64_t) timeoutMs)) {
+            timeoutMs = (_deadlineMs - now > 0x7FFFFFFF) ? 0x7FFFFFFF : (int) (_deadlineMs - now);
+        }
+    }
+
+    return timeoutMs;
+}
+
+// Ask for event flags to be set on cancel().
+void UbloxCancelToken::attach(EventFlags *flags, uint32_t events)
+{
+    core_util_critical_section_enter();
+    _flags = flags;
+    _events = events;
+    core_util_critical_section_exit();
+}
+
+// End of file
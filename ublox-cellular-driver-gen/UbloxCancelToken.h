@@ -0,0 +1,133 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _UBLOX_CANCEL_TOKEN_
+#define _UBLOX_CANCEL_TOKEN_
+
+#include "mbed.h"
+
+/** Deadline value meaning "no deadline".
+ */
+#define CANCEL_TOKEN_NO_DEADLINE 0
+
+/** UbloxCancelToken class.
+ *
+ * A way to stop a long-running driver operation, e.g. an HTTP
+ * command or a file read, from another thread or from an interrupt:
+ * the caller passes the token to the operation and later calls
+ * cancel(), or gives the token an absolute deadline beforehand.  The
+ * operation checks the token between its steps (each AT exchange,
+ * each block of a file read) and while waiting for a URC, which
+ * cancel() cuts short, then stops as soon as the module allows,
+ * aborting what the module is doing where the module can.
+ *
+ * A token may be passed to any number of operations in turn, and so
+ * can stop a whole sequence of them, but to only one at a time.
+ */
+class UbloxCancelToken {
+
+public:
+    /** Constructor: not cancelled, with no deadline.
+     */
+    UbloxCancelToken();
+
+    /** Cancel whatever operation has been given the token, now
+     * and from now on.  May be called from an interrupt.
+     */
+    void cancel();
+
+    /** Set an absolute deadline, after which the token counts as
+     * cancelled.
+     *
+     * @param deadlineMs the deadline in terms of Kernel::get_ms_count(),
+     *                   CANCEL_TOKEN_NO_DEADLINE for none.
+     */
+    void setDeadline(uint64_t deadlineMs);
+
+    /** Set the deadline to a time from now.
+     *
+     * @param timeoutMs the time from now in milliseconds,
+     *                  negative for no deadline.
+     */
+    void setTimeout(int timeoutMs);
+
+    /** Return the deadline.
+     *
+     * @return the deadline in terms of Kernel::get_ms_count(),
+     *         CANCEL_TOKEN_NO_DEADLINE if there is none.
+     */
+    uint64_t getDeadline();
+
+    /** Clear the cancellation and the deadline so that the token
+     * can be used again.
+     */
+    void reset();
+
+    /** Return whether cancel() has been called.
+     *
+     * @return true if cancel() has been called.
+     */
+    bool isCancelled();
+
+    /** Return whether an operation given the token should stop:
+     * cancel() has been called or the deadline has passed.
+     *
+     * @return true if the operation should stop.
+     */
+    bool isExpired();
+
+    /** Shorten a timeout so that it ends at the deadline.
+     *
+     * @param timeoutMs the timeout in milliseconds, negative for none.
+     * @return          the shorter of the timeout and the time to
+     *                  the deadline, 0 if the token has expired,
+     *                  negative if there is neither.
+     */
+    int timeLeft(int timeoutMs = -1);
+
+    /** Ask for event flags to be set if the token is cancelled,
+     * so that a wait for them is cut short; used by the driver
+     * around each wait.
+     *
+     * @param flags  the event flags, NULL to stop.
+     * @param events the flags to set.
+     */
+    void attach(EventFlags *flags, uint32_t events);
+
+protected:
+
+    /** Set by cancel().
+     */
+    volatile bool _cancelled;
+
+    /** The deadline, CANCEL_TOKEN_NO_DEADLINE if none.
+     */
+    uint64_t _deadlineMs;
+
+    /** The event flags to set on cancel(), NULL if none.
+     */
+    EventFlags * volatile _flags;
+
+    /** The flags to set.
+     */
+    uint32_t _events;
+};
+
+/** True if an operation given a token, which may be NULL, should stop.
+ */
+#define CANCEL_TOKEN_EXPIRED(token) (((token) != NULL) && (token)->isExpired())
+
+#endif // _UBLOX_CANCEL_TOKEN_
@@ -24,36 +24,547 @@
 #define tr_error(...) (void(0)) // dummies if feature common pal is not added
 #endif
 
+/**********************************************************************
+ * PROTECTED METHODS: URC Thread
+ **********************************************************************/
+
+// The body of the URC thread.
+void UbloxCellularDriverGen::urcThreadMain()
+{
+    while (_urcThreadRunning) {
+        _urcEvents.wait_any(URC_EVENT_RX);
+        urcRead(AT_CHANNEL_CONTROL);
+        urcRead(AT_CHANNEL_URC);
+        urcRead(AT_CHANNEL_DATA);
+    }
+}
+
+// Pass the lines waiting on an AT channel through its parser.
+void UbloxCellularDriverGen::urcRead(AtChannel channel)
+{
+    bool more = true;
+
+    // One line at a time, letting go of the AT channel in between
+    // so that nobody waits on the URC thread for longer than a line
+    // takes to arrive.  If another thread was using the AT channel
+    // when the characters arrived they will have been consumed
+    // already, so only do anything if there is still something there
+    while (more) {
+        LOCK();
+
+        more = _urcThreadRunning && ((channel == AT_CHANNEL_CONTROL) || (_cmux != NULL));
+        // Don't wait for the data channel: whoever
+        // is using it will read what has arrived
+        if (more && (channel == AT_CHANNEL_DATA)) {
+            more = _dataMtx.trylock();
+        }
+        if (more) {
+            more = _channelFh[channel]->readable();
+            if (more) {
+                _channelAt[channel]->set_timeout(MBED_CONF_UBLOX_CELL_DRIVER_GEN_URC_THREAD_READ_TIMEOUT_MS);
+                more = _urcDispatcher.handleLine(_channelAt[channel], _channelFh[channel]);
+                _channelAt[channel]->set_timeout(_at_timeout);
+            }
+            if (channel == AT_CHANNEL_DATA) {
+                _dataMtx.unlock();
+            }
+        }
+
+        UNLOCK();
+    }
+}
+
+// Callback from the serial port when characters are received.
+void UbloxCellularDriverGen::urcThreadSignal()
+{
+    _urcEvents.set(URC_EVENT_RX);
+}
+
+// Wait for URC events.  NOTE: LOCK() before calling.
+uint32_t UbloxCellularDriverGen::waitUrcEvents(uint32_t events, int timeoutMs,
+                                               UbloxCancelToken *token)
+{
+    uint32_t flags = 0;
+    UbloxAtQueue::AtPriority priority;
+    int depth;
+
+    // Attach before looking at the token so that a cancel()
+    // in between still ends the wait
+    if (token != NULL) {
+        token->attach(&_urcEvents, events);
+        timeoutMs = token->timeLeft(timeoutMs);
+    }
+
+    if (timeoutMs != 0) {
+        _mtx.unlock();
+        depth = _atQueue.suspend(&priority);
+        flags = _urcEvents.wait_any(events, (timeoutMs < 0) ? osWaitForever : timeoutMs);
+        _atQueue.resume(depth, priority);
+        _mtx.lock();
+    }
+
+    if (token != NULL) {
+        token->attach(NULL, 0);
+        if (token->isExpired()) {
+            flags = 0;
+        }
+    }
+
+    if (flags & osFlagsError) {
+        flags = 0;
+    }
+
+    return flags & events;
+}
+
+/**********************************************************************
+ * PROTECTED METHODS: AT Transaction Queue
+ **********************************************************************/
+
+// Give up the turn on the AT interface if it has been held too long.
+void UbloxCellularDriverGen::yieldAtLock(int depth)
+{
+    UbloxAtQueue::AtPriority priority;
+
+    if (_atQueue.holdExpired(depth)) {
+        _mtx.unlock();
+        depth = _atQueue.suspend(&priority);
+        TRACE_EVENT(UBLOX_TRACE_AT_YIELD, depth, priority);
+        _atQueue.resume(depth, priority);
+        _mtx.lock();
+    }
+}
+
+/**********************************************************************
+ * PROTECTED METHODS: State Locks
+ **********************************************************************/
+
+// Take a state lock.
+void UbloxCellularDriverGen::stateLock(Mutex *mtx)
+{
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_STATS
+    uint32_t startUs;
+
+    // Only a wait is counted
+    if (!mtx->trylock()) {
+        startUs = _atStats.now();
+        mtx->lock();
+        _atStats.recordStateWait(startUs);
+    }
+#else
+    mtx->lock();
+#endif
+}
+
+// Release a state lock.
+void UbloxCellularDriverGen::stateUnlock(Mutex *mtx)
+{
+    mtx->unlock();
+}
+
+/**********************************************************************
+ * PROTECTED METHODS: URC Dispatch
+ **********************************************************************/
+
+// Read characters of a URC into a buffer.
+int UbloxCellularDriverGen::readUrcToChar(char *buf, int size, char end)
+{
+    int count = 0;
+    int x = 0;
+
+    if (size > 0) {
+        for (count = 0; (count < size) && (x >= 0) && (x != end); count++) {
+            x = _urcDispatcher.getc();
+            *(buf + count) = (char) x;
+        }
+
+        count--;
+        *(buf + count) = 0;
+
+        // Convert line endings: if end was '\n' and the preceding
+        // character was '\r' then overwrite that with null as well
+        if ((count > 0) && (end == '\n') && (*(buf + count - 1) == '\r')) {
+            count--;
+            *(buf + count) = 0;
+        }
+    }
+
+    return count;
+}
+
+/**********************************************************************
+ * PROTECTED METHODS: Capabilities
+ **********************************************************************/
+
+// Return whether the module has a feature.
+bool UbloxCellularDriverGen::hasCapability(Capability cap)
+{
+    Capabilities caps;
+
+    if (!getCapabilities(&caps) && probeCapabilities()) {
+        getCapabilities(&caps);
+    }
+
+    return !caps.probed || ((caps.flags & cap) != 0);
+}
+
+// Add the features used by a derived class: none here.
+void UbloxCellularDriverGen::probeMoreCapabilities(Capabilities *caps)
+{
+    (void) caps;
+}
+
+// Send the test form of a command.
+bool UbloxCellularDriverGen::testCommand(const char *command, char *info, int size)
+{
+    bool success = false;
+    char line[64];
+    const char *ok = _numericResultCodes ? "0" : "OK";
+
+    if ((info != NULL) && (size > 0)) {
+        *info = 0;
+    }
+    if (AT_COMMAND(AT_CHANNEL_CONTROL).literal("AT").text(command).literal("=?").send()) {
+        // Any information text comes before the final result code,
+        // which may instead be an error that aborts the recv()
+        while (!success && _at->recv("%63[^\n]\n", line)) {
+            if (strcmp(line, ok) == 0) {
+                success = true;
+            } else if ((info != NULL) && (size > 0) && (*info == 0)) {
+                strncpy(info, line, size - 1);
+                info[size - 1] = 0;
+            }
+        }
+    }
+
+    return success;
+}
+
+// Return whether a value is within the first list of ranges.
+bool UbloxCellularDriverGen::inTestRange(const char *info, int value)
+{
+    char *end;
+    long first;
+    long last;
+
+    info = strchr(info, '(');
+    while (info != NULL) {
+        first = strtol(info + 1, &end, 10);
+        if (end == info + 1) {
+            break;
+        }
+        last = first;
+        if (*end == '-') {
+            info = end;
+            last = strtol(info + 1, &end, 10);
+            if (end == info + 1) {
+                break;
+            }
+        }
+        if ((value >= first) && (value <= last)) {
+            return true;
+        }
+        info = (*end == ',') ? end : NULL;
+    }
+
+    return false;
+}
+
+/**********************************************************************
+ * PROTECTED METHODS: AT Errors
+ **********************************************************************/
+
+// Forget the last AT error on a channel.
+void UbloxCellularDriverGen::clearAtError(AtChannel channel)
+{
+    storeAtError(AT_ERROR_NONE, -1, _channelAt[channel]);
+}
+
+// Store an AT error.
+void UbloxCellularDriverGen::storeAtError(AtErrorType eType, int eCode, ATCmdParser *at)
+{
+    if (at == NULL) {
+        at = _at;
+    }
+
+    stateLock(&_stateMtx);
+    _atError.eType = eType;
+    _atError.eCode = eCode;
+    // Without the multiplexer the channels share a parser
+    for (int x = 0; x < MAX_NUM_AT_CHANNELS; x++) {
+        if (_channelAt[x] == at) {
+            _channelAtError[x] = _atError;
+        }
+    }
+    stateUnlock(&_stateMtx);
+}
+
+// Record an AT error and abort the AT command in progress.
+void UbloxCellularDriverGen::setAtError(AtErrorType eType)
+{
+    UbloxUrcDispatcher::Scanner scanner(&_urcDispatcher);
+    int eCode = -1;
+
+    // Note: not calling _at->recv() from here as we're
+    // already in an _at->recv()
+    // +CME ERROR: <err> or +CMS ERROR: <err>, nothing for the others
+    scanner.getInt(&eCode);
+    scanner.finish();
+    if (!_failFast) {
+        return;
+    }
+    storeAtError(eType, eCode, _urcDispatcher.parser());
+
+    // This is a final result code so there is no point in waiting
+    // for anything else: make the recv() of the parser that it
+    // arrived on return now
+    _urcDispatcher.parser()->abort();
+}
+
+// URC for the final result code "ERROR".
+void UbloxCellularDriverGen::ERROR_URC()
+{
+    setAtError(AT_ERROR_GENERIC);
+}
+
+// URC for the final result code "+CME ERROR".
+void UbloxCellularDriverGen::CME_ERROR_URC()
+{
+    setAtError(AT_ERROR_CME);
+}
+
+// URC for the final result code "+CMS ERROR".
+void UbloxCellularDriverGen::CMS_ERROR_URC()
+{
+    setAtError(AT_ERROR_CMS);
+}
+
+// URC for the final result code "ABORTED".
+void UbloxCellularDriverGen::ABORTED_URC()
+{
+    setAtError(AT_ERROR_ABORTED);
+}
+
+// URC for the final result code "ERROR" as a number.
+void UbloxCellularDriverGen::NUMERIC_ERROR_URC()
+{
+    // The AT parser can't be rid of the prefix once numeric result
+    // codes are off again, when a lone "4" is just a line
+    if (!_numericResultCodes || !_failFast) {
+        return;
+    }
+
+    // Nothing follows the code to give to setAtError()
+    storeAtError(AT_ERROR_GENERIC, -1, _urcDispatcher.parser());
+    _urcDispatcher.parser()->abort();
+}
+
+/**********************************************************************
+ * PROTECTED METHODS: Network Registration
+ **********************************************************************/
+
+// Set a registration status from a URC or a query response.
+void UbloxCellularDriverGen::setNwkRegStatus(volatile NetworkRegistrationStatus *status)
+{
+    UbloxUrcDispatcher::Scanner scanner(&_urcDispatcher);
+    int a;
+    int b;
+
+    // Note: not calling _at->recv() from here as we're
+    // already in an _at->recv()
+    // +CREG: [<n>,]<stat>[,...], likewise +CGREG and +CEREG
+    if (scanner.getInt(&a)) {
+        *status = (NetworkRegistrationStatus) (scanner.getInt(&b) ? b : a);
+    }
+    scanner.finish();
+}
+
+// URC for circuit switched registration status.
+void UbloxCellularDriverGen::CREG_URC()
+{
+    setNwkRegStatus(&_dev_info.reg_status_csd);
+}
+
+// URC for packet switched registration status.
+void UbloxCellularDriverGen::CGREG_URC()
+{
+    setNwkRegStatus(&_dev_info.reg_status_psd);
+}
+
+// URC for EUTRAN registration status.
+void UbloxCellularDriverGen::CEREG_URC()
+{
+    setNwkRegStatus(&_dev_info.reg_status_eps);
+}
+
+/**********************************************************************
+ * PROTECTED METHODS: Result Codes
+ **********************************************************************/
+
+// Set the result codes of the module on one AT channel.
+bool UbloxCellularDriverGen::setResultCodes(AtChannel channel, bool numeric)
+{
+    UbloxAtCommand command = AT_COMMAND(channel);
+
+    // Echo stays off, as the base class left it
+    if (numeric) {
+        command.literal("ATE0V0;+CMEE=1");
+    } else {
+        command.literal("ATV1;+CMEE=2");
+    }
+
+    // The module answers in whichever form it has just been given,
+    // which may differ between modules, so take either
+    return command.send() && _channelAt[channel]->recv("%*[0OK]\n");
+}
+
+/**********************************************************************
+ * PROTECTED METHODS: Baud Rate
+ **********************************************************************/
+
+// The time that characters take on the wire.
+int UbloxCellularDriverGen::wireTimeMs(int numChars)
+{
+    // 64 bits since the product may not fit in 32
+    return (_baud > 0) ? (int) (((uint64_t) numChars * 8000) / _baud) : 0;
+}
+
+// Tell the module to change baud rate and follow it.
+bool UbloxCellularDriverGen::changeBaud(int baud)
+{
+    // The module sends OK at the old rate and then changes
+    if (!AT_COMMAND(AT_CHANNEL_CONTROL).literal("AT+IPR=").number(baud).send() || !_at->recv(AT_OK)) {
+        return false;
+    }
+    wait_ms(BAUD_CHANGE_DELAY_MS);
+    _fh->set_baud(baud);
+    stateLock(&_stateMtx);
+    _baud = baud;
+    stateUnlock(&_stateMtx);
+    // Lose anything that arrived while the two ends differed
+    _at->flush();
+
+    return true;
+}
+
+// Check that the module responds correctly at the current baud rate.
+bool UbloxCellularDriverGen::baudProbe(char *imei)
+{
+    char buf[15 + 1];
+    bool success = true;
+
+    for (int x = 0; success && (x < BAUD_PROBE_ITERATIONS); x++) {
+        clearAtError();
+        memset(buf, 0, sizeof (buf));
+        success = AT_COMMAND(AT_CHANNEL_CONTROL).literal("AT+CGSN").send() &&
+                  _at->recv("%15[^\n]\n", buf) && _at->recv(AT_OK) &&
+                  (strlen(buf) > 0);
+        if (success) {
+            if (*imei == 0) {
+                strcpy(imei, buf);
+            } else {
+                success = (strcmp(imei, buf) == 0);
+            }
+        }
+    }
+
+    return success;
+}
+
+/**********************************************************************
+ * PROTECTED METHODS: Multiplexer
+ **********************************************************************/
+
+// Return the AT parser of a channel.
+ATCmdParser *UbloxCellularDriverGen::atChannel(AtChannel channel)
+{
+    return _channelAt[channel];
+}
+
+// Return the AT transaction queue of a channel.
+UbloxAtQueue *UbloxCellularDriverGen::atQueue(AtChannel channel)
+{
+    return ((channel == AT_CHANNEL_DATA) && (_cmux != NULL)) ? &_atDataQueue : &_atQueue;
+}
+
+// Lock a channel.
+void UbloxCellularDriverGen::channelLock(AtChannel channel)
+{
+    if ((channel == AT_CHANNEL_DATA) && (_cmux != NULL)) {
+        _dataMtx.lock();
+    } else {
+        _mtx.lock();
+    }
+}
+
+// Unlock a channel.
+void UbloxCellularDriverGen::channelUnlock(AtChannel channel)
+{
+    if ((channel == AT_CHANNEL_DATA) && (_cmux != NULL)) {
+        _dataMtx.unlock();
+    } else {
+        _mtx.unlock();
+    }
+}
+
 /**********************************************************************
  * PROTECTED METHODS: Short Message Service
  **********************************************************************/
 
+// One step of sending an SMS, the only one.
+int UbloxCellularDriverGen::smsSendStep(UbloxAtQueue::Transaction *transaction)
+{
+    int result = -1;
+    const char *num = transaction->op.str;
+    const char *buf = transaction->op.data;
+    char typeOfAddress = TYPE_OF_ADDRESS_NATIONAL;
+    LOCK();
+    clearAtError();
+    AT_STATS_START();
+
+    if ((strlen (num) > 0) && (*(num) == '+')) {
+        typeOfAddress = TYPE_OF_ADDRESS_INTERNATIONAL;
+    }
+    if (AT_COMMAND(AT_CHANNEL_CONTROL).literal("AT+CMGS=").quoted(num).literal(",").
+                                       number(typeOfAddress).send() &&
+        _at->recv(">")) {
+        if (AT_COMMAND(AT_CHANNEL_CONTROL).text(buf).literal("\x1A").write() &&  // CTRL-Z
+            _at->recv(AT_OK)) {
+            result = 0;
+        }
+    }
+
+    AT_STATS_END(AT_FAMILY_CMGS, result == 0, AT_TIMED_OUT(), (result == 0) ? strlen(buf) : 0);
+    UNLOCK();
+    return result;
+}
+
 // URC for Short Message listing.
 void UbloxCellularDriverGen::CMGL_URC()
 {
-    char buf[64];
+    UbloxUrcDispatcher::Scanner scanner(&_urcDispatcher);
     int index;
+    bool gotIndex;
 
     // Note: not calling _at->recv() from here as we're
     // already in an _at->recv()
     // +CMGL: <ix>,...
-    *buf = 0;
-    if (read_at_to_char(buf, sizeof(buf), '\n') > 0) {
-        // Now also read out the text message, so that we don't
-        // accidentally trigger URCs or the like on any of
-        // its contents
-        *_smsBuf = 0;
-        read_at_to_char(_smsBuf, sizeof(_smsBuf), '\n');
-        // Note: don't put any debug in here, this URC is being
-        // called multiple times and debug may cause it to
-        // miss characters
-        if (sscanf(buf, ": %d,", &index) == 1) {
-            _smsCount++;
-            if ((_userSmsIndex != NULL) && (_userSmsNum > 0)) {
-                *_userSmsIndex = index;
-                _userSmsIndex++;
-                _userSmsNum--;
-            }
+    gotIndex = scanner.getInt(&index);
+    scanner.finish();
+    // Now also read out the text message, so that we don't
+    // accidentally trigger URCs or the like on any of
+    // its contents
+    *_smsBuf = 0;
+    readUrcToChar(_smsBuf, sizeof(_smsBuf), '\n');
+    // Note: don't put any debug in here, this URC is being
+    // called multiple times and debug may cause it to
+    // miss characters
+    if (gotIndex) {
+        _smsCount++;
+        if ((_userSmsIndex != NULL) && (_userSmsNum > 0)) {
+            *_userSmsIndex = index;
+            _userSmsIndex++;
+            _userSmsNum--;
         }
     }
 }
@@ -61,72 +572,71 @@ void UbloxCellularDriverGen::CMGL_URC()
 // URC for new SMS messages.
 void UbloxCellularDriverGen::CMTI_URC()
 {
-    char buf[32];
+    UbloxUrcDispatcher::Scanner scanner(&_urcDispatcher);
 
     // Note: not calling _at->recv() from here as we're
     // already in an _at->recv()
-    *buf = 0;
-    if (read_at_to_char(buf, sizeof (buf), '\n') > 0) {
+    if (!scanner.atEnd()) {
         // No need to parse, any content is good
-        tr_info("New SMS received");
+        TRACE_EVENT(UBLOX_TRACE_SMS_NEW);
     }
+    scanner.finish();
 }
 
 /**********************************************************************
  * PROTECTED METHODS: Unstructured Supplementary Service Data
  **********************************************************************/
 
+// URC for USSD responses.
+void UbloxCellularDriverGen::CUSD_URC()
+{
+    UbloxUrcDispatcher::Scanner scanner(&_urcDispatcher);
+    char buf[USSD_STRING_LENGTH + 1];
+    int m;
+
+    // Note: not calling _at->recv() from here as we're
+    // already in an _at->recv()
+    // +CUSD: <m>[,"<str>",<dcs>]
+    // The return string may include newlines: the scanner
+    // reads a quoted string up to the closing quote
+    if (scanner.getInt(&m) && (scanner.getString(buf, sizeof (buf)) > 0)) {
+        if (_cusdUrcBuf != NULL) {
+            memcpy (_cusdUrcBuf, buf, USSD_STRING_LENGTH + 1);
+            _cusdUrcReceived = true;
+            _urcEvents.set(URC_EVENT_USSD);
+        }
+    }
+    scanner.finish();
+}
+
 // URC for call waiting.
 void UbloxCellularDriverGen::CCWA_URC()
 {
     char buf[32];
+    UbloxUrcDispatcher::Scanner scanner(&_urcDispatcher, buf, sizeof (buf));
     int numChars;
     int a;
     int b = 0;
+    bool gotStatus;
 
     // Note: not calling _at->recv() from here as we're
     // already in an _at->recv()
     // +CCWA: <status>[, <class>]
-    numChars = read_at_to_char(buf, sizeof (buf), '\n');
+    gotStatus = scanner.getInt(&a);
+    if (gotStatus) {
+        scanner.getInt(&b);
+    }
+    numChars = scanner.finish();
     if (numChars > 0) {
-        if (sscanf(buf, ": %d, %d", &a, &b) > 0) {
+        if (gotStatus) {
             if (_ssUrcBuf == NULL) {
                 _ssUrcBuf = (char *) malloc(numChars + 5 + 1);
                 if (_ssUrcBuf != NULL) {
                     memcpy (_ssUrcBuf, "+CCWA", 5);
                     memcpy (_ssUrcBuf + 5, buf, numChars);
                     *(_ssUrcBuf + numChars + 5) = 0;
-                    if (a > 0) {
-                        debug_if(_debug_trace_on, "Calling Waiting is active");
-                    } else {
-                        debug_if(_debug_trace_on, "Calling Waiting is not active");
-                    }
-                    if (b > 0) {
-                        if (b & 0x01) {
-                            debug_if(_debug_trace_on, " for voice\n");
-                        }
-                        if (b & 0x02) {
-                            debug_if(_debug_trace_on, " for data\n");
-                        }
-                        if (b & 0x04) {
-                            debug_if(_debug_trace_on, " for fax\n");
-                        }
-                        if (b & 0x08) {
-                            debug_if(_debug_trace_on, " for SMS\n");
-                        }
-                        if (b & 0x10) {
-                            debug_if(_debug_trace_on, " for data circuit sync\n");
-                        }
-                        if (b & 0x20) {
-                            debug_if(_debug_trace_on, " for data circuit async\n");
-                        }
-                        if (b & 0x40) {
-                            debug_if(_debug_trace_on, " for dedicated packet access\n");
-                        }
-                        if (b & 0x80) {
-                            debug_if(_debug_trace_on, " for dedicated PAD access\n");
-                        }
-                    }
+                    _urcEvents.set(URC_EVENT_USSD);
+                    TRACE_EVENT(UBLOX_TRACE_SS_CCWA, a, b);
                 }
             }
         }
@@ -137,18 +647,27 @@ void UbloxCellularDriverGen::CCWA_URC()
 void UbloxCellularDriverGen::CCFC_URC()
 {
     char buf[32];
+    UbloxUrcDispatcher::Scanner scanner(&_urcDispatcher, buf, sizeof (buf));
     int numChars;
     char num[32];
     int a, b;
-    int numValues;
+    int numValues = 0;
 
     // Note: not calling _at->recv() from here as we're
     // already in an _at->recv()
     // +CCFC: <status>[, <class>]
-    numChars = read_at_to_char(buf, sizeof (buf), '\n');
+    memset (num, 0, sizeof (num));
+    if (scanner.getInt(&a)) {
+        numValues++;
+        if (scanner.getInt(&b)) {
+            numValues++;
+            if (scanner.getString(num, sizeof (num)) > 0) {
+                numValues++;
+            }
+        }
+    }
+    numChars = scanner.finish();
     if (numChars > 0) {
-        memset (num, 0, sizeof (num));
-        numValues = sscanf(buf, ": %d,%d,\"%32[^\"][\"]", &a, &b, num);
         if (numValues > 0) {
             if (_ssUrcBuf == NULL) {
                 _ssUrcBuf = (char *) malloc(numChars + 5 + 1);
@@ -156,274 +675,1301 @@ void UbloxCellularDriverGen::CCFC_URC()
                     memcpy (_ssUrcBuf, "+CCFC", 5);
                     memcpy (_ssUrcBuf + 5, buf, numChars);
                     *(_ssUrcBuf + numChars + 5) = 0;
-                    if (a > 0) {
-                        debug_if(_debug_trace_on, "Calling Forwarding is active ");
-                    } else {
-                        debug_if(_debug_trace_on, "Calling Forwarding is not active ");
-                    }
-                    if (numValues > 1) {
-                        if (b > 0) {
-                            if (b & 0x01) {
-                                debug_if(_debug_trace_on, " for voice");
-                            }
-                            if (b & 0x02) {
-                                debug_if(_debug_trace_on, " for data");
-                            }
-                            if (b & 0x04) {
-                                debug_if(_debug_trace_on, " for fax");
-                            }
-                            if (b & 0x08) {
-                                debug_if(_debug_trace_on, " for SMS");
-                            }
-                            if (b & 0x10) {
-                                debug_if(_debug_trace_on, " for data circuit sync");
-                            }
-                            if (b & 0x20) {
-                                debug_if(_debug_trace_on, " for data circuit async");
-                            }
-                            if (b & 0x40) {
-                                debug_if(_debug_trace_on, " for dedicated packet access");
-                            }
-                            if (b & 0x80) {
-                                debug_if(_debug_trace_on, " for dedicated PAD access");
-                            }
-                        }
-                    }
-                    if (numValues > 2) {
-                        debug_if(_debug_trace_on, " for %s\n", num);
-                    } else {
-                        debug_if(_debug_trace_on, "\n");
-                    }
+                    _urcEvents.set(URC_EVENT_USSD);
+                    TRACE_EVENT(UBLOX_TRACE_SS_CCFC, a, (numValues > 1) ? b : -1,
+                                numValues > 2);
                 }
             }
         }
     }
-}
+}
+
+
+// URC for calling line ID restriction.
+void UbloxCellularDriverGen::CLIR_URC()
+{
+    char buf[32];
+    UbloxUrcDispatcher::Scanner scanner(&_urcDispatcher, buf, sizeof (buf));
+    int numChars;
+    int a, b;
+    int numValues = 0;
+
+    // Note: not calling _at->recv() from here as we're
+    // already in an _at->recv()
+    // +CLIR: <n>[, <m>]
+    if (scanner.getInt(&a)) {
+        numValues++;
+        if (scanner.getInt(&b)) {
+            numValues++;
+        }
+    }
+    numChars = scanner.finish();
+    if (numChars > 0) {
+        if (numValues > 0) {
+            if (_ssUrcBuf == NULL) {
+                _ssUrcBuf = (char *) malloc(numChars + 5 + 1);
+                if (_ssUrcBuf != NULL) {
+                    memcpy (_ssUrcBuf, "+CLIR", 5);
+                    memcpy (_ssUrcBuf + 5, buf, numChars);
+                    *(_ssUrcBuf + numChars + 5) = 0;
+                    _urcEvents.set(URC_EVENT_USSD);
+                    TRACE_EVENT(UBLOX_TRACE_SS_CLIR, a, (numValues > 1) ? b : -1);
+                }
+            }
+        }
+    }
+}
+
+// URC for calling line ID presentation.
+void UbloxCellularDriverGen::CLIP_URC()
+{
+    char buf[32];
+    UbloxUrcDispatcher::Scanner scanner(&_urcDispatcher, buf, sizeof (buf));
+    int numChars;
+    int a, b;
+    int numValues = 0;
+
+    // Note: not calling _at->recv() from here as we're
+    // already in an _at->recv()
+    // +CLIP: <n>[, <m>]
+    if (scanner.getInt(&a)) {
+        numValues++;
+        if (scanner.getInt(&b)) {
+            numValues++;
+        }
+    }
+    numChars = scanner.finish();
+    if (numChars > 0) {
+        if (numValues > 0) {
+            if (_ssUrcBuf == NULL) {
+                _ssUrcBuf = (char *) malloc(numChars + 5 + 1);
+                if (_ssUrcBuf != NULL) {
+                    memcpy (_ssUrcBuf, "+CLIP", 5);
+                    memcpy (_ssUrcBuf + 5, buf, numChars);
+                    *(_ssUrcBuf + numChars + 5) = 0;
+                    _urcEvents.set(URC_EVENT_USSD);
+                    TRACE_EVENT(UBLOX_TRACE_SS_CLIP, a, (numValues > 1) ? b : -1);
+                }
+            }
+        }
+    }
+}
+
+// URC for connected line ID presentation.
+void UbloxCellularDriverGen::COLP_URC()
+{
+    char buf[32];
+    UbloxUrcDispatcher::Scanner scanner(&_urcDispatcher, buf, sizeof (buf));
+    int numChars;
+    int a, b;
+    int numValues = 0;
+
+    // Note: not calling _at->recv() from here as we're
+    // already in an _at->recv()
+    // +COLP: <n>[, <m>]
+    if (scanner.getInt(&a)) {
+        numValues++;
+        if (scanner.getInt(&b)) {
+            numValues++;
+        }
+    }
+    numChars = scanner.finish();
+    if (numChars > 0) {
+        if (numValues > 0) {
+            if (_ssUrcBuf == NULL) {
+                _ssUrcBuf = (char *) malloc(numChars + 5 + 1);
+                if (_ssUrcBuf != NULL) {
+                    memcpy (_ssUrcBuf, "+COLP", 5);
+                    memcpy (_ssUrcBuf + 5, buf, numChars);
+                    *(_ssUrcBuf + numChars + 5) = 0;
+                    _urcEvents.set(URC_EVENT_USSD);
+                    TRACE_EVENT(UBLOX_TRACE_SS_COLP, a, (numValues > 1) ? b : -1);
+                }
+            }
+        }
+    }
+}
+
+// URC for connected line ID restriction.
+void UbloxCellularDriverGen::COLR_URC()
+{
+    char buf[32];
+    UbloxUrcDispatcher::Scanner scanner(&_urcDispatcher, buf, sizeof (buf));
+    int numChars;
+    int a;
+    bool gotStatus;
+
+    // Note: not calling _at->recv() from here as we're
+    // already in an _at->recv()
+    // +COLR: <status>
+    gotStatus = scanner.getInt(&a);
+    numChars = scanner.finish();
+    if (numChars > 0) {
+        if (gotStatus) {
+            if (_ssUrcBuf == NULL) {
+                _ssUrcBuf = (char *) malloc(numChars + 5 + 1);
+                if (_ssUrcBuf != NULL) {
+                    memcpy (_ssUrcBuf, "+COLR", 5);
+                    memcpy (_ssUrcBuf + 5, buf, numChars);
+                    *(_ssUrcBuf + numChars + 5) = 0;
+                    _urcEvents.set(URC_EVENT_USSD);
+                    TRACE_EVENT(UBLOX_TRACE_SS_COLR, a);
+                }
+            }
+        }
+    }
+}
+
+/**********************************************************************
+ * PROTECTED METHODS: File System
+ **********************************************************************/
+
+// One step of writing a file, the only one.
+int UbloxCellularDriverGen::writeFileStep(UbloxAtQueue::Transaction *transaction)
+{
+    int bytesWritten = -1;
+    const char *filename = transaction->op.str;
+    const char *buf = transaction->op.data;
+    int len = transaction->op.len;
+    LOCK();
+    clearAtError();
+    AT_STATS_START();
+
+    if (AT_COMMAND(AT_CHANNEL_CONTROL).literal("AT+UDWNFILE=").quoted(filename).literal(",").
+                                       number(len).send() &&
+        _at->recv(">")) {
+        if (AT_COMMAND(AT_CHANNEL_CONTROL).append(buf, len).write() && _at->recv(AT_OK)) {
+            bytesWritten = len;
+        }
+    }
+
+    // The module may add to a file that is there already, so the size
+    // isn't known; after a failure the file may or may not be there
+    if (bytesWritten >= 0) {
+        fileIndexSet(filename, -1);
+    } else {
+        fileIndexRemove(filename, false);
+    }
+
+    AT_STATS_END(AT_FAMILY_UDWNFILE, bytesWritten >= 0, AT_TIMED_OUT(), bytesWritten);
+    UNLOCK();
+    return bytesWritten;
+}
+
+// One step of reading a file.
+// Note: this is implemented with block reads since, unless flow
+// control is on, there is a danger of character loss with large
+// whole-file reads.  The read runs from op.start to op.size, the end,
+// which the first step finds if it isn't known.  With a sink each
+// block goes to the start of op.buf, which is op.len long, and on to
+// the sink; without one the file is read into op.buf, up to op.len.
+// The block size adapts, growing while blocks arrive intact and
+// shrinking when one comes up short, which is then asked for again,
+// up to MBED_CONF_UBLOX_CELL_DRIVER_GEN_FILE_BLOCK_RETRIES times
+int UbloxCellularDriverGen::readFileStep(UbloxAtQueue::Transaction *transaction)
+{
+    const char *filename = transaction->op.str;
+    bool streaming = transaction->sink;
+    char *buf = transaction->op.buf +
+                (streaming ? 0 : transaction->op.offset - transaction->op.start);
+    bool retry = (transaction->op.retries > 0);
+    bool answered;
+    bool intact = false;
+    bool refused = false;
+    bool timedOut = false;
+    int blockSize;
+    int maxBlockSize;
+    char respFilename[48 + 1];
+    char quote = 0;
+    int sz, sz_read = 0;
+    int result = AT_QUEUE_MORE;
+    int timeLimit;
+    int wireTime;
+    int x;
+    Timer timer;
+    ATCmdParser *at;
+
+    // The first step finds out how much there is to read
+    if (transaction->op.size < 0) {
+        transaction->op.size = fileSize(filename);  // Retrieve the size of the file
+        TRACE_EVENT(UBLOX_TRACE_FILE_READ_START, transaction->op.size, transaction->op.len);
+        if (transaction->op.size <= 0) {
+            return -1;
+        }
+        if (!streaming && (transaction->op.size - transaction->op.start > transaction->op.len)) {
+            transaction->op.size = transaction->op.start + transaction->op.len;
+        }
+        return (transaction->op.size > transaction->op.offset) ? AT_QUEUE_MORE : 0;
+    }
+
+    // If this read is inside a turn that another method already
+    // holds, e.g. that of httpCommand(), let waiting threads go first
+    // when it has been held too long; the turn of this step is only
+    // nested when the data channel is the control channel
+    yieldAtLock((atQueue(AT_CHANNEL_DATA) == &_atQueue) ? 1 : 0);
+
+    memset(respFilename, 0, sizeof (respFilename));  // Ensure terminator
+    channelLock(AT_CHANNEL_DATA);
+    at = atChannel(AT_CHANNEL_DATA);
+    clearAtError(AT_CHANNEL_DATA);
+    AT_STATS_START();
+
+    // The block size learnt so far, which flow control may since
+    // have been switched off under
+    maxBlockSize = _flowControl ? FILE_BUFFER_SIZE_FLOW_CONTROL : FILE_BUFFER_SIZE_MAX;
+    if (_fileBlockSize > maxBlockSize) {
+        _fileBlockSize = maxBlockSize;
+    }
+    blockSize = transaction->op.size - transaction->op.offset;
+    if (blockSize > _fileBlockSize) {
+        blockSize = _fileBlockSize;
+    }
+    if (streaming && (blockSize > transaction->op.len)) {
+        blockSize = transaction->op.len;
+    }
+
+    answered = AT_COMMAND(AT_CHANNEL_DATA).literal("AT+URDBLOCK=").quoted(filename).literal(",").
+                                           number(transaction->op.offset).literal(",").number(blockSize).send() &&
+               at->recv("+URDBLOCK: \"%48[^\"]\",%d,\"", respFilename, &sz);
+    if (answered && (strcmp(filename, respFilename) == 0) && (sz == blockSize)) {
+
+        // Read the block straight into the caller's buffer, as much
+        // at a time as the serial port has, rather than through the AT
+        // parser one character at a time; nothing of the block is left
+        // in the parser since it stops at the opening quote.  The time
+        // limit is the amount of time it should take to read the block
+        // at the working baud rate plus however much longer than that
+        // blocks have been taking, which starts at the same again;
+        // learning the extra rather than the whole lets the block size
+        // and baud rate change.  If characters have been lost the
+        // block runs into the closing quote, so that must come next
+        timer.reset();
+        timer.start();
+        wireTime = wireTimeMs(blockSize);
+        timeLimit = wireTime + AT_TIMEOUT_MS(AT_FAMILY_URDBLOCK, wireTime);
+        {
+            UbloxAtReader reader(_channelFh[AT_CHANNEL_DATA], timeLimit);
+            sz_read = reader.read(buf, blockSize);
+            intact = (sz_read == blockSize) && (reader.read(&quote, 1) == 1) && (quote == '"');
+        }
+        timer.stop();
+
+        if (intact) {
+            x = timer.read_us() - (wireTime * 1000);
+            AT_TIMEOUT_MEASURED(AT_FAMILY_URDBLOCK, (x > 0) ? x : 0);
+            transaction->op.offset += sz_read;
+            at->recv(AT_OK);
+            if (transaction->op.offset >= transaction->op.size) {
+                result = transaction->op.offset - transaction->op.start;
+            }
+        } else {
+            // A block cut short timed out, one that ran
+            // into something other than its quote is corrupt
+            timedOut = (sz_read < blockSize);
+            if (timedOut) {
+                AT_TIMEOUT_EXPIRED(AT_FAMILY_URDBLOCK);
+            }
+            TRACE_EVENT(UBLOX_TRACE_FILE_READ_SHORT, blockSize, sz_read);
+        }
+    } else if (!answered && !AT_CHANNEL_TIMED_OUT(AT_CHANNEL_DATA)) {
+        // The module has said no, e.g. because the file has gone,
+        // and will say the same again
+        refused = true;
+        result = -1;
+    } else {
+        // An answer that isn't for the block asked for is corrupt
+        timedOut = !answered;
+    }
+
+    if (intact) {
+        // Grow once enough blocks in a row have arrived at full size
+        transaction->op.retries = 0;
+        if ((blockSize == _fileBlockSize) && (_fileBlockSize < maxBlockSize) &&
+            (++_fileBlockRun >= MBED_CONF_UBLOX_CELL_DRIVER_GEN_FILE_BLOCK_GROW_AFTER)) {
+            _fileBlockSize = (_fileBlockSize * 2 < maxBlockSize) ? _fileBlockSize * 2 : maxBlockSize;
+            _fileBlockRun = 0;
+        }
+    } else if (!refused) {
+        // Let whatever is left of the response arrive and throw it
+        // away, until the module goes quiet, so that the block can be
+        // asked for again from a clean start, smaller this time
+        for (x = 0; (x < FILE_BUFFER_SIZE_FLOW_CONTROL + 64) &&
+                    (UbloxAtReader(_channelFh[AT_CHANNEL_DATA],
+                                   MBED_CONF_UBLOX_CELL_DRIVER_GEN_URC_THREAD_READ_TIMEOUT_MS).discard(32) == 32);
+             x += 32) {
+        }
+        x = ((blockSize < _fileBlockSize) ? blockSize : _fileBlockSize) / 2;
+        _fileBlockSize = (x > MBED_CONF_UBLOX_CELL_DRIVER_GEN_FILE_BLOCK_MIN_SIZE) ?
+                         x : MBED_CONF_UBLOX_CELL_DRIVER_GEN_FILE_BLOCK_MIN_SIZE;
+        _fileBlockRun = 0;
+        if (transaction->op.retries < MBED_CONF_UBLOX_CELL_DRIVER_GEN_FILE_BLOCK_RETRIES) {
+            transaction->op.retries++;
+            TRACE_EVENT(UBLOX_TRACE_FILE_READ_RETRY, transaction->op.offset, _fileBlockSize,
+                        transaction->op.retries);
+        } else {
+            result = -1;
+        }
+    }
+
+    AT_STATS_END(AT_FAMILY_URDBLOCK, intact, timedOut, intact ? blockSize : 0);
+    AT_STATS_FILE_BLOCK(blockSize, intact, retry, result == -1, _fileBlockSize);
+    channelUnlock(AT_CHANNEL_DATA);
+
+    // Hand the block on with the channel unlocked so that the
+    // sink may use the driver, e.g. to send the block on a socket
+    if (streaming && intact && !transaction->sink(buf, blockSize)) {
+        result = transaction->op.offset - transaction->op.start;
+    }
+
+    return result;
+}
+
+// Look a file up in the file index.
+UbloxCellularDriverGen::FileIndexResult UbloxCellularDriverGen::fileIndexFind(const char *filename,
+                                                                              int *size)
+{
+    FileIndexResult result = FILE_INDEX_UNKNOWN;
+
+    // A name too long to be in the index may still be on the module
+    if (strlen(filename) > FILE_NAME_SIZE) {
+        return result;
+    }
+
+    stateLock(&_stateMtx);
+    if (_fileIndexComplete) {
+        result = FILE_INDEX_ABSENT;
+    }
+    for (int x = 0; x < _numFileIndex; x++) {
+        if (strcmp(_fileIndex[x].name, filename) == 0) {
+            *size = _fileIndex[x].size;
+            result = FILE_INDEX_PRESENT;
+            break;
+        }
+    }
+    stateUnlock(&_stateMtx);
+
+    return result;
+}
+
+// Record that a file exists.
+void UbloxCellularDriverGen::fileIndexSet(const char *filename, int size)
+{
+    int x;
+
+    stateLock(&_stateMtx);
+    for (x = 0; (x < _numFileIndex) && (strcmp(_fileIndex[x].name, filename) != 0); x++) {
+    }
+    if ((x == _numFileIndex) &&
+        ((x >= MBED_CONF_UBLOX_CELL_DRIVER_GEN_FILE_INDEX_SIZE) || (strlen(filename) > FILE_NAME_SIZE))) {
+        // No room, so there is now a file the index doesn't have
+        _fileIndexComplete = false;
+    } else {
+        if (x == _numFileIndex) {
+            strcpy(_fileIndex[x].name, filename);
+            _numFileIndex++;
+        }
+        _fileIndex[x].size = size;
+    }
+    stateUnlock(&_stateMtx);
+}
+
+// Remove a file from the file index.
+void UbloxCellularDriverGen::fileIndexRemove(const char *filename, bool gone)
+{
+    stateLock(&_stateMtx);
+    for (int x = 0; x < _numFileIndex; x++) {
+        if (strcmp(_fileIndex[x].name, filename) == 0) {
+            _fileIndex[x] = _fileIndex[--_numFileIndex];
+            break;
+        }
+    }
+    if (!gone) {
+        _fileIndexComplete = false;
+    }
+    stateUnlock(&_stateMtx);
+}
+
+// Read the module's file list into the file index.
+// Note: the list is one line of quoted names, e.g.
+// +ULSTFILE: "a.txt","b.txt", which could be longer than the AT
+// parser's buffer, so it is taken a character at a time.  Sizes
+// aren't in the list, so whatever sizes were known are lost
+bool UbloxCellularDriverGen::fileIndexFill()
+{
+    bool success = false;
+    bool overflow = false;
+    bool quoted = false;
+    char name[FILE_NAME_SIZE + 1];
+    int len = 0;
+    int c = -1;
+    AT_LOCK(AT_PRIORITY_NORMAL);
+    clearAtError();
+    AT_STATS_START();
+
+    // Start again so that the index never holds a file that has gone
+    stateLock(&_stateMtx);
+    _numFileIndex = 0;
+    _fileIndexComplete = false;
+    stateUnlock(&_stateMtx);
+
+    if (AT_COMMAND(AT_CHANNEL_CONTROL).literal("AT+ULSTFILE=0").send() &&
+        _at->recv("+ULSTFILE:")) {
+        while (((c = _at->getc()) >= 0) && (quoted || (c != '\n'))) {
+            if (c == '"') {
+                if (quoted) {
+                    if ((len > FILE_NAME_SIZE) ||
+                        (_numFileIndex >= MBED_CONF_UBLOX_CELL_DRIVER_GEN_FILE_INDEX_SIZE)) {
+                        overflow = true;
+                    } else {
+                        name[len] = 0;
+                        fileIndexSet(name, -1);
+                    }
+                }
+                quoted = !quoted;
+                len = 0;
+            } else if (quoted) {
+                if (len < FILE_NAME_SIZE) {
+                    name[len] = c;
+                }
+                len++;
+            }
+        }
+        success = (c == '\n') && _at->recv(AT_OK);
+    }
+
+    stateLock(&_stateMtx);
+    _fileIndexComplete = success && !overflow;
+    _fileIndexListed = success;
+    stateUnlock(&_stateMtx);
+
+    AT_STATS_END(AT_FAMILY_ULSTFILE, success, AT_TIMED_OUT(), 0);
+    AT_UNLOCK();
+    return success;
+}
+
+// Read part of a file, from an offset, into a buffer.
+int UbloxCellularDriverGen::readFileAt(const char* filename, int offset, char* buf, int len,
+                                       int size, UbloxCancelToken *token)
+{
+    UbloxAtQueue::Transaction transaction;
+
+    if (!hasCapability(CAP_FILE_BLOCK_READ) || (offset < 0) || (len < 0)) {
+        return -1;
+    }
+
+    transaction.setCancelToken(token);
+    transaction.op.str = filename;
+    transaction.op.buf = buf;
+    transaction.op.len = len;
+    transaction.op.start = offset;
+    transaction.op.offset = offset;
+    transaction.op.size = -1;
+    transaction.op.retries = 0;
+    // With the size known there is no need to ask for it
+    if (size >= 0) {
+        if ((offset >= size) || (len == 0)) {
+            return 0;
+        }
+        transaction.op.size = (size - offset > len) ? offset + len : size;
+    }
+
+    return atQueue(AT_CHANNEL_DATA)->run(&transaction,
+                                         callback(this, &UbloxCellularDriverGen::readFileStep),
+                                         UbloxAtQueue::AT_PRIORITY_LOW);
+}
+
+/**********************************************************************
+ * PUBLIC METHODS: Generic
+ **********************************************************************/
+
+// Constructor.
+UbloxCellularDriverGen::UbloxCellularDriverGen(PinName tx, PinName rx,
+                                               int baud, bool debug_on):
+                        _urcThread(osPriorityNormal,
+                                   MBED_CONF_UBLOX_CELL_DRIVER_GEN_URC_THREAD_STACK_SIZE)
+{
+    _userSmsIndex = NULL;
+    _userSmsNum = 0;
+    _smsCount = 0;
+    _ssUrcBuf = NULL;
+    _cusdUrcBuf = NULL;
+    _cusdUrcReceived = false;
+    _flowControl = false;
+    _fileBlockSize = FILE_BUFFER_SIZE;
+    _fileBlockRun = 0;
+    _numericResultCodes = false;
+    _failFast = true;
+    _baud = baud;
+    _cmux = NULL;
+    _uartAt = NULL;
+    _baseAt = NULL;
+    memset(&_caps, 0, sizeof (_caps));
+    _numFileIndex = 0;
+    _fileIndexComplete = false;
+    _fileIndexListed = false;
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_STATS
+    _atQueue.setStats(&_atStats);
+    _atDataQueue.setStats(&_atStats);
+#endif
+
+    // Initialise the base class, which starts the AT parser
+    baseClassInit(tx, rx, baud, debug_on);
+    _urcDispatcher.setParser(_at, _fh);
+    _serialFh = _fh;
+    for (int x = 0; x < MAX_NUM_AT_CHANNELS; x++) {
+        _channelAt[x] = _at;
+        _channelFh[x] = _serialFh;
+    }
+    clearAtError();
+
+    // Final result codes that indicate an error, caught here
+    // so that a failed command doesn't wait for the AT timeout
+    _urcDispatcher.add("ERROR", callback(this, &UbloxCellularDriverGen::ERROR_URC));
+    _urcDispatcher.add("+CME ERROR", callback(this, &UbloxCellularDriverGen::CME_ERROR_URC));
+    _urcDispatcher.add("+CMS ERROR", callback(this, &UbloxCellularDriverGen::CMS_ERROR_URC));
+    _urcDispatcher.add("ABORTED", callback(this, &UbloxCellularDriverGen::ABORTED_URC));
+
+    // Network registration, as the base class does on its own AT parser
+    _urcDispatcher.add("+CREG", callback(this, &UbloxCellularDriverGen::CREG_URC));
+    _urcDispatcher.add("+CGREG", callback(this, &UbloxCellularDriverGen::CGREG_URC));
+    _urcDispatcher.add("+CEREG", callback(this, &UbloxCellularDriverGen::CEREG_URC));
+
+    // URCs related to SMS
+    _urcDispatcher.add("+CMGL", callback(this, &UbloxCellularDriverGen::CMGL_URC));
+    // Include the colon with this one as otherwise it could be found
+    // by +CMT, should it ever occur
+    _urcDispatcher.add("+CMTI:", callback(this, &UbloxCellularDriverGen::CMTI_URC));
+
+    // URCs relater to supplementary services
+    _urcDispatcher.add("+CCWA", callback(this, &UbloxCellularDriverGen::CCWA_URC));
+    _urcDispatcher.add("+CCFC", callback(this, &UbloxCellularDriverGen::CCFC_URC));
+    _urcDispatcher.add("+CLIR", callback(this, &UbloxCellularDriverGen::CLIR_URC));
+    _urcDispatcher.add("+CLIP", callback(this, &UbloxCellularDriverGen::CLIP_URC));
+    _urcDispatcher.add("+COLP", callback(this, &UbloxCellularDriverGen::COLP_URC));
+    _urcDispatcher.add("+COLR", callback(this, &UbloxCellularDriverGen::COLR_URC));
+    _urcDispatcher.add("+CUSD:", callback(this, &UbloxCellularDriverGen::CUSD_URC));
+
+    // Start the thread that reads URCs whenever characters arrive
+    _urcThreadRunning = true;
+    _fh->sigio(callback(this, &UbloxCellularDriverGen::urcThreadSignal));
+    _urcThread.start(callback(this, &UbloxCellularDriverGen::urcThreadMain));
+}
+
+// Destructor.
+UbloxCellularDriverGen::~UbloxCellularDriverGen()
+{
+    cmuxStop();
+    transcriptStop();
+    _fh->sigio(NULL);
+    _urcThreadRunning = false;
+    _urcEvents.set(URC_EVENT_RX);
+    _urcThread.join();
+}
+
+/**********************************************************************
+ * PUBLIC METHODS: Capabilities
+ **********************************************************************/
+
+// Initialise the modem and probe what it can do.
+bool UbloxCellularDriverGen::init(const char *pin)
+{
+    bool success = UbloxCellularBase::init(pin);
+
+    // Whatever was known of the file system may no longer hold
+    invalidateFileIndex();
+    if (success) {
+        probeCapabilities();
+    }
+
+    return success;
+}
+
+// Find out what the module can do.
+bool UbloxCellularDriverGen::probeCapabilities()
+{
+    Capabilities caps;
+
+    if (getCapabilities(&caps) || !_modem_initialised) {
+        return caps.probed;
+    }
+
+    memset(&caps, 0, sizeof (caps));
+    AT_LOCK(AT_PRIORITY_NORMAL);
+
+    // If the module can't give its firmware version it isn't answering,
+    // so leave probing for another time rather than decide it can do
+    // nothing
+    if (AT_COMMAND(AT_CHANNEL_CONTROL).literal("AT+CGMR").send() &&
+        _at->recv("%23[^\n]\n", caps.firmware) &&
+        _at->recv(AT_OK)) {
+        if (testCommand("+URDBLOCK")) {
+            caps.flags |= CAP_FILE_BLOCK_READ;
+        }
+        probeMoreCapabilities(&caps);
+        caps.probed = true;
+        debug_if(_debug_trace_on, "Firmware \"%s\", capabilities 0x%02x, %d HTTP profile(s)\n",
+                 caps.firmware, (unsigned int) caps.flags, caps.numHttpProfiles);
+    }
+    // Errors from test commands are not of interest to anyone
+    clearAtError();
+
+    AT_UNLOCK();
+
+    stateLock(&_stateMtx);
+    if (!_caps.probed) {
+        _caps = caps;
+    }
+    stateUnlock(&_stateMtx);
+
+    return caps.probed;
+}
+
+// Get what the module can do.
+bool UbloxCellularDriverGen::getCapabilities(Capabilities *caps)
+{
+    stateLock(&_stateMtx);
+    *caps = _caps;
+    stateUnlock(&_stateMtx);
+
+    return caps->probed;
+}
+
+/**********************************************************************
+ * PUBLIC METHODS: AT Errors
+ **********************************************************************/
+
+// Get the last AT error.
+UbloxCellularDriverGen::AtError UbloxCellularDriverGen::getLastAtError()
+{
+    AtError atError;
+    stateLock(&_stateMtx);
+
+    atError = _atError;
+
+    stateUnlock(&_stateMtx);
+    return atError;
+}
+
+// Switch fail fast on or off.
+void UbloxCellularDriverGen::setFailFast(bool failFast)
+{
+    stateLock(&_stateMtx);
+
+    _failFast = failFast;
+
+    stateUnlock(&_stateMtx);
+}
+
+// Return whether fail fast is on.
+bool UbloxCellularDriverGen::isFailFastOn()
+{
+    bool failFast;
+    stateLock(&_stateMtx);
+
+    failFast = _failFast;
+
+    stateUnlock(&_stateMtx);
+    return failFast;
+}
+
+/**********************************************************************
+ * PUBLIC METHODS: AT Transaction Queue
+ **********************************************************************/
+
+// Set the maximum wait and hold times of the AT transaction queues.
+void UbloxCellularDriverGen::setAtQueueLimits(int maxWaitMs, int maxHoldMs)
+{
+    _atQueue.setLimits(maxWaitMs, maxHoldMs);
+    _atDataQueue.setLimits(maxWaitMs, maxHoldMs);
+}
+
+/**********************************************************************
+ * PUBLIC METHODS: AT Statistics
+ **********************************************************************/
+
+// Get the statistics for a family of AT commands.
+bool UbloxCellularDriverGen::getAtStats(UbloxAtStats::AtFamily family,
+                                        UbloxAtStats::Counters *counters)
+{
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_STATS
+    return _atStats.get(family, counters);
+#else
+    (void) family;
+    (void) counters;
+    return false;
+#endif
+}
+
+// Get the statistics for waits for the AT interface.
+bool UbloxCellularDriverGen::getAtWaitStats(UbloxAtStats::Counters *counters)
+{
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_STATS
+    _atStats.getWait(counters);
+    return true;
+#else
+    (void) counters;
+    return false;
+#endif
+}
+
+// Get the statistics for waits for a state lock.
+bool UbloxCellularDriverGen::getStateWaitStats(UbloxAtStats::Counters *counters)
+{
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_STATS
+    _atStats.getStateWait(counters);
+    return true;
+#else
+    (void) counters;
+    return false;
+#endif
+}
+
+// Get the statistics for the blocks of file reads.
+bool UbloxCellularDriverGen::getFileReadStats(UbloxAtStats::FileReadCounters *counters)
+{
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_STATS
+    _atStats.getFileRead(counters);
+    return true;
+#else
+    (void) counters;
+    return false;
+#endif
+}
+
+// Set the AT statistics back to zero.
+void UbloxCellularDriverGen::resetAtStats()
+{
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_STATS
+    _atStats.reset();
+#endif
+}
+
+/**********************************************************************
+ * PUBLIC METHODS: AT Timeouts
+ **********************************************************************/
+
+// Get the estimate for a family of AT commands.
+bool UbloxCellularDriverGen::getAtTimeout(UbloxAtStats::AtFamily family,
+                                          UbloxAtTimeouts::Estimate *estimate)
+{
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_ADAPTIVE_TIMEOUTS
+    return _atTimeouts.get(family, estimate);
+#else
+    (void) family;
+    (void) estimate;
+    return false;
+#endif
+}
+
+// Set the bounds of the timeout of a family of AT commands.
+bool UbloxCellularDriverGen::setAtTimeoutBounds(UbloxAtStats::AtFamily family,
+                                                int minMs, int maxMs)
+{
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_ADAPTIVE_TIMEOUTS
+    return _atTimeouts.setBounds(family, minMs, maxMs);
+#else
+    (void) family;
+    (void) minMs;
+    (void) maxMs;
+    return false;
+#endif
+}
+
+// Forget the latencies measured so far.
+void UbloxCellularDriverGen::resetAtTimeouts()
+{
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_ADAPTIVE_TIMEOUTS
+    _atTimeouts.reset();
+#endif
+}
+
+/**********************************************************************
+ * PUBLIC METHODS: Trace
+ **********************************************************************/
+
+// Read the event trace.
+int UbloxCellularDriverGen::getTrace(UbloxTrace::Entry *entries, int maxEntries)
+{
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_TRACE
+    return _trace.read(entries, maxEntries);
+#else
+    (void) entries;
+    (void) maxEntries;
+    return 0;
+#endif
+}
+
+// Print the event trace.
+void UbloxCellularDriverGen::printTrace()
+{
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_TRACE
+    _trace.print();
+#endif
+}
+
+// Empty the event trace.
+void UbloxCellularDriverGen::clearTrace()
+{
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_TRACE
+    _trace.clear();
+#endif
+}
+
+/**********************************************************************
+ * PUBLIC METHODS: Baud Rate
+ **********************************************************************/
+
+// Change the baud rate, checking that the new one works.
+bool UbloxCellularDriverGen::setBaud(int baud)
+{
+    bool success = false;
+    char imei[15 + 1];
+    int oldBaud;
+    int atTimeout;
+    AT_LOCK(AT_PRIORITY_NORMAL);
+    atTimeout = _at_timeout; // Has to be inside LOCK()s
+    oldBaud = _baud;
+    at_set_timeout(BAUD_PROBE_TIMEOUT_MS);
+
+    // Get the IMEI at the working rate to compare with
+    *imei = 0;
+    if ((_cmux == NULL) && baudProbe(imei)) {
+        if (baud == oldBaud) {
+            success = true;
+        } else if (changeBaud(baud)) {
+            success = baudProbe(imei);
+            debug_if(_debug_trace_on, "setBaud: %d is %s\n", baud,
+                     success ? "good" : "not reliable");
+            if (!success) {
+                // Ask for the old rate back; the module may not
+                // hear this, in which case it is back at the old
+                // rate anyway when next powered on
+                changeBaud(oldBaud);
+                _fh->set_baud(oldBaud);
+                stateLock(&_stateMtx);
+                _baud = oldBaud;
+                stateUnlock(&_stateMtx);
+                _at->flush();
+                if (!baudProbe(imei)) {
+                    debug_if(_debug_trace_on, "setBaud: no response at %d either\n", oldBaud);
+                }
+            }
+        }
+    }
+
+    at_set_timeout(atTimeout);
+    AT_UNLOCK();
+    return success;
+}
+
+// Find the fastest reliable baud rate.
+int UbloxCellularDriverGen::negotiateBaud(const int *rates, int numRates)
+{
+    static const int defaultRates[] = {921600, 460800, 230400};
+    int baud;
+
+    if (rates == NULL) {
+        rates = defaultRates;
+        numRates = sizeof (defaultRates) / sizeof (defaultRates[0]);
+    }
+
+    AT_LOCK(AT_PRIORITY_NORMAL);
+    for (int x = 0; x < numRates; x++) {
+        if ((rates[x] > _baud) && setBaud(rates[x])) {
+            break;
+        }
+    }
+    baud = _baud;
+    debug_if(_debug_trace_on, "negotiateBaud: running at %d\n", baud);
+
+    AT_UNLOCK();
+    return baud;
+}
+
+// Return the baud rate in use.
+int UbloxCellularDriverGen::getBaud()
+{
+    int baud;
+    stateLock(&_stateMtx);
+
+    baud = _baud;
+
+    stateUnlock(&_stateMtx);
+    return baud;
+}
+
+/**********************************************************************
+ * PUBLIC METHODS: Serial Flow Control
+ **********************************************************************/
+
+// Switch RTS/CTS flow control on or off.
+bool UbloxCellularDriverGen::setFlowControl(bool enable, PinName rts, PinName cts)
+{
+    bool success;
+    AT_LOCK(AT_PRIORITY_NORMAL);
+    clearAtError();
+
+    // AT&K3 is RTS/CTS, AT&K0 is none; the module answers
+    // before it changes over so the OK is safe either way
+    success = (_cmux == NULL) &&
+              AT_COMMAND(AT_CHANNEL_CONTROL).literal("AT&K").number(enable ? 3 : 0).send() &&
+              _at->recv(AT_OK);
+    if (success) {
+        if (enable) {
+            _fh->set_flow_control(UARTSerial::RTSCTS, rts, cts);
+        } else {
+            _fh->set_flow_control(UARTSerial::Disabled);
+        }
+        stateLock(&_stateMtx);
+        _flowControl = enable;
+        stateUnlock(&_stateMtx);
+        debug_if(_debug_trace_on, "Flow control is %s\n", enable ? "on" : "off");
+    }
+
+    AT_UNLOCK();
+    return success;
+}
+
+// Return whether flow control is on.
+bool UbloxCellularDriverGen::isFlowControlOn()
+{
+    bool flowControl;
+    stateLock(&_stateMtx);
+
+    flowControl = _flowControl;
+
+    stateUnlock(&_stateMtx);
+    return flowControl;
+}
+
+/**********************************************************************
+ * PUBLIC METHODS: Result Codes
+ **********************************************************************/
+
+// Switch numeric result codes on or off.
+bool UbloxCellularDriverGen::setNumericResultCodes(bool numeric)
+{
+    bool success = true;
+    // All of the channels change together
+    _atDataQueue.acquire();
+    _dataMtx.lock();
+    AT_LOCK(AT_PRIORITY_NORMAL);
+    clearAtError();
+
+    if (numeric) {
+        _urcDispatcher.add(AT_NUMERIC_ERROR, callback(this, &UbloxCellularDriverGen::NUMERIC_ERROR_URC));
+    }
+    for (int x = 0; success && (x < MAX_NUM_AT_CHANNELS); x++) {
+        // Without the multiplexer the channels are all one
+        if ((x == AT_CHANNEL_CONTROL) || (_cmux != NULL)) {
+            success = setResultCodes((AtChannel) x, numeric);
+        }
+    }
+    if (success) {
+        stateLock(&_stateMtx);
+        _numericResultCodes = numeric;
+        stateUnlock(&_stateMtx);
+    }
+    debug_if(_debug_trace_on, "Result codes are %s\n", _numericResultCodes ? "numeric" : "verbose");
+
+    AT_UNLOCK();
+    _dataMtx.unlock();
+    _atDataQueue.release();
+    return success;
+}
+
+// Return whether numeric result codes are on.
+bool UbloxCellularDriverGen::isNumericResultCodesOn()
+{
+    bool numeric;
+    stateLock(&_stateMtx);
+
+    numeric = _numericResultCodes;
+
+    stateUnlock(&_stateMtx);
+    return numeric;
+}
+
+/**********************************************************************
+ * PUBLIC METHODS: Multiplexer
+ **********************************************************************/
+
+// Switch the multiplexer on.
+bool UbloxCellularDriverGen::cmuxStart()
+{
+    bool success = false;
+    UbloxCmux *cmux;
+    // Everything stops while the channels change
+    _atDataQueue.acquire();
+    _dataMtx.lock();
+    AT_LOCK(AT_PRIORITY_NORMAL);
+    clearAtError();
+
+    if ((_cmux == NULL) &&
+        AT_COMMAND(AT_CHANNEL_CONTROL).literal("AT+CMUX=0,0,,").number(CMUX_MAX_FRAME_SIZE).send() &&
+        _at->recv(AT_OK)) {
+        _fh->sigio(NULL);
+        // Not _cmux until it is up, so that isCmuxOn() never
+        // sees one that fails to start
+        cmux = new UbloxCmux(_serialFh);
+        if (cmux->start(MAX_NUM_AT_CHANNELS)) {
+            _uartAt = _at;
+            for (int x = 0; x < MAX_NUM_AT_CHANNELS; x++) {
+                _channelFh[x] = cmux->channel(x + 1);
+                _channelAt[x] = new ATCmdParser(_channelFh[x], OUTPUT_ENTER_KEY,
+                                                AT_PARSER_BUFFER_SIZE, _at_timeout,
+                                                _debug_trace_on);
+                _urcDispatcher.addParser(_channelAt[x], _channelFh[x]);
+                cmux->channel(x + 1)->sigio(callback(this, &UbloxCellularDriverGen::urcThreadSignal));
+            }
+            _at = _channelAt[AT_CHANNEL_CONTROL];
+            stateLock(&_stateMtx);
+            _cmux = cmux;
+            stateUnlock(&_stateMtx);
+            // Each channel starts with the settings of the module
+            // as stored, so give them the result codes in use
+            for (int x = 0; _numericResultCodes && (x < MAX_NUM_AT_CHANNELS); x++) {
+                setResultCodes((AtChannel) x, true);
+            }
+            success = true;
+        } else {
+            delete cmux;
+            _fh->sigio(callback(this, &UbloxCellularDriverGen::urcThreadSignal));
+            _at->flush();
+        }
+    }
+    debug_if(_debug_trace_on, "cmuxStart: %s\n", success ? "on" : "failed");
 
+    AT_UNLOCK();
+    _dataMtx.unlock();
+    _atDataQueue.release();
+    return success;
+}
 
-// URC for calling line ID restriction.
-void UbloxCellularDriverGen::CLIR_URC()
+// Switch the multiplexer off.
+bool UbloxCellularDriverGen::cmuxStop()
 {
-    char buf[32];
-    int numChars;
-    int a, b;
-    int numValues;
-
-    // Note: not calling _at->recv() from here as we're
-    // already in an _at->recv()
-    // +CLIR: <n>[, <m>]
-    numChars = read_at_to_char(buf, sizeof (buf), '\n');
-    if (numChars > 0) {
-        numValues = sscanf(buf, ": %d,%d", &a, &b);
-        if (numValues > 0) {
-            if (_ssUrcBuf == NULL) {
-                _ssUrcBuf = (char *) malloc(numChars + 5 + 1);
-                if (_ssUrcBuf != NULL) {
-                    memcpy (_ssUrcBuf, "+CLIR", 5);
-                    memcpy (_ssUrcBuf + 5, buf, numChars);
-                    *(_ssUrcBuf + numChars + 5) = 0;
-                    switch (a) {
-                        case 0:
-                            debug_if(_debug_trace_on, "Calling Line ID restriction is as subscribed\n");
-                            break;
-                        case 1:
-                            debug_if(_debug_trace_on, "Calling Line ID invocation ");
-                            break;
-                        case 2:
-                            debug_if(_debug_trace_on, "Calling Line ID suppression ");
-                            break;
-                    }
-                    if (numValues > 2) {
-                        switch (b) {
-                            case 0:
-                                debug_if(_debug_trace_on, " is not provisioned\n");
-                                break;
-                            case 1:
-                                debug_if(_debug_trace_on, " is provisioned permanently\n");
-                                break;
-                            case 2:
-                                debug_if(_debug_trace_on, " is unknown\n");
-                                break;
-                            case 3:
-                                debug_if(_debug_trace_on, " is in temporary mode, presentation restricted\n");
-                                break;
-                            case 4:
-                                debug_if(_debug_trace_on, " is in temporary mode, presentation allowed\n");
-                                break;
-                        }
-                    }
-                }
-            }
+    bool success = false;
+    UbloxCmux *cmux;
+    // Everything stops while the channels change
+    _atDataQueue.acquire();
+    _dataMtx.lock();
+    AT_LOCK(AT_PRIORITY_NORMAL);
+
+    if (_cmux != NULL) {
+        cmux = _cmux;
+        _at = _uartAt;
+        _uartAt = NULL;
+        for (int x = 0; x < MAX_NUM_AT_CHANNELS; x++) {
+            _urcDispatcher.removeParser(_channelAt[x]);
+            delete _channelAt[x];
+            _channelAt[x] = _at;
+            _channelFh[x] = _serialFh;
         }
+        stateLock(&_stateMtx);
+        _cmux = NULL;
+        stateUnlock(&_stateMtx);
+        cmux->stop();
+        delete cmux;
+        _fh->sigio(callback(this, &UbloxCellularDriverGen::urcThreadSignal));
+        // Lose anything that arrived while the module changed over
+        _at->flush();
+        success = true;
     }
+
+    AT_UNLOCK();
+    _dataMtx.unlock();
+    _atDataQueue.release();
+    return success;
 }
 
-// URC for calling line ID presentation.
-void UbloxCellularDriverGen::CLIP_URC()
+// Return whether the multiplexer is on.
+bool UbloxCellularDriverGen::isCmuxOn()
 {
-    char buf[32];
-    int numChars;
-    int a, b;
-    int numValues;
+    bool on;
+    stateLock(&_stateMtx);
 
-    // Note: not calling _at->recv() from here as we're
-    // already in an _at->recv()
-    // +CLIP: <n>[, <m>]
-    numChars = read_at_to_char(buf, sizeof (buf), '\n');
-    if (numChars > 0) {
-        numValues = sscanf(buf, ": %d,%d", &a, &b);
-        if (numValues > 0) {
-            if (_ssUrcBuf == NULL) {
-                _ssUrcBuf = (char *) malloc(numChars + 5 + 1);
-                if (_ssUrcBuf != NULL) {
-                    memcpy (_ssUrcBuf, "+CLIP", 5);
-                    memcpy (_ssUrcBuf + 5, buf, numChars);
-                    *(_ssUrcBuf + numChars + 5) = 0;
-                    switch (a) {
-                        case 0:
-                            debug_if(_debug_trace_on, "Calling Line ID disable ");
-                            break;
-                        case 1:
-                            debug_if(_debug_trace_on, "Calling Line ID enable ");
-                            break;
-                    }
-                    if (numValues > 1) {
-                        switch (b) {
-                            case 0:
-                                debug_if(_debug_trace_on, " is not provisioned\n");
-                                break;
-                            case 1:
-                                debug_if(_debug_trace_on, " is provisioned\n");
-                                break;
-                            case 2:
-                                debug_if(_debug_trace_on, " is unknown\n");
-                                break;
-                        }
-                    }
-                }
-            }
+    on = (_cmux != NULL);
+
+    stateUnlock(&_stateMtx);
+    return on;
+}
+
+/**********************************************************************
+ * PUBLIC METHODS: Transcript
+ **********************************************************************/
+
+// Start recording a transcript.
+bool UbloxCellularDriverGen::transcriptStart(void *buf, int size)
+{
+    bool success = false;
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_TRANSCRIPT
+    _atDataQueue.acquire();
+    _dataMtx.lock();
+    AT_LOCK(AT_PRIORITY_NORMAL);
+
+    // The AT parser of the base class is put aside for one
+    // that reads and writes through the transcript
+    if ((_cmux == NULL) && (_baseAt == NULL) &&
+        _transcript.start(_fh, buf, size)) {
+        stateLock(&_stateMtx);
+        _baseAt = _at;
+        stateUnlock(&_stateMtx);
+        _serialFh = &_transcript;
+        _at = new ATCmdParser(_serialFh, OUTPUT_ENTER_KEY,
+                              AT_PARSER_BUFFER_SIZE, _at_timeout,
+                              _debug_trace_on);
+        _urcDispatcher.addParser(_at, _serialFh);
+        for (int x = 0; x < MAX_NUM_AT_CHANNELS; x++) {
+            _channelAt[x] = _at;
+            _channelFh[x] = _serialFh;
         }
+        success = true;
     }
+    debug_if(_debug_trace_on, "transcriptStart: %s\n", success ? "on" : "failed");
+
+    AT_UNLOCK();
+    _dataMtx.unlock();
+    _atDataQueue.release();
+#else
+    (void) buf;
+    (void) size;
+#endif
+    return success;
 }
 
-// URC for connected line ID presentation.
-void UbloxCellularDriverGen::COLP_URC()
+// Stop recording a transcript.
+bool UbloxCellularDriverGen::transcriptStop()
 {
-    char buf[32];
-    int numChars;
-    int a, b;
-    int numValues;
-
-    // Note: not calling _at->recv() from here as we're
-    // already in an _at->recv()
-    // +COLP: <n>[, <m>]
-    numChars = read_at_to_char(buf, sizeof (buf), '\n');
-    if (numChars > 0) {
-        numValues = sscanf(buf, ": %d,%d", &a, &b);
-        if (numValues > 0) {
-            if (_ssUrcBuf == NULL) {
-                _ssUrcBuf = (char *) malloc(numChars + 5 + 1);
-                if (_ssUrcBuf != NULL) {
-                    memcpy (_ssUrcBuf, "+COLP", 5);
-                    memcpy (_ssUrcBuf + 5, buf, numChars);
-                    *(_ssUrcBuf + numChars + 5) = 0;
-                    switch (a) {
-                        case 0:
-                            debug_if(_debug_trace_on, "Connected Line ID disable ");
-                            break;
-                        case 1:
-                            debug_if(_debug_trace_on, "Connected Line ID enable ");
-                            break;
-                    }
-                    if (numValues > 1) {
-                        switch (b) {
-                            case 0:
-                                debug_if(_debug_trace_on, " is not provisioned\n");
-                                break;
-                            case 1:
-                                debug_if(_debug_trace_on, " is provisioned\n");
-                                break;
-                            case 2:
-                                debug_if(_debug_trace_on, " is unknown\n");
-                                break;
-                        }
-                    }
-                }
-            }
+    bool success = false;
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_TRANSCRIPT
+    _atDataQueue.acquire();
+    _dataMtx.lock();
+    AT_LOCK(AT_PRIORITY_NORMAL);
+
+    if ((_cmux == NULL) && (_baseAt != NULL)) {
+        _urcDispatcher.removeParser(_at);
+        delete _at;
+        _at = _baseAt;
+        stateLock(&_stateMtx);
+        _baseAt = NULL;
+        stateUnlock(&_stateMtx);
+        // The timeout may have been changed meanwhile
+        _at->set_timeout(_at_timeout);
+        _serialFh = _fh;
+        for (int x = 0; x < MAX_NUM_AT_CHANNELS; x++) {
+            _channelAt[x] = _at;
+            _channelFh[x] = _serialFh;
         }
+        _transcript.stop();
+        success = true;
     }
+
+    AT_UNLOCK();
+    _dataMtx.unlock();
+    _atDataQueue.release();
+#endif
+    return success;
 }
 
-// URC for connected line ID restriction.
-void UbloxCellularDriverGen::COLR_URC()
+// Return whether a transcript is being recorded.
+bool UbloxCellularDriverGen::isTranscriptOn()
 {
-    char buf[32];
-    int numChars;
-    int a;
+    bool on;
+    stateLock(&_stateMtx);
 
-    // Note: not calling _at->recv() from here as we're
-    // already in an _at->recv()
-    // +COLR: <status>
-    numChars = read_at_to_char(buf, sizeof (buf), '\n');
-    if (numChars > 0) {
-        if (sscanf(buf, ": %d", &a) > 0) {
-            if (_ssUrcBuf == NULL) {
-                _ssUrcBuf = (char *) malloc(numChars + 5 + 1);
-                if (_ssUrcBuf != NULL) {
-                    memcpy (_ssUrcBuf, "+COLR", 5);
-                    memcpy (_ssUrcBuf + 5, buf, numChars);
-                    *(_ssUrcBuf + numChars + 5) = 0;
-                    switch (a) {
-                        case 0:
-                            debug_if(_debug_trace_on, "Connected Line ID restriction is not provisioned\n");
-                            break;
-                        case 1:
-                            debug_if(_debug_trace_on, "Connected Line ID restriction is provisioned\n");
-                            break;
-                        case 2:
-                            debug_if(_debug_trace_on, "Connected Line ID restriction is unknown\n");
-                            break;
-                    }
-                }
-            }
-        }
-    }
+    on = (_baseAt != NULL);
+
+    stateUnlock(&_stateMtx);
+    return on;
+}
+
+// Read the records of the last transcript.
+int UbloxCellularDriverGen::getTranscript(UbloxTranscript::Record *records,
+                                          int maxRecords)
+{
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_TRANSCRIPT
+    return _transcript.readRecords(records, maxRecords);
+#else
+    (void) records;
+    (void) maxRecords;
+    return 0;
+#endif
+}
+
+// Print the last transcript.
+void UbloxCellularDriverGen::printTranscript()
+{
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_TRANSCRIPT
+    _transcript.print();
+#endif
 }
 
 /**********************************************************************
- * PUBLIC METHODS: Generic
+ * PUBLIC METHODS: AT Command Batching
  **********************************************************************/
 
-// Constructor.
-UbloxCellularDriverGen::UbloxCellularDriverGen(PinName tx, PinName rx,
-                                               int baud, bool debug_on)
+// Send a batch of AT commands, as few lines as possible.
+bool UbloxCellularDriverGen::atBatchSend(UbloxAtBatch *batch)
 {
-    _userSmsIndex = NULL;
-    _userSmsNum = 0;
-    _smsCount = 0;
-    _ssUrcBuf = NULL;
-
-    // Initialise the base class, which starts the AT parser
-    baseClassInit(tx, rx, baud, debug_on);
+    bool success;
+    int numCommands = batch->numCommands();
+    int first = 0;
+    int next;
+    int len;
+    int cmdLen;
+
+    if (batch->overflowed()) {
+        return false;
+    }
 
-    // URCs related to SMS
-    _at->oob("+CMGL", callback(this, &UbloxCellularDriverGen::CMGL_URC));
-    // Include the colon with this one as otherwise it could be found
-    // by +CMT, should it ever occur
-    _at->oob("+CMTI:", callback(this, &UbloxCellularDriverGen::CMTI_URC));
+    AT_LOCK(AT_PRIORITY_NORMAL);
+    AT_STATS_START();
+    success = true;
+    while (success && (first < numCommands)) {
+        // Put as many commands on the line as will fit, always
+        // at least one
+        len = batch->length(first);
+        next = first + 1;
+        while (next < numCommands) {
+            cmdLen = batch->length(next);
+            if (len + 1 + cmdLen > AT_BATCH_MAX_LINE_LENGTH) {
+                break;
+            }
+            len += 1 + cmdLen;
+            next++;
+        }
+        UbloxAtCommand command = AT_COMMAND(AT_CHANNEL_CONTROL);
+        command.literal("AT");
+        batch->appendTo(first, &command);
+        for (int x = first + 1; x < next; x++) {
+            command.literal(";");
+            batch->appendTo(x, &command);
+        }
 
-    // URCs relater to supplementary services
-    _at->oob("+CCWA", callback(this, &UbloxCellularDriverGen::CCWA_URC));
-    _at->oob("+CCFC", callback(this, &UbloxCellularDriverGen::CCFC_URC));
-    _at->oob("+CLIR", callback(this, &UbloxCellularDriverGen::CLIR_URC));
-    _at->oob("+CLIP", callback(this, &UbloxCellularDriverGen::CLIP_URC));
-    _at->oob("+COLP", callback(this, &UbloxCellularDriverGen::COLP_URC));
-    _at->oob("+COLR", callback(this, &UbloxCellularDriverGen::COLR_URC));
-}
+        clearAtError();
+        success = command.send() && _at->recv(AT_OK);
+        if (!success && (next - first > 1) && !AT_TIMED_OUT()) {
+            // The module stops at the first command on the line that
+            // fails, so find out which it was by sending them again,
+            // one at a time
+            debug_if(_debug_trace_on, "atBatchSend: line rejected, sending %d commands one by one\n",
+                     next - first);
+            success = true;
+            for (int x = first; success && (x < next); x++) {
+                UbloxAtCommand single = AT_COMMAND(AT_CHANNEL_CONTROL);
+                single.literal("AT");
+                batch->appendTo(x, &single);
+                clearAtError();
+                success = single.send() && _at->recv(AT_OK);
+            }
+        }
+        first = next;
+    }
 
-// Destructor.
-UbloxCellularDriverGen::~UbloxCellularDriverGen()
-{
+    AT_STATS_END(AT_FAMILY_BATCH, success, AT_TIMED_OUT(), 0);
+    AT_UNLOCK();
+    return success;
 }
 
 /**********************************************************************
@@ -434,7 +1980,10 @@ UbloxCellularDriverGen::~UbloxCellularDriverGen()
 int UbloxCellularDriverGen::smsList(const char* stat, int* index, int num)
 {
     int numMessages = -1;
-    LOCK();
+    AT_LOCK(AT_PRIORITY_NORMAL);
+    clearAtError();
+
+    AT_STATS_START();
 
     _userSmsIndex = index;
     _userSmsNum = num;
@@ -445,7 +1994,7 @@ int UbloxCellularDriverGen::smsList(const char* stat, int* index, int num)
                           // as the list comes out in one long
                           // stream and we can lose characters if we
                           // pause to do printfs
-    if (_at->send("AT+CMGL=\"%s\"", stat) && _at->recv("OK\n")) {
+    if (AT_COMMAND(AT_CHANNEL_CONTROL).literal("AT+CMGL=").quoted(stat).send() && _at->recv(AT_OK)) {
         numMessages = _smsCount;
     }
     _at->debug_on(_debug_trace_on);
@@ -453,40 +2002,50 @@ int UbloxCellularDriverGen::smsList(const char* stat, int* index, int num)
     // Set this back to null so that the URC won't trample
     _userSmsIndex = NULL;
 
-    UNLOCK();
+    AT_STATS_END(AT_FAMILY_CMGL, numMessages >= 0, AT_TIMED_OUT(), 0);
+    AT_UNLOCK();
     return numMessages;
 }
 
 // Send an SMS message.
 bool UbloxCellularDriverGen::smsSend(const char* num, const char* buf)
 {
-    bool success = false;
-    char typeOfAddress = TYPE_OF_ADDRESS_NATIONAL;
-    LOCK();
+    UbloxAtQueue::Transaction transaction;
 
-    if ((strlen (num) > 0) && (*(num) == '+')) {
-        typeOfAddress = TYPE_OF_ADDRESS_INTERNATIONAL;
-    }
-    if (_at->send("AT+CMGS=\"%s\",%d", num, typeOfAddress) && _at->recv(">")) {
-        if ((_at->write(buf, (int) strlen(buf)) >= (int) strlen(buf)) &&
-            (_at->putc(0x1A) == 0) &&  // CTRL-Z
-            _at->recv("OK")) {
-            success = true;
-        }
-    }
+    transaction.op.str = num;
+    transaction.op.data = buf;
 
-    UNLOCK();
-    return success;
+    return _atQueue.run(&transaction,
+                        callback(this, &UbloxCellularDriverGen::smsSendStep),
+                        UbloxAtQueue::AT_PRIORITY_HIGH) == 0;
+}
+
+// Send an SMS message without waiting.
+bool UbloxCellularDriverGen::smsSendAsync(UbloxAtQueue::Transaction *transaction,
+                                          const char* num, const char* buf,
+                                          UbloxAtQueue::AtPriority priority,
+                                          int deadlineMs,
+                                          Callback<void(int)> done)
+{
+    transaction->op.str = num;
+    transaction->op.data = buf;
+
+    return _atQueue.submit(transaction,
+                           callback(this, &UbloxCellularDriverGen::smsSendStep),
+                           priority, deadlineMs, done);
 }
 
 bool UbloxCellularDriverGen::smsDelete(int index)
 {
     bool success;
-    LOCK();
+    AT_LOCK(AT_PRIORITY_NORMAL);
+    clearAtError();
 
-    success = _at->send("AT+CMGD=%d", index) && _at->recv("OK");
+    AT_STATS_START();
+    success = AT_COMMAND(AT_CHANNEL_CONTROL).literal("AT+CMGD=").number(index).send() && _at->recv(AT_OK);
+    AT_STATS_END(AT_FAMILY_CMGD, success, AT_TIMED_OUT(), 0);
 
-    UNLOCK();
+    AT_UNLOCK();
     return success;
 }
 
@@ -495,17 +2054,19 @@ bool UbloxCellularDriverGen::smsRead(int index, char* num, char* buf, int len)
     bool success = false;
     char * endOfString;
     int smsReadLength = 0;
-    LOCK();
+    AT_LOCK(AT_PRIORITY_NORMAL);
+    clearAtError();
+    AT_STATS_START();
 
     if (len > 0) {
         //+CMGR: "REC READ", "+393488535999",,"07/04/05,18:02:28+08",145,4,0,0,"+393492000466",145,93
         // The text of the message.
         // OK
         memset (_smsBuf, 0, sizeof (SMS_BUFFER_SIZE)); // Ensure terminator
-        if (_at->send("AT+CMGR=%d", index) &&
+        if (AT_COMMAND(AT_CHANNEL_CONTROL).literal("AT+CMGR=").number(index).send() &&
             _at->recv("+CMGR: \"%*[^\"]\",\"%15[^\"]\"%*[^\n]\n", num) &&
             _at->recv("%" stringify(SMS_BUFFER_SIZE) "[^\n]\n", _smsBuf) &&
-            _at->recv("OK")) {
+            _at->recv(AT_OK)) {
             endOfString = strchr(_smsBuf, 0);
             if (endOfString != NULL) {
                 smsReadLength = endOfString - _smsBuf;
@@ -519,7 +2080,8 @@ bool UbloxCellularDriverGen::smsRead(int index, char* num, char* buf, int len)
         }
     }
 
-    UNLOCK();
+    AT_STATS_END(AT_FAMILY_CMGR, success, AT_TIMED_OUT(), smsReadLength);
+    AT_UNLOCK();
     return success;
 }
 
@@ -535,8 +2097,14 @@ bool UbloxCellularDriverGen::ussdCommand(const char* cmd, char* buf, int len)
     int atTimeout;
     int x;
     Timer timer;
-    LOCK();
-    atTimeout = _at_timeout; // Has to be inside LOCK()s
+    // The USSD lock first, since the AT channel lock
+    // is let go while waiting for the response
+    _ussdMtx.lock();
+    AT_LOCK(AT_PRIORITY_NORMAL);
+    // Has to be inside LOCK()s
+    atTimeout = AT_TIMEOUT_MS(AT_FAMILY_CUSD, _at_timeout);
+    clearAtError();
+    AT_STATS_START();
 
     if (len > 0) {
         *buf = 0;
@@ -548,51 +2116,60 @@ bool UbloxCellularDriverGen::ussdCommand(const char* cmd, char* buf, int len)
 
         if (tmpBuf != NULL) {
             memset (tmpBuf, 0, USSD_STRING_LENGTH + 1);
-            // +CUSD: \"%*d, \"%128[^\"]\",%*d"
-            if (_at->send("AT+CUSD=1,\"%s\"", cmd)) {
+            if (_ssUrcBuf != NULL) {
+                free (_ssUrcBuf);
+                _ssUrcBuf = NULL;
+            }
+            // The +CUSD response is picked up by its URC
+            _cusdUrcBuf = tmpBuf;
+            _cusdUrcReceived = false;
+            _urcEvents.clear(URC_EVENT_USSD);
+            if (AT_COMMAND(AT_CHANNEL_CONTROL).literal("AT+CUSD=1,").quoted(cmd).send()) {
                 // Wait for either +CUSD to come back or
                 // one of the other SS related URCs to trigger
-                if (_ssUrcBuf != NULL) {
-                    free (_ssUrcBuf);
-                    _ssUrcBuf = NULL;
-                }
+                // Note: don't wait for "OK" here as the +CUSD response may come
+                // before or after the OK
                 timer.start();
-                _at->set_timeout(1000);
                 while (!success && (timer.read_ms() < atTimeout)) {
-                    if (_at->recv("+CUSD: %*d,\"")) {
-                        // Note: don't wait for "OK" here as the +CUSD response may come
-                        // before or after the OK
-                        // Also, the return string may include newlines so can't just use
-                        // recv() to capture it as recv() will stop capturing at a newline.
-                        if (read_at_to_char(tmpBuf, USSD_STRING_LENGTH, '\"') > 0) {
-                            success = true;
-                            memcpy (buf, tmpBuf, len);
-                            *(buf + len - 1) = 0;
-                        }
-                    } else {
+                    if (_cusdUrcReceived) {
+                        success = true;
+                        memcpy (buf, tmpBuf, len);
+                        *(buf + len - 1) = 0;
+                    } else if (_ssUrcBuf != NULL) {
                         // Some of the return values do not appear as +CUSD but
                         // instead as the relevant URC for call waiting, call forwarding,
                         // etc.  Test those here.
-                        if (_ssUrcBuf != NULL) {
-                            success = true;
-                            x = strlen (_ssUrcBuf);
-                            if (x > len - 1 ) {
-                                x = len - 1;
-                            }
-                            memcpy (buf, _ssUrcBuf, x);
-                            *(buf + x) = 0;
-                            free (_ssUrcBuf);
-                            _ssUrcBuf = NULL;
+                        success = true;
+                        x = strlen (_ssUrcBuf);
+                        if (x > len - 1 ) {
+                            x = len - 1;
+                        }
+                        memcpy (buf, _ssUrcBuf, x);
+                        *(buf + x) = 0;
+                        free (_ssUrcBuf);
+                        _ssUrcBuf = NULL;
+                    } else {
+                        x = atTimeout - timer.read_ms();
+                        if (x > 0) {
+                            waitUrcEvents(URC_EVENT_USSD, x);
                         }
                     }
                 }
-                at_set_timeout(atTimeout);
                 timer.stop();
+                if (success) {
+                    AT_TIMEOUT_MEASURED(AT_FAMILY_CUSD, timer.read_us());
+                } else {
+                    AT_TIMEOUT_EXPIRED(AT_FAMILY_CUSD);
+                }
             }
+            _cusdUrcBuf = NULL;
+            free (tmpBuf);
         }
     }
 
-    UNLOCK();
+    AT_STATS_END(AT_FAMILY_CUSD, success, AT_TIMED_OUT(), success ? strlen(buf) : 0);
+    AT_UNLOCK();
+    _ussdMtx.unlock();
     return success;
 }
 
@@ -604,126 +2181,265 @@ bool UbloxCellularDriverGen::ussdCommand(const char* cmd, char* buf, int len)
 bool UbloxCellularDriverGen::delFile(const char* filename)
 {
     bool success;
-    LOCK();
+    AT_LOCK(AT_PRIORITY_NORMAL);
+    clearAtError();
 
-    success = _at->send("AT+UDELFILE=\"%s\"", filename) && _at->recv("OK");
+    AT_STATS_START();
+    success = AT_COMMAND(AT_CHANNEL_CONTROL).literal("AT+UDELFILE=").quoted(filename).send() &&
+              _at->recv(AT_OK);
+    // An error, rather than no answer, means the file isn't there
+    fileIndexRemove(filename, success || !AT_TIMED_OUT());
+    AT_STATS_END(AT_FAMILY_UDELFILE, success, AT_TIMED_OUT(), 0);
 
-    UNLOCK();
+    AT_UNLOCK();
     return success;
 }
 
 // Write a buffer of data to a file in the module's file system.
 int UbloxCellularDriverGen::writeFile(const char* filename, const char* buf, int len)
 {
-    int bytesWritten = -1;
-    LOCK();
+    UbloxAtQueue::Transaction transaction;
 
-    if (_at->send("AT+UDWNFILE=\"%s\",%d", filename, len) && _at->recv(">")) {
-        if ((_at->write(buf, len) >= len) && _at->recv("OK")) {
-            bytesWritten = len;
-        }
-    }
+    transaction.op.str = filename;
+    transaction.op.data = buf;
+    transaction.op.len = len;
 
-    UNLOCK();
-    return bytesWritten;
+    return _atQueue.run(&transaction,
+                        callback(this, &UbloxCellularDriverGen::writeFileStep),
+                        UbloxAtQueue::AT_PRIORITY_LOW);
 }
 
-// Read a file from the module's file system
-// Note: this is implemented with block reads since UARTSerial
-// does not currently allow flow control and there is a danger
-// of character loss with large whole-file reads
-int UbloxCellularDriverGen::readFile(const char* filename, char* buf, int len)
+// Write a buffer of data to a file without waiting.
+bool UbloxCellularDriverGen::writeFileAsync(UbloxAtQueue::Transaction *transaction,
+                                            const char* filename, const char* buf, int len,
+                                            UbloxAtQueue::AtPriority priority,
+                                            int deadlineMs,
+                                            Callback<void(int)> done)
 {
-    int countBytes = -1;  // Counter for file reading (default value)
-    int bytesToRead = fileSize(filename);  // Retrieve the size of the file
-    int offset = 0;
-    int blockSize = FILE_BUFFER_SIZE;
-    char respFilename[48 + 1];
-    int sz, sz_read;
-    bool success = true;
-    int ch = 0;
-    int timeLimit;
-    Timer timer;
+    transaction->op.str = filename;
+    transaction->op.data = buf;
+    transaction->op.len = len;
 
-    debug_if(_debug_trace_on, "readFile: filename is %s; size is %d\n", filename, bytesToRead);
+    return _atQueue.submit(transaction,
+                           callback(this, &UbloxCellularDriverGen::writeFileStep),
+                           priority, deadlineMs, done);
+}
 
-    memset(respFilename, 0, sizeof (respFilename));  // Ensure terminator
-    if (bytesToRead > 0)
-    {
-        if (bytesToRead > len) {
-            bytesToRead = len;
-        }
+// Read a file from the module's file system.
+int UbloxCellularDriverGen::readFile(const char* filename, char* buf, int len,
+                                     UbloxCancelToken *token)
+{
+    return readFileAt(filename, 0, buf, len, -1, token);
+}
 
-        while (success && (bytesToRead > 0)) {
+// Read a file from the module's file system to a sink.
+int UbloxCellularDriverGen::readFile(const char* filename,
+                                     Callback<bool(const char *, int)> sink,
+                                     char* block, int blockSize,
+                                     UbloxCancelToken *token)
+{
+    UbloxAtQueue::Transaction transaction;
 
-            if (bytesToRead < blockSize) {
-                blockSize = bytesToRead;
-            }
-            LOCK();
-
-            if (blockSize > 0) {
-                if (_at->send("AT+URDBLOCK=\"%s\",%d,%d\r\n", filename, offset, blockSize) &&
-                    _at->recv("+URDBLOCK: \"%48[^\"]\",%d,\"", respFilename, &sz) &&
-                    (strcmp(filename, respFilename) == 0)) {
-
-                    // Would use _at->read() here, but if it runs ahead of the
-                    // serial stream it returns -1 instead of the number of characters
-                    // read so far, which is not very helpful so instead use _at->getc() and
-                    // a time limit. The time limit is twice the amount of time it should take to
-                    // read the block at the working baud rate
-                    timer.reset();
-                    timer.start();
-                    timeLimit = blockSize * 2 / ((MBED_CONF_UBLOX_CELL_BAUD_RATE / 8) / 1000);
-                    sz_read = 0;
-                    while ((sz_read < blockSize) && (timer.read_ms() < timeLimit)) {
-                        ch = _at->getc();
-                        if (ch >= 0) {
-                            *buf = ch;
-                            buf++;
-                            sz_read++;
-                        }
-                    }
-                    timer.stop();
+    if (!hasCapability(CAP_FILE_BLOCK_READ) || !sink || (blockSize <= 0)) {
+        return -1;
+    }
 
-                    if (sz_read == blockSize) {
-                        bytesToRead -= sz_read;
-                        offset += sz_read;
-                        _at->recv("OK");
-                    } else {
-                        debug_if(_debug_trace_on, "blockSize %d but only received %d bytes\n", blockSize, sz_read);
-                        success = false;
-                    }
-               } else {
-                   success = false;
-               }
-            }
+    transaction.setCancelToken(token);
+    transaction.op.str = filename;
+    transaction.op.buf = block;
+    transaction.op.len = blockSize;
+    transaction.op.start = 0;
+    transaction.op.offset = 0;
+    transaction.op.size = -1;
+    transaction.op.retries = 0;
+    transaction.sink = sink;
+
+    return atQueue(AT_CHANNEL_DATA)->run(&transaction,
+                                         callback(this, &UbloxCellularDriverGen::readFileStep),
+                                         UbloxAtQueue::AT_PRIORITY_LOW);
+}
 
-            UNLOCK();
-        }
+// Read a file from the module's file system without waiting.
+bool UbloxCellularDriverGen::readFileAsync(UbloxAtQueue::Transaction *transaction,
+                                           const char* filename, char* buf, int len,
+                                           UbloxAtQueue::AtPriority priority,
+                                           int deadlineMs,
+                                           Callback<void(int)> done)
+{
+    if (!hasCapability(CAP_FILE_BLOCK_READ)) {
+        return false;
+    }
 
-        if (success) {
-            countBytes = offset;
-        }
+    transaction->op.str = filename;
+    transaction->op.buf = buf;
+    transaction->op.len = len;
+    transaction->op.start = 0;
+    transaction->op.offset = 0;
+    transaction->op.size = -1;
+    transaction->op.retries = 0;
+    transaction->sink = NULL;
+
+    return atQueue(AT_CHANNEL_DATA)->submit(transaction,
+                                            callback(this, &UbloxCellularDriverGen::readFileStep),
+                                            priority, deadlineMs, done);
+}
+
+// Read a file from the module's file system to a sink without waiting.
+bool UbloxCellularDriverGen::readFileAsync(UbloxAtQueue::Transaction *transaction,
+                                           const char* filename,
+                                           Callback<bool(const char *, int)> sink,
+                                           char* block, int blockSize,
+                                           UbloxAtQueue::AtPriority priority,
+                                           int deadlineMs,
+                                           Callback<void(int)> done)
+{
+    if (!hasCapability(CAP_FILE_BLOCK_READ) || !sink || (blockSize <= 0)) {
+        return false;
     }
 
-    return countBytes;
+    transaction->op.str = filename;
+    transaction->op.buf = block;
+    transaction->op.len = blockSize;
+    transaction->op.start = 0;
+    transaction->op.offset = 0;
+    transaction->op.size = -1;
+    transaction->op.retries = 0;
+    transaction->sink = sink;
+
+    return atQueue(AT_CHANNEL_DATA)->submit(transaction,
+                                            callback(this, &UbloxCellularDriverGen::readFileStep),
+                                            priority, deadlineMs, done);
+}
+
+// Read part of a file from an offset.
+int UbloxCellularDriverGen::readFileRange(const char* filename, int offset, char* buf, int len,
+                                          UbloxCancelToken *token)
+{
+    return readFileAt(filename, offset, buf, len, -1, token);
 }
 
 // Return the size of a file.
 int UbloxCellularDriverGen::fileSize(const char* filename)
 {
     int returnValue = -1;
-    int fileSize;
-    LOCK();
+    int fileSize = -1;
+
+    // No need to ask if the file index knows
+    switch (fileIndexFind(filename, &fileSize)) {
+        case FILE_INDEX_ABSENT:
+            return -1;
+        case FILE_INDEX_PRESENT:
+            if (fileSize >= 0) {
+                return fileSize;
+            }
+            break;
+        default:
+            break;
+    }
+
+    AT_LOCK(AT_PRIORITY_NORMAL);
+    clearAtError();
+    AT_STATS_START();
 
-    if (_at->send("AT+ULSTFILE=2,\"%s\"", filename) &&
+    if (AT_COMMAND(AT_CHANNEL_CONTROL).literal("AT+ULSTFILE=2,").quoted(filename).send() &&
         _at->recv("+ULSTFILE: %d\n", &fileSize) &&
-        _at->recv("OK")) {
+        _at->recv(AT_OK)) {
         returnValue = fileSize;
+        fileIndexSet(filename, fileSize);
+    } else {
+        // An error, rather than no answer, means the file isn't there
+        fileIndexRemove(filename, !AT_TIMED_OUT());
     }
 
-    UNLOCK();
+    AT_STATS_END(AT_FAMILY_ULSTFILE, returnValue >= 0, AT_TIMED_OUT(), 0);
+    AT_UNLOCK();
     return returnValue;
 }
 
+// Find out whether a file exists.
+bool UbloxCellularDriverGen::fileExists(const char* filename)
+{
+    int size;
+    bool listed;
+    FileIndexResult result = fileIndexFind(filename, &size);
+
+    stateLock(&_stateMtx);
+    listed = _fileIndexListed;
+    stateUnlock(&_stateMtx);
+
+    // One read of the file list answers for every file it holds
+    if ((result == FILE_INDEX_UNKNOWN) && !listed &&
+        (MBED_CONF_UBLOX_CELL_DRIVER_GEN_FILE_INDEX_SIZE > 0) && fileIndexFill()) {
+        result = fileIndexFind(filename, &size);
+    }
+    if (result == FILE_INDEX_UNKNOWN) {
+        return fileSize(filename) >= 0;
+    }
+
+    return result == FILE_INDEX_PRESENT;
+}
+
+// Forget everything in the file index.
+void UbloxCellularDriverGen::invalidateFileIndex()
+{
+    stateLock(&_stateMtx);
+    _numFileIndex = 0;
+    _fileIndexComplete = false;
+    _fileIndexListed = false;
+    stateUnlock(&_stateMtx);
+}
+
+// File cursor constructor.
+UbloxCellularDriverGen::FileCursor::FileCursor(UbloxCellularDriverGen *driver,
+                                               const char *filename)
+{
+    _driver = driver;
+    _filename = filename;
+    _offset = 0;
+    _size = -1;
+}
+
+// Read from the file at the cursor.
+int UbloxCellularDriverGen::FileCursor::read(char *buf, int len, UbloxCancelToken *token)
+{
+    int x;
+
+    if (size() < 0) {
+        return -1;
+    }
+    x = _driver->readFileAt(_filename, _offset, buf, len, _size, token);
+    if (x > 0) {
+        _offset += x;
+    }
+
+    return x;
+}
+
+// Move the cursor.
+bool UbloxCellularDriverGen::FileCursor::seek(int offset)
+{
+    if (offset < 0) {
+        return false;
+    }
+    _offset = offset;
+
+    return true;
+}
+
+// Return where the cursor is.
+int UbloxCellularDriverGen::FileCursor::tell()
+{
+    return _offset;
+}
+
+// Return the size of the file.
+int UbloxCellularDriverGen::FileCursor::size()
+{
+    if (_size < 0) {
+        _size = _driver->fileSize(_filename);
+    }
+
+    return _size;
+}
+
 // End of file
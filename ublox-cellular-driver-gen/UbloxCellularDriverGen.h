@@ -17,6 +17,69 @@
 #define _UBLOX_CELLULAR_DRIVER_GEN_
 
 #include "ublox_modem_driver/UbloxCellularBase.h"
+#include "UbloxUrcDispatcher.h"
+#include "UbloxAtQueue.h"
+#include "UbloxAtCommand.h"
+#include "UbloxAtReader.h"
+#include "UbloxAtBatch.h"
+#include "UbloxAtStats.h"
+#include "UbloxAtTimeouts.h"
+#include "UbloxTrace.h"
+#include "UbloxTranscript.h"
+#include "UbloxCmux.h"
+
+// These values can be overridden in the target_overrides section of an
+// mbed_app.json file, e.g. "ublox-cell-driver-gen.urc-thread-stack-size": 4096
+
+/** The stack size of the thread that reads URCs from the module.
+ */
+#ifndef MBED_CONF_UBLOX_CELL_DRIVER_GEN_URC_THREAD_STACK_SIZE
+# define MBED_CONF_UBLOX_CELL_DRIVER_GEN_URC_THREAD_STACK_SIZE 2048
+#endif
+
+/** The time, in milliseconds, for which the URC thread waits for the
+ * next character of a line that has begun to arrive; this must be long
+ * enough for the module to complete a URC line.
+ */
+#ifndef MBED_CONF_UBLOX_CELL_DRIVER_GEN_URC_THREAD_READ_TIMEOUT_MS
+# define MBED_CONF_UBLOX_CELL_DRIVER_GEN_URC_THREAD_READ_TIMEOUT_MS 100
+#endif
+
+/** The size of the blocks in which file data is read from the
+ * module once RTS/CTS flow control is on.
+ */
+#ifndef MBED_CONF_UBLOX_CELL_DRIVER_GEN_FLOW_CONTROL_FILE_BLOCK_SIZE
+# define MBED_CONF_UBLOX_CELL_DRIVER_GEN_FLOW_CONTROL_FILE_BLOCK_SIZE 4096
+#endif
+
+/** The smallest block that a file read shrinks to after blocks
+ * have come up short.
+ */
+#ifndef MBED_CONF_UBLOX_CELL_DRIVER_GEN_FILE_BLOCK_MIN_SIZE
+# define MBED_CONF_UBLOX_CELL_DRIVER_GEN_FILE_BLOCK_MIN_SIZE 32
+#endif
+
+/** The number of blocks of a file read that must arrive intact in a
+ * row, at the size reached, before the block size is doubled.
+ */
+#ifndef MBED_CONF_UBLOX_CELL_DRIVER_GEN_FILE_BLOCK_GROW_AFTER
+# define MBED_CONF_UBLOX_CELL_DRIVER_GEN_FILE_BLOCK_GROW_AFTER 4
+#endif
+
+/** The number of times a block of a file read that comes up short
+ * is asked for again before the read fails.
+ */
+#ifndef MBED_CONF_UBLOX_CELL_DRIVER_GEN_FILE_BLOCK_RETRIES
+# define MBED_CONF_UBLOX_CELL_DRIVER_GEN_FILE_BLOCK_RETRIES 3
+#endif
+
+/** The number of files in the module's file system whose names, and
+ * sizes once known, are kept in RAM so that fileExists() and fileSize()
+ * can answer without asking the module; 0 to keep none.
+ */
+#ifndef MBED_CONF_UBLOX_CELL_DRIVER_GEN_FILE_INDEX_SIZE
+# define MBED_CONF_UBLOX_CELL_DRIVER_GEN_FILE_INDEX_SIZE 8
+#endif
 
 /** UbloxCellularDriverGen class
  * This interface provide SMS, USSD and
@@ -40,6 +103,487 @@ public:
      */
     ~UbloxCellularDriverGen();
 
+    /**********************************************************************
+     * PUBLIC: Capabilities
+     **********************************************************************/
+
+    /** Features that a module may or may not have.
+     */
+    typedef enum {
+        CAP_FILE_BLOCK_READ = 0x01, //!< +URDBLOCK, used by readFile().
+        CAP_HTTP = 0x02,            //!< +UHTTP and +UHTTPC.
+        CAP_FTP = 0x04,             //!< +UFTP and +UFTPC.
+        CAP_FTP_DIRECT = 0x08,      //!< FTP direct link mode, +UFTPC=6 and 7.
+        CAP_CELL_LOC_TCP = 0x10,    //!< Cell Locate TCP aiding server, +UGSRV.
+        CAP_CELL_LOC_UDP = 0x20     //!< Cell Locate UDP aiding server, +UGAOP.
+    } Capability;
+
+    /** What the module can do.
+     */
+    typedef struct {
+        bool probed;         //!< False until the module has been probed.
+        uint32_t flags;      //!< The CAP_x flags of the features it has.
+        int numHttpProfiles; //!< The number of HTTP profiles usable, 0 if none.
+        char firmware[24];   //!< The firmware version, from +CGMR.
+    } Capabilities;
+
+    /** Initialise the modem, as UbloxCellularBase::init() does, and
+     * then probe what it can do (see probeCapabilities()).
+     *
+     * @param pin the SIM PIN, NULL if there is none or it has
+     *            already been given.
+     * @return    true if the modem was initialised.
+     */
+    bool init(const char *pin = 0);
+
+    /** Find out what the module can do, once, from its type and
+     * firmware version and the test form ("=?") of the command behind
+     * each feature, keeping the answer in a table that the methods of
+     * this class and of derived classes consult, so that a feature the
+     * module lacks fails at once rather than after a timeout.  This is
+     * done by init() or, if the modem was initialised some other way,
+     * e.g. by connect(), by the first method that needs to know.
+     *
+     * @return true if the module has been probed.
+     */
+    bool probeCapabilities();
+
+    /** Get what the module can do.
+     *
+     * @param caps pointer to a place to put the capabilities.
+     * @return     true if the module has been probed, otherwise
+     *             caps->probed is false and every feature is
+     *             assumed to be there.
+     */
+    bool getCapabilities(Capabilities *caps);
+
+    /**********************************************************************
+     * PUBLIC: AT Errors
+     **********************************************************************/
+
+    /** The final result codes with which the module may terminate
+     * an AT command in error.
+     */
+    typedef enum {
+        AT_ERROR_NONE = 0, //!< No error has been reported.
+        AT_ERROR_GENERIC,  //!< "ERROR".
+        AT_ERROR_CME,      //!< "+CME ERROR: <err>", a mobile equipment error.
+        AT_ERROR_CMS,      //!< "+CMS ERROR: <err>", a message service error.
+        AT_ERROR_ABORTED   //!< "ABORTED", the command was aborted.
+    } AtErrorType;
+
+    /** A struct containing an AT error type and code.
+     */
+    typedef struct {
+        AtErrorType eType;
+        int eCode;         //!< the numeric <err> for +CME/+CMS ERROR, else -1.
+    } AtError;
+
+    /** Get the error with which the module terminated the last AT
+     * command sent by the most recent call into this driver.
+     *
+     * Any of these final result codes ends the wait for a response
+     * as soon as it arrives, so a call that fails because the module
+     * has rejected a command (e.g. delFile() on a non-existent file)
+     * returns immediately rather than after the AT timeout.  If the
+     * module reported no error, for instance because the call failed
+     * on a timeout, the type will be AT_ERROR_NONE.
+     *
+     * Note: if +CMEE has been set to verbose mode the module reports
+     * errors as text, in which case eCode will be -1; it is numeric
+     * while numeric result codes are on (see setNumericResultCodes()).
+     *
+     * @return the last AT error.
+     */
+    AtError getLastAtError();
+
+    /** Switch fail fast on or off.
+     *
+     * With fail fast on, the default, an error final result code ends
+     * the wait for a response as soon as it arrives (see
+     * getLastAtError()).  With it off the driver behaves as it did
+     * before it recognised those codes: the code is not recorded and a
+     * failing command waits out the AT timeout.  This is only of use to
+     * measure the difference between the two.
+     *
+     * @param failFast true to return on an error final result code,
+     *                 false to wait for the AT timeout.
+     */
+    void setFailFast(bool failFast);
+
+    /** Return whether fail fast is on.
+     *
+     * @return true if fail fast is on.
+     */
+    bool isFailFastOn();
+
+    /**********************************************************************
+     * PUBLIC: AT Transaction Queue
+     **********************************************************************/
+
+    /* All of the methods of this class that use the AT interface take
+     * turns, by priority class and deadline, through an AT transaction
+     * queue (see UbloxAtQueue).  Short commands take one turn, file
+     * transfers take one turn per block, so that, for instance, an SMS
+     * can be sent between the blocks of a long file read.  The ...Async()
+     * variants queue the work to be done by the driver's transaction
+     * thread and report the result through a callback or through the
+     * transaction, on which the caller may wait().
+     *
+     * Note: the callback of an ...Async() method is called from the
+     * driver's transaction thread and must not wait on another
+     * transaction.
+     *
+     * Waiting threads are given turns in order of arrival within their
+     * priority class, and anything that has waited for longer than
+     * the maximum wait goes first, so that no caller waits forever.
+     * A file read done while a turn is already held, e.g. that of the
+     * response to httpCommand(), gives the turn to waiting threads
+     * between blocks once it has been held for longer than the
+     * maximum hold.
+     */
+
+    /** Set the maximum wait and hold times of the AT transaction
+     * queues, by default ublox-cell-driver-gen.at-queue-max-wait-ms
+     * and ublox-cell-driver-gen.at-queue-max-hold-ms.
+     *
+     * @param maxWaitMs how long a caller may wait for a turn before
+     *                  going ahead of all priority classes, 0 for
+     *                  no limit.
+     * @param maxHoldMs how long a turn may be held across the blocks
+     *                  of a file read before waiting callers go
+     *                  first, 0 for no limit.
+     */
+    void setAtQueueLimits(int maxWaitMs, int maxHoldMs);
+
+    /**********************************************************************
+     * PUBLIC: AT Statistics
+     **********************************************************************/
+
+    /** Get the counters and latency histogram for a family of AT
+     * commands (see UbloxAtStats).
+     *
+     * @param family   the AT command family.
+     * @param counters a place to put the counters.
+     * @return         true if successful, false if family is not
+     *                 valid or the statistics have been compiled out
+     *                 (MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_STATS is 0).
+     */
+    bool getAtStats(UbloxAtStats::AtFamily family, UbloxAtStats::Counters *counters);
+
+    /** Get the number of times callers have waited for their turn on
+     * the AT interface and the histogram of how long they waited.
+     *
+     * @param counters a place to put the counters.
+     * @return         true if successful, false if the statistics
+     *                 have been compiled out.
+     */
+    bool getAtWaitStats(UbloxAtStats::Counters *counters);
+
+    /** Get the number of times callers have waited for a state lock,
+     * e.g. that of the HTTP profiles in UbloxATCellularInterfaceExt,
+     * and the histogram of how long they waited.  State locks are
+     * held only while state is copied, never for an AT transaction,
+     * so these waits should be short.
+     *
+     * @param counters a place to put the counters.
+     * @return         true if successful, false if the statistics
+     *                 have been compiled out.
+     */
+    bool getStateWaitStats(UbloxAtStats::Counters *counters);
+
+    /** Get the counters for the blocks of file reads: how many came
+     * up short and were asked for again, how the block size has moved
+     * and the throughput, for tuning the block size (see
+     * MBED_CONF_UBLOX_CELL_DRIVER_GEN_FILE_BLOCK_MIN_SIZE and its
+     * neighbours) to the module, baud rate and board at a site.
+     *
+     * @param counters a place to put the counters.
+     * @return         true if successful, false if the statistics
+     *                 have been compiled out.
+     */
+    bool getFileReadStats(UbloxAtStats::FileReadCounters *counters);
+
+    /** Set all of the AT statistics back to zero.
+     */
+    void resetAtStats();
+
+    /**********************************************************************
+     * PUBLIC: AT Timeouts
+     **********************************************************************/
+
+    /** Get the latency estimate and timeout learnt for a family of AT
+     * commands (see UbloxAtTimeouts).  The driver learns how much
+     * longer the data of a +URDBLOCK takes than the block should
+     * take at the baud rate and how long the answer to a +CUSD,
+     * +UHTTPC or +UFTPC takes, using the timeouts it learns in place
+     * of fixed ones; for HTTP and FTP this is so unless a timeout has
+     * been set with httpSetTimeout() or ftpSetTimeout().
+     *
+     * @param family   the AT command family.
+     * @param estimate a place to put the estimate.
+     * @return         true if successful, false if family is not
+     *                 valid or adaptive timeouts have been compiled out
+     *                 (MBED_CONF_UBLOX_CELL_DRIVER_GEN_ADAPTIVE_TIMEOUTS
+     *                 is 0).
+     */
+    bool getAtTimeout(UbloxAtStats::AtFamily family, UbloxAtTimeouts::Estimate *estimate);
+
+    /** Set the bounds within which the timeout of a family of AT
+     * commands is kept.
+     *
+     * @param family the AT command family.
+     * @param minMs  the shortest timeout in milliseconds, at least 1.
+     * @param maxMs  the longest timeout in milliseconds, at least minMs.
+     * @return       true if successful, false if a parameter is not
+     *               valid or adaptive timeouts have been compiled out.
+     */
+    bool setAtTimeoutBounds(UbloxAtStats::AtFamily family, int minMs, int maxMs);
+
+    /** Forget the latencies measured so far, going back to the
+     * fixed timeouts until they have been measured again.
+     */
+    void resetAtTimeouts();
+
+    /**********************************************************************
+     * PUBLIC: Trace
+     **********************************************************************/
+
+    /** Read the driver's event trace (see UbloxTrace), oldest first.
+     *
+     * @param entries    a place to put the events.
+     * @param maxEntries the number of events there is room for.
+     * @return           the number of events read, 0 if the trace
+     *                   has been compiled out
+     *                   (MBED_CONF_UBLOX_CELL_DRIVER_GEN_TRACE is 0).
+     */
+    int getTrace(UbloxTrace::Entry *entries, int maxEntries);
+
+    /** Print the driver's event trace, oldest first; run the output
+     * through ublox-cellular-driver-gen/host/trace_decoder to read it.
+     */
+    void printTrace();
+
+    /** Empty the driver's event trace.
+     */
+    void clearTrace();
+
+    /**********************************************************************
+     * PUBLIC: Baud Rate
+     **********************************************************************/
+
+    /** Change the baud rate of the serial port to the module, at both
+     * ends, using AT+IPR, and check that the new rate works by reading
+     * the module's IMEI several times over; if it does not, go back to
+     * the rate in use before.  The change is not stored in the module's
+     * profile, so the module will be back at its default rate when it
+     * is next powered on.
+     *
+     * Note: init() should be called before this method can be used.
+     *
+     * @param baud the baud rate to change to.
+     * @return     true if the module is now running reliably at
+     *             baud, otherwise false.
+     */
+    bool setBaud(int baud);
+
+    /** Find the fastest baud rate at which the module works reliably:
+     * each rate that is higher than the current one is tried in turn
+     * with setBaud() until one works.  The rate that results is used
+     * for all of the driver's timing calculations, e.g. how long to
+     * wait for a block of file data.
+     *
+     * Note: init() should be called before this method can be used.
+     *
+     * @param rates    the rates to try, fastest first, NULL for a
+     *                 default list (921600, 460800, 230400).
+     * @param numRates the number of entries at rates.
+     * @return         the baud rate in use afterwards.
+     */
+    int negotiateBaud(const int *rates = NULL, int numRates = 0);
+
+    /** Return the baud rate in use.
+     *
+     * @return the baud rate.
+     */
+    int getBaud();
+
+    /**********************************************************************
+     * PUBLIC: Serial Flow Control
+     **********************************************************************/
+
+    /** Switch RTS/CTS hardware flow control on the serial port to the
+     * module on or off, at both ends.  Without flow control the
+     * module's file data has to be read in blocks small enough to fit
+     * in the serial receive buffer (see FILE_BUFFER_SIZE); with it the
+     * module waits while the buffer is full, so readFile() and HTTP
+     * responses are read in blocks of flow-control-file-block-size
+     * bytes and large FTP directory listings arrive intact.
+     *
+     * Note: init() should be called before this method can be used
+     * and RTS/CTS must be wired between the MCU and the module.
+     *
+     * @param enable true to switch flow control on, false to switch
+     *               it off.
+     * @param rts    the MCU pin that is the RTS output to the module.
+     * @param cts    the MCU pin that is the CTS input from the module.
+     * @return       true if successful, otherwise false.
+     */
+    bool setFlowControl(bool enable, PinName rts = MDMRTS, PinName cts = MDMCTS);
+
+    /** Return whether RTS/CTS flow control is on.
+     *
+     * @return true if flow control is on.
+     */
+    bool isFlowControlOn();
+
+    /**********************************************************************
+     * PUBLIC: Result Codes
+     **********************************************************************/
+
+    /** Switch the module between verbose result codes, e.g. "OK" or
+     * "+CME ERROR: operation not allowed", and numeric ones, e.g. "0"
+     * or "+CME ERROR: 3", on every AT channel.  With numeric result
+     * codes (ATE0V0, AT+CMEE=1) information text loses the line break
+     * in front of it and each final result code is a single digit,
+     * so a response has fewer characters to send and fewer for the AT
+     * parser to match; this adds up over many short transactions, e.g.
+     * the blocks of readFile() or a batch of HTTP parameters.  The
+     * setting is kept across cmuxStart() and cmuxStop().
+     *
+     * Note: init() should be called before this method can be used.
+     * The methods of the base classes, i.e. init() itself, connect(),
+     * disconnect() and the socket API of UbloxATCellularInterface,
+     * wait for verbose result codes, so numeric result codes should
+     * be switched off before any of those is used.
+     *
+     * @param numeric true for numeric result codes, false for
+     *                verbose ones.
+     * @return        true if successful, otherwise false.
+     */
+    bool setNumericResultCodes(bool numeric);
+
+    /** Return whether numeric result codes are on.
+     *
+     * @return true if numeric result codes are on.
+     */
+    bool isNumericResultCodesOn();
+
+    /**********************************************************************
+     * PUBLIC: Multiplexer
+     **********************************************************************/
+
+    /** The channels into which the serial port to the module is
+     * divided while the 27.010 multiplexer is on.  With it off all
+     * of them are the serial port itself.
+     */
+    typedef enum {
+        AT_CHANNEL_CONTROL = 0, //!< DLC 1: AT commands, including those of the base classes.
+        AT_CHANNEL_URC,         //!< DLC 2: read only by the URC thread.
+        AT_CHANNEL_DATA,        //!< DLC 3: bulk transfers, e.g. readFile().
+        MAX_NUM_AT_CHANNELS
+    } AtChannel;
+
+    /** Switch on the 3GPP 27.010 multiplexer (AT+CMUX), dividing the
+     * serial port to the module into a channel for AT commands, one
+     * for URCs and one for bulk transfers (see UbloxCmux).  Each channel
+     * has its own AT parser and bulk transfers take turns on the data
+     * channel separately from everything else, so a long readFile()
+     * no longer holds up, for instance, smsSend() or a registration
+     * check.
+     *
+     * Note: init() should be called before this method can be used.
+     * The baud rate and flow control cannot be changed while the
+     * multiplexer is on.  URCs that base classes hand directly to
+     * their AT parser, i.e. those of the socket API of
+     * UbloxATCellularInterface, are not seen on the channels, so
+     * sockets should not be used while the multiplexer is on.
+     *
+     * @return true if successful, otherwise false.
+     */
+    bool cmuxStart();
+
+    /** Switch the multiplexer off, returning the module to AT
+     * commands on the serial port.
+     *
+     * @return true if successful, false if the multiplexer was
+     *         not on.
+     */
+    bool cmuxStop();
+
+    /** Return whether the multiplexer is on.
+     *
+     * @return true if the multiplexer is on.
+     */
+    bool isCmuxOn();
+
+    /**********************************************************************
+     * PUBLIC: Transcript
+     **********************************************************************/
+
+    /** Start recording a transcript of everything that passes over the
+     * serial port to the module, with timings (see UbloxTranscript), so
+     * that a session can be replayed on a PC by
+     * ublox-cellular-driver-gen/host/transcript_replay.
+     *
+     * Note: the multiplexer must be off when recording starts and
+     * when it stops; it may be switched on and off in between, in
+     * which case the frames are recorded.  While recording, as while
+     * the multiplexer is on, URCs that base classes hand directly to
+     * their AT parser, i.e. those of the socket API of
+     * UbloxATCellularInterface, are not seen.
+     *
+     * @param buf  the buffer to record into, which must stay valid
+     *             until the transcript has been read or printed.
+     * @param size the size of buf.
+     * @return     true if recording started, false if it could not
+     *             or if transcripts have been compiled out
+     *             (MBED_CONF_UBLOX_CELL_DRIVER_GEN_TRANSCRIPT is 0).
+     */
+    bool transcriptStart(void *buf, int size);
+
+    /** Stop recording a transcript.
+     *
+     * @return true if successful, false if no transcript was
+     *         being recorded or the multiplexer is on.
+     */
+    bool transcriptStop();
+
+    /** Return whether a transcript is being recorded.
+     *
+     * @return true if a transcript is being recorded.
+     */
+    bool isTranscriptOn();
+
+    /** Read the records of the last transcript, oldest first.
+     *
+     * @param records    a place to put the records.
+     * @param maxRecords the number of records there is room for.
+     * @return           the number of records read.
+     */
+    int getTranscript(UbloxTranscript::Record *records, int maxRecords);
+
+    /** Print the last transcript, for transcript_replay to read
+     * from a capture of the console.
+     */
+    void printTranscript();
+
+    /**********************************************************************
+     * PUBLIC: AT Command Batching
+     **********************************************************************/
+
+    /** Send a batch of parameter-setting AT commands (see UbloxAtBatch),
+     * as many to a line as will fit, separated by ';', so that the
+     * module answers each line with a single "OK".  If the module
+     * rejects a line then the commands on it are sent again one at
+     * a time, stopping at the first that fails, so that the error
+     * reported by getLastAtError() is that of the failing command.
+     *
+     * @param batch the batch of commands.
+     * @return      true if every command succeeded, otherwise false.
+     */
+    bool atBatchSend(UbloxAtBatch *batch);
+
     /**********************************************************************
      * PUBLIC: Short Message Service
      **********************************************************************/
@@ -95,6 +639,29 @@ public:
      * @return    true if successful, false otherwise.
      */
     bool smsSend(const char* num, const char* buf);
+
+    /** Send a message to a recipient without waiting.
+     *
+     * @param transaction the transaction, which must remain valid
+     *                    until it has completed; its result is 0 on
+     *                    success, otherwise negative.
+     * @param num         the phone number of the recipient; must remain
+     *                    valid until the transaction has completed.
+     * @param buf         the content of the message, null terminated;
+     *                    must remain valid until the transaction has
+     *                    completed.
+     * @param priority    the priority class of the transaction.
+     * @param deadlineMs  the time, in milliseconds from now, by which the
+     *                    message must have been sent, AT_QUEUE_NO_DEADLINE
+     *                    for no deadline.
+     * @param done        callback with the result, may be NULL.
+     * @return            true if the transaction was queued.
+     */
+    bool smsSendAsync(UbloxAtQueue::Transaction *transaction,
+                      const char* num, const char* buf,
+                      UbloxAtQueue::AtPriority priority = UbloxAtQueue::AT_PRIORITY_HIGH,
+                      int deadlineMs = AT_QUEUE_NO_DEADLINE,
+                      Callback<void(int)> done = NULL);
     
     /**********************************************************************
      * PUBLIC: Unstructured Supplementary Service Data
@@ -151,6 +718,30 @@ public:
      * @return the number of bytes written.
      */
     int writeFile(const char* filename, const char* buf, int len);
+
+    /** Write some data to a file in the module's local file system
+     * without waiting.
+     *
+     * @param transaction the transaction, which must remain valid until
+     *                    it has completed; its result is the number of
+     *                    bytes written, negative on failure.
+     * @param filename    the name of the file; must remain valid until
+     *                    the transaction has completed.
+     * @param buf         the data to write; must remain valid until
+     *                    the transaction has completed.
+     * @param len         the size of the data to write.
+     * @param priority    the priority class of the transaction.
+     * @param deadlineMs  the time, in milliseconds from now, by which the
+     *                    write must be complete, AT_QUEUE_NO_DEADLINE
+     *                    for no deadline.
+     * @param done        callback with the result, may be NULL.
+     * @return            true if the transaction was queued.
+     */
+    bool writeFileAsync(UbloxAtQueue::Transaction *transaction,
+                        const char* filename, const char* buf, int len,
+                        UbloxAtQueue::AtPriority priority = UbloxAtQueue::AT_PRIORITY_LOW,
+                        int deadlineMs = AT_QUEUE_NO_DEADLINE,
+                        Callback<void(int)> done = NULL);
     
     /** Read a file from the module's local file system.
      *
@@ -159,87 +750,888 @@ public:
      * @param  filename the name of the file
      * @param  buf a buffer to hold the data
      * @param  len the size to read
-     * @return the number of bytes read
+     * @param  token a cancel token, checked before each block is read,
+     *         may be NULL
+     * @return the number of bytes read, AT_QUEUE_CANCELLED or
+     *         AT_QUEUE_DEADLINE if stopped by the token, otherwise
+     *         negative on failure
     */
-    int readFile(const char* filename, char* buf, int len);
+    int readFile(const char* filename, char* buf, int len,
+                 UbloxCancelToken *token = NULL);
+
+    /** Read a file from the module's local file system without waiting.
+     * To be able to cancel the read, give the transaction a cancel
+     * token with UbloxAtQueue::Transaction::setCancelToken() first.
+     *
+     * @param transaction the transaction, which must remain valid until
+     *                    it has completed; its result is the number of
+     *                    bytes read, negative on failure.
+     * @param filename    the name of the file; must remain valid until
+     *                    the transaction has completed.
+     * @param buf         a buffer to hold the data.
+     * @param len         the size to read.
+     * @param priority    the priority class of the transaction.
+     * @param deadlineMs  the time, in milliseconds from now, by which the
+     *                    read must be complete, AT_QUEUE_NO_DEADLINE
+     *                    for no deadline.
+     * @param done        callback with the result, may be NULL.
+     * @return            true if the transaction was queued.
+     */
+    bool readFileAsync(UbloxAtQueue::Transaction *transaction,
+                       const char* filename, char* buf, int len,
+                       UbloxAtQueue::AtPriority priority = UbloxAtQueue::AT_PRIORITY_LOW,
+                       int deadlineMs = AT_QUEUE_NO_DEADLINE,
+                       Callback<void(int)> done = NULL);
     
+    /** Read a file from the module's local file system a block at
+     * a time, handing each block to a sink, e.g. one that writes it
+     * to flash, feeds a parser or sends it on a socket, so that only
+     * one block need be held in RAM however large the file.  The sink
+     * is called with the AT channel unlocked, so it may itself use
+     * this driver.
+     *
+     * Note: init() should be called before this method can be used.
+     *
+     * @param  filename  the name of the file.
+     * @param  sink      called with each block and its length in
+     *                   turn; returns false to stop the read.
+     * @param  block     a buffer to hold a block.
+     * @param  blockSize the size of block, which limits the size of
+     *                   the blocks read.
+     * @param  token     a cancel token, checked before each block is
+     *                   read, may be NULL.
+     * @return the number of bytes handed to the sink, AT_QUEUE_CANCELLED
+     *         or AT_QUEUE_DEADLINE if stopped by the token, otherwise
+     *         negative on failure.
+     */
+    int readFile(const char* filename, Callback<bool(const char *, int)> sink,
+                 char* block, int blockSize, UbloxCancelToken *token = NULL);
+
+    /** Read a file from the module's local file system a block at a
+     * time, handing each block to a sink, without waiting.  The sink
+     * is called by the thread of the AT queue.
+     *
+     * @param transaction the transaction, which must remain valid until
+     *                    it has completed; its result is the number of
+     *                    bytes handed to the sink, negative on failure.
+     * @param filename    the name of the file; must remain valid until
+     *                    the transaction has completed.
+     * @param sink        called with each block and its length in
+     *                    turn; returns false to stop the read.
+     * @param block       a buffer to hold a block; must remain valid
+     *                    until the transaction has completed.
+     * @param blockSize   the size of block.
+     * @param priority    the priority class of the transaction.
+     * @param deadlineMs  the time, in milliseconds from now, by which the
+     *                    read must be complete, AT_QUEUE_NO_DEADLINE
+     *                    for no deadline.
+     * @param done        callback with the result, may be NULL.
+     * @return            true if the transaction was queued.
+     */
+    bool readFileAsync(UbloxAtQueue::Transaction *transaction,
+                       const char* filename, Callback<bool(const char *, int)> sink,
+                       char* block, int blockSize,
+                       UbloxAtQueue::AtPriority priority = UbloxAtQueue::AT_PRIORITY_LOW,
+                       int deadlineMs = AT_QUEUE_NO_DEADLINE,
+                       Callback<void(int)> done = NULL);
+
+    /** Read part of a file from the module's local file system,
+     * starting at a given offset, e.g. the tail of a log or one record
+     * of a large HTTP response, without reading what comes before it.
+     *
+     * Note: init() should be called before this method can be used.
+     *
+     * @param  filename the name of the file.
+     * @param  offset   the offset in the file at which to start.
+     * @param  buf      a buffer to hold the data.
+     * @param  len      the size to read.
+     * @param  token    a cancel token, checked before each block is
+     *                  read, may be NULL.
+     * @return the number of bytes read, fewer than len where the file
+     *         ends first, 0 if offset is at or beyond the end of the
+     *         file, AT_QUEUE_CANCELLED or AT_QUEUE_DEADLINE if stopped
+     *         by the token, otherwise negative on failure.
+     */
+    int readFileRange(const char* filename, int offset, char* buf, int len,
+                      UbloxCancelToken *token = NULL);
+
     /** Retrieve the file size from the module's local file system.
+     * A size already in the file index is returned without asking the
+     * module, as is the failure for a file the index knows isn't there,
+     * in which case getLastAtError() is left as it was.
      *
      * Note: init() should be called before this method can be used.
      *
      * @param  filename the name of the file.
-     * @return the file size in bytes.
+     * @return the file size in bytes, negative on failure.
      */
     int fileSize(const char* filename);
-    
+
+    /** Find out whether a file exists in the module's local file
+     * system.  The file index answers if it can; if it can't, and the
+     * module's file list hasn't been read into it since it was last
+     * invalidated, the list is read with AT+ULSTFILE=0, and if that
+     * still doesn't settle it the module is asked for the size of the
+     * file.
+     *
+     * The file index holds the names of the files in the module's
+     * file system, up to MBED_CONF_UBLOX_CELL_DRIVER_GEN_FILE_INDEX_SIZE
+     * of them, and their sizes once fileSize() has found them.  It is
+     * kept up to date by writeFile(), delFile() and, in
+     * UbloxATCellularInterfaceExt, by the HTTP and FTP commands that
+     * write files.
+     *
+     * Note: init() should be called before this method can be used.
+     *
+     * @param  filename the name of the file.
+     * @return true if the file exists, false if it doesn't or the
+     *         module couldn't say.
+     */
+    bool fileExists(const char* filename);
+
+    /** Forget everything in the file index, e.g. after the module's
+     * file system has been changed by something other than this
+     * driver; init() does this too.
+     */
+    void invalidateFileIndex();
+
+    /** A cursor for reading a file in the module's local file system
+     * in order, or from wherever it is moved to, a range at a time.
+     * The size of the file is found once, by the first read, rather
+     * than on every read, so a file that changes while it is being
+     * read should be read with a new cursor.  A cursor may be used
+     * by one thread at a time.
+     */
+    class FileCursor {
+    public:
+        /** Constructor; talks to nothing.
+         *
+         * @param driver   the driver whose module holds the file.
+         * @param filename the name of the file; must remain valid
+         *                 for as long as the cursor is used.
+         */
+        FileCursor(UbloxCellularDriverGen *driver, const char *filename);
+
+        /** Read from the file at the cursor and move the cursor
+         * on by the amount read.
+         *
+         * @param buf   a buffer to hold the data.
+         * @param len   the size to read.
+         * @param token a cancel token, checked before each block
+         *              is read, may be NULL.
+         * @return      the number of bytes read, 0 at the end of
+         *              the file, otherwise as readFileRange().
+         */
+        int read(char *buf, int len, UbloxCancelToken *token = NULL);
+
+        /** Move the cursor.
+         *
+         * @param offset the offset in the file to move to; may be
+         *               beyond the end, where read() returns 0.
+         * @return       true if successful, false if offset is
+         *               negative.
+         */
+        bool seek(int offset);
+
+        /** Return where the cursor is.
+         *
+         * @return the offset in the file.
+         */
+        int tell();
+
+        /** Return the size of the file, finding it if no read
+         * has yet done so.
+         *
+         * @return the size of the file, negative on failure.
+         */
+        int size();
+
+    protected:
+        UbloxCellularDriverGen *_driver;
+        const char *_filename;
+        int _offset;
+        int _size;
+    };
+
 protected:
 
     /**********************************************************************
-     * PROTECTED: Short Message Service
+     * PROTECTED: URC Thread
      **********************************************************************/
 
-    /** The number type for telephone numbers without a + on the front
+    /** Event flag: the serial port has received characters.
      */
-    #define TYPE_OF_ADDRESS_NATIONAL 129
+    #define URC_EVENT_RX    0x01
 
-    /** The number type for telephone numbers with a + on the front
+    /** Event flag: a USSD or supplementary services response has arrived.
      */
-    #define TYPE_OF_ADDRESS_INTERNATIONAL 145
+    #define URC_EVENT_USSD  0x02
 
-    /** Convert a #define to a string
+    /** The thread that reads URCs from the module whenever the
+     * AT channel is not otherwise in use.
      */
-    #define stringify(a) str(a)
-    #define str(a) #a
+    Thread _urcThread;
 
-    /** Place to store the index of an SMS message.
+    /** Set to false to make the URC thread exit.
      */
-    int *_userSmsIndex;
+    volatile bool _urcThreadRunning;
 
-    /** The number of SMS message being returned to the user.
+    /** Event flags, set by the serial port and by URC handlers, so
+     * that callers waiting for a URC are woken as soon as it arrives.
      */
-    int _userSmsNum;
+    EventFlags _urcEvents;
 
-    /** The number of SMS messages stored in the module.
+    /** The body of the URC thread: whenever characters arrive and
+     * nobody else is using the AT channel, pass them through the URC
+     * dispatcher so that any URCs among them are handled.
      */
-    int _smsCount;
+    void urcThreadMain();
 
-    /** Temporary storage for an SMS message.
+    /** Pass the lines waiting on an AT channel through the URC
+     * dispatcher, a line at a time, until none is waiting.  Takes
+     * the AT channel lock, and the channel, for each line: do not
+     * hold either when calling.
+     *
+     * @param channel the channel.
      */
-    char _smsBuf[SMS_BUFFER_SIZE];
+    void urcRead(AtChannel channel);
 
-    /** URC for Short Message listing.
+    /** Callback from the serial port when characters are received.
      */
-    void CMGL_URC();
+    void urcThreadSignal();
 
-    /** URC for new SMS messages.
+    /** Wait for one or more URC_EVENT_x flags to be set, releasing
+     * the AT channel lock and any turn on the AT interface while waiting
+     * so that the URC thread can dispatch the URC and other threads
+     * can use the AT channel.
+     * The flags waited for are cleared.  NOTE: LOCK() before calling.
+     *
+     * @param events    the URC_EVENT_x flags to wait for.
+     * @param timeoutMs the maximum time to wait in milliseconds,
+     *                  negative to wait forever.
+     * @param token     a cancel token which, when cancelled or at its
+     *                  deadline, ends the wait; may be NULL.
+     * @return          the flags that were set, 0 on timeout or if
+     *                  the token has expired.
      */
-    void CMTI_URC();
+    uint32_t waitUrcEvents(uint32_t events, int timeoutMs,
+                           UbloxCancelToken *token = NULL);
 
     /**********************************************************************
-     * PROTECTED: Unstructured Supplementary Service Data
+     * PROTECTED: AT Transaction Queue
      **********************************************************************/
 
-    /** A buffer for the string assembled from the URC.
+    /** Take a turn on the AT interface and then the AT channel lock.
+     * NOTE: this takes _mtx directly since LOCK() opens a block
+     * which only UNLOCK() closes.
      */
-    char * _ssUrcBuf;
+    #define AT_LOCK(priority) do { _atQueue.acquire(UbloxAtQueue::priority); _mtx.lock(); } while (0)
 
-    /** URC for call waiting.
+    /** Release the AT channel lock and the turn on the AT interface.
      */
-    void CCWA_URC();
+    #define AT_UNLOCK() do { _mtx.unlock(); _atQueue.release(); } while (0)
 
-    /** URC for call forwarding.
+    /** The AT transaction queue.
      */
-    void CCFC_URC();
+    UbloxAtQueue _atQueue;
 
-    /** URC for calling lined ID restriction.
+    /** If the calling thread has held its turn on the AT interface
+     * for longer than the maximum hold while others wait, give it up
+     * and take it back, so that they go first.  NOTE: to be called
+     * between the steps of a transaction with no channel locked but
+     * for the AT channel lock taken by any outer AT_LOCK().
+     *
+     * @param depth the nesting depth of the turn that the current
+     *              step has taken, 0 if it took none.
      */
-    void CLIR_URC();
+    void yieldAtLock(int depth);
 
-    /** URC for calling lined ID presentation.
+    /**********************************************************************
+     * PROTECTED: State Locks
+     **********************************************************************/
+
+    /* The AT channel lock, _mtx of the base class as taken by LOCK()
+     * and AT_LOCK(), covers only transactions on the wire: the AT
+     * parsers, the URC handlers they call and whatever those share
+     * only with the thread waiting on the transaction, e.g. the
+     * indexes gathered by smsList().  Where a transaction lets go of
+     * the AT channel lock to wait for a URC, e.g. ussdCommand() or
+     * ftpCommand() of UbloxATCellularInterfaceExt, what it shares
+     * with the URC handler is covered by a lock of the operation,
+     * taken before the AT channel lock and held throughout.
+     * State that is read or changed without talking to the module,
+     * e.g. the settings returned by isCmuxOn() or the HTTP profiles
+     * of UbloxATCellularInterfaceExt, has a state lock of its own,
+     * held only while the state is copied in or out, so that getting
+     * at it never waits for a transaction:
+     *
+     *     stateLock(&_stateMtx);
+     *     on = (_cmux != NULL);
+     *     stateUnlock(&_stateMtx);
+     *
+     * A state lock may be taken while holding the AT channel lock,
+     * e.g. by a URC handler, but not the other way around.
      */
-    void CLIP_URC();
 
-    /** URC for connected lined ID restriction.
+    /** The state lock of the driver itself: the last AT error and the
+     * settings returned by getBaud(), isFlowControlOn(),
+     * isNumericResultCodesOn(), isCmuxOn() and isTranscriptOn(), which
+     * are changed under the AT channel lock and this lock together.
+     */
+    Mutex _stateMtx;
+
+    /** Take a state lock, counting any wait in the AT statistics.
+     *
+     * @param mtx the state lock.
+     */
+    void stateLock(Mutex *mtx);
+
+    /** Release a state lock.
+     *
+     * @param mtx the state lock.
+     */
+    void stateUnlock(Mutex *mtx);
+
+    /**********************************************************************
+     * PROTECTED: Multiplexer
+     **********************************************************************/
+
+    /* Work on the data channel takes turns through its own queue
+     * and is done under its own lock, rather than the AT channel lock,
+     * so that it runs alongside work on the control channel:
+     *
+     *     ATCmdParser *at;
+     *     atQueue(AT_CHANNEL_DATA)->acquire();
+     *     channelLock(AT_CHANNEL_DATA);
+     *     at = atChannel(AT_CHANNEL_DATA);
+     *     ...
+     *     channelUnlock(AT_CHANNEL_DATA);
+     *     atQueue(AT_CHANNEL_DATA)->release();
+     *
+     * Transactions do the same by being run on atQueue(channel) with
+     * steps that lock the channel.  While the multiplexer is off all
+     * of this comes down to the AT transaction queue, the AT channel lock
+     * and _at.  Code on the data channel may take a turn on the
+     * control channel, e.g. to call fileSize(), but not the other
+     * way around.
+     */
+
+    /** The multiplexer, NULL while it is off.
+     */
+    UbloxCmux *_cmux;
+
+    /** The AT parser on the serial port, while the multiplexer is on
+     * and _at is the AT parser of the control channel.
+     */
+    ATCmdParser *_uartAt;
+
+    /** The serial port as the AT parsers see it: _fh, or the
+     * transcript while one is being recorded.
+     */
+    FileHandle *_serialFh;
+
+    /** The AT parser of each channel.
+     */
+    ATCmdParser *_channelAt[MAX_NUM_AT_CHANNELS];
+
+    /** The file handle under the AT parser of each channel.
+     */
+    FileHandle *_channelFh[MAX_NUM_AT_CHANNELS];
+
+    /** The AT transaction queue of the data channel.
+     */
+    UbloxAtQueue _atDataQueue;
+
+    /** The lock of the data channel.
+     */
+    Mutex _dataMtx;
+
+    /** Return the AT parser of a channel.  NOTE: lock the
+     * channel before calling.
+     *
+     * @param channel the channel.
+     * @return        the AT parser.
+     */
+    ATCmdParser *atChannel(AtChannel channel);
+
+    /** Return the AT transaction queue through which turns
+     * are taken on a channel.
+     *
+     * @param channel the channel.
+     * @return        the queue.
+     */
+    UbloxAtQueue *atQueue(AtChannel channel);
+
+    /** Lock a channel: the data channel has its own lock while
+     * the multiplexer is on, otherwise this is the AT channel lock.
+     *
+     * @param channel the channel.
+     */
+    void channelLock(AtChannel channel);
+
+    /** Unlock a channel.
+     *
+     * @param channel the channel.
+     */
+    void channelUnlock(AtChannel channel);
+
+    /**********************************************************************
+     * PROTECTED: AT Commands
+     **********************************************************************/
+
+    /** Start an AT command on a channel, written by UbloxAtCommand
+     * straight to the file handle under the AT parser of the channel
+     * rather than through the printf() of ATCmdParser::send(), e.g.:
+     *
+     *     AT_COMMAND(AT_CHANNEL_CONTROL).literal("AT+CMGD=").number(index).send() &&
+     *     _at->recv("OK")
+     *
+     * NOTE: lock the channel before starting.
+     */
+    #define AT_COMMAND(channel) UbloxAtCommand(_channelFh[channel], _at_timeout, _debug_trace_on)
+
+    /**********************************************************************
+     * PROTECTED: Result Codes
+     **********************************************************************/
+
+    /** The final result code "OK" as ATCmdParser::recv() should look
+     * for it, the whole line in either form so that a "0" at the start
+     * of information text is not taken for it, e.g.:
+     *
+     *     _at->recv(AT_OK)
+     */
+    #define AT_OK (_numericResultCodes ? "0\n" : "OK\n")
+
+    /** The final result code "ERROR" with numeric result codes.
+     */
+    #define AT_NUMERIC_ERROR "4\n"
+
+    /** True if the module has been set to numeric result codes.
+     */
+    bool _numericResultCodes;
+
+    /** Set the result codes of the module on one AT channel.
+     *
+     * NOTE: lock the channel before calling this.
+     *
+     * @param channel the channel.
+     * @param numeric true for numeric result codes, false for
+     *                verbose ones.
+     * @return        true if successful, otherwise false.
+     */
+    bool setResultCodes(AtChannel channel, bool numeric);
+
+    /**********************************************************************
+     * PROTECTED: Baud Rate
+     **********************************************************************/
+
+    /** The number of times the IMEI is read to check a baud rate.
+     */
+    #define BAUD_PROBE_ITERATIONS 5
+
+    /** The AT timeout while checking a baud rate, in milliseconds.
+     */
+    #define BAUD_PROBE_TIMEOUT_MS 1000
+
+    /** The time, in milliseconds, to allow the module to change rate.
+     */
+    #define BAUD_CHANGE_DELAY_MS 100
+
+    /** The baud rate in use.
+     */
+    int _baud;
+
+    /** The time that characters take on the wire at the baud rate
+     * in use, counting eight bits to a character.
+     *
+     * @param numChars the number of characters.
+     * @return         the time in milliseconds, rounded down.
+     */
+    int wireTimeMs(int numChars);
+
+    /** Tell the module to change baud rate and then follow it.
+     * NOTE: LOCK() before calling.
+     *
+     * @param baud the baud rate to change to.
+     * @return     true if the module accepted the change.
+     */
+    bool changeBaud(int baud);
+
+    /** Check that the module responds correctly at the current
+     * baud rate by reading its IMEI several times over.
+     * NOTE: LOCK() before calling.
+     *
+     * @param imei the IMEI to compare with, or an empty
+     *             string, in which case the IMEI that is read
+     *             is stored there; room for 16 characters.
+     * @return     true if every read succeeded and matched.
+     */
+    bool baudProbe(char *imei);
+
+    /**********************************************************************
+     * PROTECTED: AT Command Batching
+     **********************************************************************/
+
+    /** The longest line, excluding the "AT" prefix, that atBatchSend()
+     * will build from more than one command; this need only be within
+     * what the module accepts on a line.
+     */
+    #define AT_BATCH_MAX_LINE_LENGTH MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_BATCH_MAX_LINE_LENGTH
+
+    /**********************************************************************
+     * PROTECTED: AT Statistics
+     **********************************************************************/
+
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_AT_STATS
+    /** The AT statistics.
+     */
+    UbloxAtStats _atStats;
+
+    /** Start timing an operation; once per function.
+     */
+    #define AT_STATS_START() uint32_t atStatsStartUs = _atStats.now()
+
+    /** Finish timing an operation.
+     */
+    #define AT_STATS_END(family, success, timedOut, bytes) \
+        _atStats.record(UbloxAtStats::family, atStatsStartUs, success, timedOut, bytes)
+
+    /** Record a block of a file read, timed from AT_STATS_START().
+     */
+    #define AT_STATS_FILE_BLOCK(blockSize, intact, retry, failed, nextBlockSize) \
+        _atStats.recordFileBlock(atStatsStartUs, blockSize, intact, retry, failed, nextBlockSize)
+#else
+    #define AT_STATS_START()
+    #define AT_STATS_END(family, success, timedOut, bytes)
+    #define AT_STATS_FILE_BLOCK(blockSize, intact, retry, failed, nextBlockSize)
+#endif
+
+    /** True if the last AT command on a channel failed without the
+     * module reporting an error, i.e. it timed out.
+     */
+    #define AT_CHANNEL_TIMED_OUT(channel) (_channelAtError[channel].eType == AT_ERROR_NONE)
+
+    /** True if the last AT command on the control channel failed
+     * without the module reporting an error, i.e. it timed out.
+     */
+    #define AT_TIMED_OUT() AT_CHANNEL_TIMED_OUT(AT_CHANNEL_CONTROL)
+
+    /**********************************************************************
+     * PROTECTED: AT Timeouts
+     **********************************************************************/
+
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_ADAPTIVE_TIMEOUTS
+    /** The timeouts learnt for each AT command family.
+     */
+    UbloxAtTimeouts _atTimeouts;
+
+    /** The timeout for an operation of a family, initialMs (-1 for
+     * the upper bound) until the family has been measured.
+     */
+    #define AT_TIMEOUT_MS(family, initialMs) \
+        _atTimeouts.timeoutMs(UbloxAtStats::family, initialMs)
+
+    /** Add the latency of an operation that was answered in time.
+     */
+    #define AT_TIMEOUT_MEASURED(family, latencyUs) \
+        _atTimeouts.measured(UbloxAtStats::family, latencyUs)
+
+    /** Note that an operation timed out.
+     */
+    #define AT_TIMEOUT_EXPIRED(family) _atTimeouts.timedOut(UbloxAtStats::family)
+#else
+    #define AT_TIMEOUT_MS(family, initialMs) (initialMs)
+    #define AT_TIMEOUT_MEASURED(family, latencyUs)
+    #define AT_TIMEOUT_EXPIRED(family)
+#endif
+
+    /**********************************************************************
+     * PROTECTED: Trace
+     **********************************************************************/
+
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_TRACE
+    /** The event trace.
+     */
+    UbloxTrace _trace;
+
+    /** Log an event to the trace: a UbloxTraceId and up to
+     * three integer arguments.
+     */
+    #define TRACE_EVENT(...) _trace.log(__VA_ARGS__)
+#else
+    #define TRACE_EVENT(...)
+#endif
+
+    /**********************************************************************
+     * PROTECTED: Transcript
+     **********************************************************************/
+
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_TRANSCRIPT
+    /** The transcript, which sits under the AT parser while
+     * it is being recorded.
+     */
+    UbloxTranscript _transcript;
+#endif
+
+    /** The base class's AT parser, put aside while a transcript is
+     * being recorded, NULL otherwise.
+     */
+    ATCmdParser *_baseAt;
+
+    /**********************************************************************
+     * PROTECTED: URC Dispatch
+     **********************************************************************/
+
+    /** The URC dispatcher: all of the URCs handled by this driver,
+     * and classes derived from it, are added here rather than
+     * directly to the AT parser.
+     */
+    UbloxUrcDispatcher _urcDispatcher;
+
+    /** Read characters of a URC into a buffer, as read_at_to_char()
+     * does, but including any characters the URC dispatcher read
+     * ahead.  URC handlers must use this rather than read_at_to_char().
+     *
+     * @param buf  the buffer to read into.
+     * @param size the size of buf.
+     * @param end  the character at which to stop, which is
+     *             not included in buf.
+     * @return     the number of characters read, not including
+     *             the null terminator that is added.
+     */
+    int readUrcToChar(char *buf, int size, char end);
+
+    /**********************************************************************
+     * PROTECTED: Capabilities
+     **********************************************************************/
+
+    /** What the module can do, protected by _stateMtx.
+     */
+    Capabilities _caps;
+
+    /** Return whether the module has a feature, probing the module
+     * first if that has yet to be done; until it has been probed every
+     * feature is assumed to be there.
+     *
+     * @param cap the feature.
+     * @return    true if the module has it, or may have.
+     */
+    bool hasCapability(Capability cap);
+
+    /** Add to the capabilities the features used by a derived class,
+     * e.g. HTTP; called by probeCapabilities().  NOTE: LOCK() is held.
+     *
+     * @param caps the capabilities to add to.
+     */
+    virtual void probeMoreCapabilities(Capabilities *caps);
+
+    /** Send the test form of a command and return whether the
+     * module accepted it.  NOTE: LOCK() before calling.
+     *
+     * @param command the command, without the "AT" or "=?".
+     * @param info    a place to put the first line of information
+     *                text, e.g. the ranges of the parameters; NULL
+     *                to discard it.
+     * @param size    the size of info.
+     * @return        true if the module answered OK.
+     */
+    bool testCommand(const char *command, char *info = NULL, int size = 0);
+
+    /** Return whether a value is within the first list of ranges in
+     * the answer to a test command, e.g. 6 is within "(0-4,6,10-14)".
+     *
+     * @param info  the information text of the test command.
+     * @param value the value.
+     * @return      true if the value is within the list.
+     */
+    bool inTestRange(const char *info, int value);
+
+    /**********************************************************************
+     * PROTECTED: AT Errors
+     **********************************************************************/
+
+    /** Storage for the last AT error, on any channel.
+     */
+    AtError _atError;
+
+    /** The last AT error on each channel, so that an error on one
+     * isn't taken as that of a command on another.
+     */
+    AtError _channelAtError[MAX_NUM_AT_CHANNELS];
+
+    /** True if an error final result code ends the wait for a
+     * response, see setFailFast().
+     */
+    bool _failFast;
+
+    /** Forget the last AT error; called at the start of each
+     * driver operation that talks to the module.
+     *
+     * @param channel the channel that the operation uses.
+     */
+    void clearAtError(AtChannel channel = AT_CHANNEL_CONTROL);
+
+    /** Record an AT error, reading the rest of the line for
+     * its code, and abort the AT command in progress on the
+     * parser that it arrived on.
+     *
+     * @param eType the type of final result code received.
+     */
+    void setAtError(AtErrorType eType);
+
+    /** Store an AT error under the state lock.
+     *
+     * @param eType the type of final result code received.
+     * @param eCode the numeric <err>, -1 if there is none.
+     * @param at    the AT parser that the error arrived on,
+     *              NULL for that of the control channel.
+     */
+    void storeAtError(AtErrorType eType, int eCode, ATCmdParser *at = NULL);
+
+    /** URC for the final result code "ERROR".
+     */
+    void ERROR_URC();
+
+    /** URC for the final result code "+CME ERROR".
+     */
+    void CME_ERROR_URC();
+
+    /** URC for the final result code "+CMS ERROR".
+     */
+    void CMS_ERROR_URC();
+
+    /** URC for the final result code "ABORTED".
+     */
+    void ABORTED_URC();
+
+    /** URC for the final result code "ERROR" as a number, "4";
+     * added only once numeric result codes have been switched on,
+     * and ignored once they are off again, since with verbose ones
+     * a line "4" may be information text.
+     */
+    void NUMERIC_ERROR_URC();
+
+    /**********************************************************************
+     * PROTECTED: Network Registration
+     **********************************************************************/
+
+    /* The base class hands these to its own AT parser; they are
+     * dispatched here as well so that registration is still followed
+     * on the AT parsers that this driver puts in place of it.
+     */
+
+    /** Set a registration status from a URC or a query response,
+     * where the status is the second value if there are two.
+     *
+     * @param status the status to set.
+     */
+    void setNwkRegStatus(volatile NetworkRegistrationStatus *status);
+
+    /** URC for circuit switched registration status.
+     */
+    void CREG_URC();
+
+    /** URC for packet switched registration status.
+     */
+    void CGREG_URC();
+
+    /** URC for EUTRAN registration status.
+     */
+    void CEREG_URC();
+
+    /**********************************************************************
+     * PROTECTED: Short Message Service
+     **********************************************************************/
+
+    /** The number type for telephone numbers without a + on the front
+     */
+    #define TYPE_OF_ADDRESS_NATIONAL 129
+
+    /** The number type for telephone numbers with a + on the front
+     */
+    #define TYPE_OF_ADDRESS_INTERNATIONAL 145
+
+    /** One step of sending an SMS, the only one.
+     *
+     * @param transaction the transaction.
+     * @return            0 on success, otherwise negative.
+     */
+    int smsSendStep(UbloxAtQueue::Transaction *transaction);
+
+    /** Convert a #define to a string
+     */
+    #define stringify(a) str(a)
+    #define str(a) #a
+
+    /** Place to store the index of an SMS message.
+     */
+    int *_userSmsIndex;
+
+    /** The number of SMS message being returned to the user.
+     */
+    int _userSmsNum;
+
+    /** The number of SMS messages stored in the module.
+     */
+    int _smsCount;
+
+    /** Temporary storage for an SMS message.
+     */
+    char _smsBuf[SMS_BUFFER_SIZE];
+
+    /** URC for Short Message listing.
+     */
+    void CMGL_URC();
+
+    /** URC for new SMS messages.
+     */
+    void CMTI_URC();
+
+    /**********************************************************************
+     * PROTECTED: Unstructured Supplementary Service Data
+     **********************************************************************/
+
+    /** A buffer for the string assembled from the URC.
+     */
+    char * _ssUrcBuf;
+
+    /** Where to put the string from a +CUSD response, NULL
+     * when no USSD command is in progress.
+     */
+    char * _cusdUrcBuf;
+
+    /** Set when a +CUSD response has been stored at _cusdUrcBuf.
+     */
+    volatile bool _cusdUrcReceived;
+
+    /** Held for the whole of a USSD command, taken before the AT
+     * channel lock: the command lets go of that while it waits for
+     * its response, and _cusdUrcBuf, _cusdUrcReceived and _ssUrcBuf
+     * belong to it until it returns.
+     */
+    Mutex _ussdMtx;
+
+    /** URC for USSD responses.
+     */
+    void CUSD_URC();
+
+    /** URC for call waiting.
+     */
+    void CCWA_URC();
+
+    /** URC for call forwarding.
+     */
+    void CCFC_URC();
+
+    /** URC for calling lined ID restriction.
+     */
+    void CLIR_URC();
+
+    /** URC for calling lined ID presentation.
+     */
+    void CLIP_URC();
+
+    /** URC for connected lined ID restriction.
      */
     void COLR_URC();
 
@@ -263,6 +1655,154 @@ protected:
      */
 
     #define FILE_BUFFER_SIZE 192
+
+    /** The size of a single read of file data when flow control
+     * is on; the module pauses whenever the receive buffer fills
+     * so this may be as large as the module allows.
+     */
+    #define FILE_BUFFER_SIZE_FLOW_CONTROL MBED_CONF_UBLOX_CELL_DRIVER_GEN_FLOW_CONTROL_FILE_BLOCK_SIZE
+
+    /** The largest single read of file data without flow control:
+     * the size of the serial port's receive buffer, which a block
+     * must fit in if it is not read out as fast as it arrives, less
+     * room for the +URDBLOCK header, but no less than FILE_BUFFER_SIZE.
+     */
+#if defined(MBED_CONF_DRIVERS_UART_SERIAL_RXBUF_SIZE) && \
+    (MBED_CONF_DRIVERS_UART_SERIAL_RXBUF_SIZE - 64 > FILE_BUFFER_SIZE)
+    #define FILE_BUFFER_SIZE_MAX (MBED_CONF_DRIVERS_UART_SERIAL_RXBUF_SIZE - 64)
+#else
+    #define FILE_BUFFER_SIZE_MAX FILE_BUFFER_SIZE
+#endif
+
+    /** True if RTS/CTS flow control is on.
+     */
+    bool _flowControl;
+
+    /** The size of the blocks in which files are read, which starts
+     * at FILE_BUFFER_SIZE, doubles after every
+     * MBED_CONF_UBLOX_CELL_DRIVER_GEN_FILE_BLOCK_GROW_AFTER blocks
+     * that arrive intact, up to FILE_BUFFER_SIZE_FLOW_CONTROL or
+     * FILE_BUFFER_SIZE_MAX, and halves whenever one comes up short;
+     * used under the lock of the data channel.
+     */
+    int _fileBlockSize;
+
+    /** The number of blocks in a row that have arrived intact
+     * at _fileBlockSize.
+     */
+    int _fileBlockRun;
+
+    /** One step of writing a file, the only one.
+     *
+     * @param transaction the transaction.
+     * @return            the number of bytes written, negative
+     *                    on failure.
+     */
+    int writeFileStep(UbloxAtQueue::Transaction *transaction);
+
+    /** The longest file name the module allows.
+     */
+    #define FILE_NAME_SIZE 48
+
+    /** What the file index knows of a file.
+     */
+    typedef enum {
+        FILE_INDEX_UNKNOWN, //!< Nothing.
+        FILE_INDEX_ABSENT,  //!< That it isn't there.
+        FILE_INDEX_PRESENT  //!< That it is there.
+    } FileIndexResult;
+
+    /** An entry in the file index.
+     */
+    typedef struct {
+        char name[FILE_NAME_SIZE + 1];
+        int size; //!< Negative if not known.
+    } FileIndexEntry;
+
+    /** The file index, protected by _stateMtx.  Anything added to it
+     * is added with the AT channel lock held too, so that what one
+     * command finds out can't overwrite what a later one has done to
+     * the same file.
+     */
+    FileIndexEntry _fileIndex[(MBED_CONF_UBLOX_CELL_DRIVER_GEN_FILE_INDEX_SIZE > 0) ?
+                              MBED_CONF_UBLOX_CELL_DRIVER_GEN_FILE_INDEX_SIZE : 1];
+
+    /** The number of entries in the file index.
+     */
+    int _numFileIndex;
+
+    /** True if every file in the module's file system is in the
+     * file index, so that a file that isn't there doesn't exist.
+     */
+    bool _fileIndexComplete;
+
+    /** True if the module's file list has been read into the file
+     * index since it was last invalidated.
+     */
+    bool _fileIndexListed;
+
+    /** Look a file up in the file index.
+     *
+     * @param filename the name of the file.
+     * @param size     a place to put the size of the file, negative
+     *                 if not known, where it is present.
+     * @return         what the file index knows of the file.
+     */
+    FileIndexResult fileIndexFind(const char *filename, int *size);
+
+    /** Record in the file index that a file exists; if there is no
+     * room for it the file index is no longer complete.  Call with
+     * the AT channel lock held.
+     *
+     * @param filename the name of the file.
+     * @param size     the size of the file, negative if not known,
+     *                 e.g. because it has just been written.
+     */
+    void fileIndexSet(const char *filename, int size);
+
+    /** Remove a file from the file index.  Call with the AT channel
+     * lock held.
+     *
+     * @param filename the name of the file.
+     * @param gone     true if the file is known not to exist, false
+     *                 if it may or may not, e.g. after a timeout, in
+     *                 which case the file index is no longer complete.
+     */
+    void fileIndexRemove(const char *filename, bool gone);
+
+    /** Read the module's file list into the file index.
+     *
+     * @return true if successful, false otherwise.
+     */
+    bool fileIndexFill();
+
+    /** Let a file cursor read through readFileAt().
+     */
+    friend class FileCursor;
+
+    /** Read part of a file, from an offset, into a buffer.
+     *
+     * @param filename the name of the file.
+     * @param offset   the offset in the file at which to start.
+     * @param buf      a buffer to hold the data.
+     * @param len      the size to read.
+     * @param size     the size of the file, negative if not known,
+     *                 in which case it is found first.
+     * @param token    a cancel token, may be NULL.
+     * @return         the number of bytes read, negative on failure.
+     */
+    int readFileAt(const char* filename, int offset, char* buf, int len,
+                   int size, UbloxCancelToken *token);
+
+    /** One step of reading a file: the first gets the size of
+     * the file, unless it is known, and each one after that reads
+     * a block, or reads again one that came up short.
+     *
+     * @param transaction the transaction.
+     * @return            AT_QUEUE_MORE until done, then the number
+     *                    of bytes read, negative on failure.
+     */
+    int readFileStep(UbloxAtQueue::Transaction *transaction);
 };
 
 #endif // _UBLOX_CELLULAR_DRIVER_GEN_
@@ -0,0 +1,543 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "UbloxCmux.h"
+
+// The length field of a frame is one byte up to this size, two above it
+#define CMUX_ONE_BYTE_LENGTH_MAX 127
+
+// The value the frame check sequence of a good frame adds up to
+#define CMUX_FCS_GOOD 0xCF
+
+/**********************************************************************
+ * PROTECTED METHODS: Channel
+ **********************************************************************/
+
+// Constructor.
+UbloxCmux::Channel::Channel()
+{
+    _cmux = NULL;
+    _dlci = 0;
+    _blocking = true;
+    _open = false;
+    _rxStopped = false;
+    _txStopped = false;
+    _rxCount = 0;
+    _rxRead = 0;
+    _rxWrite = 0;
+}
+
+/**********************************************************************
+ * PUBLIC METHODS: Channel
+ **********************************************************************/
+
+// Read received data.
+ssize_t UbloxCmux::Channel::read(void *buffer, size_t size)
+{
+    char *buf = (char *) buffer;
+    ssize_t count = 0;
+    bool go = false;
+
+    while (_blocking && (_rxCount == 0) && _open) {
+        _events.wait_any(CMUX_CHANNEL_EVENT_RX);
+    }
+
+    _cmux->_rxMtx.lock();
+    while ((count < (ssize_t) size) && (_rxCount > 0)) {
+        *(buf + count) = _rxBuf[_rxRead];
+        _rxRead++;
+        if (_rxRead >= (int) sizeof (_rxBuf)) {
+            _rxRead = 0;
+        }
+        _rxCount--;
+        count++;
+    }
+    if (_rxStopped && (_rxCount < (int) sizeof (_rxBuf) / 4)) {
+        _rxStopped = false;
+        go = true;
+    }
+    _cmux->_rxMtx.unlock();
+
+    if (go) {
+        _cmux->sendMsc(_dlci, false);
+    }
+
+    return ((count == 0) && (size > 0)) ? -EAGAIN : count;
+}
+
+// Send data.
+ssize_t UbloxCmux::Channel::write(const void *buffer, size_t size)
+{
+    const char *buf = (const char *) buffer;
+    ssize_t count = 0;
+    int len;
+
+    while ((count < (ssize_t) size) && _open) {
+        if (_txStopped) {
+            // The module has asked us to wait
+            _events.wait_any(CMUX_CHANNEL_EVENT_TX, CMUX_ANSWER_TIMEOUT_MS);
+            continue;
+        }
+        len = size - count;
+        if (len > CMUX_MAX_FRAME_SIZE) {
+            len = CMUX_MAX_FRAME_SIZE;
+        }
+        if (!_cmux->sendFrame(_dlci, CMUX_FRAME_UIH, buf + count, len)) {
+            break;
+        }
+        count += len;
+    }
+
+    return ((count == 0) && (size > 0)) ? -EIO : count;
+}
+
+// Seeking is not supported.
+off_t UbloxCmux::Channel::seek(off_t offset, int whence)
+{
+    (void) offset;
+    (void) whence;
+    return -ESPIPE;
+}
+
+// Close.
+int UbloxCmux::Channel::close()
+{
+    return 0;
+}
+
+// A channel is a terminal.
+int UbloxCmux::Channel::isatty()
+{
+    return 1;
+}
+
+// Set whether read() waits for data.
+int UbloxCmux::Channel::set_blocking(bool blocking)
+{
+    _blocking = blocking;
+    return 0;
+}
+
+// Return the events that are ready.
+short UbloxCmux::Channel::poll(short events) const
+{
+    short revents = POLLOUT;
+
+    if (_rxCount > 0) {
+        revents |= POLLIN;
+    }
+
+    return revents & events;
+}
+
+// Set a function to call whenever data arrives.
+void UbloxCmux::Channel::sigio(Callback<void()> func)
+{
+    _sigio = func;
+}
+
+/**********************************************************************
+ * PROTECTED METHODS
+ **********************************************************************/
+
+// Add a byte to a frame check sequence: the reversed CRC-8
+// of 27.010, done bit by bit as frames are small.
+uint8_t UbloxCmux::fcsAdd(uint8_t fcs, char byte)
+{
+    uint8_t x = fcs ^ (uint8_t) byte;
+
+    for (int y = 0; y < 8; y++) {
+        x = (x & 0x01) ? (x >> 1) ^ 0xE0 : (x >> 1);
+    }
+
+    return x;
+}
+
+// Send a frame.
+bool UbloxCmux::sendFrame(int dlci, uint8_t control, const char *data, int len)
+{
+    int pos = 0;
+    int headerLen;
+    uint8_t fcs = 0xFF;
+    int x;
+    bool success = true;
+
+    _txMtx.lock();
+    _txFrame[pos++] = CMUX_FLAG;
+    _txFrame[pos++] = (dlci << 2) | CMUX_CR | CMUX_EA;
+    _txFrame[pos++] = control;
+    if (len > CMUX_ONE_BYTE_LENGTH_MAX) {
+        _txFrame[pos++] = (len << 1) & 0xFE;
+        _txFrame[pos++] = len >> 7;
+    } else {
+        _txFrame[pos++] = (len << 1) | CMUX_EA;
+    }
+    headerLen = pos;
+    if (len > 0) {
+        memcpy(_txFrame + pos, data, len);
+        pos += len;
+    }
+    // UIH frames are checked over the header only
+    for (x = 1; x < (((control & ~CMUX_PF) == CMUX_FRAME_UIH) ? headerLen : pos); x++) {
+        fcs = fcsAdd(fcs, _txFrame[x]);
+    }
+    _txFrame[pos++] = 0xFF - fcs;
+    _txFrame[pos++] = CMUX_FLAG;
+
+    // The serial port is non-blocking while we own it
+    x = 0;
+    while (success && (x < pos)) {
+        ssize_t written = _fh->write(_txFrame + x, pos - x);
+        if (written > 0) {
+            x += written;
+        } else if (written == -EAGAIN) {
+            Thread::wait(1);
+        } else {
+            success = false;
+        }
+    }
+    _txMtx.unlock();
+
+    return success;
+}
+
+// Send a frame that asks for an answer and wait for it.
+bool UbloxCmux::command(int dlci, uint8_t control)
+{
+    uint32_t flags;
+
+    for (int x = 0; x < CMUX_ANSWER_TRIES; x++) {
+        _events.clear(CMUX_EVENT_UA | CMUX_EVENT_DM);
+        if (!sendFrame(dlci, control | CMUX_PF, NULL, 0)) {
+            return false;
+        }
+        flags = _events.wait_any(CMUX_EVENT_UA | CMUX_EVENT_DM, CMUX_ANSWER_TIMEOUT_MS);
+        if (!(flags & osFlagsError) && (_answerDlci == dlci)) {
+            return (flags & CMUX_EVENT_UA) != 0;
+        }
+    }
+
+    return false;
+}
+
+// Send a modem status command for a channel.
+bool UbloxCmux::sendMsc(int dlci, bool stop)
+{
+    char msg[4];
+
+    msg[0] = CMUX_MSG_MSC | CMUX_CR | CMUX_EA;
+    msg[1] = (2 << 1) | CMUX_EA;
+    msg[2] = (dlci << 2) | CMUX_CR | CMUX_EA;
+    msg[3] = CMUX_V24_SIGNALS | (stop ? CMUX_V24_FC : 0);
+
+    return sendFrame(0, CMUX_FRAME_UIH, msg, sizeof (msg));
+}
+
+// Handle a multiplexer control message.
+void UbloxCmux::rxControl(const char *data, int len)
+{
+    char response[16];
+    uint8_t type;
+    int dlci;
+
+    if ((len < 2) || (len > (int) sizeof (response))) {
+        return;
+    }
+    type = (uint8_t) data[0];
+    if (type & CMUX_CR) {
+        // A command from the module: note any flow control and
+        // answer with the same message as a response
+        if (((type & ~(CMUX_CR | CMUX_EA)) == CMUX_MSG_MSC) && (len >= 4)) {
+            dlci = (data[2] >> 2) & 0x3F;
+            if ((dlci >= 1) && (dlci <= CMUX_MAX_NUM_CHANNELS)) {
+                _channels[dlci - 1]._txStopped = (data[3] & CMUX_V24_FC) != 0;
+                _channels[dlci - 1]._events.set(CMUX_CHANNEL_EVENT_TX);
+            }
+        }
+        memcpy(response, data, len);
+        response[0] = type & ~CMUX_CR;
+        sendFrame(0, CMUX_FRAME_UIH, response, len);
+    }
+}
+
+// Handle a complete frame.
+void UbloxCmux::rxFrame()
+{
+    int dlci = (_rxAddress >> 2) & 0x3F;
+    Channel *channel;
+    bool stop = false;
+    int x;
+
+    switch (_rxControl & ~CMUX_PF) {
+        case CMUX_FRAME_UA:
+        case CMUX_FRAME_DM:
+            _answerDlci = dlci;
+            _events.set(((_rxControl & ~CMUX_PF) == CMUX_FRAME_UA) ? CMUX_EVENT_UA : CMUX_EVENT_DM);
+            break;
+        case CMUX_FRAME_UIH:
+        case CMUX_FRAME_UI:
+            if (dlci == 0) {
+                rxControl(_rxFrame, _rxLength);
+            } else if ((dlci <= CMUX_MAX_NUM_CHANNELS) && _channels[dlci - 1]._open) {
+                channel = &_channels[dlci - 1];
+                _rxMtx.lock();
+                for (x = 0; (x < _rxLength) && (channel->_rxCount < (int) sizeof (channel->_rxBuf)); x++) {
+                    channel->_rxBuf[channel->_rxWrite] = _rxFrame[x];
+                    channel->_rxWrite++;
+                    if (channel->_rxWrite >= (int) sizeof (channel->_rxBuf)) {
+                        channel->_rxWrite = 0;
+                    }
+                    channel->_rxCount++;
+                }
+                _numRxLost += _rxLength - x;
+                if (!channel->_rxStopped &&
+                    (channel->_rxCount > (int) sizeof (channel->_rxBuf) * 3 / 4)) {
+                    channel->_rxStopped = true;
+                    stop = true;
+                }
+                _rxMtx.unlock();
+                if (stop) {
+                    sendMsc(dlci, true);
+                }
+                channel->_events.set(CMUX_CHANNEL_EVENT_RX);
+                if (channel->_sigio) {
+                    channel->_sigio();
+                }
+            }
+            break;
+        default:
+            // Nothing else is expected from the module
+            break;
+    }
+}
+
+// Run the frame reader over some received bytes.
+void UbloxCmux::rx(const char *data, int len)
+{
+    char byte;
+
+    for (int x = 0; x < len; x++) {
+        byte = data[x];
+        switch (_rxState) {
+            case RX_FLAG:
+                if (byte == (char) CMUX_FLAG) {
+                    _rxState = RX_ADDRESS;
+                }
+                break;
+            case RX_ADDRESS:
+                // Runs of flags are allowed between frames
+                if (byte != (char) CMUX_FLAG) {
+                    _rxAddress = (uint8_t) byte;
+                    _rxFcs = fcsAdd(0xFF, byte);
+                    _rxState = RX_CONTROL;
+                }
+                break;
+            case RX_CONTROL:
+                _rxControl = (uint8_t) byte;
+                _rxFcs = fcsAdd(_rxFcs, byte);
+                _rxState = RX_LENGTH;
+                break;
+            case RX_LENGTH:
+                _rxFcs = fcsAdd(_rxFcs, byte);
+                _rxLength = (byte >> 1) & 0x7F;
+                _rxPos = 0;
+                if (!(byte & CMUX_EA)) {
+                    _rxState = RX_LENGTH_2;
+                } else {
+                    _rxState = (_rxLength > 0) ? RX_DATA : RX_FCS;
+                }
+                break;
+            case RX_LENGTH_2:
+                _rxFcs = fcsAdd(_rxFcs, byte);
+                _rxLength |= ((int) (uint8_t) byte) << 7;
+                _rxState = (_rxLength > 0) ? RX_DATA : RX_FCS;
+                break;
+            case RX_DATA:
+                if (_rxLength > (int) sizeof (_rxFrame)) {
+                    // Too big: wait for the next frame
+                    _numRxLost += _rxLength;
+                    _rxState = RX_FLAG;
+                    break;
+                }
+                _rxFrame[_rxPos] = byte;
+                if ((_rxControl & ~CMUX_PF) != CMUX_FRAME_UIH) {
+                    _rxFcs = fcsAdd(_rxFcs, byte);
+                }
+                _rxPos++;
+                if (_rxPos >= _rxLength) {
+                    _rxState = RX_FCS;
+                }
+                break;
+            case RX_FCS:
+                _rxFcs = fcsAdd(_rxFcs, byte);
+                _rxState = RX_END;
+                break;
+            case RX_END:
+                if (byte == (char) CMUX_FLAG) {
+                    if (_rxFcs == CMUX_FCS_GOOD) {
+                        rxFrame();
+                    }
+                    // The closing flag may also open the next frame
+                    _rxState = RX_ADDRESS;
+                } else {
+                    _rxState = RX_FLAG;
+                }
+                break;
+        }
+    }
+}
+
+// Callback from the serial port when data arrives.
+void UbloxCmux::rxSignal()
+{
+    _events.set(CMUX_EVENT_RX);
+}
+
+// The body of the thread that reads frames.
+void UbloxCmux::threadMain()
+{
+    char buf[32];
+    ssize_t len;
+
+    while (_running) {
+        // Time out now and again in case a sigio() is missed
+        _events.wait_any(CMUX_EVENT_RX, CMUX_ANSWER_TIMEOUT_MS);
+        do {
+            len = _fh->read(buf, sizeof (buf));
+            if (len > 0) {
+                rx(buf, len);
+            }
+        } while ((len > 0) && _running);
+    }
+}
+
+/**********************************************************************
+ * PUBLIC METHODS
+ **********************************************************************/
+
+// Constructor.
+UbloxCmux::UbloxCmux(FileHandle *fh)
+{
+    _fh = fh;
+    _thread = NULL;
+    _running = false;
+    _answerDlci = -1;
+    _rxState = RX_FLAG;
+    _rxAddress = 0;
+    _rxControl = 0;
+    _rxLength = 0;
+    _rxPos = 0;
+    _rxFcs = 0;
+    _numRxLost = 0;
+    for (int x = 0; x < CMUX_MAX_NUM_CHANNELS; x++) {
+        _channels[x]._cmux = this;
+        _channels[x]._dlci = x + 1;
+    }
+}
+
+// Destructor.
+UbloxCmux::~UbloxCmux()
+{
+    stop();
+}
+
+// Start the multiplexer.
+bool UbloxCmux::start(int numChannels)
+{
+    bool success;
+
+    if (_thread != NULL) {
+        return false;
+    }
+    if (numChannels > CMUX_MAX_NUM_CHANNELS) {
+        numChannels = CMUX_MAX_NUM_CHANNELS;
+    }
+
+    _rxState = RX_FLAG;
+    _fh->set_blocking(false);
+    _fh->sigio(callback(this, &UbloxCmux::rxSignal));
+    _running = true;
+    _thread = new Thread(osPriorityAboveNormal,
+                         MBED_CONF_UBLOX_CELL_DRIVER_GEN_CMUX_THREAD_STACK_SIZE);
+    _thread->start(callback(this, &UbloxCmux::threadMain));
+
+    success = command(0, CMUX_FRAME_SABM);
+    for (int x = 0; success && (x < numChannels); x++) {
+        _channels[x]._rxCount = 0;
+        _channels[x]._rxRead = 0;
+        _channels[x]._rxWrite = 0;
+        _channels[x]._rxStopped = false;
+        _channels[x]._txStopped = false;
+        _channels[x]._open = command(x + 1, CMUX_FRAME_SABM);
+        success = _channels[x]._open && sendMsc(x + 1, false);
+    }
+
+    if (!success) {
+        stop();
+    }
+
+    return success;
+}
+
+// Stop the multiplexer.
+void UbloxCmux::stop()
+{
+    char cld[2];
+
+    if (_thread == NULL) {
+        return;
+    }
+
+    for (int x = CMUX_MAX_NUM_CHANNELS - 1; x >= 0; x--) {
+        if (_channels[x]._open) {
+            command(x + 1, CMUX_FRAME_DISC);
+            _channels[x]._open = false;
+            _channels[x]._events.set(CMUX_CHANNEL_EVENT_RX | CMUX_CHANNEL_EVENT_TX);
+        }
+    }
+
+    // Closing down the multiplexer returns the module to AT commands
+    cld[0] = CMUX_MSG_CLD | CMUX_CR | CMUX_EA;
+    cld[1] = CMUX_EA;
+    sendFrame(0, CMUX_FRAME_UIH, cld, sizeof (cld));
+    wait_ms(CMUX_ANSWER_TIMEOUT_MS / 10);
+
+    _running = false;
+    _events.set(CMUX_EVENT_RX);
+    _thread->join();
+    delete _thread;
+    _thread = NULL;
+
+    _fh->sigio(NULL);
+    _fh->set_blocking(true);
+}
+
+// Return a channel.
+UbloxCmux::Channel *UbloxCmux::channel(int dlci)
+{
+    if ((dlci >= 1) && (dlci <= CMUX_MAX_NUM_CHANNELS) && _channels[dlci - 1]._open) {
+        return &_channels[dlci - 1];
+    }
+
+    return NULL;
+}
+
+// Return the number of received bytes thrown away.
+uint32_t UbloxCmux::numRxLost()
+{
+    return _numRxLost;
+}
+
+// End of file
@@ -0,0 +1,360 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _UBLOX_CMUX_
+#define _UBLOX_CMUX_
+
+#include "mbed.h"
+
+/** The largest amount of data in a CMUX frame, N1; the module is
+ * told to use the same with AT+CMUX.
+ */
+#ifndef MBED_CONF_UBLOX_CELL_DRIVER_GEN_CMUX_MAX_FRAME_SIZE
+# define MBED_CONF_UBLOX_CELL_DRIVER_GEN_CMUX_MAX_FRAME_SIZE 127
+#endif
+
+/** The size of the receive buffer of each CMUX channel.
+ */
+#ifndef MBED_CONF_UBLOX_CELL_DRIVER_GEN_CMUX_CHANNEL_BUFFER_SIZE
+# define MBED_CONF_UBLOX_CELL_DRIVER_GEN_CMUX_CHANNEL_BUFFER_SIZE 1024
+#endif
+
+/** The stack size of the thread that reads CMUX frames.
+ */
+#ifndef MBED_CONF_UBLOX_CELL_DRIVER_GEN_CMUX_THREAD_STACK_SIZE
+# define MBED_CONF_UBLOX_CELL_DRIVER_GEN_CMUX_THREAD_STACK_SIZE 1024
+#endif
+
+/** UbloxCmux class.
+ *
+ * The basic option of the 3GPP 27.010 multiplexer protocol, run over
+ * the serial port to the module once the module has been put into
+ * multiplexer mode with AT+CMUX.  Each data link connection (DLC)
+ * above DLC 0, which carries multiplexer control, is presented as a
+ * Channel: a FileHandle, on which an ATCmdParser can be run just as
+ * it would be on the serial port.
+ *
+ * A thread reads frames from the serial port and puts the data into
+ * the receive buffer of the channel it is for.  Data written to a
+ * channel is sent in UIH frames of up to
+ * MBED_CONF_UBLOX_CELL_DRIVER_GEN_CMUX_MAX_FRAME_SIZE bytes.  Flow
+ * control is done per channel with the modem status command: the
+ * module is told to stop sending on a channel when its receive buffer
+ * is three quarters full and to go on when it has been emptied to a
+ * quarter; when the module does the same, writes to that channel wait.
+ */
+class UbloxCmux {
+
+public:
+    /** The number of channels, DLC 1 upwards.
+     */
+    #define CMUX_MAX_NUM_CHANNELS 3
+
+    /** A channel: one DLC of the multiplexer.
+     */
+    class Channel : public FileHandle {
+        friend class UbloxCmux;
+
+    public:
+        /** Read received data.
+         *
+         * @param buffer a place to put the data.
+         * @param size   the amount of room at buffer.
+         * @return       the number of bytes read, -EAGAIN if there
+         *               is nothing to read and the channel is not
+         *               blocking.
+         */
+        virtual ssize_t read(void *buffer, size_t size);
+
+        /** Send data.
+         *
+         * @param buffer the data.
+         * @param size   the amount of data.
+         * @return       the number of bytes sent, negative on error.
+         */
+        virtual ssize_t write(const void *buffer, size_t size);
+
+        /** Not supported.
+         *
+         * @return -ESPIPE.
+         */
+        virtual off_t seek(off_t offset, int whence = SEEK_SET);
+
+        /** Does nothing: channels are closed by UbloxCmux::stop().
+         *
+         * @return 0.
+         */
+        virtual int close();
+
+        /** Return 1, a channel being a terminal.
+         *
+         * @return 1.
+         */
+        virtual int isatty();
+
+        /** Set whether read() waits for data.
+         *
+         * @param blocking true to wait, the default.
+         * @return         0.
+         */
+        virtual int set_blocking(bool blocking);
+
+        /** Return which of the events asked about are ready,
+         * POLLIN if there is data to read, POLLOUT always.
+         *
+         * @param events the events.
+         * @return       the events that are ready.
+         */
+        virtual short poll(short events) const;
+
+        /** Set a function to call whenever data arrives.
+         *
+         * @param func the function, NULL for none.
+         */
+        virtual void sigio(Callback<void()> func);
+
+    protected:
+        #define CMUX_CHANNEL_EVENT_RX 0x01
+        #define CMUX_CHANNEL_EVENT_TX 0x02
+
+        UbloxCmux *_cmux;
+        int _dlci;
+        bool _blocking;
+        bool _open;
+        volatile bool _rxStopped;
+        volatile bool _txStopped;
+        Callback<void()> _sigio;
+        EventFlags _events;
+        char _rxBuf[MBED_CONF_UBLOX_CELL_DRIVER_GEN_CMUX_CHANNEL_BUFFER_SIZE];
+        volatile int _rxCount;
+        int _rxRead;
+        int _rxWrite;
+
+        Channel();
+    };
+
+    /** Constructor.
+     *
+     * @param fh the serial port to the module.
+     */
+    UbloxCmux(FileHandle *fh);
+
+    /** Destructor: stops the multiplexer if it is running.
+     */
+    ~UbloxCmux();
+
+    /** Start the multiplexer, opening DLC 0 and then each channel.
+     * The module must already have been put into multiplexer mode.
+     * While the multiplexer is running it owns the serial port:
+     * it sets it to non-blocking and takes its sigio() callback.
+     *
+     * @param numChannels the number of channels to open, at most
+     *                    CMUX_MAX_NUM_CHANNELS.
+     * @return            true if successful, otherwise false, in which
+     *                    case the multiplexer is stopped again.
+     */
+    bool start(int numChannels = CMUX_MAX_NUM_CHANNELS);
+
+    /** Stop the multiplexer, closing each channel and then the
+     * multiplexer, which returns the module to AT command mode.
+     * The serial port is set back to blocking, without a sigio()
+     * callback.
+     */
+    void stop();
+
+    /** Return a channel.
+     *
+     * @param dlci the DLC of the channel, 1 upwards.
+     * @return     the channel, NULL if it is not open.
+     */
+    Channel *channel(int dlci);
+
+    /** Return the number of received bytes that were thrown away
+     * because there was no room for them in a channel.
+     *
+     * @return the number of bytes lost.
+     */
+    uint32_t numRxLost();
+
+protected:
+
+    /** Frame delimiter, field bits and frame types.
+     */
+    #define CMUX_FLAG        0xF9
+    #define CMUX_EA          0x01
+    #define CMUX_CR          0x02
+    #define CMUX_PF          0x10
+    #define CMUX_FRAME_SABM  0x2F
+    #define CMUX_FRAME_UA    0x63
+    #define CMUX_FRAME_DM    0x0F
+    #define CMUX_FRAME_DISC  0x43
+    #define CMUX_FRAME_UIH   0xEF
+    #define CMUX_FRAME_UI    0x03
+
+    /** Multiplexer control message types on DLC 0,
+     * without the EA and C/R bits.
+     */
+    #define CMUX_MSG_CLD     0xC0
+    #define CMUX_MSG_MSC     0xE0
+
+    /** The V.24 signals sent in a modem status command: DV, RTR
+     * and RTC set, plus FC to ask the other end to stop sending.
+     */
+    #define CMUX_V24_SIGNALS 0x8D
+    #define CMUX_V24_FC      0x02
+
+    /** How long to wait for the module to answer when opening
+     * or closing a DLC, and how many times to ask.
+     */
+    #define CMUX_ANSWER_TIMEOUT_MS 1000
+    #define CMUX_ANSWER_TRIES 3
+
+    /** The largest amount of data in a frame.
+     */
+    #define CMUX_MAX_FRAME_SIZE MBED_CONF_UBLOX_CELL_DRIVER_GEN_CMUX_MAX_FRAME_SIZE
+
+    /** Event flags: the serial port has data, a DLC has been
+     * answered with UA or DM (shifted left by DLCI).
+     */
+    #define CMUX_EVENT_RX   0x01
+    #define CMUX_EVENT_UA   0x02
+    #define CMUX_EVENT_DM   0x04
+
+    /** The states of the frame reader.
+     */
+    typedef enum {
+        RX_FLAG,
+        RX_ADDRESS,
+        RX_CONTROL,
+        RX_LENGTH,
+        RX_LENGTH_2,
+        RX_DATA,
+        RX_FCS,
+        RX_END
+    } RxState;
+
+    /** The serial port.
+     */
+    FileHandle *_fh;
+
+    /** The channels, index 0 being DLC 1.
+     */
+    Channel _channels[CMUX_MAX_NUM_CHANNELS];
+
+    /** The thread that reads frames.
+     */
+    Thread *_thread;
+
+    /** Set to stop the thread.
+     */
+    volatile bool _running;
+
+    /** Events for the thread and for those waiting for answers.
+     */
+    EventFlags _events;
+
+    /** The DLC and event of the last UA or DM received.
+     */
+    volatile int _answerDlci;
+
+    /** Protects the receive buffers of the channels.
+     */
+    Mutex _rxMtx;
+
+    /** Protects sending, so that frames aren't interleaved.
+     */
+    Mutex _txMtx;
+
+    /** Where frames are built to be sent.
+     */
+    char _txFrame[CMUX_MAX_FRAME_SIZE + 7];
+
+    /** The state of the frame reader and the frame it is reading.
+     */
+    RxState _rxState;
+    uint8_t _rxAddress;
+    uint8_t _rxControl;
+    int _rxLength;
+    int _rxPos;
+    uint8_t _rxFcs;
+    char _rxFrame[CMUX_MAX_FRAME_SIZE];
+
+    /** The number of received bytes thrown away.
+     */
+    uint32_t _numRxLost;
+
+    /** Add a byte to a frame check sequence.
+     *
+     * @param fcs  the frame check sequence so far, 0xFF to start.
+     * @param byte the byte.
+     * @return     the new frame check sequence.
+     */
+    static uint8_t fcsAdd(uint8_t fcs, char byte);
+
+    /** Send a frame.
+     *
+     * @param dlci    the DLC.
+     * @param control the frame type, including any P/F bit.
+     * @param data    the data, NULL if there is none.
+     * @param len     the amount of data, at most CMUX_MAX_FRAME_SIZE.
+     * @return        true if the frame was written.
+     */
+    bool sendFrame(int dlci, uint8_t control, const char *data, int len);
+
+    /** Send a frame that asks for an answer and wait for it.
+     *
+     * @param dlci    the DLC.
+     * @param control the frame type, SABM or DISC.
+     * @return        true if the module answered with UA.
+     */
+    bool command(int dlci, uint8_t control);
+
+    /** Send a modem status command for a channel.
+     *
+     * @param dlci the DLC of the channel.
+     * @param stop true to ask the module to stop sending on it.
+     * @return     true if the command was sent.
+     */
+    bool sendMsc(int dlci, bool stop);
+
+    /** Handle a complete frame.
+     */
+    void rxFrame();
+
+    /** Handle a multiplexer control message received on DLC 0.
+     *
+     * @param data the message.
+     * @param len  the length of the message.
+     */
+    void rxControl(const char *data, int len);
+
+    /** Run the frame reader over some received bytes.
+     *
+     * @param data the bytes.
+     * @param len  the number of bytes.
+     */
+    void rx(const char *data, int len);
+
+    /** Callback from the serial port when data arrives.
+     */
+    void rxSignal();
+
+    /** The body of the thread that reads frames.
+     */
+    void threadMain();
+};
+
+#endif // _UBLOX_CMUX_
@@ -0,0 +1,125 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "UbloxTrace.h"
+
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_TRACE
+
+MBED_STATIC_ASSERT((UBLOX_TRACE_RING_SIZE & (UBLOX_TRACE_RING_SIZE - 1)) == 0,
+                   "MBED_CONF_UBLOX_CELL_DRIVER_GEN_TRACE_RING_SIZE must be a power of two");
+
+/**********************************************************************
+ * PROTECTED METHODS
+ **********************************************************************/
+
+// Copy an event out of the ring.
+bool UbloxTrace::copy(uint32_t seq, Entry *entry)
+{
+    volatile Entry *slot = &(_ring[seq & (UBLOX_TRACE_RING_SIZE - 1)]);
+
+    if (slot->seq != seq) {
+        return false;
+    }
+    entry->seq = seq;
+    entry->timeUs = slot->timeUs;
+    entry->id = slot->id;
+    for (int x = 0; x < UBLOX_TRACE_NUM_ARGS; x++) {
+        entry->args[x] = slot->args[x];
+    }
+
+    // If a writer got to the slot while we were copying it
+    // will have changed the sequence number
+    return slot->seq == seq;
+}
+
+/**********************************************************************
+ * PUBLIC METHODS
+ **********************************************************************/
+
+// Constructor.
+UbloxTrace::UbloxTrace()
+{
+    _seq = 0;
+    clear();
+}
+
+// Log an event.
+void UbloxTrace::log(UbloxTraceId id, int32_t a, int32_t b, int32_t c)
+{
+    uint32_t seq = core_util_atomic_incr_u32(&_seq, 1);
+    volatile Entry *slot = &(_ring[seq & (UBLOX_TRACE_RING_SIZE - 1)]);
+
+    // Mark the slot as being written, fill it in, then give it
+    // its sequence number so that readers know that it is complete
+    slot->seq = 0;
+    slot->timeUs = us_ticker_read();
+    slot->id = id;
+    slot->args[0] = a;
+    slot->args[1] = b;
+    slot->args[2] = c;
+    slot->seq = seq;
+}
+
+// Read the events in the trace.
+int UbloxTrace::read(Entry *entries, int maxEntries)
+{
+    uint32_t last = _seq;
+    uint32_t count = (last < UBLOX_TRACE_RING_SIZE) ? last : UBLOX_TRACE_RING_SIZE;
+    int numEntries = 0;
+
+    if (maxEntries <= 0) {
+        return 0;
+    }
+    if (count > (uint32_t) maxEntries) {
+        count = maxEntries;
+    }
+    for (uint32_t seq = last - count + 1; seq != last + 1; seq++) {
+        if (copy(seq, entries + numEntries)) {
+            numEntries++;
+        }
+    }
+
+    return numEntries;
+}
+
+// Print the events in the trace.
+void UbloxTrace::print()
+{
+    uint32_t last = _seq;
+    uint32_t count = (last < UBLOX_TRACE_RING_SIZE) ? last : UBLOX_TRACE_RING_SIZE;
+    Entry entry;
+
+    for (uint32_t seq = last - count + 1; seq != last + 1; seq++) {
+        if (copy(seq, &entry)) {
+            printf(UBLOX_TRACE_LINE_PREFIX ",%lu,%lu,%lu,%ld,%ld,%ld\n",
+                   (unsigned long) entry.seq, (unsigned long) entry.timeUs,
+                   (unsigned long) entry.id, (long) entry.args[0],
+                   (long) entry.args[1], (long) entry.args[2]);
+        }
+    }
+}
+
+// Empty the trace.
+void UbloxTrace::clear()
+{
+    for (int x = 0; x < UBLOX_TRACE_RING_SIZE; x++) {
+        _ring[x].seq = 0;
+    }
+}
+
+#endif // MBED_CONF_UBLOX_CELL_DRIVER_GEN_TRACE
+
+// End of file
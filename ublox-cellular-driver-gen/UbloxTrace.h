@@ -0,0 +1,113 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _UBLOX_TRACE_
+#define _UBLOX_TRACE_
+
+#include "mbed.h"
+#include "UbloxTraceIds.h"
+
+/** Set to 0 to compile the trace out of the driver.
+ */
+#ifndef MBED_CONF_UBLOX_CELL_DRIVER_GEN_TRACE
+# define MBED_CONF_UBLOX_CELL_DRIVER_GEN_TRACE 1
+#endif
+
+/** The number of events the trace holds; a power of two.
+ */
+#ifndef MBED_CONF_UBLOX_CELL_DRIVER_GEN_TRACE_RING_SIZE
+# define MBED_CONF_UBLOX_CELL_DRIVER_GEN_TRACE_RING_SIZE 64
+#endif
+
+/** UbloxTrace class.
+ *
+ * A binary event trace: each event is logged as a timestamp, an ID
+ * from UbloxTraceIds.h and up to three integers into a ring buffer
+ * in RAM, overwriting the oldest.  Logging formats nothing and takes
+ * no lock, just an atomic increment and a few stores, so it may be
+ * done from a URC handler, even while a long response such as +CMGL
+ * is streaming in, or from an interrupt.
+ *
+ * The text is added on the host: the lines printed by print() are
+ * decoded by ublox-cellular-driver-gen/host/trace_decoder.
+ */
+class UbloxTrace {
+
+public:
+    /** An event in the trace.
+     */
+    typedef struct {
+        uint32_t seq;                        //!< Sequence number, from 1.
+        uint32_t timeUs;                     //!< When it was logged.
+        uint32_t id;                         //!< A UbloxTraceId.
+        int32_t args[UBLOX_TRACE_NUM_ARGS];  //!< The arguments.
+    } Entry;
+
+    /** Constructor.
+     */
+    UbloxTrace();
+
+    /** Log an event.
+     *
+     * @param id the event.
+     * @param a  the first argument.
+     * @param b  the second argument.
+     * @param c  the third argument.
+     */
+    void log(UbloxTraceId id, int32_t a = 0, int32_t b = 0, int32_t c = 0);
+
+    /** Read the events in the trace, oldest first.  Events that are
+     * overwritten while being read are left out.
+     *
+     * @param entries    a place to put the events.
+     * @param maxEntries the number of events there is room for.
+     * @return           the number of events read.
+     */
+    int read(Entry *entries, int maxEntries);
+
+    /** Print the events in the trace, oldest first, one per line,
+     * in the form the host decoder reads.
+     */
+    void print();
+
+    /** Empty the trace.
+     */
+    void clear();
+
+protected:
+
+    /** The ring size, which must be a power of two.
+     */
+    #define UBLOX_TRACE_RING_SIZE MBED_CONF_UBLOX_CELL_DRIVER_GEN_TRACE_RING_SIZE
+
+    /** The events.
+     */
+    volatile Entry _ring[UBLOX_TRACE_RING_SIZE];
+
+    /** The sequence number of the last event logged.
+     */
+    volatile uint32_t _seq;
+
+    /** Copy an event out of the ring.
+     *
+     * @param seq   the sequence number of the event.
+     * @param entry a place to put it.
+     * @return      true if the event was still there.
+     */
+    bool copy(uint32_t seq, Entry *entry);
+};
+
+#endif // _UBLOX_TRACE_
@@ -0,0 +1,65 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _UBLOX_TRACE_IDS_
+#define _UBLOX_TRACE_IDS_
+
+/** The events that the driver logs to its trace (see UbloxTrace),
+ * each with up to three integer arguments, a, b and c.  No text is
+ * logged: the host program ublox-cellular-driver-gen/host/trace_decoder
+ * turns a trace printed with printTrace() back into text.  This file
+ * is shared with that program and so must not depend on mbed.
+ *
+ * Only add to the end of this list: the values appear in traces.
+ */
+typedef enum {
+    UBLOX_TRACE_NONE = 0,
+    UBLOX_TRACE_SMS_NEW,         //!< +CMTI, no arguments.
+    UBLOX_TRACE_SS_CCWA,         //!< +CCWA, a: status, b: class bits.
+    UBLOX_TRACE_SS_CCFC,         //!< +CCFC, a: status, b: class bits or -1,
+                                 //!< c: 1 if a number was given.
+    UBLOX_TRACE_SS_CLIR,         //!< +CLIR, a: <n>, b: <m> or -1.
+    UBLOX_TRACE_SS_CLIP,         //!< +CLIP, a: <n>, b: <m> or -1.
+    UBLOX_TRACE_SS_COLP,         //!< +COLP, a: <n>, b: <m> or -1.
+    UBLOX_TRACE_SS_COLR,         //!< +COLR, a: status.
+    UBLOX_TRACE_FILE_READ_START, //!< readFile(), a: file size, b: length asked for.
+    UBLOX_TRACE_FILE_READ_SHORT, //!< +URDBLOCK, a: block size, b: bytes received.
+    UBLOX_TRACE_HTTP_COMMAND,    //!< +UHTTPC sent, a: profile, b: HTTP command.
+    UBLOX_TRACE_HTTP_ERROR,      //!< +UHTTPC rejected, a: profile, b: HTTP command.
+    UBLOX_TRACE_HTTP_RESULT,     //!< +UUHTTPCR, a: profile, b: HTTP command, c: result.
+    UBLOX_TRACE_FTP_COMMAND,     //!< +UFTPC sent, a: FTP command.
+    UBLOX_TRACE_FTP_ERROR,       //!< +UFTPC rejected, a: FTP command.
+    UBLOX_TRACE_FTP_RESULT,      //!< +UUFTPCR, a: FTP command, b: result.
+    UBLOX_TRACE_CELL_LOC_STEP,   //!< +UULOCIND, a: step, b: result.
+    UBLOX_TRACE_CELL_LOC_FOUND,  //!< +UULOC, a: hypothesis index.
+    UBLOX_TRACE_HTTP_CANCEL,     //!< +UHTTPC cancelled, a: profile, b: HTTP command.
+    UBLOX_TRACE_FTP_ABORT,       //!< +UFTPC cancelled and aborted, a: FTP command.
+    UBLOX_TRACE_AT_YIELD,        //!< Turn held too long given up, a: nesting depth, b: priority class.
+    UBLOX_TRACE_FILE_READ_RETRY, //!< +URDBLOCK asked for again, a: offset, b: block size, c: retry.
+    MAX_NUM_UBLOX_TRACE_IDS
+} UbloxTraceId;
+
+/** The number of arguments of a trace event.
+ */
+#define UBLOX_TRACE_NUM_ARGS 3
+
+/** The prefix of each line printed by printTrace(), followed by
+ * the sequence number, the time in microseconds, the event and its
+ * arguments, all in decimal and separated by commas.
+ */
+#define UBLOX_TRACE_LINE_PREFIX "UBXTRC"
+
+#endif // _UBLOX_TRACE_IDS_
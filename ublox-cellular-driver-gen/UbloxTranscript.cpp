@@ -0,0 +1,261 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "UbloxTranscript.h"
+
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_TRANSCRIPT
+
+/**********************************************************************
+ * PROTECTED METHODS
+ **********************************************************************/
+
+// Add characters to the transcript.
+void UbloxTranscript::record(Direction direction, uint32_t timeUs,
+                             const char *data, int size)
+{
+    int count;
+
+    _mtx.lock();
+
+    // Once something has been lost the rest can't be replayed,
+    // so nothing more is added
+    while ((size > 0) && (_numLost == 0)) {
+        // Start a new record unless the characters carry on
+        // from the last one
+        if ((_last < 0) || (_lastHeader.direction != direction) ||
+            (timeUs - _lastHeader.endUs > MBED_CONF_UBLOX_CELL_DRIVER_GEN_TRANSCRIPT_MERGE_GAP_MS * 1000) ||
+            (_lastHeader.size >= TRANSCRIPT_MAX_RECORD_SIZE)) {
+            if (_used + (int) sizeof (Header) >= _size) {
+                break;
+            }
+            _last = _used;
+            _lastHeader.startUs = timeUs;
+            _lastHeader.size = 0;
+            _lastHeader.direction = direction;
+            _lastHeader.spare = 0;
+            _used += sizeof (Header);
+            _numRecords++;
+        }
+
+        count = size;
+        if (count > _size - _used) {
+            count = _size - _used;
+        }
+        if (count > TRANSCRIPT_MAX_RECORD_SIZE - _lastHeader.size) {
+            count = TRANSCRIPT_MAX_RECORD_SIZE - _lastHeader.size;
+        }
+        if (count == 0) {
+            break;
+        }
+        memcpy(_buf + _used, data, count);
+        _used += count;
+        data += count;
+        size -= count;
+        _lastHeader.size += count;
+        _lastHeader.endUs = timeUs;
+        memcpy(_buf + _last, &_lastHeader, sizeof (Header));
+    }
+    _numLost += size;
+
+    _mtx.unlock();
+}
+
+/**********************************************************************
+ * PUBLIC METHODS
+ **********************************************************************/
+
+// Constructor.
+UbloxTranscript::UbloxTranscript()
+{
+    _fh = NULL;
+    _buf = NULL;
+    _size = 0;
+    _used = 0;
+    _last = -1;
+    _numRecords = 0;
+    _numLost = 0;
+    _startUs = 0;
+}
+
+// Start recording.
+bool UbloxTranscript::start(FileHandle *fh, void *buf, int size)
+{
+    if ((buf == NULL) || (size <= (int) sizeof (Header))) {
+        return false;
+    }
+
+    _mtx.lock();
+    _buf = (char *) buf;
+    _size = size;
+    _used = 0;
+    _last = -1;
+    _numRecords = 0;
+    _numLost = 0;
+    _startUs = us_ticker_read();
+    _fh = fh;
+    _mtx.unlock();
+
+    return true;
+}
+
+// Stop recording.
+void UbloxTranscript::stop()
+{
+    _mtx.lock();
+    _fh = NULL;
+    _mtx.unlock();
+}
+
+// Read the records.
+int UbloxTranscript::readRecords(Record *records, int maxRecords)
+{
+    Header header;
+    int offset = 0;
+    int numRecords = 0;
+
+    _mtx.lock();
+    while ((numRecords < maxRecords) && (numRecords < _numRecords)) {
+        memcpy(&header, _buf + offset, sizeof (header));
+        offset += sizeof (header);
+        records[numRecords].startUs = header.startUs;
+        records[numRecords].endUs = header.endUs;
+        records[numRecords].direction = (Direction) header.direction;
+        records[numRecords].size = header.size;
+        records[numRecords].data = _buf + offset;
+        offset += header.size;
+        numRecords++;
+    }
+    _mtx.unlock();
+
+    return numRecords;
+}
+
+// Return the number of characters lost.
+uint32_t UbloxTranscript::numLost()
+{
+    return _numLost;
+}
+
+// Print the transcript.
+void UbloxTranscript::print()
+{
+    Header header;
+    int offset = 0;
+    int count;
+    uint32_t spanUs;
+
+    _mtx.lock();
+    printf(UBLOX_TRANSCRIPT_LINE_PREFIX ",S,%d,%lu\n", _numRecords,
+           (unsigned long) _numLost);
+    for (int x = 0; x < _numRecords; x++) {
+        memcpy(&header, _buf + offset, sizeof (header));
+        offset += sizeof (header);
+        // Long records are split, the times shared out between the lines
+        spanUs = header.endUs - header.startUs;
+        for (int y = 0; y < header.size; y += count) {
+            count = header.size - y;
+            if (count > TRANSCRIPT_PRINT_LINE_SIZE) {
+                count = TRANSCRIPT_PRINT_LINE_SIZE;
+            }
+            printf(UBLOX_TRANSCRIPT_LINE_PREFIX ",%c,%lu,%lu,",
+                   (header.direction == TRANSCRIPT_TX) ? 'T' : 'R',
+                   (unsigned long) (header.startUs + (uint32_t) (((uint64_t) spanUs * y) / header.size)),
+                   (unsigned long) (header.startUs + (uint32_t) (((uint64_t) spanUs * (y + count)) / header.size)));
+            for (int z = 0; z < count; z++) {
+                printf("%02x", (unsigned char) *(_buf + offset + y + z));
+            }
+            printf("\n");
+        }
+        offset += header.size;
+    }
+    printf(UBLOX_TRANSCRIPT_LINE_PREFIX ",E\n");
+    _mtx.unlock();
+}
+
+// Read from the serial port.
+ssize_t UbloxTranscript::read(void *buffer, size_t size)
+{
+    ssize_t count = -EBADF;
+
+    if (_fh != NULL) {
+        count = _fh->read(buffer, size);
+        if (count > 0) {
+            record(TRANSCRIPT_RX, us_ticker_read() - _startUs, (const char *) buffer, count);
+        }
+    }
+
+    return count;
+}
+
+// Write to the serial port.
+ssize_t UbloxTranscript::write(const void *buffer, size_t size)
+{
+    ssize_t count = -EBADF;
+    uint32_t timeUs = us_ticker_read() - _startUs;
+
+    if (_fh != NULL) {
+        count = _fh->write(buffer, size);
+        if (count > 0) {
+            record(TRANSCRIPT_TX, timeUs, (const char *) buffer, count);
+        }
+    }
+
+    return count;
+}
+
+// Seeking is not supported.
+off_t UbloxTranscript::seek(off_t offset, int whence)
+{
+    (void) offset;
+    (void) whence;
+    return -ESPIPE;
+}
+
+// Close.
+int UbloxTranscript::close()
+{
+    return 0;
+}
+
+// The serial port is a terminal.
+int UbloxTranscript::isatty()
+{
+    return 1;
+}
+
+// Set whether the serial port blocks.
+int UbloxTranscript::set_blocking(bool blocking)
+{
+    return (_fh != NULL) ? _fh->set_blocking(blocking) : -EBADF;
+}
+
+// Return the events that are ready.
+short UbloxTranscript::poll(short events) const
+{
+    return (_fh != NULL) ? _fh->poll(events) : 0;
+}
+
+// Set a function to call whenever data arrives.
+void UbloxTranscript::sigio(Callback<void()> func)
+{
+    if (_fh != NULL) {
+        _fh->sigio(func);
+    }
+}
+
+#endif // MBED_CONF_UBLOX_CELL_DRIVER_GEN_TRANSCRIPT
+
+// End of file
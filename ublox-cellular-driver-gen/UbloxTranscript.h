@@ -0,0 +1,246 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _UBLOX_TRANSCRIPT_
+#define _UBLOX_TRANSCRIPT_
+
+#include "mbed.h"
+
+/** Set to 0 to compile transcript recording out of the driver.
+ */
+#ifndef MBED_CONF_UBLOX_CELL_DRIVER_GEN_TRANSCRIPT
+# define MBED_CONF_UBLOX_CELL_DRIVER_GEN_TRANSCRIPT 1
+#endif
+
+/** Characters that pass in the same direction within this many
+ * milliseconds of the last one are added to the same record.
+ */
+#ifndef MBED_CONF_UBLOX_CELL_DRIVER_GEN_TRANSCRIPT_MERGE_GAP_MS
+# define MBED_CONF_UBLOX_CELL_DRIVER_GEN_TRANSCRIPT_MERGE_GAP_MS 1
+#endif
+
+/** The prefix of each line printed by UbloxTranscript::print().
+ * The first line is the prefix, "S", the number of records and the
+ * number of characters lost; each record follows as the prefix,
+ * "T" (to the module) or "R" (from the module), the times of its
+ * first and last characters in microseconds from the start and the
+ * characters in hex, split over several lines if it is long; the
+ * last line is the prefix and "E".  All are separated by commas.
+ */
+#define UBLOX_TRANSCRIPT_LINE_PREFIX "UBXTS"
+
+/** UbloxTranscript class.
+ *
+ * A transcript of everything that passes over the serial port to
+ * the module, with timings, for replay on a PC with
+ * ublox-cellular-driver-gen/host/transcript_replay.  The transcript
+ * sits between the AT parser and the serial port as a FileHandle,
+ * passing everything through and recording each run of characters
+ * that go in one direction as a record in a buffer given to start().
+ * The times are those at which the driver wrote or read the
+ * characters.  When the buffer is full recording stops and further
+ * characters are counted as lost.
+ */
+class UbloxTranscript : public FileHandle {
+
+public:
+    /** The direction of a record.
+     */
+    typedef enum {
+        TRANSCRIPT_TX = 0,  //!< To the module.
+        TRANSCRIPT_RX = 1   //!< From the module.
+    } Direction;
+
+    /** A record of the transcript.
+     */
+    typedef struct {
+        uint32_t startUs;     //!< When the first character passed, from start().
+        uint32_t endUs;       //!< When the last character passed.
+        Direction direction;  //!< Which way the characters went.
+        int size;             //!< The number of characters.
+        const char *data;     //!< The characters, in the buffer given to start().
+    } Record;
+
+    /** Constructor.
+     */
+    UbloxTranscript();
+
+    /** Start recording, forgetting any previous transcript.
+     *
+     * @param fh   the serial port, to which everything is passed.
+     * @param buf  the buffer to record into, which must stay valid
+     *             until the transcript has been read or printed.
+     * @param size the size of buf.
+     * @return     true if successful, false if the buffer is too
+     *             small to hold a record.
+     */
+    bool start(FileHandle *fh, void *buf, int size);
+
+    /** Stop recording.  The transcript can still be read and
+     * printed but nothing may be passed through until start() is
+     * called again.
+     */
+    void stop();
+
+    /** Read the records of the transcript, oldest first.
+     *
+     * @param records    a place to put the records.
+     * @param maxRecords the number of records there is room for.
+     * @return           the number of records read.
+     */
+    int readRecords(Record *records, int maxRecords);
+
+    /** Return the number of characters that were not recorded
+     * because the buffer was full.
+     *
+     * @return the number of characters lost.
+     */
+    uint32_t numLost();
+
+    /** Print the transcript, in the form transcript_replay reads.
+     */
+    void print();
+
+    /** Read from the serial port, recording what is read.
+     *
+     * @param buffer a place to put the data.
+     * @param size   the amount of room at buffer.
+     * @return       what the serial port returns.
+     */
+    virtual ssize_t read(void *buffer, size_t size);
+
+    /** Write to the serial port, recording what is written.
+     *
+     * @param buffer the data.
+     * @param size   the amount of data.
+     * @return       what the serial port returns.
+     */
+    virtual ssize_t write(const void *buffer, size_t size);
+
+    /** Not supported.
+     *
+     * @return -ESPIPE.
+     */
+    virtual off_t seek(off_t offset, int whence = SEEK_SET);
+
+    /** Does nothing: the serial port is closed by its owner.
+     *
+     * @return 0.
+     */
+    virtual int close();
+
+    /** Return 1, the serial port being a terminal.
+     *
+     * @return 1.
+     */
+    virtual int isatty();
+
+    /** Set whether the serial port blocks.
+     *
+     * @param blocking true to block.
+     * @return         what the serial port returns.
+     */
+    virtual int set_blocking(bool blocking);
+
+    /** Return which of the events asked about are ready on the
+     * serial port.
+     *
+     * @param events the events.
+     * @return       the events that are ready.
+     */
+    virtual short poll(short events) const;
+
+    /** Set a function for the serial port to call whenever data
+     * arrives.
+     *
+     * @param func the function, NULL for none.
+     */
+    virtual void sigio(Callback<void()> func);
+
+protected:
+
+    /** The header of a record in the buffer, followed by its
+     * characters; copied in and out as the buffer need not be
+     * aligned.
+     */
+    typedef struct {
+        uint32_t startUs;
+        uint32_t endUs;
+        uint16_t size;
+        uint8_t direction;
+        uint8_t spare;
+    } Header;
+
+    /** The largest number of characters in one record.
+     */
+    #define TRANSCRIPT_MAX_RECORD_SIZE 0xFFFF
+
+    /** The longest run of characters printed on one line.
+     */
+    #define TRANSCRIPT_PRINT_LINE_SIZE 32
+
+    /** The serial port, NULL while not recording.
+     */
+    FileHandle *_fh;
+
+    /** The buffer.
+     */
+    char *_buf;
+
+    /** The size of the buffer.
+     */
+    int _size;
+
+    /** The amount of the buffer used.
+     */
+    int _used;
+
+    /** The offset of the header of the last record, -1 if none.
+     */
+    int _last;
+
+    /** A copy of the header of the last record.
+     */
+    Header _lastHeader;
+
+    /** The number of records.
+     */
+    int _numRecords;
+
+    /** The number of characters lost.
+     */
+    uint32_t _numLost;
+
+    /** The us_ticker time at start().
+     */
+    uint32_t _startUs;
+
+    /** Protects the buffer, which is written by whichever thread
+     * is reading or writing.
+     */
+    Mutex _mtx;
+
+    /** Add characters to the transcript.
+     *
+     * @param direction the way they went.
+     * @param timeUs    when they went, from start().
+     * @param data      the characters.
+     * @param size      the number of characters.
+     */
+    void record(Direction direction, uint32_t timeUs, const char *data, int size);
+};
+
+#endif // _UBLOX_TRANSCRIPT_
@@ -0,0 +1,440 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "UbloxUrcDispatcher.h"
+
+// Node indexes and handler indexes are stored in a uint8_t
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_URC_MAX_TRIE_NODES > 256
+# error "ublox-cell-driver-gen.urc-max-trie-nodes must be no more than 256"
+#endif
+#if MBED_CONF_UBLOX_CELL_DRIVER_GEN_URC_MAX_PREFIXES >= URC_NO_HANDLER
+# error "ublox-cell-driver-gen.urc-max-prefixes must be less than 255"
+#endif
+
+/**********************************************************************
+ * PROTECTED METHODS
+ **********************************************************************/
+
+// Called by an AT parser when an entry point prefix arrives.
+void UbloxUrcDispatcher::Entry::run()
+{
+    UbloxUrcDispatcher *dispatcher = parser->dispatcher;
+
+    dispatcher->_mtx.lock();
+    dispatcher->_at = parser->at;
+    dispatcher->_fh = parser->fh;
+    dispatcher->resolve(node);
+    dispatcher->_mtx.unlock();
+}
+
+// Put an AT parser in a place in _parsers.
+bool UbloxUrcDispatcher::setSlot(int parser, ATCmdParser *at, FileHandle *fh)
+{
+    Parser *p = &_parsers[parser];
+
+    if ((at != NULL) && (p->entries == NULL)) {
+        p->entries = new Entry[MBED_CONF_UBLOX_CELL_DRIVER_GEN_URC_MAX_PREFIXES];
+        if (p->entries == NULL) {
+            return false;
+        }
+    }
+    p->at = at;
+    p->fh = fh;
+
+    return true;
+}
+
+// Hand an entry point to an AT parser.
+void UbloxUrcDispatcher::addEntry(int parser, int entry, int node)
+{
+    Entry *e = &_parsers[parser].entries[entry];
+
+    e->parser = &_parsers[parser];
+    e->node = node;
+    e->parser->at->oob(_entryPrefixes[entry], callback(e, &Entry::run));
+}
+
+// Find the child of a node for a given character.
+int UbloxUrcDispatcher::findChild(int node, char ch)
+{
+    int child = _nodes[node].child;
+
+    while ((child != 0) && (_nodes[child].ch != ch)) {
+        child = _nodes[child].sibling;
+    }
+
+    return child;
+}
+
+// Read on from an entry point and call the handler of the
+// longest prefix that matches.
+void UbloxUrcDispatcher::resolve(int node)
+{
+    int handler = _nodes[node].handler;
+    int used = 0;
+    int child;
+    int ch;
+
+    // Note: not calling _at->recv() from here as we're
+    // already in an _at->recv()
+    _lookaheadLen = 0;
+    while ((_nodes[node].child != 0) && (_lookaheadLen < (int) sizeof (_lookahead))) {
+        ch = _at->getc();
+        if (ch < 0) {
+            break;
+        }
+        _lookahead[_lookaheadLen] = (char) ch;
+        _lookaheadLen++;
+        child = findChild(node, (char) ch);
+        if (child == 0) {
+            break;
+        }
+        node = child;
+        if (_nodes[node].handler != URC_NO_HANDLER) {
+            handler = _nodes[node].handler;
+            used = _lookaheadLen;
+        }
+    }
+
+    // Anything read beyond the longest prefix belongs to the URC
+    // and is given to the handler first by getc()
+    _lookaheadPos = used;
+    _handlers[handler].call();
+
+    _lookaheadLen = 0;
+    _lookaheadPos = 0;
+}
+
+/**********************************************************************
+ * PUBLIC METHODS
+ **********************************************************************/
+
+// Constructor.
+UbloxUrcDispatcher::UbloxUrcDispatcher()
+{
+    _at = NULL;
+    _fh = NULL;
+    for (int x = 0; x < URC_MAX_PARSERS; x++) {
+        _parsers[x].dispatcher = this;
+        _parsers[x].at = NULL;
+        _parsers[x].fh = NULL;
+        _parsers[x].entries = NULL;
+    }
+    // Node 0 is the root
+    _nodes[0].ch = 0;
+    _nodes[0].handler = URC_NO_HANDLER;
+    _nodes[0].child = 0;
+    _nodes[0].sibling = 0;
+    _numNodes = 1;
+    _numHandlers = 0;
+    _numEntries = 0;
+    _lookaheadLen = 0;
+    _lookaheadPos = 0;
+}
+
+// Destructor.
+UbloxUrcDispatcher::~UbloxUrcDispatcher()
+{
+    for (int x = 0; x < URC_MAX_PARSERS; x++) {
+        delete[] _parsers[x].entries;
+    }
+}
+
+// Set the AT parser.
+void UbloxUrcDispatcher::setParser(ATCmdParser *at, FileHandle *fh)
+{
+    _at = at;
+    _fh = fh;
+    // Without room for its entry points the
+    // dispatcher can only be used stand-alone
+    setSlot(0, at, fh);
+}
+
+// Add another AT parser.
+bool UbloxUrcDispatcher::addParser(ATCmdParser *at, FileHandle *fh)
+{
+    for (int x = 1; x < URC_MAX_PARSERS; x++) {
+        if (_parsers[x].at == NULL) {
+            if (!setSlot(x, at, fh)) {
+                return false;
+            }
+            for (int y = 0; y < _numEntries; y++) {
+                addEntry(x, y, _parsers[0].entries[y].node);
+            }
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Stop using an AT parser.
+void UbloxUrcDispatcher::removeParser(ATCmdParser *at)
+{
+    _mtx.lock();
+    for (int x = 1; x < URC_MAX_PARSERS; x++) {
+        if (_parsers[x].at == at) {
+            _parsers[x].at = NULL;
+            _parsers[x].fh = NULL;
+        }
+    }
+    if (_at == at) {
+        _at = _parsers[0].at;
+        _fh = _parsers[0].fh;
+    }
+    _mtx.unlock();
+}
+
+// Add a URC prefix and its handler.
+bool UbloxUrcDispatcher::add(const char *prefix, Callback<void()> handler)
+{
+    int node = 0;
+    int child;
+    bool covered = false;
+
+    if ((prefix == NULL) || (*prefix == 0)) {
+        return false;
+    }
+
+    for (const char *p = prefix; *p != 0; p++) {
+        child = findChild(node, *p);
+        if (child == 0) {
+            if (_numNodes >= (int) (sizeof (_nodes) / sizeof (_nodes[0]))) {
+                return false;
+            }
+            child = _numNodes;
+            _numNodes++;
+            _nodes[child].ch = *p;
+            _nodes[child].handler = URC_NO_HANDLER;
+            _nodes[child].child = 0;
+            _nodes[child].sibling = _nodes[node].child;
+            _nodes[node].child = child;
+        }
+        node = child;
+        // A shorter prefix on the way here means that the AT parser
+        // will already hand this one over through that prefix
+        if ((*(p + 1) != 0) && (_nodes[node].handler != URC_NO_HANDLER)) {
+            covered = true;
+        }
+    }
+
+    if (_nodes[node].handler != URC_NO_HANDLER) {
+        _handlers[_nodes[node].handler] = handler;
+        return true;
+    }
+
+    if (_numHandlers >= (int) (sizeof (_handlers) / sizeof (_handlers[0]))) {
+        return false;
+    }
+    _handlers[_numHandlers] = handler;
+    _nodes[node].handler = _numHandlers;
+    _numHandlers++;
+
+    if (!covered && (_parsers[0].at != NULL)) {
+        _entryPrefixes[_numEntries] = prefix;
+        for (int x = 0; x < URC_MAX_PARSERS; x++) {
+            if (_parsers[x].at != NULL) {
+                addEntry(x, _numEntries, node);
+            }
+        }
+        _numEntries++;
+    }
+
+    return true;
+}
+
+// Handle one line that has arrived on an AT parser.
+bool UbloxUrcDispatcher::handleLine(ATCmdParser *at, FileHandle *fh)
+{
+    int handler = URC_NO_HANDLER;
+    int node = 0;
+    int ch = 0;
+
+    _mtx.lock();
+    _at = at;
+    _fh = fh;
+
+    // Walk the trie from the start of the line while a longer prefix
+    // may match, keeping the characters read beyond the longest
+    // prefix so far for the handler, as resolve() does
+    _lookaheadLen = 0;
+    while ((_nodes[node].child != 0) && (_lookaheadLen < (int) sizeof (_lookahead))) {
+        ch = at->getc();
+        if (ch < 0) {
+            break;
+        }
+        _lookahead[_lookaheadLen] = (char) ch;
+        _lookaheadLen++;
+        // The AT parser turns either end of line character into '\n'
+        node = findChild(node, (ch == '\r') ? '\n' : (char) ch);
+        if (node == 0) {
+            break;
+        }
+        if (_nodes[node].handler != URC_NO_HANDLER) {
+            handler = _nodes[node].handler;
+            _lookaheadLen = 0;
+        }
+    }
+
+    if (handler != URC_NO_HANDLER) {
+        // Whatever the handler leaves of its line is thrown
+        // away as a line of its own next time
+        _lookaheadPos = 0;
+        _handlers[handler].call();
+        ch = 0;
+    } else {
+        // Not a URC: throw the rest of the line away
+        while ((ch >= 0) && (ch != '\r') && (ch != '\n')) {
+            ch = at->getc();
+        }
+    }
+
+    _lookaheadLen = 0;
+    _lookaheadPos = 0;
+    _mtx.unlock();
+
+    return (ch >= 0);
+}
+
+// Find the handler for the URC at the start of a buffer.
+int UbloxUrcDispatcher::match(const char *buf, int len)
+{
+    int handler = -1;
+    int node = 0;
+
+    for (int x = 0; x < len; x++) {
+        node = findChild(node, buf[x]);
+        if (node == 0) {
+            break;
+        }
+        if (_nodes[node].handler != URC_NO_HANDLER) {
+            handler = _nodes[node].handler;
+        }
+    }
+
+    return handler;
+}
+
+// Call a handler found by match().
+void UbloxUrcDispatcher::call(int handler)
+{
+    if ((handler >= 0) && (handler < _numHandlers)) {
+        _handlers[handler].call();
+    }
+}
+
+// Return the AT parser that the URC being handled arrived on.
+ATCmdParser *UbloxUrcDispatcher::parser()
+{
+    return _at;
+}
+
+// Get the next character of the URC being handled.
+int UbloxUrcDispatcher::getc()
+{
+    int ch = -1;
+
+    if (_lookaheadPos < _lookaheadLen) {
+        ch = (unsigned char) _lookahead[_lookaheadPos];
+        _lookaheadPos++;
+    } else if (_at != NULL) {
+        ch = _at->getc();
+    }
+
+    return ch;
+}
+
+// Read characters of the URC being handled.
+int UbloxUrcDispatcher::read(char *buf, int len, int timeoutMs)
+{
+    int count = 0;
+    int x;
+
+    while ((count < len) && (_lookaheadPos < _lookaheadLen)) {
+        *(buf + count) = _lookahead[_lookaheadPos];
+        _lookaheadPos++;
+        count++;
+    }
+    if ((count < len) && (_fh != NULL)) {
+        count += UbloxAtReader(_fh, timeoutMs).read(buf + count, len - count);
+        if (count == 0) {
+            return -1;
+        }
+    } else if ((count < len) && (_at != NULL)) {
+        x = _at->read(buf + count, len - count);
+        if (x < 0) {
+            return (count > 0) ? count : x;
+        }
+        count += x;
+    }
+
+    return count;
+}
+
+// Read characters of the URC being handled and throw them away.
+int UbloxUrcDispatcher::discard(int len, int timeoutMs)
+{
+    char buf[32];
+    int count = 0;
+    int size;
+    int x;
+
+    while ((count < len) && (_lookaheadPos < _lookaheadLen)) {
+        _lookaheadPos++;
+        count++;
+    }
+    if ((count < len) && (_fh != NULL)) {
+        count += UbloxAtReader(_fh, timeoutMs).discard(len - count);
+    } else {
+        while (count < len) {
+            size = ((len - count) < (int) sizeof (buf)) ? len - count : (int) sizeof (buf);
+            x = read(buf, size, timeoutMs);
+            if (x <= 0) {
+                break;
+            }
+            count += x;
+        }
+    }
+
+    return count;
+}
+
+// Scanner constructor.
+UbloxUrcDispatcher::Scanner::Scanner(UbloxUrcDispatcher *dispatcher,
+                                     char *copy, int copySize):
+                            UbloxUrcScanner(NULL, 0, copy, copySize)
+{
+    _dispatcher = dispatcher;
+}
+
+// Read the next character of the URC for the scanner.
+int UbloxUrcDispatcher::Scanner::getChar()
+{
+    return _dispatcher->getc();
+}
+
+// Return the number of prefixes added.
+int UbloxUrcDispatcher::numPrefixes()
+{
+    return _numHandlers;
+}
+
+// Return the number of trie nodes in use.
+int UbloxUrcDispatcher::numNodes()
+{
+    return _numNodes;
+}
+
+// End of file
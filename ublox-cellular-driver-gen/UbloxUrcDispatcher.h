@@ -0,0 +1,346 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _UBLOX_URC_DISPATCHER_
+#define _UBLOX_URC_DISPATCHER_
+
+#include "mbed.h"
+#include "UbloxUrcScanner.h"
+#include "UbloxAtReader.h"
+
+/** The maximum number of URC prefixes that can be added.
+ */
+#ifndef MBED_CONF_UBLOX_CELL_DRIVER_GEN_URC_MAX_PREFIXES
+# define MBED_CONF_UBLOX_CELL_DRIVER_GEN_URC_MAX_PREFIXES 32
+#endif
+
+/** The maximum number of nodes in the URC prefix trie: at most
+ * one per character of all the prefixes added, fewer where
+ * prefixes share a common start.
+ */
+#ifndef MBED_CONF_UBLOX_CELL_DRIVER_GEN_URC_MAX_TRIE_NODES
+# define MBED_CONF_UBLOX_CELL_DRIVER_GEN_URC_MAX_TRIE_NODES 160
+#endif
+
+/** UbloxUrcDispatcher class.
+ *
+ * Resolves the handler for a URC with a prefix trie, walking the
+ * incoming characters once.  Prefixes added to the dispatcher are
+ * handed to the AT parser as out-of-band entry points, except where
+ * a shorter prefix already covers them: in that case the dispatcher
+ * reads on from the shorter prefix and picks the longest prefix that
+ * matches, so that, for instance, "+UULOC" and "+UULOCIND" are told
+ * apart explicitly rather than by the order in which they were added.
+ *
+ * Any characters read beyond the matching prefix while doing so belong
+ * to the URC, so URC handlers must read via getc(), read() or a
+ * Scanner rather than directly from the AT parser.
+ *
+ * URCs may arrive on more than one AT parser, e.g. on each channel
+ * of a multiplexer: one URC is handled at a time and getc(), read()
+ * and Scanners read from the parser that the URC arrived on.  Where
+ * the file handle under a parser is given too, read() and discard()
+ * take binary data straight from it, in bulk.
+ */
+class UbloxUrcDispatcher {
+
+public:
+    /** Constructor.
+     */
+    UbloxUrcDispatcher();
+
+    /** Destructor.
+     */
+    ~UbloxUrcDispatcher();
+
+    /** Set the AT parser that the URCs arrive on; should be
+     * called before any prefixes are added.
+     *
+     * @param at the AT parser, NULL to use the dispatcher
+     *           stand-alone, with match() only.
+     * @param fh the file handle under the AT parser, NULL
+     *           to read binary data through the parser.
+     */
+    void setParser(ATCmdParser *at, FileHandle *fh = NULL);
+
+    /** Add another AT parser that URCs arrive on: the prefixes
+     * added so far, and any added later, are handed to it too.
+     *
+     * @param at the AT parser.
+     * @param fh the file handle under the AT parser, NULL
+     *           to read binary data through the parser.
+     * @return   true if successful, false if there is no room
+     *           for another parser.
+     */
+    bool addParser(ATCmdParser *at, FileHandle *fh = NULL);
+
+    /** Stop using an AT parser added with addParser(), e.g. because
+     * it is about to be deleted.  The parser keeps its out-of-band
+     * entry points, so it must not be used again.
+     *
+     * @param at the AT parser.
+     */
+    void removeParser(ATCmdParser *at);
+
+    /** Add a URC prefix and its handler.  If the prefix has
+     * been added before its handler is replaced.
+     *
+     * @param prefix  the URC prefix, e.g. "+UUHTTPCR", which
+     *                must remain valid.
+     * @param handler the handler to call when the URC arrives.
+     * @return        true if successful, false if the prefix
+     *                or trie storage is exhausted.
+     */
+    bool add(const char *prefix, Callback<void()> handler);
+
+    /** Handle one line that has arrived on an AT parser outside of
+     * an AT command, e.g. in a URC thread: if the line starts with
+     * a URC prefix the handler for the longest prefix that matches
+     * is called, otherwise the line is thrown away.  Characters are
+     * read with the timeout of the parser, which should be set to an
+     * inter-character one: nothing is waited for beyond the end of
+     * the line.
+     *
+     * @param at the AT parser, one given to setParser() or addParser().
+     * @param fh the file handle under the AT parser, NULL
+     *           to read binary data through the parser.
+     * @return   true if the line was handled, false if the parser
+     *           timed out part way through it.
+     */
+    bool handleLine(ATCmdParser *at, FileHandle *fh = NULL);
+
+    /** Find the handler for the URC at the start of a buffer,
+     * returning the longest prefix that matches.
+     *
+     * @param buf  the received characters.
+     * @param len  the number of characters at buf.
+     * @return     the index of the handler (in the order the
+     *             prefixes were added), negative if there is none.
+     */
+    int match(const char *buf, int len);
+
+    /** Call a handler found by match().
+     *
+     * @param handler the index returned by match().
+     */
+    void call(int handler);
+
+    /** Return the AT parser that the URC being handled arrived on,
+     * e.g. to abort the AT command in progress there.
+     *
+     * @return the AT parser.
+     */
+    ATCmdParser *parser();
+
+    /** Get the next character of the URC being handled: characters
+     * the dispatcher read while looking for a longer prefix are returned
+     * first, then characters are read from the AT parser.
+     *
+     * @return the character, negative on timeout.
+     */
+    int getc();
+
+    /** Read characters of the URC being handled, e.g. binary data
+     * that follows the fields, starting with any that the dispatcher
+     * read ahead, then straight from the file handle under the
+     * parser, if there is one, else through the parser.
+     *
+     * @param buf       the buffer to read into.
+     * @param len       the number of characters to read.
+     * @param timeoutMs how long to wait for all of them; ignored
+     *                  when reading through the parser, which
+     *                  waits its own timeout.
+     * @return          the number of characters read, negative
+     *                  if none arrived in time.
+     */
+    int read(char *buf, int len, int timeoutMs);
+
+    /** Read characters of the URC being handled and throw them
+     * away, e.g. binary data that doesn't fit a buffer, as read()
+     * does.
+     *
+     * @param len       the number of characters to throw away.
+     * @param timeoutMs how long to wait for all of them.
+     * @return          the number of characters thrown away.
+     */
+    int discard(int len, int timeoutMs);
+
+    /** Scanner for the fields of the URC being handled, reading the
+     * characters via getc() as they arrive.
+     */
+    class Scanner : public UbloxUrcScanner {
+    public:
+        /** Constructor.
+         *
+         * @param dispatcher the dispatcher handling the URC.
+         * @param copy       a buffer to copy the consumed characters
+         *                   into, NULL if not required.
+         * @param copySize   the size of copy.
+         */
+        Scanner(UbloxUrcDispatcher *dispatcher, char *copy = NULL, int copySize = 0);
+
+    protected:
+        UbloxUrcDispatcher *_dispatcher;
+        virtual int getChar();
+    };
+
+    /** Return the number of prefixes added.
+     *
+     * @return the number of prefixes.
+     */
+    int numPrefixes();
+
+    /** Return the number of trie nodes in use.
+     *
+     * @return the number of trie nodes.
+     */
+    int numNodes();
+
+protected:
+
+    /** Marker for a node with no handler.
+     */
+    #define URC_NO_HANDLER 0xFF
+
+    /** The maximum number of AT parsers: the serial port and
+     * one per multiplexer channel.
+     */
+    #define URC_MAX_PARSERS 4
+
+    /** A node of the trie: children are held as a linked
+     * list through their siblings and node 0 is the root,
+     * so 0 also marks the end of a list.
+     */
+    typedef struct {
+        char ch;
+        uint8_t handler;
+        uint8_t child;
+        uint8_t sibling;
+    } Node;
+
+    class Parser;
+
+    /** An entry point, handed to an AT parser, for a prefix
+     * not covered by a shorter one.
+     */
+    class Entry {
+    public:
+        Parser *parser;
+        uint8_t node;
+        void run();
+    };
+
+    /** An AT parser that URCs arrive on, with its entry points, of
+     * which there is room for as many as there may be prefixes.
+     */
+    class Parser {
+    public:
+        UbloxUrcDispatcher *dispatcher;
+        ATCmdParser *at;
+        FileHandle *fh;
+        Entry *entries;
+    };
+
+    /** Serialises the handling of URCs from different parsers.
+     */
+    Mutex _mtx;
+
+    /** The AT parser that the URC being handled arrived on.
+     */
+    ATCmdParser *_at;
+
+    /** The file handle under _at, NULL if not known.
+     */
+    FileHandle *_fh;
+
+    /** The AT parsers, index 0 being the one given to setParser();
+     * at is NULL where there is none.  The entry points of each are
+     * allocated when it is first used and kept for the next parser
+     * in the same place, since a removed parser keeps them.
+     */
+    Parser _parsers[URC_MAX_PARSERS];
+
+    /** The trie.
+     */
+    Node _nodes[MBED_CONF_UBLOX_CELL_DRIVER_GEN_URC_MAX_TRIE_NODES];
+
+    /** The number of nodes in use.
+     */
+    int _numNodes;
+
+    /** The handlers.
+     */
+    Callback<void()> _handlers[MBED_CONF_UBLOX_CELL_DRIVER_GEN_URC_MAX_PREFIXES];
+
+    /** The number of handlers in use.
+     */
+    int _numHandlers;
+
+    /** The prefixes of the entry points.
+     */
+    const char *_entryPrefixes[MBED_CONF_UBLOX_CELL_DRIVER_GEN_URC_MAX_PREFIXES];
+
+    /** The number of entry points in use.
+     */
+    int _numEntries;
+
+    /** Characters read beyond the end of the matching prefix.
+     */
+    char _lookahead[16];
+
+    /** The number of characters at _lookahead.
+     */
+    int _lookaheadLen;
+
+    /** The next character to return from _lookahead.
+     */
+    int _lookaheadPos;
+
+    /** Find the child of a node for a given character.
+     *
+     * @param node the parent node.
+     * @param ch   the character.
+     * @return     the child node, 0 if there is none.
+     */
+    int findChild(int node, char ch);
+
+    /** Put an AT parser in a place in _parsers, allocating its
+     * entry points if that place has none yet.
+     *
+     * @param parser the index of the place in _parsers.
+     * @param at     the AT parser.
+     * @param fh     the file handle under the AT parser.
+     * @return       true if successful, false if out of memory.
+     */
+    bool setSlot(int parser, ATCmdParser *at, FileHandle *fh);
+
+    /** Hand an entry point to an AT parser.
+     *
+     * @param parser the index of the parser in _parsers.
+     * @param entry  the index of the entry point.
+     * @param node   the node at the end of the entry point's prefix.
+     */
+    void addEntry(int parser, int entry, int node);
+
+    /** Continue from an entry point, reading characters from the AT
+     * parser while a longer prefix may match, then call the handler
+     * for the longest prefix that did.
+     *
+     * @param node the node at the end of the entry point's prefix.
+     */
+    void resolve(int node);
+};
+
+#endif // _UBLOX_URC_DISPATCHER_
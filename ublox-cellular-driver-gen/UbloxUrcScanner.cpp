@@ -0,0 +1,363 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include "UbloxUrcScanner.h"
+
+/**********************************************************************
+ * PROTECTED METHODS
+ **********************************************************************/
+
+// Read the next character from the buffer.
+int UbloxUrcScanner::getChar()
+{
+    int ch = -1;
+
+    if ((_buf != NULL) && (_pos < _len)) {
+        ch = (unsigned char) *(_buf + _pos);
+        _pos++;
+    }
+
+    return ch;
+}
+
+// Look at the next character without consuming it.
+int UbloxUrcScanner::peek()
+{
+    if (!_haveCh) {
+        // Read a buffer directly rather than through getChar()
+        if (_buf != NULL) {
+            _ch = (_pos < _len) ? (unsigned char) *(_buf + _pos) : -1;
+            _pos++;
+        } else {
+            _ch = getChar();
+        }
+        _haveCh = true;
+    }
+
+    return _ch;
+}
+
+// Consume the character returned by peek().
+void UbloxUrcScanner::next()
+{
+    if (_haveCh && (_ch >= 0)) {
+        if ((_copy != NULL) && (_copyLen < _copySize - 1) &&
+            (_ch != '\r') && (_ch != '\n')) {
+            *(_copy + _copyLen) = (char) _ch;
+            _copyLen++;
+            *(_copy + _copyLen) = 0;
+        }
+        _haveCh = false;
+    }
+}
+
+// Skip spaces and, at the start, the colon after the prefix.
+void UbloxUrcScanner::skipSpaces()
+{
+    while (peek() == ' ') {
+        next();
+    }
+    if (!_started) {
+        _started = true;
+        if (peek() == ':') {
+            next();
+            while (peek() == ' ') {
+                next();
+            }
+        }
+    }
+}
+
+// Return whether a character ends a line.
+bool UbloxUrcScanner::isEnd(int ch)
+{
+    return (ch < 0) || (ch == '\r') || (ch == '\n');
+}
+
+// Read one or more decimal digits.
+bool UbloxUrcScanner::getDigits(int32_t *value, int *numChars)
+{
+    int count = 0;
+
+    *value = 0;
+    while ((peek() >= '0') && (peek() <= '9')) {
+        *value = (*value * 10) + (peek() - '0');
+        next();
+        count++;
+    }
+    if (numChars != NULL) {
+        *numChars = count;
+    }
+
+    return count > 0;
+}
+
+// Finish a field.
+bool UbloxUrcScanner::endField()
+{
+    while (peek() == ' ') {
+        next();
+    }
+    if (peek() == ',') {
+        next();
+        return true;
+    }
+
+    return isEnd(peek());
+}
+
+/**********************************************************************
+ * PUBLIC METHODS
+ **********************************************************************/
+
+// Constructor.
+UbloxUrcScanner::UbloxUrcScanner(const char *buf, int len,
+                                 char *copy, int copySize)
+{
+    _buf = buf;
+    _len = len;
+    _pos = 0;
+    _copy = copy;
+    _copySize = copySize;
+    _copyLen = 0;
+    if ((_copy != NULL) && (_copySize > 0)) {
+        *_copy = 0;
+    }
+    _ch = -1;
+    _haveCh = false;
+    _started = false;
+}
+
+// Destructor.
+UbloxUrcScanner::~UbloxUrcScanner()
+{
+}
+
+// Get an integer field.
+bool UbloxUrcScanner::getInt(int *value)
+{
+    int32_t x;
+    bool negative = false;
+
+    skipSpaces();
+    if ((peek() == '-') || (peek() == '+')) {
+        negative = (peek() == '-');
+        next();
+    }
+    if (!getDigits(&x) || !endField()) {
+        return false;
+    }
+    *value = negative ? -x : x;
+
+    return true;
+}
+
+// Get a decimal number field as a fixed point integer.
+bool UbloxUrcScanner::getFixed(int32_t *value, int decimals, bool *hasFraction)
+{
+    int32_t x = 0;
+    bool negative = false;
+    bool digits = false;
+    bool point = false;
+
+    skipSpaces();
+    if ((peek() == '-') || (peek() == '+')) {
+        negative = (peek() == '-');
+        next();
+    }
+    while ((peek() >= '0') && (peek() <= '9')) {
+        x = (x * 10) + (peek() - '0');
+        next();
+        digits = true;
+    }
+    if (peek() == '.') {
+        next();
+        point = true;
+    }
+    for (int y = 0; y < decimals; y++) {
+        x *= 10;
+        if (point && (peek() >= '0') && (peek() <= '9')) {
+            x += peek() - '0';
+            next();
+            digits = true;
+        }
+    }
+    // Drop any digits beyond those we want
+    while (point && (peek() >= '0') && (peek() <= '9')) {
+        next();
+    }
+    if (!digits || !endField()) {
+        return false;
+    }
+    *value = negative ? -x : x;
+    if (hasFraction != NULL) {
+        *hasFraction = point;
+    }
+
+    return true;
+}
+
+// Get a string field.
+int UbloxUrcScanner::getString(char *buf, int size)
+{
+    int count = 0;
+
+    skipSpaces();
+    if (peek() == '\"') {
+        next();
+        while ((peek() >= 0) && (peek() != '\"')) {
+            if (count < size - 1) {
+                *(buf + count) = (char) peek();
+                count++;
+            }
+            next();
+        }
+        if (peek() != '\"') {
+            return -1;
+        }
+        next();
+    } else {
+        while (!isEnd(peek()) && (peek() != ',')) {
+            if (count < size - 1) {
+                *(buf + count) = (char) peek();
+                count++;
+            }
+            next();
+        }
+        // Don't keep trailing spaces
+        while ((count > 0) && (*(buf + count - 1) == ' ')) {
+            count--;
+        }
+    }
+    if (size > 0) {
+        *(buf + count) = 0;
+    }
+
+    return endField() ? count : -1;
+}
+
+// Get a date field.
+bool UbloxUrcScanner::getDate(int *day, int *month, int *year)
+{
+    int32_t d, m, y;
+
+    skipSpaces();
+    if (!getDigits(&d) || (peek() != '/')) {
+        return false;
+    }
+    next();
+    if (!getDigits(&m) || (peek() != '/')) {
+        return false;
+    }
+    next();
+    if (!getDigits(&y) || !endField()) {
+        return false;
+    }
+    *day = d;
+    *month = m;
+    *year = y;
+
+    return true;
+}
+
+// Get a time field.
+bool UbloxUrcScanner::getTime(int *hour, int *minute, int *second)
+{
+    int32_t h, m, s;
+
+    skipSpaces();
+    if (!getDigits(&h) || (peek() != ':')) {
+        return false;
+    }
+    next();
+    if (!getDigits(&m) || (peek() != ':')) {
+        return false;
+    }
+    next();
+    if (!getDigits(&s)) {
+        return false;
+    }
+    if (peek() == '.') {
+        next();
+        while ((peek() >= '0') && (peek() <= '9')) {
+            next();
+        }
+    }
+    if (!endField()) {
+        return false;
+    }
+    *hour = h;
+    *minute = m;
+    *second = s;
+
+    return true;
+}
+
+// Consume the opening quote of a field.
+bool UbloxUrcScanner::openQuote()
+{
+    skipSpaces();
+    if (peek() != '\"') {
+        return false;
+    }
+    next();
+
+    return true;
+}
+
+// Skip a field.
+bool UbloxUrcScanner::skipField()
+{
+    skipSpaces();
+    if (isEnd(peek())) {
+        return false;
+    }
+    if (peek() == '\"') {
+        next();
+        while ((peek() >= 0) && (peek() != '\"')) {
+            next();
+        }
+        next();
+    }
+    while (!isEnd(peek()) && (peek() != ',')) {
+        next();
+    }
+
+    return endField();
+}
+
+// Return whether the end of the line has been reached.
+bool UbloxUrcScanner::atEnd()
+{
+    skipSpaces();
+
+    return isEnd(peek());
+}
+
+// Consume the rest of the line.
+int UbloxUrcScanner::finish()
+{
+    int ch;
+
+    do {
+        ch = peek();
+        next();
+    } while ((ch >= 0) && (ch != '\n'));
+
+    return _copyLen;
+}
+
+// End of file
@@ -0,0 +1,219 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _UBLOX_URC_SCANNER_
+#define _UBLOX_URC_SCANNER_
+
+#include <stdint.h>
+
+/** UbloxUrcScanner class.
+ *
+ * Converts the fields of a URC, the part after the prefix, e.g.
+ * ": 0,4,1" for "+UUHTTPCR: 0,4,1", one field at a time as the
+ * characters are read, without copying the line first and without
+ * using the C library's scanf().  Fields are separated by commas;
+ * a leading colon is skipped, as are spaces around fields.
+ *
+ * As characters are consumed they can also be copied into a buffer
+ * for URCs that need to hand the text of the line on.
+ *
+ * This base class scans a buffer; the characters of a URC as it
+ * arrives are scanned with UbloxUrcDispatcher::Scanner.  The class
+ * does not depend on mbed so that it can also be built on a host.
+ */
+class UbloxUrcScanner {
+
+public:
+    /** Constructor.
+     *
+     * @param buf      the characters to scan, may be NULL if
+     *                 getChar() is overridden.
+     * @param len      the number of characters at buf.
+     * @param copy     a buffer to copy the consumed characters
+     *                 into, excluding line endings, NULL if not
+     *                 required.
+     * @param copySize the size of copy, including room for
+     *                 a null terminator.
+     */
+    UbloxUrcScanner(const char *buf, int len,
+                    char *copy = NULL, int copySize = 0);
+
+    /** Destructor.
+     */
+    virtual ~UbloxUrcScanner();
+
+    /** Get an integer field.
+     *
+     * @param value pointer to a place to put the value.
+     * @return      true if successful, otherwise false.
+     */
+    bool getInt(int *value);
+
+    /** Get a decimal number field, e.g. a latitude, as a fixed
+     * point integer; digits beyond the number of decimal places
+     * asked for are dropped.
+     *
+     * @param value       pointer to a place to put the value,
+     *                    multiplied by 10 to the power decimals.
+     * @param decimals    the number of decimal places to keep.
+     * @param hasFraction pointer to a place to put whether the
+     *                    field had a decimal point, may be NULL.
+     * @return            true if successful, otherwise false.
+     */
+    bool getFixed(int32_t *value, int decimals, bool *hasFraction = NULL);
+
+    /** Get a string field: if the field is quoted everything up
+     * to the closing quote, including commas and line endings, is
+     * the string, otherwise the string ends at the next comma or
+     * the end of the line.  Characters that don't fit are dropped.
+     *
+     * @param buf  the buffer to put the string in.
+     * @param size the size of buf, including room for a
+     *             null terminator.
+     * @return     the number of characters put in buf,
+     *             negative on failure.
+     */
+    int getString(char *buf, int size);
+
+    /** Get a date field of the form dd/mm/yyyy.
+     *
+     * @param day   pointer to a place to put the day of the month.
+     * @param month pointer to a place to put the month, 1 to 12.
+     * @param year  pointer to a place to put the year.
+     * @return      true if successful, otherwise false.
+     */
+    bool getDate(int *day, int *month, int *year);
+
+    /** Get a time field of the form hh:mm:ss, optionally followed
+     * by fractions of a second, which are dropped.
+     *
+     * @param hour   pointer to a place to put the hour.
+     * @param minute pointer to a place to put the minute.
+     * @param second pointer to a place to put the second.
+     * @return       true if successful, otherwise false.
+     */
+    bool getTime(int *hour, int *minute, int *second);
+
+    /** Consume the opening quote of a field that is followed by
+     * data which the caller is going to read some other way.  No
+     * character beyond the quote is read.
+     *
+     * @return true if the field starts with a quote, otherwise false.
+     */
+    bool openQuote();
+
+    /** Skip a field, whatever it contains.
+     *
+     * @return true if successful, false if at the end of the line.
+     */
+    bool skipField();
+
+    /** Return whether the end of the line has been reached.
+     *
+     * @return true if there are no more fields.
+     */
+    bool atEnd();
+
+    /** Consume the rest of the line, including the line ending;
+     * this should always be called once scanning is done so that
+     * none of the line is left behind.
+     *
+     * @return the number of characters in the copy buffer.
+     */
+    int finish();
+
+protected:
+
+    /** The characters being scanned.
+     */
+    const char *_buf;
+
+    /** The number of characters at _buf.
+     */
+    int _len;
+
+    /** The next character to read from _buf.
+     */
+    int _pos;
+
+    /** The buffer to copy consumed characters into.
+     */
+    char *_copy;
+
+    /** The size of _copy.
+     */
+    int _copySize;
+
+    /** The number of characters in _copy.
+     */
+    int _copyLen;
+
+    /** The character that has been read but not yet consumed.
+     */
+    int _ch;
+
+    /** True if _ch holds a character.
+     */
+    bool _haveCh;
+
+    /** True once the leading colon has been dealt with.
+     */
+    bool _started;
+
+    /** Read the next character.
+     *
+     * @return the character, negative if there are no more.
+     */
+    virtual int getChar();
+
+    /** Look at the next character without consuming it.
+     *
+     * @return the character, negative if there are no more.
+     */
+    int peek();
+
+    /** Consume the character returned by peek().
+     */
+    void next();
+
+    /** Skip spaces and, at the start, the colon after the prefix.
+     */
+    void skipSpaces();
+
+    /** Return whether a character ends a line.
+     *
+     * @param ch the character.
+     * @return   true if ch ends a line.
+     */
+    bool isEnd(int ch);
+
+    /** Read one or more decimal digits.
+     *
+     * @param value    pointer to a place to put the value.
+     * @param numChars pointer to a place to put the number of
+     *                 digits read, may be NULL.
+     * @return         true if at least one digit was read.
+     */
+    bool getDigits(int32_t *value, int *numChars = NULL);
+
+    /** Finish a field: consume a following comma, if there is one.
+     *
+     * @return true if the field was followed by a comma or the
+     *         end of the line, false if something else follows.
+     */
+    bool endField();
+};
+
+#endif // _UBLOX_URC_SCANNER_
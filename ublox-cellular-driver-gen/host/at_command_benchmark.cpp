@@ -0,0 +1,266 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host-side benchmark comparing the printf() of ATCmdParser::send(),
+// through which the driver used to send AT commands, with
+// UbloxAtCommand.  Each command is built both ways into a file handle
+// that keeps what is written, the two are checked against each other
+// and then each way is timed over many iterations, in nanoseconds and,
+// where the CPU has a time stamp counter, in cycles.  Build and run
+// with "make".
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "mbed.h"
+#include "ATCmdParser.h"
+#include "UbloxAtCommand.h"
+#if defined(__x86_64__) || defined(__i386__)
+# include <x86intrin.h>
+#endif
+
+// ----------------------------------------------------------------
+// COMPILE-TIME MACROS
+// ----------------------------------------------------------------
+
+// The number of times to send each command.
+#ifndef ITERATIONS
+# define ITERATIONS 100000
+#endif
+
+// The size of the AT parser's buffer, as the driver has it.
+#define PARSER_BUFFER_SIZE 256
+
+// ----------------------------------------------------------------
+// PRIVATE TYPES
+// ----------------------------------------------------------------
+
+// A file handle that keeps the last thing written to it.
+class SinkFileHandle : public FileHandle {
+public:
+    SinkFileHandle() : _count(0) {}
+    virtual ssize_t read(void *buffer, size_t size) { return -EAGAIN; }
+    virtual ssize_t write(const void *buffer, size_t size)
+    {
+        if (_count + size > sizeof (_buf)) {
+            _count = 0;
+        }
+        memcpy(_buf + _count, buffer, size);
+        _count += size;
+        return size;
+    }
+    virtual off_t seek(off_t offset, int whence) { return -ESPIPE; }
+    virtual int close() { return 0; }
+    virtual short poll(short events) const { return POLLOUT; }
+    void clear() { _count = 0; }
+    int count() { return _count; }
+    const char *data() { return _buf; }
+private:
+    char _buf[1024];
+    size_t _count;
+};
+
+// A command, sent both ways, and a name.
+typedef struct {
+    const char *name;
+    bool (*sendParser)(ATCmdParser *at);
+    bool (*sendCommand)(FileHandle *fh);
+} Command;
+
+// ----------------------------------------------------------------
+// PRIVATE VARIABLES
+// ----------------------------------------------------------------
+
+static const char *gFilename = "test_file_name.txt";
+static const char *gPath = "/api/v1/devices/0123456789abcdef/readings?from=2017-07-12T10:00:00Z";
+static char gLongPath[400];
+
+// ----------------------------------------------------------------
+// PRIVATE FUNCTIONS: COMMANDS
+// ----------------------------------------------------------------
+
+static bool cmgdParser(ATCmdParser *at)
+{
+    return at->send("AT+CMGD=%d", 12);
+}
+
+static bool cmgdCommand(FileHandle *fh)
+{
+    return UbloxAtCommand(fh, 0).literal("AT+CMGD=").number(12).send();
+}
+
+static bool urdblockParser(ATCmdParser *at)
+{
+    return at->send("AT+URDBLOCK=\"%s\",%d,%d", gFilename, 12288, 512);
+}
+
+static bool urdblockCommand(FileHandle *fh)
+{
+    return UbloxAtCommand(fh, 0).literal("AT+URDBLOCK=").quoted(gFilename).literal(",").
+           number(12288).literal(",").number(512).send();
+}
+
+static bool uhttpcParser(ATCmdParser *at)
+{
+    return at->send("AT+UHTTPC=%d,%d,\"%s\",\"%s\",\"%s\",%d", 0, 5, gPath,
+                    "http_last_response_0", "temperature=21", 4);
+}
+
+static bool uhttpcCommand(FileHandle *fh)
+{
+    UbloxAtCommand command(fh, 0);
+
+    command.literal("AT+UHTTPC=").number(0).literal(",").number(5).
+            literal(",").quoted(gPath).literal(",").quoted("http_last_response_0").
+            literal(",").quoted("temperature=21").literal(",").number(4);
+    return command.send();
+}
+
+static bool longParser(ATCmdParser *at)
+{
+    return at->send("AT+UHTTPC=%d,%d,\"%s\",\"%s\"", 0, 1, gLongPath, "http_last_response_0");
+}
+
+static bool longCommand(FileHandle *fh)
+{
+    return UbloxAtCommand(fh, 0).literal("AT+UHTTPC=").number(0).literal(",").number(1).
+           literal(",").quoted(gLongPath).literal(",").quoted("http_last_response_0").send();
+}
+
+static const Command commands[] = {
+    {"+CMGD", cmgdParser, cmgdCommand},
+    {"+URDBLOCK", urdblockParser, urdblockCommand},
+    {"+UHTTPC", uhttpcParser, uhttpcCommand},
+    {"+UHTTPC long", longParser, longCommand}
+};
+
+// ----------------------------------------------------------------
+// PRIVATE FUNCTIONS: BENCHMARK
+// ----------------------------------------------------------------
+
+// Return a monotonic time in nanoseconds.
+static long long nowNs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((long long) ts.tv_sec * 1000000000LL) + ts.tv_nsec;
+}
+
+// Return the CPU cycle count, 0 if there is no way to read it.
+static unsigned long long nowCycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// Check that the two ways agree on a command, returning false if
+// they don't; the parser truncates a command that doesn't fit its
+// buffer, which is reported but not a failure.
+static bool check(const Command *command, ATCmdParser *at, SinkFileHandle *sink)
+{
+    char expected[1024];
+    int expectedLen;
+
+    sink->clear();
+    if (!command->sendCommand(sink)) {
+        printf("%-14s send failed\n", command->name);
+        return false;
+    }
+    expectedLen = sink->count();
+    memcpy(expected, sink->data(), expectedLen);
+    sink->clear();
+    command->sendParser(at);
+    if ((sink->count() != expectedLen) || (memcmp(sink->data(), expected, expectedLen) != 0)) {
+        if (expectedLen > PARSER_BUFFER_SIZE) {
+            printf("%-14s (%d characters, truncated to %d by the parser)\n", command->name,
+                   expectedLen, sink->count());
+            return true;
+        }
+        printf("%-14s differs: \"%.*s\", \"%.*s\"\n", command->name,
+               sink->count(), sink->data(), expectedLen, expected);
+        return false;
+    }
+
+    return true;
+}
+
+// Time the parser over ITERATIONS, giving ns and cycles per command.
+static void timeParser(const Command *command, ATCmdParser *at,
+                       long long *ns, unsigned long long *cycles)
+{
+    long long start = nowNs();
+    unsigned long long startCycles = nowCycles();
+
+    for (int x = 0; x < ITERATIONS; x++) {
+        command->sendParser(at);
+    }
+    *cycles = (nowCycles() - startCycles) / ITERATIONS;
+    *ns = (nowNs() - start) / ITERATIONS;
+}
+
+// Time UbloxAtCommand over ITERATIONS, giving ns and cycles per command.
+static void timeCommand(const Command *command, FileHandle *fh,
+                        long long *ns, unsigned long long *cycles)
+{
+    long long start = nowNs();
+    unsigned long long startCycles = nowCycles();
+
+    for (int x = 0; x < ITERATIONS; x++) {
+        command->sendCommand(fh);
+    }
+    *cycles = (nowCycles() - startCycles) / ITERATIONS;
+    *ns = (nowNs() - start) / ITERATIONS;
+}
+
+// ----------------------------------------------------------------
+// MAIN
+// ----------------------------------------------------------------
+
+int main()
+{
+    bool success = true;
+    SinkFileHandle sink;
+    ATCmdParser at(&sink, "\r", PARSER_BUFFER_SIZE, 0);
+    long long parserNs;
+    long long commandNs;
+    unsigned long long parserCycles;
+    unsigned long long commandCycles;
+
+    for (unsigned int x = 0; x < sizeof (gLongPath) - 1; x++) {
+        gLongPath[x] = 'a' + (x % 26);
+    }
+
+    printf("%-14s %10s %10s %14s %14s\n", "Command", "printf ns", "builder ns",
+           "printf cycles", "builder cycles");
+    for (unsigned int x = 0; x < sizeof (commands) / sizeof (commands[0]); x++) {
+        if (check(&commands[x], &at, &sink)) {
+            timeParser(&commands[x], &at, &parserNs, &parserCycles);
+            timeCommand(&commands[x], &sink, &commandNs, &commandCycles);
+            printf("%-14s %10lld %10lld %14llu %14llu\n", commands[x].name,
+                   parserNs, commandNs, parserCycles, commandCycles);
+        } else {
+            success = false;
+        }
+    }
+
+    return success ? 0 : 1;
+}
+
+// End of file
@@ -0,0 +1,222 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host-side benchmark comparing the loop of ATCmdParser::getc(),
+// through which the driver used to receive the data of a +URDBLOCK
+// response, with UbloxAtReader.  Blocks of the sizes readFile() uses,
+// with and without flow control, are read both ways from a file handle
+// that hands out characters as a serial port would, as much as its
+// receive buffer holds at a time; what is read is checked and then
+// each way is timed over many blocks, in CPU nanoseconds and, where
+// the CPU has a time stamp counter, in cycles, per KB.  Build and run
+// with "make".
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "mbed.h"
+#include "ATCmdParser.h"
+#include "UbloxAtReader.h"
+#if defined(__x86_64__) || defined(__i386__)
+# include <x86intrin.h>
+#endif
+
+// ----------------------------------------------------------------
+// COMPILE-TIME MACROS
+// ----------------------------------------------------------------
+
+// The number of KB to read each way for each block size.
+#ifndef KBYTES
+# define KBYTES 16384
+#endif
+
+// The size of a serial port's receive buffer, as UARTSerial has it.
+#define RX_BUFFER_SIZE 256
+
+// The size of the AT parser's buffer, as the driver has it.
+#define PARSER_BUFFER_SIZE 256
+
+// The time limit for a block, long enough never to be reached.
+#define TIME_LIMIT_MS 10000
+
+// ----------------------------------------------------------------
+// PRIVATE TYPES
+// ----------------------------------------------------------------
+
+// A file handle that hands out a repeating pattern of characters,
+// at most a receive buffer's worth per read.
+class SourceFileHandle : public FileHandle {
+public:
+    SourceFileHandle() : _next(0) {}
+    virtual ssize_t read(void *buffer, size_t size)
+    {
+        if (size > RX_BUFFER_SIZE) {
+            size = RX_BUFFER_SIZE;
+        }
+        for (size_t x = 0; x < size; x++) {
+            ((char *) buffer)[x] = pattern(_next);
+            _next++;
+        }
+        return size;
+    }
+    virtual ssize_t write(const void *buffer, size_t size) { return -EAGAIN; }
+    virtual off_t seek(off_t offset, int whence) { return -ESPIPE; }
+    virtual int close() { return 0; }
+    virtual short poll(short events) const { return POLLIN; }
+    void rewind() { _next = 0; }
+    static char pattern(unsigned int x) { return (char) ((x * 7) + (x >> 8)); }
+private:
+    unsigned int _next;
+};
+
+// ----------------------------------------------------------------
+// PRIVATE VARIABLES
+// ----------------------------------------------------------------
+
+// The block sizes of readFile() without and with flow control.
+static const int blockSizes[] = {192, 4096};
+
+static char gBuf[4096];
+
+// ----------------------------------------------------------------
+// PRIVATE FUNCTIONS: READING
+// ----------------------------------------------------------------
+
+// Read a block as readFileStep() used to, a character at a time.
+static int readGetc(ATCmdParser *at, char *buf, int blockSize)
+{
+    Timer timer;
+    int count = 0;
+    int ch;
+
+    timer.start();
+    while ((count < blockSize) && (timer.read_ms() < TIME_LIMIT_MS)) {
+        ch = at->getc();
+        if (ch >= 0) {
+            *(buf + count) = ch;
+            count++;
+        }
+    }
+
+    return count;
+}
+
+// Read a block as readFileStep() does now.
+static int readBulk(FileHandle *fh, char *buf, int blockSize)
+{
+    return UbloxAtReader(fh, TIME_LIMIT_MS).read(buf, blockSize);
+}
+
+// ----------------------------------------------------------------
+// PRIVATE FUNCTIONS: BENCHMARK
+// ----------------------------------------------------------------
+
+// Return the CPU time used by the process in nanoseconds.
+static long long cpuNs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ((long long) ts.tv_sec * 1000000000LL) + ts.tv_nsec;
+}
+
+// Return the CPU cycle count, 0 if there is no way to read it.
+static unsigned long long nowCycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// Check that a block read one way from the start of the pattern
+// holds it, returning false if it doesn't.
+static bool check(const char *name, int blockSize, bool bulk, ATCmdParser *at,
+                  SourceFileHandle *source)
+{
+    int count;
+
+    source->rewind();
+    count = bulk ? readBulk(source, gBuf, blockSize) : readGetc(at, gBuf, blockSize);
+    if (count != blockSize) {
+        printf("%-6s %5d: read %d\n", name, blockSize, count);
+        return false;
+    }
+    for (int x = 0; x < count; x++) {
+        if (gBuf[x] != SourceFileHandle::pattern(x)) {
+            printf("%-6s %5d: differs at %d\n", name, blockSize, x);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Time reading KBYTES in blocks one way, giving CPU ns and cycles
+// per KB.
+static void timeReads(bool bulk, ATCmdParser *at, FileHandle *fh, int blockSize,
+                      long long *ns, unsigned long long *cycles)
+{
+    int blocks = (KBYTES * 1024) / blockSize;
+    long long start = cpuNs();
+    unsigned long long startCycles = nowCycles();
+
+    for (int x = 0; x < blocks; x++) {
+        if (bulk) {
+            readBulk(fh, gBuf, blockSize);
+        } else {
+            readGetc(at, gBuf, blockSize);
+        }
+    }
+    *cycles = (nowCycles() - startCycles) / KBYTES;
+    *ns = (cpuNs() - start) / KBYTES;
+}
+
+// ----------------------------------------------------------------
+// MAIN
+// ----------------------------------------------------------------
+
+int main()
+{
+    bool success = true;
+    SourceFileHandle source;
+    ATCmdParser at(&source, "\r", PARSER_BUFFER_SIZE, TIME_LIMIT_MS);
+    long long getcNs;
+    long long bulkNs;
+    unsigned long long getcCycles;
+    unsigned long long bulkCycles;
+    int size;
+
+    printf("%-10s %12s %12s %14s %14s\n", "Block size", "getc ns/KB", "bulk ns/KB",
+           "getc cycles/KB", "bulk cycles/KB");
+    for (unsigned int x = 0; x < sizeof (blockSizes) / sizeof (blockSizes[0]); x++) {
+        size = blockSizes[x];
+        if (check("getc", size, false, &at, &source) &&
+            check("bulk", size, true, &at, &source)) {
+            timeReads(false, &at, &source, size, &getcNs, &getcCycles);
+            timeReads(true, &at, &source, size, &bulkNs, &bulkCycles);
+            printf("%-10d %12lld %12lld %14llu %14llu\n", size,
+                   getcNs, bulkNs, getcCycles, bulkCycles);
+        } else {
+            success = false;
+        }
+    }
+
+    return success ? 0 : 1;
+}
+
+// End of file
@@ -0,0 +1,2212 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// A mock u-blox cellular module, so that the driver and its greentea
+// tests can run on a PC.  It creates a pty, links it to the path given
+// with -p, where the UARTSerial of the host shim opens it, and answers
+// the AT commands that the driver and the tests use, including the
+// module file system (UDWNFILE, URDBLOCK, ULSTFILE, UDELFILE), HTTP
+// (UHTTP, UHTTPC and +UUHTTPCR), FTP (UFTP, UFTPC, +UUFTPCR and
+// +UUFTPCD), SMS (CMGS, CMGL, CMGR, CMGD and +CMTI), USSD (CUSD),
+// Cell Locate (ULOC, +UULOC and +UULOCIND), AT+IPR, AT&K and the
+// 27.010 multiplexer.  Characters go out no faster than the baud rate
+// allows and each response waits for the configured latency, so that
+// timings measured against it mean something.
+// Build with "make", run with "./mock_modem -h" for the options.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <termios.h>
+#include <pty.h>
+#include <sys/wait.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <functional>
+
+// ----------------------------------------------------------------
+// COMPILE-TIME MACROS
+// ----------------------------------------------------------------
+
+// The path the pty is linked to if -p is not given; the same as
+// HOST_SERIAL_DEFAULT in shim/mbed.h.
+#define DEFAULT_PORT "/tmp/ublox-mock-modem"
+
+// The environment variable that tells the host shim where the pty
+// is, set for the command run after "--".
+#define HOST_SERIAL_ENV "UBLOX_HOST_SERIAL"
+
+// Characters go to the pty in bursts of up to this many, each at
+// the moment its last character would have arrived over a serial
+// line, so that the scheduling of the host (which isn't real time)
+// doesn't hold up a stream more than a burst's worth; no more than
+// the receive buffer of the host shim's UARTSerial holds.
+#define TX_BURST_SIZE 256
+
+// Above the fastest reliable baud rate one character in this many
+// is corrupted.
+#define CORRUPT_INTERVAL 16
+
+// The number of multiplexer channels, DLC 1 upwards; DLC 2 carries
+// the URCs, as the driver expects.
+#define CMUX_NUM_CHANNELS 3
+#define CMUX_URC_CHANNEL 2
+
+// 27.010 framing, as in UbloxCmux.h.
+#define CMUX_FLAG        0xF9
+#define CMUX_EA          0x01
+#define CMUX_CR          0x02
+#define CMUX_PF          0x10
+#define CMUX_FRAME_SABM  0x2F
+#define CMUX_FRAME_UA    0x63
+#define CMUX_FRAME_DM    0x0F
+#define CMUX_FRAME_DISC  0x43
+#define CMUX_FRAME_UIH   0xEF
+#define CMUX_FRAME_UI    0x03
+#define CMUX_MSG_CLD     0xC0
+#define CMUX_MSG_MSC     0xE0
+#define CMUX_V24_FC      0x02
+#define CMUX_FCS_GOOD    0xCF
+#define CMUX_MAX_FRAME_SIZE 1024
+
+// The number of HTTP profiles.
+#define NUM_HTTP_PROFILES 4
+
+// The number of SMS messages the SIM holds.
+#define MAX_NUM_SMS 30
+
+// What the module says about itself.
+#define MODULE_ID "SARA-U201"
+#define MODULE_FIRMWARE "23.60"
+#define MODULE_IMEI "357520070017564"
+#define MODULE_IMSI "234159012345678"
+#define MODULE_ICCID "8944501104169548380"
+#define MODULE_IP_ADDRESS "10.160.23.4"
+
+// The time stamp on SMS messages, listings and positions; fixed so
+// that runs can be compared.
+#define MOCK_DATE_SMS "17/10/16,12:00:00+04"
+#define MOCK_DATE_LOC "16/10/2017,12:00:00.000"
+#define MOCK_DATE_LS "Oct 16 12:00"
+
+// ----------------------------------------------------------------
+// PRIVATE TYPES
+// ----------------------------------------------------------------
+
+// What a channel is doing with the characters it receives.
+typedef enum {
+    MODE_COMMAND,
+    MODE_FILE_DATA,
+    MODE_SMS_TEXT
+} ChannelMode;
+
+// Characters waiting to go out on a channel, not before dueUs.
+typedef struct {
+    uint64_t dueUs;
+    std::string data;
+} Output;
+
+// A channel: the serial port itself (0) or a multiplexer DLC.
+typedef struct {
+    bool open;
+    bool stopped;
+    ChannelMode mode;
+    std::string line;
+    std::string dataName;
+    int dataLen;
+    std::string data;
+    std::deque<Output> tx;
+} Channel;
+
+// Something to do later.
+typedef struct {
+    uint64_t dueUs;
+    std::function<void()> action;
+} Event;
+
+// An HTTP profile.
+typedef struct {
+    std::string serverName;
+    std::string serverIp;
+    int port;
+    bool secure;
+    int errorClass;
+    int errorCode;
+} HttpProfile;
+
+// An SMS message on the SIM.
+typedef struct {
+    int index;
+    std::string stat;
+    std::string number;
+    std::string text;
+} Sms;
+
+// A command line answer from the script.
+typedef struct {
+    std::string command;
+    std::vector<std::string> lines;
+} Reply;
+
+// ----------------------------------------------------------------
+// PRIVATE VARIABLES
+// ----------------------------------------------------------------
+
+// Settings.
+static const char *port = DEFAULT_PORT;
+static int baud = 115200;
+static int maxReliableBaud = 921600;
+static int latencyMs = 0;
+static int networkDelayMs = 100;
+static int blockLossEvery = 0;
+static bool verbose = false;
+
+// The pty.
+static int masterFd = -1;
+static int slaveFd = -1;
+
+// Transmission: the characters being written and when the
+// next may go.
+static std::string txRaw;
+static uint64_t txFreeUs = 0;
+static bool txBlocked = false;
+static unsigned int txCount = 0;
+
+// Changes that take effect once the answer to the command
+// that asked for them has gone.
+static int pendingBaud = 0;
+static bool pendingCmuxOn = false;
+static bool pendingCmuxOff = false;
+
+// The channels, 0 being the serial port when not multiplexed.
+static Channel channels[CMUX_NUM_CHANNELS + 1];
+static bool cmuxOn = false;
+static std::deque<std::string> cmuxControlTx;
+static int cmuxNextChannel = 1;
+
+// The frame being received while multiplexed.
+static int cmuxRxState = 0;
+static uint8_t cmuxRxAddress = 0;
+static uint8_t cmuxRxControl = 0;
+static int cmuxRxLength = 0;
+static std::string cmuxRxData;
+static uint8_t cmuxRxFcs = 0;
+
+// Module state.
+static bool echo = true;
+static bool numericResults = false;
+static int cmeeMode = 2;
+static bool flowControl = false;
+static std::vector<Event> events;
+static std::vector<Reply> replies;
+static std::map<std::string, std::string> files;
+static unsigned int numBlocks = 0;
+static HttpProfile httpProfiles[NUM_HTTP_PROFILES];
+static std::vector<Sms> sms;
+static int smsReference = 0;
+
+// The FTP server: files and directories by full path.
+static std::map<int, std::string> ftpPars;
+static std::map<std::string, std::string> ftpFiles;
+static std::set<std::string> ftpDirs;
+static std::string ftpCwd = "/";
+static bool ftpLoggedIn = false;
+static int ftpErrorClass = 0;
+static int ftpErrorCode = 0;
+// The FTP command waiting for the network, -1 if none, and a count
+// of aborts so that an aborted command does nothing when its time comes
+static int ftpInProgress = -1;
+static int ftpAborts = 0;
+
+// Set on SIGINT/SIGTERM.
+static volatile bool stopRequested = false;
+
+// ----------------------------------------------------------------
+// PRIVATE FUNCTIONS: GENERAL
+// ----------------------------------------------------------------
+
+// Return a monotonic time in microseconds.
+static uint64_t nowUs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec * 1000000ULL) + (ts.tv_nsec / 1000);
+}
+
+// Convert a baud rate to a termios speed, 0 if there isn't one.
+static speed_t baudToSpeed(int rate)
+{
+    switch (rate) {
+        case 9600:
+            return B9600;
+        case 19200:
+            return B19200;
+        case 38400:
+            return B38400;
+        case 57600:
+            return B57600;
+        case 115200:
+            return B115200;
+        case 230400:
+            return B230400;
+        case 460800:
+            return B460800;
+        case 921600:
+            return B921600;
+        case 3000000:
+            return B3000000;
+        default:
+            return 0;
+    }
+}
+
+// Print some characters for -v, escaping what isn't printable.
+static void logData(const char *prefix, const std::string &data)
+{
+    if (verbose) {
+        fprintf(stderr, "%s", prefix);
+        for (size_t x = 0; (x < data.size()) && (x < 200); x++) {
+            unsigned char c = data[x];
+            if (c == '\r') {
+                fprintf(stderr, "\\r");
+            } else if (c == '\n') {
+                fprintf(stderr, "\\n");
+            } else if ((c < 0x20) || (c >= 0x7F)) {
+                fprintf(stderr, "\\x%02x", c);
+            } else {
+                fputc(c, stderr);
+            }
+        }
+        if (data.size() > 200) {
+            fprintf(stderr, "... (%d bytes)", (int) data.size());
+        }
+        fprintf(stderr, "\n");
+    }
+}
+
+// Turn \r, \n, \t, \\ and \xHH in a script string into characters.
+static std::string unescape(const std::string &in)
+{
+    std::string out;
+
+    for (size_t x = 0; x < in.size(); x++) {
+        if ((in[x] == '\\') && (x + 1 < in.size())) {
+            x++;
+            switch (in[x]) {
+                case 'r':
+                    out += '\r';
+                    break;
+                case 'n':
+                    out += '\n';
+                    break;
+                case 't':
+                    out += '\t';
+                    break;
+                case 'x':
+                    if (x + 2 < in.size()) {
+                        out += (char) strtol(in.substr(x + 1, 2).c_str(), NULL, 16);
+                        x += 2;
+                    }
+                    break;
+                default:
+                    out += in[x];
+                    break;
+            }
+        } else {
+            out += in[x];
+        }
+    }
+
+    return out;
+}
+
+// Split the arguments of an AT command at the commas that are
+// outside quotes, removing the quotes.
+static std::vector<std::string> splitArgs(const std::string &args)
+{
+    std::vector<std::string> out;
+    std::string arg;
+    bool quoted = false;
+
+    for (size_t x = 0; x < args.size(); x++) {
+        if (args[x] == '"') {
+            quoted = !quoted;
+        } else if ((args[x] == ',') && !quoted) {
+            out.push_back(arg);
+            arg.clear();
+        } else {
+            arg += args[x];
+        }
+    }
+    out.push_back(arg);
+
+    return out;
+}
+
+// Return the integer value of an argument, or a default.
+static int argInt(const std::vector<std::string> &args, size_t index, int value = -1)
+{
+    if ((index < args.size()) && (args[index].size() > 0)) {
+        value = atoi(args[index].c_str());
+    }
+
+    return value;
+}
+
+// Return a string argument, or an empty string.
+static std::string argStr(const std::vector<std::string> &args, size_t index)
+{
+    return (index < args.size()) ? args[index] : std::string();
+}
+
+// If a command starts with name (ignoring case), put what
+// follows in rest and return true.
+static bool is(const std::string &cmd, const char *name, std::string *rest)
+{
+    size_t len = strlen(name);
+
+    if ((cmd.size() >= len) && (strncasecmp(cmd.c_str(), name, len) == 0)) {
+        *rest = cmd.substr(len);
+        return true;
+    }
+
+    return false;
+}
+
+// A hash, for addresses and check sums that are stable between runs.
+static uint32_t hash(const std::string &str, uint32_t seed = 2166136261U)
+{
+    uint32_t h = seed;
+
+    for (size_t x = 0; x < str.size(); x++) {
+        h = (h ^ (uint8_t) str[x]) * 16777619U;
+    }
+
+    return h;
+}
+
+// Return the time from now until a deadline, or zero if it
+// has passed, but no more than limitUs.
+static uint64_t microsecondsUntil(uint64_t deadlineUs, uint64_t now, uint64_t limitUs)
+{
+    if (deadlineUs <= now) {
+        return 0;
+    }
+
+    return (deadlineUs - now < limitUs) ? deadlineUs - now : limitUs;
+}
+
+// Do something after a delay.
+static void later(int delayMs, std::function<void()> action)
+{
+    Event event;
+
+    event.dueUs = nowUs() + (uint64_t) delayMs * 1000;
+    event.action = action;
+    events.push_back(event);
+}
+
+// ----------------------------------------------------------------
+// PRIVATE FUNCTIONS: OUTPUT
+// ----------------------------------------------------------------
+
+// Queue characters to go out on a channel once the response
+// latency has passed.
+static void respond(Channel *channel, const std::string &data, int delayMs)
+{
+    Output output;
+
+    output.dueUs = nowUs() + (uint64_t) delayMs * 1000;
+    // Never overtake what is already queued
+    if (!channel->tx.empty() && (channel->tx.back().dueUs > output.dueUs)) {
+        output.dueUs = channel->tx.back().dueUs;
+    }
+    output.data = data;
+    channel->tx.push_back(output);
+}
+
+// Information text as the module formats it: between line breaks
+// with verbose result codes (ATV1), followed by one with numeric
+// result codes (ATV0).
+static std::string info(const std::string &text)
+{
+    return numericResults ? text + "\r\n" : "\r\n" + text + "\r\n";
+}
+
+// A final result code as the module formats it: with numeric result
+// codes "OK" is "0" and "ERROR" is "4", ended by a carriage return
+// alone, and with AT+CMEE=1 a +CME ERROR gives a number rather
+// than text.
+static std::string finalResult(const std::string &result)
+{
+    static const struct {
+        const char *text;
+        int code;
+    } cmeErrors[] = {
+        {"operation not allowed", 3},
+        {"FILE NOT FOUND", 1612}
+    };
+    std::string line = result;
+    char buf[32];
+
+    if ((cmeeMode == 1) && (line.compare(0, 12, "+CME ERROR: ") == 0)) {
+        for (size_t x = 0; x < sizeof (cmeErrors) / sizeof (cmeErrors[0]); x++) {
+            if (line.compare(12, std::string::npos, cmeErrors[x].text) == 0) {
+                snprintf(buf, sizeof (buf), "+CME ERROR: %d", cmeErrors[x].code);
+                line = buf;
+            }
+        }
+    }
+    if (!numericResults) {
+        return "\r\n" + line + "\r\n";
+    }
+    if (line == "OK") {
+        return "0\r";
+    }
+    if (line == "ERROR") {
+        return "4\r";
+    }
+
+    return line + "\r\n";
+}
+
+// Send an unsolicited result code now, on the URC channel
+// if multiplexed.
+static void urc(const std::string &line)
+{
+    Channel *channel = &channels[0];
+
+    if (cmuxOn && channels[CMUX_URC_CHANNEL].open) {
+        channel = &channels[CMUX_URC_CHANNEL];
+    }
+    respond(channel, "\r\n" + line + "\r\n", 0);
+}
+
+// Build a multiplexer frame.
+static std::string cmuxFrame(int dlci, uint8_t control, const std::string &data)
+{
+    std::string frame;
+    uint8_t fcs = 0xFF;
+    size_t headerLen;
+    size_t len = data.size();
+
+    frame += (char) CMUX_FLAG;
+    frame += (char) ((dlci << 2) | CMUX_EA);
+    frame += (char) control;
+    if (len > 127) {
+        frame += (char) ((len << 1) & 0xFE);
+        frame += (char) (len >> 7);
+    } else {
+        frame += (char) ((len << 1) | CMUX_EA);
+    }
+    headerLen = frame.size();
+    frame += data;
+    // UIH frames are checked over the header only
+    for (size_t x = 1; x < (((control & ~CMUX_PF) == CMUX_FRAME_UIH) ? headerLen : frame.size()); x++) {
+        fcs ^= (uint8_t) frame[x];
+        for (int y = 0; y < 8; y++) {
+            fcs = (fcs & 0x01) ? (fcs >> 1) ^ 0xE0 : (fcs >> 1);
+        }
+    }
+    frame += (char) (0xFF - fcs);
+    frame += (char) CMUX_FLAG;
+
+    return frame;
+}
+
+// Take the next characters to write from the channels: a burst
+// from the serial port or a frame from one of the DLCs, which
+// take turns.
+static void fillTx(uint64_t now)
+{
+    Channel *channel;
+    std::string data;
+    size_t len;
+
+    if (!cmuxOn) {
+        channel = &channels[0];
+        while (!channel->tx.empty() && (channel->tx.front().dueUs <= now) &&
+               (txRaw.size() < TX_BURST_SIZE)) {
+            // The line is idle until the characters are due
+            if (txRaw.empty() && (txFreeUs < channel->tx.front().dueUs)) {
+                txFreeUs = channel->tx.front().dueUs;
+            }
+            len = TX_BURST_SIZE - txRaw.size();
+            if (len > channel->tx.front().data.size()) {
+                len = channel->tx.front().data.size();
+            }
+            txRaw += channel->tx.front().data.substr(0, len);
+            channel->tx.front().data.erase(0, len);
+            if (channel->tx.front().data.empty()) {
+                channel->tx.pop_front();
+            }
+        }
+    } else if (!cmuxControlTx.empty()) {
+        if (txFreeUs < now) {
+            txFreeUs = now;
+        }
+        txRaw = cmuxControlTx.front();
+        cmuxControlTx.pop_front();
+    } else {
+        for (int x = 0; (x < CMUX_NUM_CHANNELS) && txRaw.empty(); x++) {
+            int dlci = cmuxNextChannel;
+            cmuxNextChannel = (cmuxNextChannel % CMUX_NUM_CHANNELS) + 1;
+            channel = &channels[dlci];
+            // A channel the driver has stopped waits, as does
+            // everything once the pty is full
+            while (channel->open && !channel->stopped && !channel->tx.empty() &&
+                   (channel->tx.front().dueUs <= now) &&
+                   (data.size() < (size_t) 127)) {
+                if (data.empty() && (txFreeUs < channel->tx.front().dueUs)) {
+                    txFreeUs = channel->tx.front().dueUs;
+                }
+                len = 127 - data.size();
+                if (len > channel->tx.front().data.size()) {
+                    len = channel->tx.front().data.size();
+                }
+                data += channel->tx.front().data.substr(0, len);
+                channel->tx.front().data.erase(0, len);
+                if (channel->tx.front().data.empty()) {
+                    channel->tx.pop_front();
+                }
+            }
+            if (!data.empty()) {
+                txRaw = cmuxFrame(dlci, CMUX_FRAME_UIH, data);
+            }
+        }
+    }
+}
+
+// Return whether everything queued has been written.
+static bool txEmpty()
+{
+    if (!txRaw.empty() || !cmuxControlTx.empty()) {
+        return false;
+    }
+    for (int x = 0; x <= CMUX_NUM_CHANNELS; x++) {
+        if (!channels[x].tx.empty()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Reset a channel.
+static void channelReset(Channel *channel)
+{
+    channel->open = false;
+    channel->stopped = false;
+    channel->mode = MODE_COMMAND;
+    channel->line.clear();
+    channel->dataName.clear();
+    channel->dataLen = 0;
+    channel->data.clear();
+    channel->tx.clear();
+}
+
+// Make the changes that wait for the answer to have gone.
+static void txDone()
+{
+    if (txEmpty()) {
+        if (pendingBaud > 0) {
+            if (verbose) {
+                fprintf(stderr, "mock_modem: now at %d baud\n", pendingBaud);
+            }
+            baud = pendingBaud;
+            pendingBaud = 0;
+        }
+        if (pendingCmuxOn) {
+            pendingCmuxOn = false;
+            for (int x = 0; x <= CMUX_NUM_CHANNELS; x++) {
+                channelReset(&channels[x]);
+            }
+            cmuxRxState = 0;
+            cmuxOn = true;
+            if (verbose) {
+                fprintf(stderr, "mock_modem: multiplexer on\n");
+            }
+        }
+        if (pendingCmuxOff) {
+            pendingCmuxOff = false;
+            for (int x = 0; x <= CMUX_NUM_CHANNELS; x++) {
+                channelReset(&channels[x]);
+            }
+            channels[0].open = true;
+            cmuxOn = false;
+            if (verbose) {
+                fprintf(stderr, "mock_modem: multiplexer off\n");
+            }
+        }
+    }
+}
+
+// Return how long some characters take to go at the baud rate.
+static uint64_t txTimeUs(size_t size)
+{
+    return ((uint64_t) size * 10 * 1000000) / baud;
+}
+
+// Return when the next burst of characters may be written.
+static uint64_t txReadyUs()
+{
+    return txFreeUs + txTimeUs((txRaw.size() < TX_BURST_SIZE) ? txRaw.size() : TX_BURST_SIZE);
+}
+
+// Write what is due, no faster than the baud rate.
+static void transmit()
+{
+    uint64_t now = nowUs();
+    struct termios tio;
+    bool garbled = false;
+    char buf[TX_BURST_SIZE];
+    ssize_t len;
+    size_t size;
+
+    if (txRaw.empty()) {
+        fillTx(now);
+        if (!txRaw.empty()) {
+            logData(cmuxOn ? "-> [mux] " : "-> ", txRaw);
+        }
+    }
+    if (txRaw.empty() || (now < txReadyUs())) {
+        return;
+    }
+
+    // If the two ends don't agree on the baud rate
+    // all that arrives is rubbish
+    if ((tcgetattr(slaveFd, &tio) == 0) && (cfgetospeed(&tio) != baudToSpeed(baud))) {
+        garbled = true;
+    }
+
+    size = txRaw.size();
+    if (size > TX_BURST_SIZE) {
+        size = TX_BURST_SIZE;
+    }
+    memcpy(buf, txRaw.data(), size);
+    for (size_t x = 0; x < size; x++) {
+        txCount++;
+        if (garbled) {
+            buf[x] = (char) 0xFF;
+        } else if ((baud > maxReliableBaud) && ((txCount % CORRUPT_INTERVAL) == 0)) {
+            buf[x] ^= 0x55;
+        }
+    }
+
+    len = write(masterFd, buf, size);
+    txBlocked = false;
+    if (len > 0) {
+        txRaw.erase(0, len);
+        // Time lost to the host is made up, but by no more
+        // than a burst
+        txFreeUs += txTimeUs(len);
+        if (txFreeUs + txTimeUs(TX_BURST_SIZE) < now) {
+            txFreeUs = now - txTimeUs(TX_BURST_SIZE);
+        }
+        if (txRaw.empty()) {
+            txDone();
+        }
+    } else if ((len < 0) && (errno == EAGAIN)) {
+        // The other end isn't reading, e.g. RTS is off
+        txBlocked = true;
+    }
+}
+
+// ----------------------------------------------------------------
+// PRIVATE FUNCTIONS: FILE SYSTEM
+// ----------------------------------------------------------------
+
+// AT+UDWNFILE="<filename>",<size>
+static std::string cmdUdwnfile(Channel *channel, const std::vector<std::string> &args)
+{
+    int len = argInt(args, 1);
+
+    if ((args.size() < 2) || args[0].empty() || (len <= 0)) {
+        return "+CME ERROR: operation not allowed";
+    }
+    channel->mode = MODE_FILE_DATA;
+    channel->dataName = args[0];
+    channel->dataLen = len;
+    channel->data.clear();
+    respond(channel, ">", latencyMs);
+
+    return "";
+}
+
+// AT+URDBLOCK="<filename>",<offset>,<size>
+static std::string cmdUrdblock(const std::vector<std::string> &args, std::string *out)
+{
+    std::map<std::string, std::string>::iterator file = files.find(argStr(args, 0));
+    int offset = argInt(args, 1);
+    int size = argInt(args, 2);
+    std::string data;
+    char buf[64];
+
+    if (file == files.end()) {
+        return "+CME ERROR: FILE NOT FOUND";
+    }
+    if ((offset < 0) || (size < 0)) {
+        return "+CME ERROR: operation not allowed";
+    }
+    if (offset < (int) file->second.size()) {
+        data = file->second.substr(offset, size);
+    }
+    snprintf(buf, sizeof (buf), "+URDBLOCK: \"%s\",%d,\"", file->first.c_str(), (int) data.size());
+    // Lose a character, as an overrun receive buffer would
+    if ((blockLossEvery > 0) && !data.empty() && (++numBlocks % blockLossEvery == 0)) {
+        data.erase(data.size() / 2, 1);
+    }
+    *out += info(std::string(buf) + data + "\"");
+
+    return "OK";
+}
+
+// AT+ULSTFILE=[<op_code>[,"<filename>"]]
+static std::string cmdUlstfile(const std::vector<std::string> &args, std::string *out)
+{
+    std::map<std::string, std::string>::iterator file;
+    std::string line = "+ULSTFILE: ";
+    char buf[32];
+
+    switch (argInt(args, 0, 0)) {
+        case 0:
+            for (file = files.begin(); file != files.end(); file++) {
+                if (file != files.begin()) {
+                    line += ",";
+                }
+                line += "\"" + file->first + "\"";
+            }
+            break;
+        case 1:
+            snprintf(buf, sizeof (buf), "%d", 1000000);
+            line += buf;
+            break;
+        case 2:
+            file = files.find(argStr(args, 1));
+            if (file == files.end()) {
+                return "+CME ERROR: FILE NOT FOUND";
+            }
+            snprintf(buf, sizeof (buf), "%d", (int) file->second.size());
+            line += buf;
+            break;
+        default:
+            return "+CME ERROR: operation not allowed";
+    }
+    *out += info(line);
+
+    return "OK";
+}
+
+// AT+UDELFILE="<filename>"
+static std::string cmdUdelfile(const std::vector<std::string> &args)
+{
+    if (files.erase(argStr(args, 0)) == 0) {
+        return "+CME ERROR: FILE NOT FOUND";
+    }
+
+    return "OK";
+}
+
+// ----------------------------------------------------------------
+// PRIVATE FUNCTIONS: HTTP
+// ----------------------------------------------------------------
+
+// Set an HTTP profile back to its defaults.
+static void httpReset(HttpProfile *profile)
+{
+    profile->serverName.clear();
+    profile->serverIp.clear();
+    profile->port = 80;
+    profile->secure = false;
+    profile->errorClass = 0;
+    profile->errorCode = 0;
+}
+
+// Make up the response of a web server.  Requests to httpbin.org
+// are echoed as that server does, text files contain "Hello world!"
+// and anything else is redirected.
+static bool httpResponse(HttpProfile *profile, int cmd, const std::string &path,
+                         const std::string &data, std::string *response)
+{
+    std::string host = profile->serverName.empty() ? profile->serverIp : profile->serverName;
+    std::string scheme = profile->secure ? "https" : "http";
+    std::string status = "200 OK";
+    std::string body;
+    std::string headers;
+    char buf[64];
+
+    if (host == "httpbin.org") {
+        if (path == "/headers") {
+            body = "{\n  \"headers\": {\n    \"Host\": \"httpbin.org\", \n"
+                   "    \"User-Agent\": \"UBlox\"\n  }\n}\n";
+        } else if ((path == "/get") || (path == "/delete") || (path == "/post") ||
+                   (path == "/put")) {
+            body = "{\n  \"args\": {}, \n";
+            if ((cmd == 3) || (cmd == 4) || (cmd == 5)) {
+                body += "  \"data\": \"" + data + "\", \n";
+            }
+            body += "  \"headers\": {\n    \"Host\": \"httpbin.org\"\n  }, \n"
+                    "  \"url\": \"" + scheme + "://httpbin.org" + path + "\"\n}\n";
+        } else {
+            status = "404 NOT FOUND";
+        }
+    } else if (profile->secure) {
+        status = "302 MovedTemporarily";
+    } else if ((path.size() > 4) && (path.compare(path.size() - 4, 4, ".txt") == 0)) {
+        body = "Hello world!\n";
+    } else {
+        status = "301 Moved Permanently";
+    }
+
+    headers = "HTTP/1.1 " + status + "\r\nServer: mock_modem\r\n";
+    if (status[0] == '3') {
+        headers += "Location: " + scheme + "://www." + host + path + "\r\n";
+    }
+    snprintf(buf, sizeof (buf), "Content-Length: %d\r\n", (int) body.size());
+    headers += buf;
+    headers += "Connection: close\r\n\r\n";
+    *response = headers;
+    if (cmd != 0) {
+        *response += body;
+    }
+
+    return status[0] != '4';
+}
+
+// AT+UHTTP=<profile_id>[,<op_code>,<param_val>]
+static std::string cmdUhttp(const std::vector<std::string> &args)
+{
+    int id = argInt(args, 0);
+    HttpProfile *profile;
+
+    if ((id < 0) || (id >= NUM_HTTP_PROFILES)) {
+        return "+CME ERROR: operation not allowed";
+    }
+    profile = &httpProfiles[id];
+    if (args.size() < 3) {
+        httpReset(profile);
+        return "OK";
+    }
+    switch (argInt(args, 1)) {
+        case 0:
+            profile->serverIp = args[2];
+            profile->serverName.clear();
+            break;
+        case 1:
+            profile->serverName = args[2];
+            profile->serverIp.clear();
+            break;
+        case 2:
+        case 3:
+        case 4:
+            break;
+        case 5:
+            profile->port = argInt(args, 2);
+            break;
+        case 6:
+            profile->secure = (argInt(args, 2) != 0);
+            break;
+        default:
+            return "+CME ERROR: operation not allowed";
+    }
+
+    return "OK";
+}
+
+// AT+UHTTPC=<profile_id>,<http_command>,<path>,<filename>[,<param1>[,<param2>[,<param3>]]]
+static std::string cmdUhttpc(const std::vector<std::string> &args)
+{
+    int id = argInt(args, 0);
+    int cmd = argInt(args, 1);
+    std::string path = argStr(args, 2);
+    std::string filename = argStr(args, 3);
+    std::string data = argStr(args, 4);
+    HttpProfile *profile;
+
+    if ((id < 0) || (id >= NUM_HTTP_PROFILES) || (cmd < 0) || (cmd > 5) ||
+        filename.empty()) {
+        return "+CME ERROR: operation not allowed";
+    }
+    profile = &httpProfiles[id];
+
+    later(networkDelayMs, [=]() {
+        HttpProfile *profile = &httpProfiles[id];
+        std::string body = data;
+        std::string response;
+        bool success = !profile->serverName.empty() || !profile->serverIp.empty();
+        char buf[64];
+
+        // PUT and POST of a file send the contents of a file
+        if (success && ((cmd == 3) || (cmd == 4))) {
+            std::map<std::string, std::string>::iterator file = files.find(data);
+            success = (file != files.end());
+            if (success) {
+                body = file->second;
+            }
+        }
+        if (success) {
+            success = httpResponse(profile, cmd, path, body, &response);
+            files[filename] = response;
+        }
+        profile->errorClass = success ? 0 : 3;
+        profile->errorCode = success ? 0 : 73;
+        snprintf(buf, sizeof (buf), "+UUHTTPCR: %d,%d,%d", id, cmd, success ? 1 : 0);
+        urc(buf);
+    });
+    (void) profile;
+
+    return "OK";
+}
+
+// AT+UHTTPER=<profile_id>
+static std::string cmdUhttper(const std::vector<std::string> &args, std::string *out)
+{
+    int id = argInt(args, 0);
+    char buf[64];
+
+    if ((id < 0) || (id >= NUM_HTTP_PROFILES)) {
+        return "+CME ERROR: operation not allowed";
+    }
+    snprintf(buf, sizeof (buf), "+UHTTPER: %d,%d,%d", id,
+             httpProfiles[id].errorClass, httpProfiles[id].errorCode);
+    *out += info(std::string(buf));
+
+    return "OK";
+}
+
+// ----------------------------------------------------------------
+// PRIVATE FUNCTIONS: FTP
+// ----------------------------------------------------------------
+
+// Turn a name on the FTP server into a full path.
+static std::string ftpPath(const std::string &name)
+{
+    std::string path;
+
+    if (name.empty() || (name[0] == '/')) {
+        path = name;
+    } else {
+        path = ftpCwd + ((ftpCwd == "/") ? "" : "/") + name;
+    }
+    if (path.size() > 1 && path[path.size() - 1] == '/') {
+        path.erase(path.size() - 1);
+    }
+
+    return path;
+}
+
+// Return the directory a full path is in.
+static std::string ftpParent(const std::string &path)
+{
+    size_t slash = path.rfind('/');
+
+    return (slash == 0) ? "/" : path.substr(0, slash);
+}
+
+// Return the last part of a full path.
+static std::string ftpBaseName(const std::string &path)
+{
+    return path.substr(path.rfind('/') + 1);
+}
+
+// A line of an FTP directory listing.
+static std::string ftpListLine(const std::string &path, bool isDir)
+{
+    char buf[256];
+    int size = isDir ? 4096 : (int) ftpFiles[path].size();
+
+    snprintf(buf, sizeof (buf), "%s 1 mock mock %d " MOCK_DATE_LS " %s\r\n",
+             isDir ? "drwxr-xr-x" : "-rw-r--r--", size, ftpBaseName(path).c_str());
+
+    return buf;
+}
+
+// List a directory of the FTP server.
+static std::string ftpList(const std::string &dir)
+{
+    std::string listing;
+    std::set<std::string>::iterator d;
+    std::map<std::string, std::string>::iterator f;
+
+    for (d = ftpDirs.begin(); d != ftpDirs.end(); d++) {
+        if ((*d != "/") && (ftpParent(*d) == dir)) {
+            listing += ftpListLine(*d, true);
+        }
+    }
+    for (f = ftpFiles.begin(); f != ftpFiles.end(); f++) {
+        if (ftpParent(f->first) == dir) {
+            listing += ftpListLine(f->first, false);
+        }
+    }
+
+    return listing;
+}
+
+// Carry out an FTP command, returning whether it worked and
+// putting any data for +UUFTPCD in data.
+static bool ftpDo(int cmd, const std::vector<std::string> &args, std::string *data,
+                  std::string *md5)
+{
+    std::string path1 = ftpPath(argStr(args, 1));
+    std::string path2 = ftpPath(argStr(args, 2));
+    std::map<std::string, std::string>::iterator file;
+    std::string newCwd;
+    char buf[40];
+
+    if (cmd == 1) {
+        ftpLoggedIn = !ftpPars[0].empty() || !ftpPars[1].empty();
+        return ftpLoggedIn;
+    }
+    if (!ftpLoggedIn) {
+        return false;
+    }
+
+    switch (cmd) {
+        case 0:
+            ftpLoggedIn = false;
+            ftpCwd = "/";
+            return true;
+        case 2:
+            return ftpFiles.erase(path1) > 0;
+        case 3:
+            file = ftpFiles.find(path1);
+            if ((file == ftpFiles.end()) || (ftpFiles.count(path2) > 0)) {
+                return false;
+            }
+            ftpFiles[path2] = file->second;
+            ftpFiles.erase(path1);
+            return true;
+        case 4:
+            // <remote_filename>,<local_filename>
+            file = ftpFiles.find(path1);
+            if (file == ftpFiles.end()) {
+                return false;
+            }
+            files[args.size() > 2 ? argStr(args, 2) : argStr(args, 1)] =
+                file->second.substr(argInt(args, 3, 0) < (int) file->second.size() ?
+                                    argInt(args, 3, 0) : file->second.size());
+            return true;
+        case 5:
+            // <local_filename>,<remote_filename>
+            file = files.find(argStr(args, 1));
+            if ((file == files.end()) || (ftpDirs.count(ftpParent(path2)) == 0)) {
+                return false;
+            }
+            ftpFiles[args.size() > 2 ? path2 : path1] = file->second;
+            return true;
+        case 8:
+            if (argStr(args, 1) == "..") {
+                newCwd = ftpParent(ftpCwd);
+            } else {
+                newCwd = path1;
+            }
+            if (ftpDirs.count(newCwd) == 0) {
+                return false;
+            }
+            ftpCwd = newCwd;
+            return true;
+        case 10:
+            if ((ftpDirs.count(path1) > 0) || (ftpDirs.count(ftpParent(path1)) == 0)) {
+                return false;
+            }
+            ftpDirs.insert(path1);
+            return true;
+        case 11:
+            if ((path1 == "/") || (ftpDirs.count(path1) == 0) || !ftpList(path1).empty()) {
+                return false;
+            }
+            ftpDirs.erase(path1);
+            return true;
+        case 13:
+            if (ftpFiles.count(path1) > 0) {
+                *data = ftpListLine(path1, false);
+            } else if (ftpDirs.count(path1) > 0) {
+                *data = ftpListLine(path1, true);
+            } else {
+                return false;
+            }
+            return true;
+        case 14:
+            if (args.size() > 1) {
+                if (ftpDirs.count(path1) == 0) {
+                    return false;
+                }
+                *data = ftpList(path1);
+            } else {
+                *data = ftpList(ftpCwd);
+            }
+            return true;
+        case 100:
+            // A check sum stands in for the MD5 sum
+            file = ftpFiles.find(path1);
+            if (file == ftpFiles.end()) {
+                return false;
+            }
+            snprintf(buf, sizeof (buf), "%08x%08x%08x%08x",
+                     hash(file->second, 1), hash(file->second, 2),
+                     hash(file->second, 3), hash(file->second, 4));
+            *md5 = buf;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// AT+UFTP=<op_code>[,<param1>]
+static std::string cmdUftp(const std::vector<std::string> &args)
+{
+    int opCode = argInt(args, 0);
+
+    if ((opCode < 0) || (opCode > 8)) {
+        return "+CME ERROR: operation not allowed";
+    }
+    if (args.size() > 1) {
+        ftpPars[opCode] = args[1];
+    } else {
+        ftpPars.erase(opCode);
+    }
+
+    return "OK";
+}
+
+// AT+UFTPC=<op_code>[,<param1>[,<param2>[,<param3>]]], where op code
+// 20 aborts the command in progress, which then fails at once
+static std::string cmdUftpc(const std::vector<std::string> &args)
+{
+    int cmd = argInt(args, 0);
+    int aborts = ftpAborts;
+
+    if (cmd == 20) {
+        if (ftpInProgress < 0) {
+            return "+CME ERROR: operation not allowed";
+        }
+        cmd = ftpInProgress;
+        ftpInProgress = -1;
+        ftpAborts++;
+        ftpErrorClass = 1;
+        ftpErrorCode = 426;
+        later(0, [=]() {
+            char buf[64];
+
+            snprintf(buf, sizeof (buf), "+UUFTPCR: %d,0", cmd);
+            urc(buf);
+        });
+        return "OK";
+    }
+
+    ftpInProgress = cmd;
+    later(networkDelayMs, [=]() {
+        std::string data;
+        std::string md5;
+        char buf[64];
+        bool success;
+
+        if (aborts != ftpAborts) {
+            return;
+        }
+        ftpInProgress = -1;
+        success = ftpDo(cmd, args, &data, &md5);
+
+        ftpErrorClass = success ? 0 : 1;
+        ftpErrorCode = success ? 0 : 550;
+        if (success && ((cmd == 13) || (cmd == 14))) {
+            snprintf(buf, sizeof (buf), "+UUFTPCD: %d,%d,\"", cmd, (int) data.size());
+            urc(buf + data + "\"");
+        }
+        snprintf(buf, sizeof (buf), "+UUFTPCR: %d,%d", cmd, success ? 1 : 0);
+        if (!md5.empty()) {
+            urc(buf + (",\"" + md5 + "\""));
+        } else {
+            urc(buf);
+        }
+    });
+
+    return "OK";
+}
+
+// AT+UFTPER
+static std::string cmdUftper(std::string *out)
+{
+    char buf[64];
+
+    snprintf(buf, sizeof (buf), "+UFTPER: %d,%d", ftpErrorClass, ftpErrorCode);
+    *out += info(std::string(buf));
+
+    return "OK";
+}
+
+// ----------------------------------------------------------------
+// PRIVATE FUNCTIONS: SMS
+// ----------------------------------------------------------------
+
+// Put a message on the SIM, returning its index or -1 if full.
+static int smsStore(const std::string &stat, const std::string &number,
+                    const std::string &text)
+{
+    Sms message;
+
+    for (int index = 1; index <= MAX_NUM_SMS; index++) {
+        bool used = false;
+        for (size_t x = 0; x < sms.size(); x++) {
+            if (sms[x].index == index) {
+                used = true;
+            }
+        }
+        if (!used) {
+            message.index = index;
+            message.stat = stat;
+            message.number = number;
+            message.text = text;
+            sms.push_back(message);
+            return index;
+        }
+    }
+
+    return -1;
+}
+
+// Find a message on the SIM.
+static Sms *smsFind(int index)
+{
+    for (size_t x = 0; x < sms.size(); x++) {
+        if (sms[x].index == index) {
+            return &sms[x];
+        }
+    }
+
+    return NULL;
+}
+
+// AT+CMGS="<da>"[,<toda>]
+static std::string cmdCmgs(Channel *channel, const std::vector<std::string> &args)
+{
+    if (argStr(args, 0).empty()) {
+        return "+CMS ERROR: 304";
+    }
+    channel->mode = MODE_SMS_TEXT;
+    channel->dataName = args[0];
+    channel->data.clear();
+    respond(channel, "\r\n> ", latencyMs);
+
+    return "";
+}
+
+// The text of a message to send has arrived: the network takes it
+// and, a while later, whoever it went to replies "ACK".
+static void smsSent(Channel *channel)
+{
+    char buf[32];
+    std::string number = channel->dataName;
+
+    smsReference = (smsReference + 1) % 256;
+    snprintf(buf, sizeof (buf), "+CMGS: %d", smsReference);
+    respond(channel, info(buf) + finalResult("OK"), latencyMs + networkDelayMs);
+
+    later(networkDelayMs * 10, [=]() {
+        char buf[32];
+        int index = smsStore("REC UNREAD", number, "ACK");
+
+        if (index > 0) {
+            snprintf(buf, sizeof (buf), "+CMTI: \"SM\",%d", index);
+            urc(buf);
+        }
+    });
+}
+
+// AT+CMGL[="<stat>"]
+static std::string cmdCmgl(const std::vector<std::string> &args, std::string *out)
+{
+    std::string stat = argStr(args, 0);
+    char buf[128];
+
+    if (stat.empty()) {
+        stat = "REC UNREAD";
+    }
+    for (size_t x = 0; x < sms.size(); x++) {
+        if ((stat == "ALL") || (sms[x].stat == stat)) {
+            snprintf(buf, sizeof (buf), "+CMGL: %d,\"%s\",\"%s\",,\"" MOCK_DATE_SMS "\"",
+                     sms[x].index, sms[x].stat.c_str(), sms[x].number.c_str());
+            *out += info(std::string(buf)) + sms[x].text + "\r\n";
+            if (sms[x].stat == "REC UNREAD") {
+                sms[x].stat = "REC READ";
+            }
+        }
+    }
+
+    return "OK";
+}
+
+// AT+CMGR=<index>
+static std::string cmdCmgr(const std::vector<std::string> &args, std::string *out)
+{
+    Sms *message = smsFind(argInt(args, 0));
+    char buf[128];
+
+    if (message == NULL) {
+        return "+CMS ERROR: 321";
+    }
+    if (message->stat == "REC UNREAD") {
+        message->stat = "REC READ";
+    }
+    snprintf(buf, sizeof (buf), "+CMGR: \"%s\",\"%s\",,\"" MOCK_DATE_SMS "\"",
+             message->stat.c_str(), message->number.c_str());
+    *out += info(std::string(buf)) + message->text + "\r\n";
+
+    return "OK";
+}
+
+// AT+CMGD=<index>
+static std::string cmdCmgd(const std::vector<std::string> &args)
+{
+    int index = argInt(args, 0);
+
+    for (size_t x = 0; x < sms.size(); x++) {
+        if (sms[x].index == index) {
+            sms.erase(sms.begin() + x);
+            return "OK";
+        }
+    }
+
+    return "+CMS ERROR: 321";
+}
+
+// ----------------------------------------------------------------
+// PRIVATE FUNCTIONS: USSD AND CELL LOCATE
+// ----------------------------------------------------------------
+
+// AT+CUSD=[<n>[,<str>[,<dcs>]]]
+static std::string cmdCusd(const std::vector<std::string> &args)
+{
+    std::string str = argStr(args, 1);
+
+    if (argInt(args, 0, 0) == 1) {
+        later(networkDelayMs, [=]() {
+            std::string answer;
+
+            if (str == "*100#") {
+                answer = "Your balance is 10.00 GBP";
+            } else if (str.compare(0, 2, "*#") == 0) {
+                answer = "Service " + str.substr(2, str.size() - 3) + " is not active";
+            } else {
+                answer = "Unknown service code " + str;
+            }
+            urc("+CUSD: 0,\"" + answer + "\",15");
+        });
+    }
+
+    return "OK";
+}
+
+// AT+ULOC=2,<sensor>,<response_type>,<timeout>,<accuracy>[,<num_hypothesis>]
+static std::string cmdUloc(const std::vector<std::string> &args)
+{
+    int type = argInt(args, 2, 0);
+    int numHypothesis = argInt(args, 5, 1);
+
+    if ((argInt(args, 0) != 2) || (type < 0) || (type > 2) ||
+        (numHypothesis < 1) || (numHypothesis > 16)) {
+        return "+CME ERROR: operation not allowed";
+    }
+
+    // The scan and the server exchange, then the answer
+    for (int step = 0; step < 4; step++) {
+        later(networkDelayMs * (step + 1), [=]() {
+            char buf[32];
+            snprintf(buf, sizeof (buf), "+UULOCIND: %d,0", step);
+            urc(buf);
+        });
+    }
+    later(networkDelayMs * 5, [=]() {
+        char buf[160];
+
+        if (type == 0) {
+            urc("+UULOC: " MOCK_DATE_LOC ",52.2225403,-0.0738213,45,750");
+        } else if (type == 1) {
+            urc("+UULOC: " MOCK_DATE_LOC ",52.2225403,-0.0738213,45,750,0,0,0,2,0,0,0");
+        } else {
+            for (int x = 1; x <= numHypothesis; x++) {
+                snprintf(buf, sizeof (buf),
+                         "+UULOC: %d,%d,2," MOCK_DATE_LOC ",52.22%05d,-0.07%05d,45,%d,0,0,0,0,0,0",
+                         x, numHypothesis, 25403 + (x * 100), 38213 + (x * 100), 750 + (x * 50));
+                urc(buf);
+            }
+        }
+    });
+
+    return "OK";
+}
+
+// ----------------------------------------------------------------
+// PRIVATE FUNCTIONS: COMMANDS
+// ----------------------------------------------------------------
+
+// The test form of a command, "<name>=?", giving the ranges of its
+// parameters for those that the mock answers.
+static std::string cmdTest(const std::string &name, std::string *out)
+{
+    char buf[64];
+
+    if (strcasecmp(name.c_str(), "+UHTTP") == 0) {
+        snprintf(buf, sizeof (buf), "+UHTTP: (0-%d),(0-10)", NUM_HTTP_PROFILES - 1);
+        *out += info(std::string(buf));
+    } else if (strcasecmp(name.c_str(), "+UFTPC") == 0) {
+        *out += info("+UFTPC: (0-8,10,11,13,14,20,100)");
+    } else if ((strcasecmp(name.c_str(), "+URDBLOCK") != 0) &&
+               (strcasecmp(name.c_str(), "+UGSRV") != 0) &&
+               (strcasecmp(name.c_str(), "+UGAOP") != 0)) {
+        return "ERROR";
+    }
+
+    return "OK";
+}
+
+// Carry out one command of a command line (without "AT" or ";"),
+// adding any information text to out and returning the final
+// result code, or an empty string if the command has answered
+// for itself.
+static std::string execute(Channel *channel, const std::string &cmd, std::string *out)
+{
+    std::string rest;
+    std::vector<std::string> args;
+    char buf[64];
+
+    // The script comes first
+    for (size_t x = 0; x < replies.size(); x++) {
+        if ((cmd.size() >= replies[x].command.size()) &&
+            (strncasecmp(cmd.c_str(), replies[x].command.c_str(), replies[x].command.size()) == 0)) {
+            for (size_t y = 0; y + 1 < replies[x].lines.size(); y++) {
+                *out += info(replies[x].lines[y]);
+            }
+            return replies[x].lines.empty() ? std::string("OK") : replies[x].lines.back();
+        }
+    }
+
+    if (cmd.empty()) {
+        return "OK";
+    }
+    // Basic commands may follow one another with no ';', e.g. "E0V0"
+    if ((cmd[0] != '+') && (cmd.size() > 2) && isdigit((unsigned char) cmd[1]) &&
+        !isdigit((unsigned char) cmd[2])) {
+        rest = execute(channel, cmd.substr(0, 2), out);
+        return (rest == "OK") ? execute(channel, cmd.substr(2), out) : rest;
+    }
+    if (is(cmd, "E", &rest) && ((rest == "0") || (rest == "1") || rest.empty())) {
+        echo = (rest == "1");
+        return "OK";
+    }
+    if (is(cmd, "V", &rest) && ((rest == "0") || (rest == "1") || rest.empty())) {
+        // Takes effect at once, so ATV0 is answered with "0"
+        numericResults = (rest != "1");
+        return "OK";
+    }
+    if (is(cmd, "+CMEE=", &rest)) {
+        cmeeMode = atoi(rest.c_str());
+        return "OK";
+    }
+    if (is(cmd, "&K", &rest)) {
+        flowControl = (rest == "3");
+        return "OK";
+    }
+    if (is(cmd, "I", &rest) && (rest.empty() || (rest == "0"))) {
+        *out += info(MODULE_ID);
+        return "OK";
+    }
+    if (cmd[0] != '+') {
+        return "ERROR";
+    }
+    if ((cmd.size() > 2) && (cmd.compare(cmd.size() - 2, 2, "=?") == 0)) {
+        return cmdTest(cmd.substr(0, cmd.size() - 2), out);
+    }
+
+    // Extended commands: "+NAME", "+NAME?" or "+NAME=<args>"
+    if (is(cmd, "+CPIN?", &rest)) {
+        *out += info("+CPIN: READY");
+        return "OK";
+    }
+    if (is(cmd, "+CCID", &rest)) {
+        *out += info("+CCID: " MODULE_ICCID);
+        return "OK";
+    }
+    if (is(cmd, "+CIMI", &rest)) {
+        *out += info(MODULE_IMSI);
+        return "OK";
+    }
+    if (is(cmd, "+CGMR", &rest)) {
+        *out += info(MODULE_FIRMWARE);
+        return "OK";
+    }
+    if (is(cmd, "+CGSN", &rest)) {
+        *out += info(MODULE_IMEI);
+        return "OK";
+    }
+    if (is(cmd, "+CREG?", &rest) || is(cmd, "+CGREG?", &rest) || is(cmd, "+CEREG?", &rest)) {
+        snprintf(buf, sizeof (buf), "%.*s: 0,1", (int) cmd.size() - 1, cmd.c_str());
+        *out += info(std::string(buf));
+        return "OK";
+    }
+    if (is(cmd, "+COPS?", &rest)) {
+        *out += info("+COPS: 0,0,\"MOCK\",2");
+        return "OK";
+    }
+    if (is(cmd, "+UPSND=", &rest)) {
+        args = splitArgs(rest);
+        snprintf(buf, sizeof (buf), "+UPSND: %d,0,\"" MODULE_IP_ADDRESS "\"", argInt(args, 0));
+        *out += info(std::string(buf));
+        return "OK";
+    }
+    if (is(cmd, "+UDNSRN=", &rest)) {
+        uint32_t h = hash(argStr(splitArgs(rest), 1));
+        snprintf(buf, sizeof (buf), "+UDNSRN: \"%d.%d.%d.%d\"", 1 + (h >> 24) % 223,
+                 (h >> 16) & 0xFF, (h >> 8) & 0xFF, 1 + (h & 0xFF) % 254);
+        *out += info(std::string(buf));
+        return "OK";
+    }
+    if (is(cmd, "+IPR?", &rest)) {
+        snprintf(buf, sizeof (buf), "+IPR: %d", baud);
+        *out += info(std::string(buf));
+        return "OK";
+    }
+    if (is(cmd, "+IPR=", &rest)) {
+        if (baudToSpeed(atoi(rest.c_str())) == 0) {
+            return "ERROR";
+        }
+        pendingBaud = atoi(rest.c_str());
+        return "OK";
+    }
+    if (is(cmd, "+CMUX=", &rest)) {
+        if (cmuxOn) {
+            return "ERROR";
+        }
+        pendingCmuxOn = true;
+        return "OK";
+    }
+    if (is(cmd, "+UDWNFILE=", &rest)) {
+        return cmdUdwnfile(channel, splitArgs(rest));
+    }
+    if (is(cmd, "+URDBLOCK=", &rest)) {
+        return cmdUrdblock(splitArgs(rest), out);
+    }
+    if (is(cmd, "+ULSTFILE", &rest)) {
+        return cmdUlstfile(splitArgs(rest.empty() ? rest : rest.substr(1)), out);
+    }
+    if (is(cmd, "+UDELFILE=", &rest)) {
+        return cmdUdelfile(splitArgs(rest));
+    }
+    if (is(cmd, "+UHTTPER=", &rest)) {
+        return cmdUhttper(splitArgs(rest), out);
+    }
+    if (is(cmd, "+UHTTPC=", &rest)) {
+        return cmdUhttpc(splitArgs(rest));
+    }
+    if (is(cmd, "+UHTTP=", &rest)) {
+        return cmdUhttp(splitArgs(rest));
+    }
+    if (is(cmd, "+UFTPER", &rest)) {
+        return cmdUftper(out);
+    }
+    if (is(cmd, "+UFTPC=", &rest)) {
+        return cmdUftpc(splitArgs(rest));
+    }
+    if (is(cmd, "+UFTP=", &rest)) {
+        return cmdUftp(splitArgs(rest));
+    }
+    if (is(cmd, "+CMGS=", &rest)) {
+        return cmdCmgs(channel, splitArgs(rest));
+    }
+    if (is(cmd, "+CMGL", &rest)) {
+        return cmdCmgl(splitArgs(rest.empty() ? rest : rest.substr(1)), out);
+    }
+    if (is(cmd, "+CMGR=", &rest)) {
+        return cmdCmgr(splitArgs(rest), out);
+    }
+    if (is(cmd, "+CMGD=", &rest)) {
+        return cmdCmgd(splitArgs(rest));
+    }
+    if (is(cmd, "+CUSD=", &rest)) {
+        return cmdCusd(splitArgs(rest));
+    }
+    if (is(cmd, "+ULOC=", &rest)) {
+        return cmdUloc(splitArgs(rest));
+    }
+
+    // Settings that need only an OK
+    if (is(cmd, "+CPIN=", &rest) || is(cmd, "+UGPIOC=", &rest) ||
+        is(cmd, "+CREG=", &rest) || is(cmd, "+CGREG=", &rest) || is(cmd, "+CEREG=", &rest) ||
+        is(cmd, "+COPS=", &rest) || is(cmd, "+UPSD=", &rest) || is(cmd, "+UPSDA=", &rest) ||
+        is(cmd, "+CMGF=", &rest) || is(cmd, "+CNMI=", &rest) || is(cmd, "+UGSRV=", &rest) ||
+        is(cmd, "+UGAOP=", &rest) || is(cmd, "+ULOCCELL=", &rest) ||
+        is(cmd, "+ULOCIND=", &rest)) {
+        return "OK";
+    }
+
+    return "ERROR";
+}
+
+// Carry out a command line: "AT" followed by one or more commands
+// separated by ';', stopping at the first that fails.
+static void commandLine(Channel *channel, const std::string &line)
+{
+    std::string out;
+    std::string result = "OK";
+    std::string cmd;
+    bool quoted = false;
+    size_t start;
+
+    logData("<- ", line);
+    if (echo) {
+        out = line + "\r";
+    }
+    if ((line.size() < 2) || (strncasecmp(line.c_str(), "AT", 2) != 0)) {
+        // Not a command, the module ignores it
+        if (!out.empty()) {
+            respond(channel, out, 0);
+        }
+        return;
+    }
+
+    start = 2;
+    for (size_t x = 2; (x <= line.size()) && (result == "OK"); x++) {
+        if ((x < line.size()) && (line[x] == '"')) {
+            quoted = !quoted;
+        } else if ((x == line.size()) || ((line[x] == ';') && !quoted)) {
+            cmd = line.substr(start, x - start);
+            start = x + 1;
+            if (!cmd.empty() || (x == line.size())) {
+                result = execute(channel, cmd, &out);
+            }
+        }
+    }
+
+    if (!result.empty()) {
+        out += finalResult(result);
+    }
+    if (!out.empty()) {
+        respond(channel, out, latencyMs);
+    }
+}
+
+// Deal with a character received on a channel.
+static void channelRx(Channel *channel, char c)
+{
+    switch (channel->mode) {
+        case MODE_FILE_DATA:
+            channel->data += c;
+            if ((int) channel->data.size() >= channel->dataLen) {
+                files[channel->dataName] = channel->data;
+                channel->data.clear();
+                channel->mode = MODE_COMMAND;
+                respond(channel, finalResult("OK"), latencyMs);
+            }
+            break;
+        case MODE_SMS_TEXT:
+            if (c == 0x1A) {
+                // CTRL-Z sends
+                channel->mode = MODE_COMMAND;
+                smsSent(channel);
+                channel->data.clear();
+            } else if (c == 0x1B) {
+                // ESC abandons
+                channel->mode = MODE_COMMAND;
+                channel->data.clear();
+                respond(channel, finalResult("OK"), latencyMs);
+            } else {
+                channel->data += c;
+            }
+            break;
+        default:
+            if (c == '\r') {
+                if (!channel->line.empty()) {
+                    commandLine(channel, channel->line);
+                }
+                channel->line.clear();
+            } else if ((c != '\n') && (channel->line.size() < 1024)) {
+                channel->line += c;
+            }
+            break;
+    }
+}
+
+// ----------------------------------------------------------------
+// PRIVATE FUNCTIONS: MULTIPLEXER
+// ----------------------------------------------------------------
+
+// Handle a complete frame from the driver.
+static void cmuxRxFrame()
+{
+    int dlci = (cmuxRxAddress >> 2) & 0x3F;
+    uint8_t control = cmuxRxControl & ~CMUX_PF;
+    std::string response;
+
+    logData("<- [mux] ", cmuxRxData);
+    if (dlci > CMUX_NUM_CHANNELS) {
+        cmuxControlTx.push_back(cmuxFrame(dlci, CMUX_FRAME_DM | CMUX_PF, ""));
+        return;
+    }
+
+    switch (control) {
+        case CMUX_FRAME_SABM:
+            channels[dlci].open = true;
+            cmuxControlTx.push_back(cmuxFrame(dlci, CMUX_FRAME_UA | CMUX_PF, ""));
+            break;
+        case CMUX_FRAME_DISC:
+            if (dlci == 0) {
+                pendingCmuxOff = true;
+            } else {
+                channelReset(&channels[dlci]);
+            }
+            cmuxControlTx.push_back(cmuxFrame(dlci, CMUX_FRAME_UA | CMUX_PF, ""));
+            break;
+        case CMUX_FRAME_UIH:
+        case CMUX_FRAME_UI:
+            if ((dlci == 0) && (cmuxRxData.size() >= 2) && (cmuxRxData[0] & CMUX_CR)) {
+                // A command: answer with the same message as a response
+                uint8_t type = cmuxRxData[0] & ~(CMUX_CR | CMUX_EA);
+                if ((type == CMUX_MSG_MSC) && (cmuxRxData.size() >= 4)) {
+                    int channel = (cmuxRxData[2] >> 2) & 0x3F;
+                    if ((channel >= 1) && (channel <= CMUX_NUM_CHANNELS)) {
+                        channels[channel].stopped = (cmuxRxData[3] & CMUX_V24_FC) != 0;
+                    }
+                } else if (type == CMUX_MSG_CLD) {
+                    pendingCmuxOff = true;
+                }
+                response = cmuxRxData;
+                response[0] = cmuxRxData[0] & ~CMUX_CR;
+                cmuxControlTx.push_back(cmuxFrame(0, CMUX_FRAME_UIH, response));
+            } else if ((dlci > 0) && channels[dlci].open) {
+                for (size_t x = 0; x < cmuxRxData.size(); x++) {
+                    channelRx(&channels[dlci], cmuxRxData[x]);
+                }
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// Run the frame reader over a received character.
+static void cmuxRx(char c)
+{
+    uint8_t byte = (uint8_t) c;
+
+    // Each state adds the byte to the check sum as it goes
+    switch (cmuxRxState) {
+        case 0:
+            if (byte == CMUX_FLAG) {
+                cmuxRxState = 1;
+            }
+            return;
+        case 1:
+            if (byte == CMUX_FLAG) {
+                return;
+            }
+            cmuxRxAddress = byte;
+            cmuxRxFcs = 0xFF;
+            cmuxRxState = 2;
+            break;
+        case 2:
+            cmuxRxControl = byte;
+            cmuxRxState = 3;
+            break;
+        case 3:
+            cmuxRxLength = byte >> 1;
+            cmuxRxData.clear();
+            cmuxRxState = (byte & CMUX_EA) ? ((cmuxRxLength > 0) ? 5 : 6) : 4;
+            break;
+        case 4:
+            cmuxRxLength |= ((int) byte) << 7;
+            cmuxRxState = (cmuxRxLength > 0) ? 5 : 6;
+            break;
+        case 5:
+            cmuxRxData += c;
+            if ((int) cmuxRxData.size() >= cmuxRxLength) {
+                cmuxRxState = 6;
+            }
+            if ((cmuxRxControl & ~CMUX_PF) == CMUX_FRAME_UIH) {
+                return;
+            }
+            if (cmuxRxLength > CMUX_MAX_FRAME_SIZE) {
+                cmuxRxState = 0;
+                return;
+            }
+            break;
+        case 6:
+            cmuxRxState = 7;
+            break;
+        default:
+            if (byte == CMUX_FLAG) {
+                if (cmuxRxFcs == CMUX_FCS_GOOD) {
+                    cmuxRxFrame();
+                }
+                cmuxRxState = 1;
+            } else {
+                cmuxRxState = 0;
+            }
+            return;
+    }
+
+    cmuxRxFcs ^= byte;
+    for (int y = 0; y < 8; y++) {
+        cmuxRxFcs = (cmuxRxFcs & 0x01) ? (cmuxRxFcs >> 1) ^ 0xE0 : (cmuxRxFcs >> 1);
+    }
+}
+
+// ----------------------------------------------------------------
+// PRIVATE FUNCTIONS: SET-UP
+// ----------------------------------------------------------------
+
+// Put the initial contents on the FTP server.
+static void ftpInit()
+{
+    ftpDirs.insert("/");
+    ftpDirs.insert("/pub");
+    ftpFiles["/readme.txt"] = "Welcome to the mock_modem FTP server.\r\n";
+    ftpFiles["/pub/example.txt"] = "Hello world!\r\n";
+}
+
+// Read a script, returning false on error.  Each line is one of:
+//   reply <command> => <line>[\n<line>...]  answer a command that starts
+//                                           with <command> (e.g. "+CSQ")
+//                                           with these lines, the last
+//                                           being the final result code
+//   urc <ms> <line>                         send a URC <ms> after start
+//   file <name> <contents>                  put a file on the module
+//   ftp <path> [<contents>]                 put a file on the FTP server,
+//                                           or a directory if <path>
+//                                           ends with '/'
+//   sms <number> <text>                     put an unread SMS on the SIM
+// Strings may contain \r, \n, \t, \\ and \xHH; '#' starts a comment.
+static bool readScript(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    char buf[4096];
+    int lineNumber = 0;
+    bool success = true;
+
+    if (fp == NULL) {
+        fprintf(stderr, "mock_modem: unable to open script %s (%s)\n", path, strerror(errno));
+        return false;
+    }
+
+    while (success && (fgets(buf, sizeof (buf), fp) != NULL)) {
+        std::string line = buf;
+        std::string keyword;
+        std::string first;
+        std::string rest;
+        size_t x;
+
+        lineNumber++;
+        while (!line.empty() && ((line[line.size() - 1] == '\n') || (line[line.size() - 1] == '\r'))) {
+            line.erase(line.size() - 1);
+        }
+        if (line.empty() || (line[0] == '#')) {
+            continue;
+        }
+        x = line.find(' ');
+        keyword = line.substr(0, x);
+        rest = (x == std::string::npos) ? "" : line.substr(x + 1);
+        x = rest.find(' ');
+        first = rest.substr(0, x);
+        rest = (x == std::string::npos) ? "" : rest.substr(x + 1);
+
+        if (keyword == "reply") {
+            Reply reply;
+            std::string answer;
+            x = line.find("=>");
+            if (x == std::string::npos) {
+                success = false;
+            } else {
+                reply.command = line.substr(6, x - 6);
+                while (!reply.command.empty() && (reply.command[reply.command.size() - 1] == ' ')) {
+                    reply.command.erase(reply.command.size() - 1);
+                }
+                if (strncasecmp(reply.command.c_str(), "AT", 2) == 0) {
+                    reply.command.erase(0, 2);
+                }
+                answer = unescape(line.substr(x + 2 + ((line.size() > x + 2) && (line[x + 2] == ' '))));
+                while (!answer.empty()) {
+                    x = answer.find('\n');
+                    reply.lines.push_back(answer.substr(0, x));
+                    answer = (x == std::string::npos) ? "" : answer.substr(x + 1);
+                }
+                replies.push_back(reply);
+            }
+        } else if (keyword == "urc") {
+            std::string text = unescape(rest);
+            later(atoi(first.c_str()), [=]() { urc(text); });
+        } else if (keyword == "file") {
+            files[first] = unescape(rest);
+        } else if (keyword == "ftp") {
+            if (!first.empty() && (first[first.size() - 1] == '/')) {
+                ftpDirs.insert(ftpPath(first));
+            } else {
+                ftpFiles[ftpPath(first)] = unescape(rest);
+            }
+        } else if (keyword == "sms") {
+            smsStore("REC UNREAD", first, unescape(rest));
+        } else {
+            success = false;
+        }
+        if (!success) {
+            fprintf(stderr, "mock_modem: %s line %d not understood: %s\n", path, lineNumber, buf);
+        }
+    }
+
+    fclose(fp);
+    return success;
+}
+
+// Create the pty and link it to the port path.
+static bool openPty()
+{
+    struct termios tio;
+    char name[256];
+    int flags;
+
+    if (openpty(&masterFd, &slaveFd, name, NULL, NULL) < 0) {
+        fprintf(stderr, "mock_modem: unable to open a pty (%s)\n", strerror(errno));
+        return false;
+    }
+    // The slave stays open here as well so that the driver can
+    // come and go; it starts at the mock's baud rate
+    if (tcgetattr(slaveFd, &tio) == 0) {
+        cfmakeraw(&tio);
+        cfsetispeed(&tio, baudToSpeed(baud));
+        cfsetospeed(&tio, baudToSpeed(baud));
+        tcsetattr(slaveFd, TCSANOW, &tio);
+    }
+    flags = fcntl(masterFd, F_GETFL);
+    fcntl(masterFd, F_SETFL, flags | O_NONBLOCK);
+
+    unlink(port);
+    if (symlink(name, port) < 0) {
+        fprintf(stderr, "mock_modem: unable to link %s to %s (%s)\n", port, name, strerror(errno));
+        return false;
+    }
+    if (verbose) {
+        fprintf(stderr, "mock_modem: %s is %s, %d baud\n", port, name, baud);
+    }
+
+    return true;
+}
+
+// Stop on SIGINT or SIGTERM.
+static void stopHandler(int signal)
+{
+    (void) signal;
+    stopRequested = true;
+}
+
+// Print the usage.
+static void usage(const char *name)
+{
+    printf("Usage: %s [options] [-- command [args]]\n"
+           "A mock u-blox module on a pty, for running the driver on a PC.  If a\n"
+           "command is given it is run with " HOST_SERIAL_ENV " set to the pty and\n"
+           "the mock stops when it exits, with its exit status; otherwise the mock\n"
+           "runs until stopped.\n"
+           "  -p path  link the pty to path (default " DEFAULT_PORT ")\n"
+           "  -b baud  the baud rate to start at (default 115200)\n"
+           "  -r baud  the fastest reliable baud rate; above it characters\n"
+           "           are corrupted (default 921600)\n"
+           "  -l ms    the latency of each response (default 0)\n"
+           "  -d ms    the delay of the network, before the result of an HTTP,\n"
+           "           FTP, USSD or Cell Locate operation (default 100); SMS\n"
+           "           replies take ten times this\n"
+           "  -e n     lose a character from every nth +URDBLOCK block (default\n"
+           "           0, none)\n"
+           "  -s file  a script of answers, URCs, files and messages\n"
+           "  -v       print what goes back and forth on stderr\n"
+           "  -h       print this\n", name);
+}
+
+// ----------------------------------------------------------------
+// MAIN
+// ----------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+    const char *script = NULL;
+    char **command = NULL;
+    pid_t child = -1;
+    int status = 0;
+    int opt;
+    char buf[256];
+    ssize_t len;
+    struct pollfd pfd;
+    struct timespec ts;
+    uint64_t now;
+    uint64_t waitUs;
+
+    while ((opt = getopt(argc, argv, "p:b:r:l:d:e:s:vh")) != -1) {
+        switch (opt) {
+            case 'p':
+                port = optarg;
+                break;
+            case 'b':
+                baud = atoi(optarg);
+                break;
+            case 'r':
+                maxReliableBaud = atoi(optarg);
+                break;
+            case 'l':
+                latencyMs = atoi(optarg);
+                break;
+            case 'd':
+                networkDelayMs = atoi(optarg);
+                break;
+            case 'e':
+                blockLossEvery = atoi(optarg);
+                break;
+            case 's':
+                script = optarg;
+                break;
+            case 'v':
+                verbose = true;
+                break;
+            default:
+                usage(argv[0]);
+                return (opt == 'h') ? 0 : 2;
+        }
+    }
+    if (optind < argc) {
+        command = argv + optind;
+    }
+    if (baudToSpeed(baud) == 0) {
+        fprintf(stderr, "mock_modem: %d baud is not supported\n", baud);
+        return 2;
+    }
+
+    for (int x = 0; x < NUM_HTTP_PROFILES; x++) {
+        httpReset(&httpProfiles[x]);
+    }
+    for (int x = 0; x <= CMUX_NUM_CHANNELS; x++) {
+        channelReset(&channels[x]);
+    }
+    channels[0].open = true;
+    ftpInit();
+    if (((script != NULL) && !readScript(script)) || !openPty()) {
+        return 2;
+    }
+
+    signal(SIGINT, stopHandler);
+    signal(SIGTERM, stopHandler);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (command != NULL) {
+        child = fork();
+        if (child == 0) {
+            close(masterFd);
+            close(slaveFd);
+            setenv(HOST_SERIAL_ENV, port, 1);
+            execvp(command[0], command);
+            fprintf(stderr, "mock_modem: unable to run %s (%s)\n", command[0], strerror(errno));
+            _exit(127);
+        } else if (child < 0) {
+            fprintf(stderr, "mock_modem: unable to fork (%s)\n", strerror(errno));
+            return 2;
+        }
+    }
+
+    while (!stopRequested) {
+        if ((child > 0) && (waitpid(child, &status, WNOHANG) == child)) {
+            break;
+        }
+
+        // Things that are due, then what there is to send
+        now = nowUs();
+        for (size_t x = 0; x < events.size();) {
+            if (events[x].dueUs <= now) {
+                std::function<void()> action = events[x].action;
+                events.erase(events.begin() + x);
+                action();
+            } else {
+                x++;
+            }
+        }
+        transmit();
+
+        // Wait for characters or until something else is due
+        now = nowUs();
+        waitUs = 100000;
+        if (!txRaw.empty() && !txBlocked) {
+            waitUs = microsecondsUntil(txReadyUs(), now, waitUs);
+        }
+        for (int x = 0; x <= CMUX_NUM_CHANNELS; x++) {
+            if (!channels[x].tx.empty() && !channels[x].stopped) {
+                uint64_t due = channels[x].tx.front().dueUs;
+                waitUs = microsecondsUntil((due > txFreeUs) ? due : txFreeUs, now, waitUs);
+            }
+        }
+        if (!cmuxControlTx.empty()) {
+            waitUs = microsecondsUntil(txFreeUs, now, waitUs);
+        }
+        for (size_t x = 0; x < events.size(); x++) {
+            waitUs = microsecondsUntil(events[x].dueUs, now, waitUs);
+        }
+        ts.tv_sec = waitUs / 1000000;
+        ts.tv_nsec = (waitUs % 1000000) * 1000;
+        pfd.fd = masterFd;
+        pfd.events = POLLIN | (txBlocked ? POLLOUT : 0);
+        pfd.revents = 0;
+        if ((ppoll(&pfd, 1, &ts, NULL) > 0) && (pfd.revents & POLLIN)) {
+            len = read(masterFd, buf, sizeof (buf));
+            if (len > 0) {
+                struct termios tio;
+                // Characters sent at the wrong baud rate aren't understood
+                if ((tcgetattr(slaveFd, &tio) == 0) &&
+                    (cfgetispeed(&tio) != baudToSpeed(baud))) {
+                    len = 0;
+                }
+                for (ssize_t x = 0; x < len; x++) {
+                    if (cmuxOn) {
+                        cmuxRx(buf[x]);
+                    } else {
+                        channelRx(&channels[0], buf[x]);
+                    }
+                }
+            }
+        }
+    }
+
+    if ((child > 0) && stopRequested) {
+        kill(child, SIGTERM);
+        waitpid(child, &status, 0);
+    }
+    unlink(port);
+    close(masterFd);
+    close(slaveFd);
+
+    if (child > 0) {
+        return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+    }
+
+    return 0;
+}
+
+// End of file
@@ -0,0 +1,25 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _HOST_SHIM_APN_DB_
+#define _HOST_SHIM_APN_DB_
+
+// The APN database of the cellular interface is not needed on a PC:
+// the mock modem accepts any APN.
+
+#endif // _HOST_SHIM_APN_DB_
+
+// End of file
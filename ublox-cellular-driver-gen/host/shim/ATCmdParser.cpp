@@ -0,0 +1,411 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// The host implementation of ATCmdParser.
+
+#include "ATCmdParser.h"
+
+#define LF 10
+#define CR 13
+
+namespace mbed {
+
+ATCmdParser::ATCmdParser(FileHandle *fh, const char *output_delimiter,
+                         int buffer_size, int timeout, bool debug)
+{
+    _fh = fh;
+    _buffer_size = buffer_size;
+    _buffer = new char[buffer_size];
+    _timeout = timeout;
+    _in_prev = 0;
+    _dbg_on = debug;
+    _aborted = false;
+    _oobs = NULL;
+    set_delimiter(output_delimiter);
+}
+
+ATCmdParser::~ATCmdParser()
+{
+    while (_oobs != NULL) {
+        OobEntry *o = _oobs;
+        _oobs = o->next;
+        delete o;
+    }
+    delete[] _buffer;
+}
+
+void ATCmdParser::set_timeout(int timeout)
+{
+    _timeout = timeout;
+}
+
+void ATCmdParser::set_delimiter(const char *output_delimiter)
+{
+    _output_delimiter = output_delimiter;
+    _output_delim_size = strlen(output_delimiter);
+}
+
+void ATCmdParser::debug_on(uint8_t on)
+{
+    _dbg_on = (on != 0);
+}
+
+int ATCmdParser::putc(char c)
+{
+    pollfh fhs;
+
+    fhs.fh = _fh;
+    fhs.events = POLLOUT;
+    if ((mbed::poll(&fhs, 1, _timeout) > 0) && (fhs.revents & POLLOUT)) {
+        return (_fh->write(&c, 1) == 1) ? 0 : -1;
+    }
+
+    return -1;
+}
+
+int ATCmdParser::getc()
+{
+    pollfh fhs;
+    unsigned char ch;
+
+    fhs.fh = _fh;
+    fhs.events = POLLIN;
+    if ((mbed::poll(&fhs, 1, _timeout) > 0) && (fhs.revents & POLLIN)) {
+        return (_fh->read(&ch, 1) == 1) ? ch : -1;
+    }
+
+    return -1;
+}
+
+void ATCmdParser::flush()
+{
+    unsigned char ch;
+
+    while (_fh->readable()) {
+        _fh->read(&ch, 1);
+    }
+}
+
+int ATCmdParser::write(const char *data, int size)
+{
+    int x = 0;
+
+    for (; x < size; x++) {
+        if (putc(data[x]) < 0) {
+            return -1;
+        }
+    }
+
+    return x;
+}
+
+int ATCmdParser::read(char *data, int size)
+{
+    int x = 0;
+    int c;
+
+    for (; x < size; x++) {
+        c = getc();
+        if (c < 0) {
+            return -1;
+        }
+        data[x] = c;
+    }
+
+    return x;
+}
+
+int ATCmdParser::vprintf(const char *format, va_list args)
+{
+    int x = 0;
+
+    if (vsnprintf(_buffer, _buffer_size, format, args) < 0) {
+        return -1;
+    }
+
+    for (; _buffer[x]; x++) {
+        if (putc(_buffer[x]) < 0) {
+            return -1;
+        }
+    }
+
+    return x;
+}
+
+int ATCmdParser::printf(const char *format, ...)
+{
+    va_list args;
+    int result;
+
+    va_start(args, format);
+    result = vprintf(format, args);
+    va_end(args);
+
+    return result;
+}
+
+int ATCmdParser::vscanf(const char *format, va_list args)
+{
+    // Format with %n appended, to find how much was matched
+    int offset = strlen(format) + 2;
+    int count = 0;
+    int x = 0;
+    int c;
+
+    if (offset + 1 >= _buffer_size) {
+        return -1;
+    }
+    memcpy(_buffer, format, offset - 2);
+    _buffer[offset - 2] = '%';
+    _buffer[offset - 1] = 'n';
+    _buffer[offset] = 0;
+    offset++;
+
+    for (;;) {
+        c = getc();
+        if (c < 0) {
+            return -1;
+        }
+        _buffer[offset + x++] = c;
+        _buffer[offset + x] = 0;
+        count = -1;
+        sscanf(_buffer + offset, _buffer, &count);
+        if (count == x) {
+            break;
+        }
+        if (offset + x + 1 >= _buffer_size) {
+            return -1;
+        }
+    }
+
+    return vsscanf(_buffer + offset, format, args);
+}
+
+int ATCmdParser::scanf(const char *format, ...)
+{
+    va_list args;
+    int result;
+
+    va_start(args, format);
+    result = vscanf(format, args);
+    va_end(args);
+
+    return result;
+}
+
+bool ATCmdParser::vsend(const char *command, va_list args)
+{
+    if (vsnprintf(_buffer, _buffer_size, command, args) < 0) {
+        return false;
+    }
+
+    for (int x = 0; _buffer[x]; x++) {
+        if (putc(_buffer[x]) < 0) {
+            return false;
+        }
+    }
+    for (int x = 0; _output_delimiter[x]; x++) {
+        if (putc(_output_delimiter[x]) < 0) {
+            return false;
+        }
+    }
+
+    debug_if(_dbg_on, "AT> %s\n", _buffer);
+    return true;
+}
+
+bool ATCmdParser::send(const char *command, ...)
+{
+    va_list args;
+    bool result;
+
+    va_start(args, command);
+    result = vsend(command, args);
+    va_end(args);
+
+    return result;
+}
+
+bool ATCmdParser::vrecv(const char *response, va_list args)
+{
+restart:
+    _aborted = false;
+
+    // Match each line of the response in turn
+    while (response[0]) {
+        // Copy the line into the buffer with the conversions
+        // made into ones that match without storing anything
+        int i = 0;
+        int offset = 0;
+        bool wholeLineWanted = false;
+
+        while (response[i]) {
+            if ((response[i] == '%') && (response[i + 1] != '%') && (response[i + 1] != '*')) {
+                _buffer[offset++] = '%';
+                _buffer[offset++] = '*';
+                i++;
+            } else {
+                _buffer[offset++] = response[i++];
+                // A line break, unless it's in a %[^\n] conversion
+                if ((response[i - 1] == '\n') &&
+                    !((i >= 3) && (response[i - 3] == '[') && (response[i - 2] == '^'))) {
+                    wholeLineWanted = true;
+                    break;
+                }
+            }
+        }
+
+        // %n gives the number of characters matched, which
+        // tells whether the whole line matched
+        _buffer[offset++] = '%';
+        _buffer[offset++] = 'n';
+        _buffer[offset++] = 0;
+
+        debug_if(_dbg_on, "AT? %s\n", _buffer);
+
+        int j = 0;
+        for (;;) {
+            int c = getc();
+            if (c < 0) {
+                debug_if(_dbg_on, "AT(Timeout)\n");
+                return false;
+            }
+
+            // Simplify newlines
+            if (((c == CR) && (_in_prev != LF)) ||
+                ((c == LF) && (_in_prev != CR))) {
+                _in_prev = c;
+                c = '\n';
+            } else if (((c == CR) && (_in_prev == LF)) ||
+                       ((c == LF) && (_in_prev == CR))) {
+                _in_prev = c;
+                continue;
+            } else {
+                _in_prev = c;
+            }
+            _buffer[offset + j++] = c;
+            _buffer[offset + j] = 0;
+
+            // Check for out of band data
+            for (OobEntry *o = _oobs; o != NULL; o = o->next) {
+                if (((unsigned) j == o->len) &&
+                    (memcmp(o->prefix, _buffer + offset, o->len) == 0)) {
+                    debug_if(_dbg_on, "AT! %s\n", o->prefix);
+                    o->cb();
+                    if (_aborted) {
+                        debug_if(_dbg_on, "AT(Aborted)\n");
+                        return false;
+                    }
+                    // The handler may have used the buffer
+                    goto restart;
+                }
+            }
+
+            // Check for a match of the whole line, waiting for the
+            // end of it if the format ends with one, as later versions
+            // of mbed do (otherwise "%[^\n]\n" matches the first character)
+            int count = -1;
+            if (!wholeLineWanted || (c == '\n')) {
+                sscanf(_buffer + offset, _buffer, &count);
+            }
+            if (count == j) {
+                debug_if(_dbg_on, "AT= %s\n", _buffer + offset);
+                // Now store the values, using the front of the buffer
+                // for the format
+                memcpy(_buffer, response, i);
+                _buffer[i] = 0;
+                vsscanf(_buffer + offset, _buffer, args);
+                response += i;
+                break;
+            }
+
+            // Start again at a newline or if out of space,
+            // which usually means binary data
+            if ((c == '\n') || (j + 1 >= _buffer_size - offset)) {
+                debug_if(_dbg_on, "AT< %s", _buffer + offset);
+                j = 0;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool ATCmdParser::recv(const char *response, ...)
+{
+    va_list args;
+    bool result;
+
+    va_start(args, response);
+    result = vrecv(response, args);
+    va_end(args);
+
+    return result;
+}
+
+void ATCmdParser::oob(const char *prefix, mbed::Callback<void()> func)
+{
+    OobEntry *o = new OobEntry;
+
+    o->len = strlen(prefix);
+    o->prefix = prefix;
+    o->cb = func;
+    o->next = _oobs;
+    _oobs = o;
+}
+
+void ATCmdParser::abort()
+{
+    _aborted = true;
+}
+
+bool ATCmdParser::process_oob()
+{
+    int x = 0;
+    int c;
+
+    if (!_fh->readable()) {
+        return false;
+    }
+
+    for (;;) {
+        c = getc();
+        if (c < 0) {
+            return false;
+        }
+        _buffer[x++] = c;
+        _buffer[x] = 0;
+
+        for (OobEntry *o = _oobs; o != NULL; o = o->next) {
+            if (((unsigned) x == o->len) && (memcmp(o->prefix, _buffer, o->len) == 0)) {
+                debug_if(_dbg_on, "AT! %s\n", o->prefix);
+                o->cb();
+                return true;
+            }
+        }
+
+        if ((x + 1 >= _buffer_size) ||
+            ((x >= _output_delim_size) &&
+             (strcmp(&_buffer[x - _output_delim_size], _output_delimiter) == 0))) {
+            debug_if(_dbg_on, "AT< %s", _buffer);
+            x = 0;
+        }
+    }
+}
+
+} // namespace mbed
+
+// End of file
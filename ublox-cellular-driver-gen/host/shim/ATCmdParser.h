@@ -0,0 +1,83 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _HOST_SHIM_AT_CMD_PARSER_
+#define _HOST_SHIM_AT_CMD_PARSER_
+
+// An AT command parser that behaves as that of mbed OS 5.5: send()
+// is printf() followed by the delimiter, recv() matches the lines of a
+// scanf() format against what arrives and out of band handlers are
+// called when their prefix is seen at the start of a line.
+
+#include "mbed.h"
+
+namespace mbed {
+
+class ATCmdParser {
+public:
+    ATCmdParser(FileHandle *fh, const char *output_delimiter = "\r",
+                int buffer_size = 256, int timeout = 8000, bool debug = false);
+    ~ATCmdParser();
+
+    void set_timeout(int timeout);
+    void setTimeout(int timeout) { set_timeout(timeout); }
+    void set_delimiter(const char *output_delimiter);
+    void setDelimiter(const char *output_delimiter) { set_delimiter(output_delimiter); }
+    void debug_on(uint8_t on);
+    void debugOn(uint8_t on) { debug_on(on); }
+
+    bool send(const char *command, ...) __attribute__((format(printf, 2, 3)));
+    bool vsend(const char *command, va_list args);
+    bool recv(const char *response, ...) __attribute__((format(scanf, 2, 3)));
+    bool vrecv(const char *response, va_list args);
+    int putc(char c);
+    int getc();
+    int write(const char *data, int size);
+    int read(char *data, int size);
+    int printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+    int vprintf(const char *format, va_list args);
+    int scanf(const char *format, ...) __attribute__((format(scanf, 2, 3)));
+    int vscanf(const char *format, va_list args);
+    void oob(const char *prefix, mbed::Callback<void()> func);
+    void flush();
+    void abort();
+    bool process_oob();
+
+private:
+    struct OobEntry {
+        unsigned len;
+        const char *prefix;
+        mbed::Callback<void()> cb;
+        OobEntry *next;
+    };
+
+    FileHandle *_fh;
+    int _buffer_size;
+    char *_buffer;
+    int _timeout;
+    const char *_output_delimiter;
+    int _output_delim_size;
+    char _in_prev;
+    bool _dbg_on;
+    bool _aborted;
+    OobEntry *_oobs;
+};
+
+} // namespace mbed
+
+#endif // _HOST_SHIM_AT_CMD_PARSER_
+
+// End of file
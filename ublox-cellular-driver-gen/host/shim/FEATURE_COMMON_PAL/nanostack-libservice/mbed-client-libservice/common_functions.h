@@ -0,0 +1,26 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _HOST_SHIM_COMMON_FUNCTIONS_
+#define _HOST_SHIM_COMMON_FUNCTIONS_
+
+// Included by the tests but nothing in it is used.
+
+#include <stdint.h>
+
+#endif // _HOST_SHIM_COMMON_FUNCTIONS_
+
+// End of file
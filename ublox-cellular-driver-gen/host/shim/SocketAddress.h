@@ -0,0 +1,105 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _HOST_SHIM_SOCKET_ADDRESS_
+#define _HOST_SHIM_SOCKET_ADDRESS_
+
+// The parts of the mbed network socket API that the driver and its
+// tests use.
+
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+
+#define NSAPI_IP_SIZE 46
+
+typedef int nsapi_error_t;
+
+enum nsapi_error {
+    NSAPI_ERROR_OK = 0,
+    NSAPI_ERROR_WOULD_BLOCK = -3001,
+    NSAPI_ERROR_UNSUPPORTED = -3002,
+    NSAPI_ERROR_PARAMETER = -3003,
+    NSAPI_ERROR_NO_CONNECTION = -3004,
+    NSAPI_ERROR_NO_SOCKET = -3005,
+    NSAPI_ERROR_NO_ADDRESS = -3006,
+    NSAPI_ERROR_NO_MEMORY = -3007,
+    NSAPI_ERROR_NO_SSID = -3008,
+    NSAPI_ERROR_DNS_FAILURE = -3009,
+    NSAPI_ERROR_DHCP_FAILURE = -3010,
+    NSAPI_ERROR_AUTH_FAILURE = -3011,
+    NSAPI_ERROR_DEVICE_ERROR = -3012
+};
+
+typedef enum nsapi_version {
+    NSAPI_UNSPEC,
+    NSAPI_IPv4,
+    NSAPI_IPv6
+} nsapi_version_t;
+
+/** SocketAddress: an IP address, kept as text, and a port.
+ */
+class SocketAddress {
+public:
+    SocketAddress(const char *addr = NULL, uint16_t port = 0)
+    {
+        set_ip_address(addr);
+        set_port(port);
+    }
+
+    bool set_ip_address(const char *addr)
+    {
+        _ip[0] = 0;
+        if (addr != NULL) {
+            strncpy(_ip, addr, sizeof (_ip) - 1);
+            _ip[sizeof (_ip) - 1] = 0;
+        }
+        return true;
+    }
+
+    void set_port(uint16_t port)
+    {
+        _port = port;
+    }
+
+    const char *get_ip_address() const
+    {
+        return (_ip[0] != 0) ? _ip : NULL;
+    }
+
+    uint16_t get_port() const
+    {
+        return _port;
+    }
+
+    nsapi_version_t get_ip_version() const
+    {
+        return (strchr(_ip, ':') != NULL) ? NSAPI_IPv6 : NSAPI_IPv4;
+    }
+
+    operator bool() const
+    {
+        return _ip[0] != 0;
+    }
+
+private:
+    char _ip[NSAPI_IP_SIZE];
+    uint16_t _port;
+};
+
+#endif // _HOST_SHIM_SOCKET_ADDRESS_
+
+// End of file
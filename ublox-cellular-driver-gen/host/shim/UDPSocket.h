@@ -0,0 +1,27 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _HOST_SHIM_UDP_SOCKET_
+#define _HOST_SHIM_UDP_SOCKET_
+
+// Sockets are not part of the host build; the tests include this
+// header but only use SocketAddress.
+
+#include "SocketAddress.h"
+
+#endif // _HOST_SHIM_UDP_SOCKET_
+
+// End of file
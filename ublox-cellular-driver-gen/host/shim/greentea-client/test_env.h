@@ -0,0 +1,32 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _HOST_SHIM_TEST_ENV_
+#define _HOST_SHIM_TEST_ENV_
+
+// Greentea's side of the conversation with the host test runner: on
+// a PC there is no runner, so the key/value pairs are just printed and
+// the timeout is enforced by the test itself.
+
+#define GREENTEA_SETUP(timeout, host_test) greentea_setup(timeout, host_test)
+
+void greentea_setup(const int timeout, const char *host_test_name);
+void greentea_send_kv(const char *key, const char *val);
+void greentea_send_kv(const char *key, const int val);
+
+#endif // _HOST_SHIM_TEST_ENV_
+
+// End of file
@@ -0,0 +1,443 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _HOST_SHIM_MBED_
+#define _HOST_SHIM_MBED_
+
+// The parts of the mbed OS API that the driver and its tests use,
+// implemented over POSIX threads and a pty so that they can be built
+// and run on a Linux PC against mock_modem.  Behaviour follows mbed OS
+// 5.5 closely enough for the driver: e.g. Mutex is recursive and,
+// as in RTX, handed to the longest waiting thread on release, EventFlags waits return osFlagsErrorTimeout on timeout and sigio()
+// callbacks are made as soon as characters arrive.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <time.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <functional>
+#include <deque>
+
+// ----------------------------------------------------------------
+// TARGET
+// ----------------------------------------------------------------
+
+typedef enum {
+    MDMTXD = 1,
+    MDMRXD,
+    MDMRTS,
+    MDMCTS,
+    NC = -1
+} PinName;
+
+#define FEATURE_COMMON_PAL 1
+
+#ifndef MBED_CONF_UBLOX_CELL_BAUD_RATE
+# define MBED_CONF_UBLOX_CELL_BAUD_RATE 115200
+#endif
+
+/** The size of the serial receive buffer, as on the C030.
+ */
+#ifndef MBED_CONF_DRIVERS_UART_SERIAL_RXBUF_SIZE
+# define MBED_CONF_DRIVERS_UART_SERIAL_RXBUF_SIZE 256
+#endif
+
+/** The size of the serial transmit buffer.
+ */
+#ifndef MBED_CONF_DRIVERS_UART_SERIAL_TXBUF_SIZE
+# define MBED_CONF_DRIVERS_UART_SERIAL_TXBUF_SIZE 256
+#endif
+
+/** The environment variable giving the path of the serial
+ * port, e.g. the pty created by mock_modem.
+ */
+#define HOST_SERIAL_ENV "UBLOX_HOST_SERIAL"
+
+/** The serial port used if HOST_SERIAL_ENV is not set.
+ */
+#define HOST_SERIAL_DEFAULT "/tmp/ublox-mock-modem"
+
+// ----------------------------------------------------------------
+// PLATFORM
+// ----------------------------------------------------------------
+
+#define MBED_ASSERT(expr) do { if (!(expr)) { mbed_assert_internal(#expr, __FILE__, __LINE__); } } while (0)
+#define MBED_STATIC_ASSERT(expr, msg) static_assert(expr, msg)
+
+void mbed_assert_internal(const char *expr, const char *file, int line);
+void error(const char *format, ...) __attribute__((format(printf, 1, 2)));
+void debug_if(int condition, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+void wait(float s);
+void wait_ms(int ms);
+void wait_us(int us);
+uint32_t us_ticker_read();
+
+void core_util_critical_section_enter();
+void core_util_critical_section_exit();
+
+static inline uint32_t core_util_atomic_incr_u32(volatile uint32_t *valuePtr, uint32_t delta)
+{
+    return __atomic_add_fetch(valuePtr, delta, __ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t core_util_atomic_decr_u32(volatile uint32_t *valuePtr, uint32_t delta)
+{
+    return __atomic_sub_fetch(valuePtr, delta, __ATOMIC_SEQ_CST);
+}
+
+static inline uint16_t core_util_atomic_incr_u16(volatile uint16_t *valuePtr, uint16_t delta)
+{
+    return __atomic_add_fetch(valuePtr, delta, __ATOMIC_SEQ_CST);
+}
+
+static inline bool core_util_atomic_cas_u32(volatile uint32_t *ptr, uint32_t *expectedCurrentValue, uint32_t desiredValue)
+{
+    return __atomic_compare_exchange_n(ptr, expectedCurrentValue, desiredValue, false,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static inline bool core_util_atomic_cas_u16(volatile uint16_t *ptr, uint16_t *expectedCurrentValue, uint16_t desiredValue)
+{
+    return __atomic_compare_exchange_n(ptr, expectedCurrentValue, desiredValue, false,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+namespace mbed {
+
+/** Callback: a function, or a method and the object to call it on.
+ */
+template <typename F>
+class Callback;
+
+template <typename R, typename... A>
+class Callback<R(A...)> {
+public:
+    Callback(R (*func)(A...) = 0)
+    {
+        if (func != 0) {
+            _func = func;
+        }
+    }
+
+    template <typename T, typename U>
+    Callback(U *obj, R (T::*method)(A...))
+    {
+        T *o = obj;
+        _func = [o, method](A... args) -> R { return (o->*method)(args...); };
+    }
+
+    template <typename T, typename U>
+    Callback(U *obj, R (*func)(T *, A...))
+    {
+        T *o = obj;
+        _func = [o, func](A... args) -> R { return func(o, args...); };
+    }
+
+    R call(A... args) const
+    {
+        MBED_ASSERT(_func);
+        return _func(args...);
+    }
+
+    R operator()(A... args) const
+    {
+        return call(args...);
+    }
+
+    operator bool() const
+    {
+        return (bool) _func;
+    }
+
+private:
+    std::function<R(A...)> _func;
+};
+
+template <typename R, typename... A>
+Callback<R(A...)> callback(R (*func)(A...) = 0)
+{
+    return Callback<R(A...)>(func);
+}
+
+template <typename T, typename U, typename R, typename... A>
+Callback<R(A...)> callback(U *obj, R (T::*method)(A...))
+{
+    return Callback<R(A...)>(obj, method);
+}
+
+template <typename T, typename U, typename R, typename... A>
+Callback<R(A...)> callback(U *obj, R (*func)(T *, A...))
+{
+    return Callback<R(A...)>(obj, func);
+}
+
+/** Timer: measures time from a monotonic clock.
+ */
+class Timer {
+public:
+    Timer();
+    void start();
+    void stop();
+    void reset();
+    float read();
+    int read_ms();
+    int read_us();
+    uint64_t read_high_resolution_us();
+    operator float();
+
+protected:
+    uint64_t slicetime();
+    uint64_t _start;
+    uint64_t _time;
+    bool _running;
+};
+
+/** poll() over FileHandles, as mbed::poll().
+ */
+class FileHandle;
+
+struct pollfh {
+    FileHandle *fh;
+    short events;
+    short revents;
+};
+
+int poll(pollfh fhs[], unsigned nfhs, int timeout);
+
+/** FileHandle: the interface of a character device.
+ */
+class FileHandle {
+public:
+    virtual ~FileHandle() {}
+    virtual ssize_t read(void *buffer, size_t size) = 0;
+    virtual ssize_t write(const void *buffer, size_t size) = 0;
+    virtual off_t seek(off_t offset, int whence = SEEK_SET) = 0;
+    virtual int close() = 0;
+    virtual int sync() { return 0; }
+    virtual int isatty() { return 0; }
+    virtual off_t tell() { return seek(0, SEEK_CUR); }
+    virtual void rewind() { seek(0, SEEK_SET); }
+    virtual off_t size();
+    virtual int set_blocking(bool blocking) { return -1; }
+    virtual short poll(short events) const { return POLLIN | POLLOUT; }
+    bool writable() const { return poll(POLLOUT) & POLLOUT; }
+    bool readable() const { return poll(POLLIN) & POLLIN; }
+    virtual void sigio(Callback<void()> func) {}
+};
+
+/** UARTSerial: the serial port to the module, which on a PC is the
+ * device named by HOST_SERIAL_ENV.
+ *
+ * A thread moves received characters into a receive buffer of
+ * MBED_CONF_DRIVERS_UART_SERIAL_RXBUF_SIZE bytes.  Without flow control
+ * characters that arrive when it is full are lost, as they would be
+ * on the board; with flow control the thread stops reading from the
+ * device until there is room.  Transmission takes as long as the baud
+ * rate says it would, beyond what fits in the transmit buffer.
+ */
+class UARTSerial : public FileHandle {
+public:
+    enum Parity {
+        None = 0,
+        Odd,
+        Even,
+        Forced1,
+        Forced0
+    };
+
+    enum Flow {
+        Disabled = 0,
+        RTS,
+        CTS,
+        RTSCTS
+    };
+
+    UARTSerial(PinName tx, PinName rx, int baud = MBED_CONF_UBLOX_CELL_BAUD_RATE);
+    virtual ~UARTSerial();
+    virtual ssize_t read(void *buffer, size_t size);
+    virtual ssize_t write(const void *buffer, size_t size);
+    virtual off_t seek(off_t offset, int whence = SEEK_SET);
+    virtual int close();
+    virtual int isatty();
+    virtual int set_blocking(bool blocking);
+    virtual short poll(short events) const;
+    virtual void sigio(Callback<void()> func);
+    void set_baud(int baud);
+    void set_format(int bits = 8, Parity parity = None, int stop_bits = 1);
+    void set_flow_control(Flow type, PinName flow1 = NC, PinName flow2 = NC);
+
+    /** Return the number of received characters lost because
+     * the receive buffer was full (host only).
+     */
+    uint32_t numRxLost();
+
+protected:
+    void rxThreadMain();
+    static void *rxThreadEntry(void *arg);
+    void wake();
+
+    int _fd;
+    int _baud;
+    bool _blocking;
+    bool _flowControl;
+    volatile bool _running;
+    pthread_t _rxThread;
+    mutable pthread_mutex_t _rxMtx;
+    pthread_cond_t _rxCond;
+    char _rxBuf[MBED_CONF_DRIVERS_UART_SERIAL_RXBUF_SIZE];
+    int _rxRead;
+    int _rxCount;
+    uint32_t _numRxLost;
+    pthread_mutex_t _txMtx;
+    uint64_t _txFreeUs;
+    pthread_mutex_t _sigioMtx;
+    Callback<void()> _sigio;
+};
+
+} // namespace mbed
+
+using namespace mbed;
+
+// ----------------------------------------------------------------
+// RTOS
+// ----------------------------------------------------------------
+
+#define osWaitForever 0xFFFFFFFFU
+
+#define osFlagsWaitAny 0x00000000U
+#define osFlagsWaitAll 0x00000001U
+#define osFlagsNoClear 0x00000002U
+#define osFlagsError 0x80000000U
+#define osFlagsErrorTimeout 0xFFFFFFFEU
+
+typedef int32_t osStatus;
+#define osOK 0
+#define osErrorTimeout -2
+
+typedef void *osThreadId;
+
+typedef enum {
+    osPriorityIdle = 1,
+    osPriorityLow = 8,
+    osPriorityBelowNormal = 16,
+    osPriorityNormal = 24,
+    osPriorityAboveNormal = 32,
+    osPriorityHigh = 40,
+    osPriorityRealtime = 48
+} osPriority;
+
+#define OS_STACK_SIZE 4096
+
+namespace rtos {
+
+/** Mutex: recursive, as in mbed OS.
+ */
+class Mutex {
+public:
+    Mutex(const char *name = NULL);
+    ~Mutex();
+    osStatus lock(uint32_t millisec = osWaitForever);
+    bool trylock();
+    osStatus unlock();
+
+private:
+    pthread_mutex_t _mutex;
+    pthread_cond_t _cond;
+    pthread_t _owner;
+    int _count;
+    unsigned int _nextTicket;
+    std::deque<unsigned int> _waiters;
+};
+
+/** Semaphore: wait() returns the number of tokens there were
+ * before one was taken, 0 on timeout.
+ */
+class Semaphore {
+public:
+    Semaphore(int32_t count = 0);
+    ~Semaphore();
+    int32_t wait(uint32_t millisec = osWaitForever);
+    osStatus release();
+
+private:
+    pthread_mutex_t _mutex;
+    pthread_cond_t _cond;
+    int32_t _count;
+};
+
+/** EventFlags.
+ */
+class EventFlags {
+public:
+    EventFlags(const char *name = NULL);
+    ~EventFlags();
+    uint32_t set(uint32_t flags);
+    uint32_t clear(uint32_t flags = 0x7fffffff);
+    uint32_t get() const;
+    uint32_t wait_all(uint32_t flags = 0, uint32_t timeout = osWaitForever, bool clear = true);
+    uint32_t wait_any(uint32_t flags = 0, uint32_t timeout = osWaitForever, bool clear = true);
+
+private:
+    uint32_t wait(uint32_t flags, uint32_t options, uint32_t timeout);
+    mutable pthread_mutex_t _mutex;
+    pthread_cond_t _cond;
+    uint32_t _flags;
+};
+
+/** Thread: a POSIX thread; priorities and stack sizes are ignored.
+ */
+class Thread {
+public:
+    Thread(osPriority priority = osPriorityNormal,
+           uint32_t stack_size = OS_STACK_SIZE,
+           unsigned char *stack_mem = NULL, const char *name = NULL);
+    ~Thread();
+    osStatus start(mbed::Callback<void()> task);
+    osStatus join();
+    static osStatus wait(uint32_t millisec);
+    static osStatus yield();
+    static osThreadId gettid();
+
+private:
+    static void *entry(void *arg);
+    pthread_t _thread;
+    bool _started;
+    bool _joined;
+};
+
+namespace Kernel {
+uint64_t get_ms_count();
+}
+
+} // namespace rtos
+
+using namespace rtos;
+
+typedef rtos::Mutex PlatformMutex;
+
+#include "ATCmdParser.h"
+
+#endif // _HOST_SHIM_MBED_
+
+// End of file
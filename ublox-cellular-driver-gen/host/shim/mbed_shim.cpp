@@ -0,0 +1,909 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// The host implementation of the parts of the mbed OS API in mbed.h.
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <termios.h>
+#include "mbed.h"
+
+// ----------------------------------------------------------------
+// PRIVATE VARIABLES
+// ----------------------------------------------------------------
+
+// Stands in for disabling interrupts.
+static pthread_mutex_t criticalSection = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+// Serialises debug output from different threads.
+static pthread_mutex_t debugMtx = PTHREAD_MUTEX_INITIALIZER;
+
+// Wakes poll() when a serial port receives something; ioGeneration
+// counts the wake-ups so that none is missed.
+static pthread_mutex_t ioMtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ioCond;
+static pthread_once_t ioOnce = PTHREAD_ONCE_INIT;
+static unsigned int ioGeneration = 0;
+
+// ----------------------------------------------------------------
+// PRIVATE FUNCTIONS
+// ----------------------------------------------------------------
+
+// Return a monotonic time in microseconds.
+static uint64_t nowUs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec * 1000000ULL) + (ts.tv_nsec / 1000);
+}
+
+// Sleep for a number of microseconds.
+static void sleepUs(uint64_t us)
+{
+    struct timespec ts;
+
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (us % 1000000) * 1000;
+    while ((nanosleep(&ts, &ts) < 0) && (errno == EINTR)) {
+    }
+}
+
+// Initialise a condition variable that times out on the monotonic clock.
+static void condInit(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+// Wait on a condition variable until an absolute time
+// from nowUs(), returning false on timeout.
+static bool condWaitUntil(pthread_cond_t *cond, pthread_mutex_t *mutex, uint64_t deadlineUs)
+{
+    struct timespec ts;
+
+    ts.tv_sec = deadlineUs / 1000000;
+    ts.tv_nsec = (deadlineUs % 1000000) * 1000;
+
+    return pthread_cond_timedwait(cond, mutex, &ts) != ETIMEDOUT;
+}
+
+// Set up the condition variable for poll().
+static void ioInit()
+{
+    condInit(&ioCond);
+}
+
+// Wake anything waiting in poll().
+static void ioNotify()
+{
+    pthread_once(&ioOnce, ioInit);
+    pthread_mutex_lock(&ioMtx);
+    ioGeneration++;
+    pthread_cond_broadcast(&ioCond);
+    pthread_mutex_unlock(&ioMtx);
+}
+
+// Convert a timeout in milliseconds to an absolute time.
+static uint64_t deadlineUs(uint32_t millisec)
+{
+    return nowUs() + ((uint64_t) millisec * 1000);
+}
+
+// Convert a baud rate to a termios speed, 0 if there isn't one.
+static speed_t baudToSpeed(int baud)
+{
+    switch (baud) {
+        case 9600:
+            return B9600;
+        case 19200:
+            return B19200;
+        case 38400:
+            return B38400;
+        case 57600:
+            return B57600;
+        case 115200:
+            return B115200;
+        case 230400:
+            return B230400;
+        case 460800:
+            return B460800;
+        case 921600:
+            return B921600;
+        case 3000000:
+            return B3000000;
+        default:
+            return 0;
+    }
+}
+
+// ----------------------------------------------------------------
+// PLATFORM
+// ----------------------------------------------------------------
+
+void mbed_assert_internal(const char *expr, const char *file, int line)
+{
+    fprintf(stderr, "mbed assertation failed: %s, file: %s, line %d\n", expr, file, line);
+    abort();
+}
+
+void error(const char *format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    exit(1);
+}
+
+void debug_if(int condition, const char *format, ...)
+{
+    va_list args;
+
+    if (condition) {
+        pthread_mutex_lock(&debugMtx);
+        va_start(args, format);
+        vprintf(format, args);
+        va_end(args);
+        fflush(stdout);
+        pthread_mutex_unlock(&debugMtx);
+    }
+}
+
+void wait(float s)
+{
+    sleepUs((uint64_t) (s * 1000000));
+}
+
+void wait_ms(int ms)
+{
+    sleepUs((uint64_t) ms * 1000);
+}
+
+void wait_us(int us)
+{
+    sleepUs(us);
+}
+
+uint32_t us_ticker_read()
+{
+    return (uint32_t) nowUs();
+}
+
+void core_util_critical_section_enter()
+{
+    pthread_mutex_lock(&criticalSection);
+}
+
+void core_util_critical_section_exit()
+{
+    pthread_mutex_unlock(&criticalSection);
+}
+
+// ----------------------------------------------------------------
+// TIMER
+// ----------------------------------------------------------------
+
+namespace mbed {
+
+Timer::Timer()
+{
+    _start = 0;
+    _time = 0;
+    _running = false;
+}
+
+void Timer::start()
+{
+    if (!_running) {
+        _start = nowUs();
+        _running = true;
+    }
+}
+
+void Timer::stop()
+{
+    _time += slicetime();
+    _running = false;
+}
+
+void Timer::reset()
+{
+    _start = nowUs();
+    _time = 0;
+}
+
+float Timer::read()
+{
+    return (float) read_high_resolution_us() / 1000000.0f;
+}
+
+int Timer::read_ms()
+{
+    return (int) (read_high_resolution_us() / 1000);
+}
+
+int Timer::read_us()
+{
+    return (int) read_high_resolution_us();
+}
+
+uint64_t Timer::read_high_resolution_us()
+{
+    return _time + slicetime();
+}
+
+Timer::operator float()
+{
+    return read();
+}
+
+uint64_t Timer::slicetime()
+{
+    return _running ? nowUs() - _start : 0;
+}
+
+// ----------------------------------------------------------------
+// FILE HANDLES
+// ----------------------------------------------------------------
+
+off_t FileHandle::size()
+{
+    off_t off = seek(0, SEEK_CUR);
+    off_t size;
+
+    if (off < 0) {
+        return off;
+    }
+    size = seek(0, SEEK_END);
+    seek(off, SEEK_SET);
+
+    return size;
+}
+
+// As mbed OS, which yields rather than blocks while it waits.
+// A serial port wakes it as soon as something arrives; anything
+// else, e.g. a multiplexer channel, is checked every millisecond.
+int poll(pollfh fhs[], unsigned nfhs, int timeout)
+{
+    uint64_t deadline = nowUs() + ((uint64_t) timeout * 1000);
+    uint64_t wakeUs;
+    unsigned int generation;
+    int count;
+
+    pthread_once(&ioOnce, ioInit);
+    for (;;) {
+        pthread_mutex_lock(&ioMtx);
+        generation = ioGeneration;
+        pthread_mutex_unlock(&ioMtx);
+        count = 0;
+        for (unsigned int x = 0; x < nfhs; x++) {
+            short mask = fhs[x].events | POLLERR | POLLHUP | POLLNVAL;
+            if (fhs[x].fh != NULL) {
+                fhs[x].revents = fhs[x].fh->poll(mask) & mask;
+            } else {
+                fhs[x].revents = POLLNVAL;
+            }
+            if (fhs[x].revents) {
+                count++;
+            }
+        }
+        if ((count > 0) || (timeout == 0) || ((timeout > 0) && (nowUs() > deadline))) {
+            break;
+        }
+        wakeUs = nowUs() + 1000;
+        if ((timeout > 0) && (wakeUs > deadline)) {
+            wakeUs = deadline;
+        }
+        pthread_mutex_lock(&ioMtx);
+        while ((generation == ioGeneration) && condWaitUntil(&ioCond, &ioMtx, wakeUs)) {
+        }
+        pthread_mutex_unlock(&ioMtx);
+    }
+
+    return count;
+}
+
+// ----------------------------------------------------------------
+// SERIAL PORT
+// ----------------------------------------------------------------
+
+UARTSerial::UARTSerial(PinName tx, PinName rx, int baud)
+{
+    const char *path = getenv(HOST_SERIAL_ENV);
+    struct termios tio;
+
+    if (path == NULL) {
+        path = HOST_SERIAL_DEFAULT;
+    }
+    _fd = open(path, O_RDWR | O_NOCTTY);
+    if (_fd < 0) {
+        error("UARTSerial: unable to open %s (%s), is mock_modem running?\n",
+              path, strerror(errno));
+    }
+    if (tcgetattr(_fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tio.c_cflag |= CLOCAL | CREAD;
+        tcsetattr(_fd, TCSANOW, &tio);
+    }
+
+    _baud = MBED_CONF_UBLOX_CELL_BAUD_RATE;
+    _blocking = true;
+    _flowControl = false;
+    _rxRead = 0;
+    _rxCount = 0;
+    _numRxLost = 0;
+    _txFreeUs = 0;
+    pthread_mutex_init(&_rxMtx, NULL);
+    condInit(&_rxCond);
+    pthread_mutex_init(&_txMtx, NULL);
+    pthread_mutex_init(&_sigioMtx, NULL);
+    set_baud(baud);
+
+    _running = true;
+    pthread_create(&_rxThread, NULL, rxThreadEntry, this);
+}
+
+UARTSerial::~UARTSerial()
+{
+    close();
+    pthread_cond_destroy(&_rxCond);
+    pthread_mutex_destroy(&_rxMtx);
+    pthread_mutex_destroy(&_txMtx);
+    pthread_mutex_destroy(&_sigioMtx);
+}
+
+void *UARTSerial::rxThreadEntry(void *arg)
+{
+    ((UARTSerial *) arg)->rxThreadMain();
+    return NULL;
+}
+
+// Call the sigio() callback, if there is one.
+void UARTSerial::wake()
+{
+    pthread_mutex_lock(&_sigioMtx);
+    if (_sigio) {
+        _sigio();
+    }
+    pthread_mutex_unlock(&_sigioMtx);
+}
+
+// Move characters from the device into the receive buffer.
+void UARTSerial::rxThreadMain()
+{
+    char buf[64];
+    struct pollfd pfd;
+    int size;
+    int write;
+    ssize_t len;
+
+    while (_running) {
+        pthread_mutex_lock(&_rxMtx);
+        // With flow control the module waits while the buffer is full
+        while (_running && _flowControl && (_rxCount >= (int) sizeof (_rxBuf))) {
+            pthread_cond_wait(&_rxCond, &_rxMtx);
+        }
+        size = sizeof (buf);
+        if (_flowControl && ((int) sizeof (_rxBuf) - _rxCount < size)) {
+            size = sizeof (_rxBuf) - _rxCount;
+        }
+        pthread_mutex_unlock(&_rxMtx);
+
+        pfd.fd = _fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (_running && (::poll(&pfd, 1, 100) > 0)) {
+            if (pfd.revents & POLLIN) {
+                len = ::read(_fd, buf, size);
+                if (len > 0) {
+                    pthread_mutex_lock(&_rxMtx);
+                    for (int x = 0; x < len; x++) {
+                        if (_rxCount < (int) sizeof (_rxBuf)) {
+                            write = (_rxRead + _rxCount) % sizeof (_rxBuf);
+                            _rxBuf[write] = buf[x];
+                            _rxCount++;
+                        } else {
+                            _numRxLost++;
+                        }
+                    }
+                    pthread_cond_broadcast(&_rxCond);
+                    pthread_mutex_unlock(&_rxMtx);
+                    ioNotify();
+                    wake();
+                }
+            } else {
+                // The other end has gone away, don't spin
+                sleepUs(10000);
+            }
+        }
+    }
+}
+
+ssize_t UARTSerial::read(void *buffer, size_t size)
+{
+    ssize_t count = 0;
+    int len;
+
+    pthread_mutex_lock(&_rxMtx);
+    while (_blocking && _running && (_rxCount == 0)) {
+        pthread_cond_wait(&_rxCond, &_rxMtx);
+    }
+    while ((_rxCount > 0) && (count < (ssize_t) size)) {
+        len = sizeof (_rxBuf) - _rxRead;
+        if (len > _rxCount) {
+            len = _rxCount;
+        }
+        if (len > (int) size - count) {
+            len = (int) size - count;
+        }
+        memcpy((char *) buffer + count, _rxBuf + _rxRead, len);
+        _rxRead = (_rxRead + len) % sizeof (_rxBuf);
+        _rxCount -= len;
+        count += len;
+    }
+    if (count > 0) {
+        pthread_cond_broadcast(&_rxCond);
+    }
+    pthread_mutex_unlock(&_rxMtx);
+
+    return (count > 0) ? count : -EAGAIN;
+}
+
+ssize_t UARTSerial::write(const void *buffer, size_t size)
+{
+    const char *buf = (const char *) buffer;
+    size_t count = 0;
+    ssize_t len;
+    uint64_t now;
+    uint64_t bufferUs;
+
+    pthread_mutex_lock(&_txMtx);
+    while (count < size) {
+        len = ::write(_fd, buf + count, size - count);
+        if (len > 0) {
+            count += len;
+        } else if ((len < 0) && (errno != EINTR) && (errno != EAGAIN)) {
+            pthread_mutex_unlock(&_txMtx);
+            return -errno;
+        }
+    }
+
+    // Take as long as the characters would take to send, less
+    // what would sit in the transmit buffer
+    now = nowUs();
+    if (_txFreeUs < now) {
+        _txFreeUs = now;
+    }
+    _txFreeUs += ((uint64_t) size * 10 * 1000000) / _baud;
+    bufferUs = ((uint64_t) MBED_CONF_DRIVERS_UART_SERIAL_TXBUF_SIZE * 10 * 1000000) / _baud;
+    if (_txFreeUs > now + bufferUs) {
+        sleepUs(_txFreeUs - bufferUs - now);
+    }
+    pthread_mutex_unlock(&_txMtx);
+
+    return size;
+}
+
+off_t UARTSerial::seek(off_t offset, int whence)
+{
+    return -ESPIPE;
+}
+
+int UARTSerial::close()
+{
+    if (_running) {
+        _running = false;
+        pthread_mutex_lock(&_rxMtx);
+        pthread_cond_broadcast(&_rxCond);
+        pthread_mutex_unlock(&_rxMtx);
+        pthread_join(_rxThread, NULL);
+        ::close(_fd);
+    }
+
+    return 0;
+}
+
+int UARTSerial::isatty()
+{
+    return 1;
+}
+
+int UARTSerial::set_blocking(bool blocking)
+{
+    _blocking = blocking;
+    return 0;
+}
+
+short UARTSerial::poll(short events) const
+{
+    short revents = POLLOUT;
+
+    pthread_mutex_lock(&_rxMtx);
+    if (_rxCount > 0) {
+        revents |= POLLIN;
+    }
+    pthread_mutex_unlock(&_rxMtx);
+
+    return revents;
+}
+
+void UARTSerial::sigio(Callback<void()> func)
+{
+    pthread_mutex_lock(&_sigioMtx);
+    _sigio = func;
+    if (_sigio && poll(POLLIN | POLLOUT)) {
+        _sigio();
+    }
+    pthread_mutex_unlock(&_sigioMtx);
+}
+
+void UARTSerial::set_baud(int baud)
+{
+    speed_t speed = baudToSpeed(baud);
+    struct termios tio;
+
+    if (speed == 0) {
+        fprintf(stderr, "UARTSerial: %d baud is not supported on this host\n", baud);
+        return;
+    }
+    if (tcgetattr(_fd, &tio) == 0) {
+        cfsetispeed(&tio, speed);
+        cfsetospeed(&tio, speed);
+        tcsetattr(_fd, TCSANOW, &tio);
+    }
+    _baud = baud;
+}
+
+void UARTSerial::set_format(int bits, Parity parity, int stop_bits)
+{
+}
+
+void UARTSerial::set_flow_control(Flow type, PinName flow1, PinName flow2)
+{
+    pthread_mutex_lock(&_rxMtx);
+    _flowControl = (type == RTSCTS);
+    pthread_cond_broadcast(&_rxCond);
+    pthread_mutex_unlock(&_rxMtx);
+}
+
+uint32_t UARTSerial::numRxLost()
+{
+    uint32_t numRxLost;
+
+    pthread_mutex_lock(&_rxMtx);
+    numRxLost = _numRxLost;
+    pthread_mutex_unlock(&_rxMtx);
+
+    return numRxLost;
+}
+
+} // namespace mbed
+
+// ----------------------------------------------------------------
+// RTOS
+// ----------------------------------------------------------------
+
+namespace rtos {
+
+Mutex::Mutex(const char *name)
+{
+    pthread_mutex_init(&_mutex, NULL);
+    condInit(&_cond);
+    _count = 0;
+    _nextTicket = 0;
+}
+
+Mutex::~Mutex()
+{
+    pthread_cond_destroy(&_cond);
+    pthread_mutex_destroy(&_mutex);
+}
+
+// Waiters queue so that, as in RTX, an unlock() hands the mutex to
+// the thread that has waited longest rather than to whichever gets
+// there first; the timing of the driver's threads depends on this.
+osStatus Mutex::lock(uint32_t millisec)
+{
+    uint64_t deadline = deadlineUs(millisec);
+    unsigned int ticket;
+    osStatus status = osOK;
+
+    pthread_mutex_lock(&_mutex);
+    if ((_count > 0) && pthread_equal(_owner, pthread_self())) {
+        _count++;
+    } else {
+        ticket = _nextTicket++;
+        _waiters.push_back(ticket);
+        while ((_count > 0) || (_waiters.front() != ticket)) {
+            if (millisec == osWaitForever) {
+                pthread_cond_wait(&_cond, &_mutex);
+            } else if (!condWaitUntil(&_cond, &_mutex, deadline) && (nowUs() >= deadline)) {
+                break;
+            }
+        }
+        if ((_count == 0) && (_waiters.front() == ticket)) {
+            _owner = pthread_self();
+            _count = 1;
+        } else {
+            status = osErrorTimeout;
+        }
+        for (std::deque<unsigned int>::iterator x = _waiters.begin(); x != _waiters.end(); x++) {
+            if (*x == ticket) {
+                _waiters.erase(x);
+                break;
+            }
+        }
+        pthread_cond_broadcast(&_cond);
+    }
+    pthread_mutex_unlock(&_mutex);
+
+    return status;
+}
+
+bool Mutex::trylock()
+{
+    bool success = false;
+
+    pthread_mutex_lock(&_mutex);
+    if ((_count > 0) && pthread_equal(_owner, pthread_self())) {
+        _count++;
+        success = true;
+    } else if ((_count == 0) && _waiters.empty()) {
+        _owner = pthread_self();
+        _count = 1;
+        success = true;
+    }
+    pthread_mutex_unlock(&_mutex);
+
+    return success;
+}
+
+osStatus Mutex::unlock()
+{
+    pthread_mutex_lock(&_mutex);
+    if (_count > 0) {
+        _count--;
+        if (_count == 0) {
+            pthread_cond_broadcast(&_cond);
+        }
+    }
+    pthread_mutex_unlock(&_mutex);
+
+    return osOK;
+}
+
+Semaphore::Semaphore(int32_t count)
+{
+    pthread_mutex_init(&_mutex, NULL);
+    condInit(&_cond);
+    _count = count;
+}
+
+Semaphore::~Semaphore()
+{
+    pthread_cond_destroy(&_cond);
+    pthread_mutex_destroy(&_mutex);
+}
+
+int32_t Semaphore::wait(uint32_t millisec)
+{
+    uint64_t deadline = deadlineUs(millisec);
+    int32_t count = 0;
+
+    pthread_mutex_lock(&_mutex);
+    while (_count == 0) {
+        if (millisec == 0) {
+            break;
+        }
+        if (millisec == osWaitForever) {
+            pthread_cond_wait(&_cond, &_mutex);
+        } else if (!condWaitUntil(&_cond, &_mutex, deadline)) {
+            break;
+        }
+    }
+    if (_count > 0) {
+        count = _count;
+        _count--;
+    }
+    pthread_mutex_unlock(&_mutex);
+
+    return count;
+}
+
+osStatus Semaphore::release()
+{
+    pthread_mutex_lock(&_mutex);
+    _count++;
+    pthread_cond_signal(&_cond);
+    pthread_mutex_unlock(&_mutex);
+
+    return osOK;
+}
+
+EventFlags::EventFlags(const char *name)
+{
+    pthread_mutex_init(&_mutex, NULL);
+    condInit(&_cond);
+    _flags = 0;
+}
+
+EventFlags::~EventFlags()
+{
+    pthread_cond_destroy(&_cond);
+    pthread_mutex_destroy(&_mutex);
+}
+
+uint32_t EventFlags::set(uint32_t flags)
+{
+    uint32_t result;
+
+    pthread_mutex_lock(&_mutex);
+    _flags |= flags;
+    result = _flags;
+    pthread_cond_broadcast(&_cond);
+    pthread_mutex_unlock(&_mutex);
+
+    return result;
+}
+
+uint32_t EventFlags::clear(uint32_t flags)
+{
+    uint32_t result;
+
+    pthread_mutex_lock(&_mutex);
+    result = _flags;
+    _flags &= ~flags;
+    pthread_mutex_unlock(&_mutex);
+
+    return result;
+}
+
+uint32_t EventFlags::get() const
+{
+    uint32_t result;
+
+    pthread_mutex_lock(&_mutex);
+    result = _flags;
+    pthread_mutex_unlock(&_mutex);
+
+    return result;
+}
+
+uint32_t EventFlags::wait_all(uint32_t flags, uint32_t timeout, bool clear)
+{
+    return wait(flags, osFlagsWaitAll | (clear ? 0 : osFlagsNoClear), timeout);
+}
+
+uint32_t EventFlags::wait_any(uint32_t flags, uint32_t timeout, bool clear)
+{
+    return wait(flags, osFlagsWaitAny | (clear ? 0 : osFlagsNoClear), timeout);
+}
+
+uint32_t EventFlags::wait(uint32_t flags, uint32_t options, uint32_t timeout)
+{
+    uint64_t deadline = deadlineUs(timeout);
+    uint32_t result = osFlagsErrorTimeout;
+    bool done;
+
+    pthread_mutex_lock(&_mutex);
+    for (;;) {
+        if (options & osFlagsWaitAll) {
+            done = ((_flags & flags) == flags);
+        } else {
+            done = ((_flags & flags) != 0);
+        }
+        if (done) {
+            result = _flags;
+            if (!(options & osFlagsNoClear)) {
+                _flags &= ~flags;
+            }
+            break;
+        }
+        if (timeout == 0) {
+            break;
+        }
+        if (timeout == osWaitForever) {
+            pthread_cond_wait(&_cond, &_mutex);
+        } else if (!condWaitUntil(&_cond, &_mutex, deadline)) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&_mutex);
+
+    return result;
+}
+
+Thread::Thread(osPriority priority, uint32_t stack_size,
+               unsigned char *stack_mem, const char *name)
+{
+    _started = false;
+    _joined = false;
+}
+
+Thread::~Thread()
+{
+    if (_started && !_joined) {
+        pthread_detach(_thread);
+    }
+}
+
+void *Thread::entry(void *arg)
+{
+    mbed::Callback<void()> *task = (mbed::Callback<void()> *) arg;
+
+    task->call();
+    delete task;
+
+    return NULL;
+}
+
+osStatus Thread::start(mbed::Callback<void()> task)
+{
+    if (_started) {
+        return -1;
+    }
+    if (pthread_create(&_thread, NULL, entry, new mbed::Callback<void()>(task)) != 0) {
+        return -1;
+    }
+    _started = true;
+
+    return osOK;
+}
+
+osStatus Thread::join()
+{
+    if (_started && !_joined) {
+        pthread_join(_thread, NULL);
+        _joined = true;
+    }
+
+    return osOK;
+}
+
+osStatus Thread::wait(uint32_t millisec)
+{
+    sleepUs((uint64_t) millisec * 1000);
+    return osOK;
+}
+
+osStatus Thread::yield()
+{
+    sched_yield();
+    return osOK;
+}
+
+osThreadId Thread::gettid()
+{
+    static __thread char id;
+
+    return &id;
+}
+
+uint64_t Kernel::get_ms_count()
+{
+    return nowUs() / 1000;
+}
+
+} // namespace rtos
+
+// End of file
@@ -0,0 +1,46 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _HOST_SHIM_MBED_TRACE_
+#define _HOST_SHIM_MBED_TRACE_
+
+// mbed-trace, printing each trace to stdout with its level and group.
+
+#include <stdint.h>
+
+#define TRACE_LEVEL_DEBUG 0x10
+#define TRACE_LEVEL_INFO 0x08
+#define TRACE_LEVEL_WARN 0x04
+#define TRACE_LEVEL_ERROR 0x02
+#define TRACE_LEVEL_CMD 0x01
+
+#define tr_debug(...) mbed_tracef(TRACE_LEVEL_DEBUG, TRACE_GROUP, __VA_ARGS__)
+#define tr_info(...) mbed_tracef(TRACE_LEVEL_INFO, TRACE_GROUP, __VA_ARGS__)
+#define tr_warn(...) mbed_tracef(TRACE_LEVEL_WARN, TRACE_GROUP, __VA_ARGS__)
+#define tr_warning(...) mbed_tracef(TRACE_LEVEL_WARN, TRACE_GROUP, __VA_ARGS__)
+#define tr_err(...) mbed_tracef(TRACE_LEVEL_ERROR, TRACE_GROUP, __VA_ARGS__)
+#define tr_error(...) mbed_tracef(TRACE_LEVEL_ERROR, TRACE_GROUP, __VA_ARGS__)
+
+int mbed_trace_init(void);
+void mbed_trace_free(void);
+void mbed_trace_config_set(uint8_t config);
+void mbed_trace_mutex_wait_function_set(void (*mutex_wait_f)(void));
+void mbed_trace_mutex_release_function_set(void (*mutex_release_f)(void));
+void mbed_tracef(uint8_t dlevel, const char *grp, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+
+#endif // _HOST_SHIM_MBED_TRACE_
+
+// End of file
@@ -0,0 +1,227 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// The host implementation of mbed-trace, greentea-client, unity and
+// utest, enough to run the greentea tests of the driver on a PC.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <signal.h>
+#include <unistd.h>
+#include "greentea-client/test_env.h"
+#include "unity.h"
+#include "utest.h"
+#include "mbed_trace.h"
+
+// ----------------------------------------------------------------
+// PRIVATE TYPES
+// ----------------------------------------------------------------
+
+// Thrown to end a test case that has failed.
+typedef struct {
+    const char *file;
+    int line;
+    const char *message;
+} Failure;
+
+// ----------------------------------------------------------------
+// PRIVATE VARIABLES
+// ----------------------------------------------------------------
+
+static void (*traceMutexWait)(void) = NULL;
+static void (*traceMutexRelease)(void) = NULL;
+
+// ----------------------------------------------------------------
+// PRIVATE FUNCTIONS
+// ----------------------------------------------------------------
+
+// Called if the test takes longer than its timeout.
+static void timeout(int signal)
+{
+    static const char message[] = "{{timeout}}\n{{end;failure}}\n";
+
+    if (write(STDOUT_FILENO, message, sizeof (message) - 1) < 0) {
+    }
+    _exit(1);
+}
+
+// ----------------------------------------------------------------
+// MBED TRACE
+// ----------------------------------------------------------------
+
+int mbed_trace_init(void)
+{
+    return 0;
+}
+
+void mbed_trace_free(void)
+{
+}
+
+void mbed_trace_config_set(uint8_t config)
+{
+}
+
+void mbed_trace_mutex_wait_function_set(void (*mutex_wait_f)(void))
+{
+    traceMutexWait = mutex_wait_f;
+}
+
+void mbed_trace_mutex_release_function_set(void (*mutex_release_f)(void))
+{
+    traceMutexRelease = mutex_release_f;
+}
+
+void mbed_tracef(uint8_t dlevel, const char *grp, const char *fmt, ...)
+{
+    const char *level;
+    va_list args;
+
+    switch (dlevel) {
+        case TRACE_LEVEL_ERROR:
+            level = "ERR ";
+            break;
+        case TRACE_LEVEL_WARN:
+            level = "WARN";
+            break;
+        case TRACE_LEVEL_INFO:
+            level = "INFO";
+            break;
+        default:
+            level = "DBG ";
+            break;
+    }
+
+    if (traceMutexWait != NULL) {
+        traceMutexWait();
+    }
+    printf("[%s][%s]: ", level, grp);
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+    printf("\n");
+    fflush(stdout);
+    if (traceMutexRelease != NULL) {
+        traceMutexRelease();
+    }
+}
+
+// ----------------------------------------------------------------
+// GREENTEA
+// ----------------------------------------------------------------
+
+void greentea_setup(const int timeoutSeconds, const char *host_test_name)
+{
+    printf("{{timeout;%d}}\n", timeoutSeconds);
+    printf("{{host_test_name;%s}}\n", host_test_name);
+    fflush(stdout);
+    signal(SIGALRM, timeout);
+    alarm(timeoutSeconds);
+}
+
+void greentea_send_kv(const char *key, const char *val)
+{
+    printf("{{%s;%s}}\n", key, val);
+}
+
+void greentea_send_kv(const char *key, const int val)
+{
+    printf("{{%s;%d}}\n", key, val);
+}
+
+// ----------------------------------------------------------------
+// UNITY
+// ----------------------------------------------------------------
+
+void utest_host_fail(const char *file, int line, const char *message)
+{
+    Failure failure;
+
+    failure.file = file;
+    failure.line = line;
+    failure.message = message;
+
+    throw failure;
+}
+
+// ----------------------------------------------------------------
+// UTEST
+// ----------------------------------------------------------------
+
+namespace utest {
+namespace v1 {
+
+Case::Case(const char *description, void (*handler)(void))
+{
+    this->description = description;
+    this->handler = handler;
+}
+
+status_t verbose_test_setup_handler(const size_t number_of_cases)
+{
+    printf(">>> Running %d test cases...\n", (int) number_of_cases);
+    return STATUS_CONTINUE;
+}
+
+status_t greentea_test_setup_handler(const size_t number_of_cases)
+{
+    return verbose_test_setup_handler(number_of_cases);
+}
+
+bool Harness::run(const Specification &specification)
+{
+    size_t passed = 0;
+    size_t failed = 0;
+
+    if ((specification.setup != NULL) &&
+        (specification.setup(specification.numCases) != STATUS_CONTINUE)) {
+        return false;
+    }
+
+    for (size_t x = 0; (x < specification.numCases) && (failed == 0); x++) {
+        const Case *c = &specification.cases[x];
+        printf("\n>>> Running case #%d: '%s'...\n", (int) x + 1, c->description);
+        printf("{{__testcase_start;%s}}\n", c->description);
+        fflush(stdout);
+        try {
+            c->handler();
+            passed++;
+            printf("{{__testcase_finish;%s;1;0}}\n", c->description);
+            printf(">>> '%s': 1 passed, 0 failed\n", c->description);
+        } catch (Failure &failure) {
+            failed++;
+            printf("%s:%d::FAIL: %s\n", failure.file, failure.line, failure.message);
+            printf("{{__testcase_finish;%s;0;1}}\n", c->description);
+            printf(">>> '%s': 0 passed, 1 failed\n", c->description);
+        }
+        fflush(stdout);
+    }
+
+    printf("\n>>> Test cases: %d passed, %d failed\n", (int) passed, (int) failed);
+    if (failed > 0) {
+        printf(">>> TESTS FAILED!\n");
+    }
+    printf("{{end;%s}}\n", (failed == 0) ? "success" : "failure");
+    fflush(stdout);
+
+    return failed == 0;
+}
+
+} // namespace v1
+} // namespace utest
+
+// End of file
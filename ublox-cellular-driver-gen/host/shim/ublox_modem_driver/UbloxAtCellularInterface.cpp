@@ -0,0 +1,205 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "UbloxAtCellularInterface.h"
+#ifdef TRACE_GROUP
+# undef TRACE_GROUP
+#endif
+#define TRACE_GROUP "UACI"
+
+/**********************************************************************
+ * PROTECTED METHODS
+ **********************************************************************/
+
+// Activate the data context.
+bool UbloxATCellularInterface::activate_context()
+{
+    bool success;
+    int at_timeout;
+    LOCK();
+
+    at_timeout = _at_timeout;
+    success = _at->send("AT+UPSD=" PROFILE ",1,\"%s\"", (_apn != NULL) ? _apn : "") &&
+              _at->recv("OK");
+    if (success && (_uname != NULL)) {
+        success = _at->send("AT+UPSD=" PROFILE ",2,\"%s\"", _uname) && _at->recv("OK");
+    }
+    if (success && (_pwd != NULL)) {
+        success = _at->send("AT+UPSD=" PROFILE ",3,\"%s\"", _pwd) && _at->recv("OK");
+    }
+    if (success) {
+        // Activation takes time
+        at_set_timeout(180000);
+        success = _at->send("AT+UPSDA=" PROFILE ",3") && _at->recv("OK");
+        at_set_timeout(at_timeout);
+    }
+    if (success) {
+        success = _at->send("AT+UPSND=" PROFILE ",0") &&
+                  _at->recv("+UPSND: " PROFILE ",0,\"%45[^\"]\"", _ip) &&
+                  _at->recv("OK");
+    }
+    _active = success;
+
+    UNLOCK();
+    return success;
+}
+
+// Deactivate the data context.
+bool UbloxATCellularInterface::deactivate_context()
+{
+    bool success;
+    int at_timeout;
+    LOCK();
+
+    at_timeout = _at_timeout;
+    at_set_timeout(180000);
+    success = _at->send("AT+UPSDA=" PROFILE ",4") && _at->recv("OK");
+    at_set_timeout(at_timeout);
+    if (success) {
+        _active = false;
+        _ip[0] = 0;
+    }
+
+    UNLOCK();
+    return success;
+}
+
+/**********************************************************************
+ * PUBLIC METHODS
+ **********************************************************************/
+
+// Constructor.
+UbloxATCellularInterface::UbloxATCellularInterface(PinName tx,
+                                                   PinName rx,
+                                                   int baud,
+                                                   bool debug_on)
+{
+    _apn = NULL;
+    _uname = NULL;
+    _pwd = NULL;
+    _active = false;
+    _ip[0] = 0;
+
+    // Initialise the base class, which starts the AT parser
+    baseClassInit(tx, rx, baud, debug_on);
+}
+
+// Destructor.
+UbloxATCellularInterface::~UbloxATCellularInterface()
+{
+}
+
+// Set the credentials.
+void UbloxATCellularInterface::set_credentials(const char *apn, const char *uname,
+                                               const char *pwd)
+{
+    _apn = apn;
+    _uname = uname;
+    _pwd = pwd;
+}
+
+// Connect with the given credentials.
+nsapi_error_t UbloxATCellularInterface::connect(const char *sim_pin, const char *apn,
+                                                const char *uname, const char *pwd)
+{
+    if (sim_pin != NULL) {
+        set_pin(sim_pin);
+    }
+    if (apn != NULL) {
+        set_credentials(apn, uname, pwd);
+    }
+
+    return connect();
+}
+
+// Connect with the credentials already set.
+nsapi_error_t UbloxATCellularInterface::connect()
+{
+    nsapi_error_t nsapi_error = NSAPI_ERROR_OK;
+
+    if (!_active) {
+        if (!init(_pin)) {
+            nsapi_error = NSAPI_ERROR_DEVICE_ERROR;
+        } else if (!nwk_registration()) {
+            nsapi_error = NSAPI_ERROR_NO_CONNECTION;
+        } else if (!activate_context()) {
+            nsapi_error = NSAPI_ERROR_NO_CONNECTION;
+        }
+    }
+
+    return nsapi_error;
+}
+
+// Disconnect.
+nsapi_error_t UbloxATCellularInterface::disconnect()
+{
+    nsapi_error_t nsapi_error = NSAPI_ERROR_DEVICE_ERROR;
+
+    if (deactivate_context() && nwk_deregistration()) {
+        nsapi_error = NSAPI_ERROR_OK;
+    }
+
+    return nsapi_error;
+}
+
+// Resolve a host name.
+nsapi_error_t UbloxATCellularInterface::gethostbyname(const char *host,
+                                                      SocketAddress *address,
+                                                      nsapi_version_t version)
+{
+    nsapi_error_t nsapi_error = NSAPI_ERROR_DNS_FAILURE;
+    char ipAddress[NSAPI_IP_SIZE];
+    unsigned int a;
+    unsigned int b;
+    unsigned int c;
+    unsigned int d;
+    int at_timeout;
+
+    if (sscanf(host, "%u.%u.%u.%u", &a, &b, &c, &d) == 4) {
+        // Already an IP address
+        address->set_ip_address(host);
+        nsapi_error = NSAPI_ERROR_OK;
+    } else {
+        LOCK();
+        at_timeout = _at_timeout;
+        // This interrogation can sometimes take longer than the usual 8 seconds
+        at_set_timeout(60000);
+        if (_at->send("AT+UDNSRN=0,\"%s\"", host) &&
+            _at->recv("+UDNSRN: \"%45[^\"]\"", ipAddress) &&
+            _at->recv("OK")) {
+            address->set_ip_address(ipAddress);
+            nsapi_error = NSAPI_ERROR_OK;
+        }
+        at_set_timeout(at_timeout);
+        UNLOCK();
+    }
+
+    return nsapi_error;
+}
+
+// Get the local IP address.
+const char *UbloxATCellularInterface::get_ip_address()
+{
+    return (_ip[0] != 0) ? _ip : NULL;
+}
+
+// Return whether a data context is active.
+bool UbloxATCellularInterface::is_connected()
+{
+    return _active;
+}
+
+// End of file
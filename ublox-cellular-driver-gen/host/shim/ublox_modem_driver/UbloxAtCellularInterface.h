@@ -0,0 +1,90 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _UBLOX_AT_CELLULAR_INTERFACE_
+#define _UBLOX_AT_CELLULAR_INTERFACE_
+
+// A host stand-in for UbloxATCellularInterface from ublox-at-cellular-
+// interface: connecting activates a PDP context with AT+UPSD/AT+UPSDA
+// and host names are resolved with AT+UDNSRN; sockets are left out.
+
+#include "UbloxCellularBase.h"
+#include "SocketAddress.h"
+
+class UbloxATCellularInterface : virtual public UbloxCellularBase {
+
+public:
+    UbloxATCellularInterface(PinName tx = MDMTXD,
+                             PinName rx = MDMRXD,
+                             int baud = MBED_CONF_UBLOX_CELL_BAUD_RATE,
+                             bool debug_on = false);
+    virtual ~UbloxATCellularInterface();
+
+    /** Set the cellular network credentials.
+     */
+    virtual void set_credentials(const char *apn, const char *uname = 0,
+                                 const char *pwd = 0);
+
+    /** Connect to the cellular network and activate a data context.
+     *
+     * @return NSAPI_ERROR_OK on success, else a negative error code.
+     */
+    virtual nsapi_error_t connect(const char *sim_pin, const char *apn = 0,
+                                  const char *uname = 0, const char *pwd = 0);
+
+    /** Connect using the credentials already set.
+     */
+    virtual nsapi_error_t connect();
+
+    /** Deactivate the data context and deregister.
+     *
+     * @return NSAPI_ERROR_OK on success, else a negative error code.
+     */
+    virtual nsapi_error_t disconnect();
+
+    /** Resolve a host name to an IP address.
+     *
+     * @return NSAPI_ERROR_OK on success, else a negative error code.
+     */
+    virtual nsapi_error_t gethostbyname(const char *host, SocketAddress *address,
+                                        nsapi_version_t version = NSAPI_UNSPEC);
+
+    /** Get the local IP address.
+     *
+     * @return the IP address, NULL if there is none.
+     */
+    virtual const char *get_ip_address();
+
+    /** Return whether a data context is active.
+     */
+    bool is_connected();
+
+protected:
+    #define PROFILE "0"
+
+    const char *_apn;
+    const char *_uname;
+    const char *_pwd;
+    bool _active;
+    char _ip[NSAPI_IP_SIZE];
+
+    bool activate_context();
+    bool deactivate_context();
+};
+
+#endif // _UBLOX_AT_CELLULAR_INTERFACE_
+
+// End of file
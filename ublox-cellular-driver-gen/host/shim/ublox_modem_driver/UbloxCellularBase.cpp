@@ -0,0 +1,419 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "UbloxCellularBase.h"
+#ifdef TRACE_GROUP
+# undef TRACE_GROUP
+#endif
+#define TRACE_GROUP "UCB"
+
+/**********************************************************************
+ * PRIVATE METHODS
+ **********************************************************************/
+
+// Set a registration status from a +CREG, +CGREG or +CEREG line,
+// which may be an answer to a query (two values) or a URC (one).
+void UbloxCellularBase::set_nwk_reg_status(volatile NetworkRegistrationStatus *status,
+                                           const char *urc)
+{
+    char buf[32];
+    int a;
+    int b;
+    int count;
+
+    if (read_at_to_char(buf, sizeof (buf), '\n') > 0) {
+        count = sscanf(buf, ": %d,%d", &a, &b);
+        if (count == 2) {
+            *status = (NetworkRegistrationStatus) b;
+        } else if (count == 1) {
+            *status = (NetworkRegistrationStatus) a;
+        }
+        if (count > 0) {
+            debug_if(_debug_trace_on, "%s status %d\n", urc, *status);
+        }
+    }
+}
+
+// Abort the current AT command on an error.
+void UbloxCellularBase::parser_abort_cb()
+{
+    _at->abort();
+}
+
+// Circuit switched registration status.
+void UbloxCellularBase::CREG_URC()
+{
+    set_nwk_reg_status(&_dev_info.reg_status_csd, "+CREG");
+}
+
+// Packet switched registration status.
+void UbloxCellularBase::CGREG_URC()
+{
+    set_nwk_reg_status(&_dev_info.reg_status_psd, "+CGREG");
+}
+
+// EUTRAN registration status.
+void UbloxCellularBase::CEREG_URC()
+{
+    set_nwk_reg_status(&_dev_info.reg_status_eps, "+CEREG");
+}
+
+// Message waiting indication, captured to keep it out of the way.
+void UbloxCellularBase::UMWI_URC()
+{
+    char buf[32];
+
+    read_at_to_char(buf, sizeof (buf), '\n');
+}
+
+/**********************************************************************
+ * PROTECTED METHODS
+ **********************************************************************/
+
+// Constructor.
+UbloxCellularBase::UbloxCellularBase()
+{
+    _pin = NULL;
+    _at = NULL;
+    _at_timeout = AT_PARSER_TIMEOUT;
+    _fh = NULL;
+    _baud = MBED_CONF_UBLOX_CELL_BAUD_RATE;
+    _modem_initialised = false;
+    _debug_trace_on = false;
+    memset(&_dev_info, 0, sizeof (_dev_info));
+    _dev_info.reg_status_csd = NOT_REGISTERED_NOT_SEARCHING;
+    _dev_info.reg_status_psd = NOT_REGISTERED_NOT_SEARCHING;
+    _dev_info.reg_status_eps = NOT_REGISTERED_NOT_SEARCHING;
+}
+
+// Destructor.
+UbloxCellularBase::~UbloxCellularBase()
+{
+    deinit();
+    delete _at;
+    delete _fh;
+}
+
+// Initialise this class.
+void UbloxCellularBase::baseClassInit(PinName tx, PinName rx,
+                                      int baud, bool debug_on)
+{
+    // Only initialise ourselves if it's not already been done
+    if (_at == NULL) {
+        if (_debug_trace_on == false) {
+            _debug_trace_on = debug_on;
+        }
+        _baud = baud;
+
+        // Set up File Handle for buffered serial comms with the
+        // cellular module (which will be used by the AT parser)
+        _fh = new UARTSerial(tx, rx, _baud);
+
+        // Set up the AT parser
+        _at = new ATCmdParser(_fh, OUTPUT_ENTER_KEY, AT_PARSER_BUFFER_SIZE,
+                              _at_timeout, _debug_trace_on);
+
+        // Error cases, out of band handling
+        _at->oob("ERROR", callback(this, &UbloxCellularBase::parser_abort_cb));
+        _at->oob("+CME ERROR", callback(this, &UbloxCellularBase::parser_abort_cb));
+        _at->oob("+CMS ERROR", callback(this, &UbloxCellularBase::parser_abort_cb));
+
+        // Registration status, out of band handling
+        _at->oob("+CREG", callback(this, &UbloxCellularBase::CREG_URC));
+        _at->oob("+CGREG", callback(this, &UbloxCellularBase::CGREG_URC));
+        _at->oob("+CEREG", callback(this, &UbloxCellularBase::CEREG_URC));
+
+        // Capture the UMWI, just to stop it getting in the way
+        _at->oob("+UMWI", callback(this, &UbloxCellularBase::UMWI_URC));
+    }
+}
+
+// Set the AT parser timeout.
+void UbloxCellularBase::at_set_timeout(int timeout)
+{
+    _at_timeout = timeout;
+    _at->set_timeout(timeout);
+}
+
+// Read up to size bytes from the AT interface up to a "end".
+int UbloxCellularBase::read_at_to_char(char *buf, int size, char end)
+{
+    int count = 0;
+    int x = 0;
+
+    if (size > 0) {
+        for (count = 0; (count < size) && (x >= 0) && (x != end); count++) {
+            x = _at->getc();
+            *(buf + count) = (char) x;
+        }
+
+        count--;
+        *(buf + count) = 0;
+
+        // Convert line endings: if end was '\n' and the
+        // preceding character was '\r' then null that too
+        if ((count > 0) && (end == '\n') && (*(buf + count - 1) == '\r')) {
+            count--;
+            *(buf + count) = 0;
+        }
+    }
+
+    return count;
+}
+
+// Power up the modem and check that it responds.
+bool UbloxCellularBase::power_up()
+{
+    bool success = false;
+    int at_timeout;
+    LOCK();
+
+    at_timeout = _at_timeout;
+
+    // Try a few times as the module may be waking up
+    at_set_timeout(1000);
+    for (int retry_count = 0; !success && (retry_count < 20); retry_count++) {
+        _at->flush();
+        if (_at->send("AT") && _at->recv("OK")) {
+            success = true;
+        }
+    }
+    at_set_timeout(at_timeout);
+
+    if (success) {
+        success = _at->send("ATE0") && _at->recv("OK") && // Turn off modem echoing
+                  _at->send("AT+CMEE=2") && _at->recv("OK") && // Turn on verbose responses
+                  _at->send("AT&K0") && _at->recv("OK"); // Turn off RTS/CTS handshaking
+    }
+
+    if (!success) {
+        tr_error("Preliminary modem setup failed.");
+    }
+
+    UNLOCK();
+    return success;
+}
+
+// Check that the SIM is ready, entering the PIN if required.
+bool UbloxCellularBase::initialise_sim_card()
+{
+    bool success = false;
+    int retry_count = 0;
+    bool done = false;
+    char pinstr[16];
+    LOCK();
+
+    while (!done && (retry_count < 10)) {
+        if (_at->send("AT+CPIN?") && _at->recv("+CPIN: %15[^\n]\nOK\n", pinstr)) {
+            if (strcmp(pinstr, "SIM PIN") == 0) {
+                if ((_pin == NULL) ||
+                    !_at->send("AT+CPIN=\"%s\"", _pin) || !_at->recv("OK")) {
+                    tr_error("PIN correct: NO");
+                    done = true;
+                }
+            } else if (strcmp(pinstr, "READY") == 0) {
+                success = _at->send("AT+CCID") && _at->recv("+CCID: %20[^\n]\nOK\n", _dev_info.iccid) &&
+                          _at->send("AT+CIMI") && _at->recv("%15[^\n]\nOK\n", _dev_info.imsi) &&
+                          _at->send("AT+CGSN") && _at->recv("%15[^\n]\nOK\n", _dev_info.imei);
+                done = true;
+            } else {
+                wait_ms(1000);
+            }
+        } else {
+            wait_ms(1000);
+        }
+        retry_count++;
+    }
+
+    UNLOCK();
+    return success;
+}
+
+// Find out what the modem is.
+bool UbloxCellularBase::set_device_identity(DeviceType *dev)
+{
+    char buf[20];
+    bool success;
+    LOCK();
+
+    success = _at->send("ATI") && _at->recv("%19[^\n]\nOK\n", buf);
+    if (success) {
+        if (strstr(buf, "SARA-G35")) {
+            *dev = DEV_SARA_G35;
+        } else if (strstr(buf, "LISA-U200-03S")) {
+            *dev = DEV_LISA_U2_03S;
+        } else if (strstr(buf, "LISA-U2")) {
+            *dev = DEV_LISA_U2;
+        } else if (strstr(buf, "SARA-U2")) {
+            *dev = DEV_SARA_U2;
+        } else if (strstr(buf, "LEON-G2")) {
+            *dev = DEV_LEON_G2;
+        } else if (strstr(buf, "TOBY-L2")) {
+            *dev = DEV_TOBY_L2;
+        } else if (strstr(buf, "MPCI-L2")) {
+            *dev = DEV_MPCI_L2;
+        }
+        debug_if(_debug_trace_on, "Device type is %d (\"%s\")\n", *dev, buf);
+    }
+
+    UNLOCK();
+    return success;
+}
+
+// Device specific initialisation.
+bool UbloxCellularBase::device_init(DeviceType dev)
+{
+    bool success = false;
+    LOCK();
+
+    if ((dev == DEV_LISA_U2) || (dev == DEV_LEON_G2) || (dev == DEV_TOBY_L2)) {
+        success = _at->send("AT+UGPIOC=20,2") && _at->recv("OK");
+    } else if ((dev == DEV_SARA_U2) || (dev == DEV_SARA_G35)) {
+        success = _at->send("AT+UGPIOC=16,2") && _at->recv("OK");
+    } else {
+        success = true;
+    }
+
+    UNLOCK();
+    return success;
+}
+
+// Return whether registered for circuit switched service.
+bool UbloxCellularBase::is_registered_csd()
+{
+    return (_dev_info.reg_status_csd == REGISTERED) ||
+           (_dev_info.reg_status_csd == REGISTERED_ROAMING);
+}
+
+// Return whether registered for packet switched service.
+bool UbloxCellularBase::is_registered_psd()
+{
+    return (_dev_info.reg_status_psd == REGISTERED) ||
+           (_dev_info.reg_status_psd == REGISTERED_ROAMING);
+}
+
+// Return whether registered for EUTRAN service.
+bool UbloxCellularBase::is_registered_eps()
+{
+    return (_dev_info.reg_status_eps == REGISTERED) ||
+           (_dev_info.reg_status_eps == REGISTERED_ROAMING);
+}
+
+/**********************************************************************
+ * PUBLIC METHODS
+ **********************************************************************/
+
+// Initialise the modem.
+bool UbloxCellularBase::init(const char *pin)
+{
+    LOCK();
+
+    if (!_modem_initialised) {
+        if (power_up()) {
+            tr_info("Modem Ready.");
+            if (pin != NULL) {
+                _pin = pin;
+            }
+            if (initialise_sim_card() &&
+                set_device_identity(&_dev_info.dev) &&
+                device_init(_dev_info.dev)) {
+                _modem_initialised = true;
+            }
+        }
+    }
+
+    UNLOCK();
+    return _modem_initialised;
+}
+
+// Perform registration.
+bool UbloxCellularBase::nwk_registration()
+{
+    bool registered = false;
+    int status;
+    int at_timeout;
+    LOCK();
+
+    at_timeout = _at_timeout; // Has to be inside LOCK()s
+
+    if (!is_registered_psd() && !is_registered_csd() && !is_registered_eps()) {
+        tr_info("Searching Network...");
+        // Enable the packet switched and network registration unsolicited result codes
+        if (_at->send("AT+CREG=1") && _at->recv("OK") &&
+            _at->send("AT+CGREG=1") && _at->recv("OK")) {
+            if (_dev_info.dev == DEV_TOBY_L2) {
+                _at->send("AT+CEREG=1") && _at->recv("OK");
+            }
+            // See if we are already in automatic mode
+            if (_at->send("AT+COPS?") && _at->recv("+COPS: %d", &status) &&
+                _at->recv("OK")) {
+                if (status != 0) {
+                    _at->send("AT+COPS=0") && _at->recv("OK");
+                }
+            }
+            // Query the registration status directly as well,
+            // the answers being processed by the URC handlers
+            _at->send("AT+CREG?") && _at->recv("OK");
+            _at->send("AT+CGREG?") && _at->recv("OK");
+        }
+
+        // Wait for registration to succeed
+        at_set_timeout(1000);
+        for (int waitSeconds = 0; !registered && (waitSeconds < 180); waitSeconds++) {
+            registered = is_registered_psd() || is_registered_csd() || is_registered_eps();
+            if (!registered) {
+                _at->recv(UNNATURAL_STRING);
+            }
+        }
+        at_set_timeout(at_timeout);
+    } else {
+        registered = true;
+    }
+
+    UNLOCK();
+    return registered;
+}
+
+// Deregister from the network.
+bool UbloxCellularBase::nwk_deregistration()
+{
+    bool success = false;
+    LOCK();
+
+    if (_at->send("AT+COPS=2") && _at->recv("OK")) {
+        _dev_info.reg_status_csd = NOT_REGISTERED_NOT_SEARCHING;
+        _dev_info.reg_status_psd = NOT_REGISTERED_NOT_SEARCHING;
+        _dev_info.reg_status_eps = NOT_REGISTERED_NOT_SEARCHING;
+        success = true;
+    }
+
+    UNLOCK();
+    return success;
+}
+
+// Put the modem into its lowest power state.
+void UbloxCellularBase::deinit()
+{
+    _modem_initialised = false;
+}
+
+// Set the PIN.
+void UbloxCellularBase::set_pin(const char *pin)
+{
+    _pin = pin;
+}
+
+// End of file
@@ -0,0 +1,238 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _UBLOX_CELLULAR_BASE_
+#define _UBLOX_CELLULAR_BASE_
+
+// A host stand-in for UbloxCellularBase from ublox-cellular-base,
+// with the same members and behaviour as far as the driver and its
+// tests depend on them: the modem is powered up, its SIM checked and
+// its type found by init(), and registration follows +CREG/+CGREG.
+
+#include "mbed.h"
+#include "mbed_trace.h"
+
+class UbloxCellularBase {
+
+public:
+    /** Initialise the modem, ready for use.
+     *
+     * @param pin PIN for the SIM card.
+     * @return    true if successful, otherwise false.
+     */
+    bool init(const char *pin = 0);
+
+    /** Perform registration with the network.
+     *
+     * @return true if successful, otherwise false.
+     */
+    bool nwk_registration();
+
+    /** Deregister from the network.
+     *
+     * @return true if successful, otherwise false.
+     */
+    bool nwk_deregistration();
+
+    /** Put the modem into its lowest power state.
+     */
+    void deinit();
+
+    /** Set the PIN code for the SIM card.
+     *
+     * @param pin PIN for the SIM card.
+     */
+    void set_pin(const char *pin);
+
+protected:
+
+    #define OUTPUT_ENTER_KEY  "\r"
+
+    #define AT_PARSER_BUFFER_SIZE 256
+
+    #define AT_PARSER_TIMEOUT 8*1000 // Milliseconds
+
+    /** A string that would not normally be sent by the modem on the AT interface.
+     */
+    #define UNNATURAL_STRING "\x01"
+
+    /** Supported u-blox modem variants.
+     */
+    typedef enum {
+        DEV_TYPE_NONE = 0,
+        DEV_SARA_G35,
+        DEV_LISA_U2,
+        DEV_LISA_U2_03S,
+        DEV_SARA_U2,
+        DEV_LEON_G2,
+        DEV_TOBY_L2,
+        DEV_MPCI_L2
+    } DeviceType;
+
+    /** Network registration status.
+     */
+    typedef enum {
+        NOT_REGISTERED_NOT_SEARCHING = 0,
+        REGISTERED = 1,
+        NOT_REGISTERED_SEARCHING = 2,
+        REGISTRATION_DENIED = 3,
+        UNKNOWN_COVERAGE = 4,
+        REGISTERED_ROAMING = 5
+    } NetworkRegistrationStatus;
+
+    /** Info about the modem.
+     */
+    typedef struct {
+        DeviceType dev;
+        char iccid[20 + 1];
+        char imsi[15 + 1];
+        char imei[15 + 1];
+        char meid[18 + 1];
+        volatile NetworkRegistrationStatus reg_status_csd;
+        volatile NetworkRegistrationStatus reg_status_psd;
+        volatile NetworkRegistrationStatus reg_status_eps;
+    } DeviceInfo;
+
+    /* IMPORTANT: the variables below are available to
+     * classes that inherit this in order to keep things
+     * simple. However, ONLY this class should free
+     * any of the pointers, or there will be havoc.
+     */
+
+    /** Point to the instance of the AT parser in use.
+     */
+    ATCmdParser *_at;
+
+    /** The current AT parser timeout value.
+     */
+    int _at_timeout;
+
+    /** File handle used by the AT parser.
+     */
+    UARTSerial *_fh;
+
+    /** Mutex to protect the AT parser.
+     */
+    PlatformMutex _mtx;
+
+    /** General info about the modem as a device.
+     */
+    DeviceInfo _dev_info;
+
+    /** The SIM PIN to use.
+     */
+    const char *_pin;
+
+    /** Set to true to spit out debug traces.
+     */
+    bool _debug_trace_on;
+
+    /** The baud rate to the modem.
+     */
+    int _baud;
+
+    /** True if the modem is ready register to the network.
+     */
+    bool _modem_initialised;
+
+    /** Constructor.
+     */
+    UbloxCellularBase();
+
+    /** Destructor.
+     */
+    ~UbloxCellularBase();
+
+    /** Initialise this class, called by the classes that derive from
+     * it; only the first call does anything.
+     */
+    void baseClassInit(PinName tx = MDMTXD,
+                       PinName rx = MDMRXD,
+                       int baud = MBED_CONF_UBLOX_CELL_BAUD_RATE,
+                       bool debug_on = false);
+
+    /** Set the AT parser timeout.
+     */
+    void at_set_timeout(int timeout);
+
+    /** Read up to size characters from buf, or until the character
+     * end is reached, overwriting the end character with a string
+     * terminator, and a preceding '\r' also if end is '\n'.
+     *
+     * @param buf  the buffer to write to.
+     * @param size the size of the buffer.
+     * @param end  the character to stop at.
+     * @return     the number of characters read, not including
+     *             the terminator.
+     */
+    int read_at_to_char(char *buf, int size, char end);
+
+    /** Power up the modem and check that it responds.
+     */
+    bool power_up();
+
+    /** Check that the SIM is ready, entering the PIN if required.
+     */
+    bool initialise_sim_card();
+
+    /** Find out what the modem is.
+     */
+    bool set_device_identity(DeviceType *dev);
+
+    /** Device specific initialisation.
+     */
+    bool device_init(DeviceType dev);
+
+    /** Return whether registered for circuit switched service.
+     */
+    bool is_registered_csd();
+
+    /** Return whether registered for packet switched service.
+     */
+    bool is_registered_psd();
+
+    /** Return whether registered for EUTRAN service.
+     */
+    bool is_registered_eps();
+
+    /** Lock a mutex when accessing the modem.
+     */
+    void lock(void)     { _mtx.lock(); }
+
+    /** Helpful macro for using lock() in-line.
+     */
+    #define LOCK()      { lock()
+
+    /** Unlock the modem when done accessing it.
+     */
+    void unlock(void)   { _mtx.unlock(); }
+
+    /** Helpful macro for using unlock() in-line.
+     */
+    #define UNLOCK()    } unlock()
+
+private:
+    void set_nwk_reg_status(volatile NetworkRegistrationStatus *status, const char *urc);
+    void parser_abort_cb();
+    void CREG_URC();
+    void CGREG_URC();
+    void CEREG_URC();
+    void UMWI_URC();
+};
+
+#endif // _UBLOX_CELLULAR_BASE_
+
+// End of file
@@ -0,0 +1,36 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _HOST_SHIM_UNITY_
+#define _HOST_SHIM_UNITY_
+
+// The Unity assertions used by the tests: a failure ends the test
+// case, as it does on the board.
+
+#define TEST_FAIL_MESSAGE(message) utest_host_fail(__FILE__, __LINE__, message)
+#define TEST_FAIL() TEST_FAIL_MESSAGE("Fail")
+#define TEST_ASSERT_MESSAGE(condition, message) do { if (!(condition)) { TEST_FAIL_MESSAGE(message); } } while (0)
+#define TEST_ASSERT(condition) TEST_ASSERT_MESSAGE(condition, "Expression Evaluated To FALSE: " #condition)
+#define TEST_ASSERT_TRUE(condition) TEST_ASSERT(condition)
+#define TEST_ASSERT_FALSE(condition) TEST_ASSERT(!(condition))
+#define TEST_ASSERT_EQUAL(expected, actual) TEST_ASSERT((expected) == (actual))
+#define TEST_ASSERT_EQUAL_INT(expected, actual) TEST_ASSERT((int) (expected) == (int) (actual))
+
+void utest_host_fail(const char *file, int line, const char *message) __attribute__((noreturn));
+
+#endif // _HOST_SHIM_UNITY_
+
+// End of file
@@ -0,0 +1,69 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _HOST_SHIM_UTEST_
+#define _HOST_SHIM_UTEST_
+
+// The utest harness, running the cases of a specification one after
+// another in the calling thread and stopping at the first failure.
+
+#include <stddef.h>
+
+namespace utest {
+namespace v1 {
+
+typedef enum {
+    STATUS_CONTINUE = 0,
+    STATUS_ABORT = -1
+} status_t;
+
+class Case {
+public:
+    Case(const char *description, void (*handler)(void));
+
+    const char *description;
+    void (*handler)(void);
+};
+
+class Specification {
+public:
+    template <size_t N>
+    Specification(status_t (*setup)(const size_t), Case (&cases)[N])
+    {
+        this->setup = setup;
+        this->cases = cases;
+        this->numCases = N;
+    }
+
+    status_t (*setup)(const size_t);
+    Case *cases;
+    size_t numCases;
+};
+
+class Harness {
+public:
+    static bool run(const Specification &specification);
+};
+
+status_t verbose_test_setup_handler(const size_t number_of_cases);
+status_t greentea_test_setup_handler(const size_t number_of_cases);
+
+} // namespace v1
+} // namespace utest
+
+#endif // _HOST_SHIM_UTEST_
+
+// End of file
@@ -0,0 +1,254 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Host-side decoder for the driver's binary event trace.  Reads the
+// output of printTrace() (e.g. a capture of the board's serial
+// console) on stdin and writes it to stdout with each trace line
+// turned back into text; all other lines are passed through as they
+// are.  The text lives here so that it takes no space in the driver.
+// Build with "make", run with "./trace_decoder < capture.txt".
+
+#include <stdio.h>
+#include <string.h>
+#include "UbloxTraceIds.h"
+
+// ----------------------------------------------------------------
+// PRIVATE VARIABLES
+// ----------------------------------------------------------------
+
+// The names of the service classes, one per bit of <class>.
+static const char *ssClasses[] = {"voice", "data", "fax", "SMS",
+                                  "data circuit sync", "data circuit async",
+                                  "dedicated packet access",
+                                  "dedicated PAD access"};
+
+// The +CLIR <m> values.
+static const char *clirStatus[] = {"is not provisioned", "is provisioned permanently",
+                                   "is unknown",
+                                   "is in temporary mode, presentation restricted",
+                                   "is in temporary mode, presentation allowed"};
+
+// The +CLIP/+COLP <m> and +COLR <status> values.
+static const char *provisionStatus[] = {"is not provisioned", "is provisioned",
+                                        "is unknown"};
+
+// The HTTP commands, as HttpCmd.
+static const char *httpCmds[] = {"HTTP HEAD command", "HTTP GET command",
+                                 "HTTP DELETE command", "HTTP PUT command",
+                                 "HTTP POST file command", "HTTP POST data command"};
+
+// An FTP command, as FtpCmd, and its name.
+typedef struct {
+    int cmd;
+    const char *name;
+} FtpCmdName;
+
+// The FTP commands.
+static const FtpCmdName ftpCmds[] = {{0, "FTP log out command"},
+                                     {1, "FTP log in command"},
+                                     {2, "FTP delete file command"},
+                                     {3, "FTP rename file command"},
+                                     {4, "FTP get file command"},
+                                     {5, "FTP put file command"},
+                                     {6, "FTP get direct command"},
+                                     {7, "FTP put direct command"},
+                                     {8, "FTP change directory command"},
+                                     {10, "FTP make directory command"},
+                                     {11, "FTP remove directory command"},
+                                     {13, "FTP file info command"},
+                                     {14, "FTP directory list command"},
+                                     {100, "FTP FOTA file command"}};
+
+// The +UULOCIND steps.
+static const char *cellLocSteps[] = {"Network scan start", "Network scan end",
+                                     "Requesting data from server",
+                                     "Received data from server",
+                                     "Sending feedback to server"};
+
+// The +UULOCIND results, 0 being no error.
+static const char *cellLocResults[] = {NULL, "Wrong URL!", "HTTP error!",
+                                       "Create socket error!", "Close socket error!",
+                                       "Write to socket error!", "Read from socket error!",
+                                       "Connection/DNS error!",
+                                       "Authentication token problem!",
+                                       "Generic error!", "User terminated!",
+                                       "No data from server!"};
+
+// ----------------------------------------------------------------
+// PRIVATE FUNCTIONS
+// ----------------------------------------------------------------
+
+// Look up a value in a table of strings.
+static const char *lookUp(const char **table, int size, int value, const char *unknown)
+{
+    if ((value >= 0) && (value < size) && (table[value] != NULL)) {
+        return table[value];
+    }
+
+    return unknown;
+}
+
+#define LOOK_UP(table, value, unknown) lookUp(table, sizeof (table) / sizeof (table[0]), \
+                                              value, unknown)
+
+// Return the name of an FTP command.
+static const char *ftpCmdName(int cmd)
+{
+    for (unsigned int x = 0; x < sizeof (ftpCmds) / sizeof (ftpCmds[0]); x++) {
+        if (ftpCmds[x].cmd == cmd) {
+            return ftpCmds[x].name;
+        }
+    }
+
+    return "FTP command not recognised";
+}
+
+// Print the service classes in a <class> bitmap.
+static void printClasses(int classes)
+{
+    for (unsigned int x = 0; x < sizeof (ssClasses) / sizeof (ssClasses[0]); x++) {
+        if ((classes > 0) && (classes & (1 << x))) {
+            printf(" for %s", ssClasses[x]);
+        }
+    }
+}
+
+// Print one event as text.
+static void printEvent(unsigned long id, long a, long b, long c)
+{
+    switch (id) {
+        case UBLOX_TRACE_SMS_NEW:
+            printf("New SMS received");
+            break;
+        case UBLOX_TRACE_SS_CCWA:
+            printf("Calling Waiting is %s", (a > 0) ? "active" : "not active");
+            printClasses(b);
+            break;
+        case UBLOX_TRACE_SS_CCFC:
+            printf("Calling Forwarding is %s", (a > 0) ? "active" : "not active");
+            printClasses(b);
+            if (c) {
+                printf(" for a number");
+            }
+            break;
+        case UBLOX_TRACE_SS_CLIR:
+            printf("Calling Line ID %s", (a == 0) ? "restriction is as subscribed" :
+                                         (a == 1) ? "invocation" :
+                                         (a == 2) ? "suppression" : "unknown mode");
+            if (b >= 0) {
+                printf(" %s", LOOK_UP(clirStatus, b, "has unknown status"));
+            }
+            break;
+        case UBLOX_TRACE_SS_CLIP:
+        case UBLOX_TRACE_SS_COLP:
+            printf("%s Line ID %s", (id == UBLOX_TRACE_SS_CLIP) ? "Calling" : "Connected",
+                   (a == 0) ? "disable" : (a == 1) ? "enable" : "unknown mode");
+            if (b >= 0) {
+                printf(" %s", LOOK_UP(provisionStatus, b, "has unknown status"));
+            }
+            break;
+        case UBLOX_TRACE_SS_COLR:
+            printf("Connected Line ID restriction %s",
+                   LOOK_UP(provisionStatus, a, "has unknown status"));
+            break;
+        case UBLOX_TRACE_FILE_READ_START:
+            printf("readFile: size is %ld, reading up to %ld", a, b);
+            break;
+        case UBLOX_TRACE_FILE_READ_SHORT:
+            printf("readFile: blockSize %ld but only received %ld bytes", a, b);
+            break;
+        case UBLOX_TRACE_HTTP_COMMAND:
+            printf("%s on profile %ld", LOOK_UP(httpCmds, b, "HTTP command not recognised"), a);
+            break;
+        case UBLOX_TRACE_HTTP_ERROR:
+            printf("%s on profile %ld: ERROR",
+                   LOOK_UP(httpCmds, b, "HTTP command not recognised"), a);
+            break;
+        case UBLOX_TRACE_HTTP_RESULT:
+            printf("%s on profile %ld, result code is %ld",
+                   LOOK_UP(httpCmds, b, "HTTP command not recognised"), a, c);
+            break;
+        case UBLOX_TRACE_FTP_COMMAND:
+            printf("%s", ftpCmdName(a));
+            break;
+        case UBLOX_TRACE_FTP_ERROR:
+            printf("%s: ERROR", ftpCmdName(a));
+            break;
+        case UBLOX_TRACE_FTP_RESULT:
+            printf("%s result code is %ld", ftpCmdName(a), b);
+            break;
+        case UBLOX_TRACE_CELL_LOC_STEP:
+            printf("%s", LOOK_UP(cellLocSteps, a, "Unknown step"));
+            if (b != 0) {
+                printf(": %s", LOOK_UP(cellLocResults, b, "Unknown result!"));
+            }
+            break;
+        case UBLOX_TRACE_CELL_LOC_FOUND:
+            printf("Position found at index %ld", a);
+            break;
+        case UBLOX_TRACE_HTTP_CANCEL:
+            printf("%s on profile %ld: cancelled",
+                   LOOK_UP(httpCmds, b, "HTTP command not recognised"), a);
+            break;
+        case UBLOX_TRACE_FTP_ABORT:
+            printf("%s: cancelled, aborting", ftpCmdName(a));
+            break;
+        case UBLOX_TRACE_AT_YIELD:
+            printf("Turn held too long, given up at depth %ld, priority class %ld", a, b);
+            break;
+        case UBLOX_TRACE_FILE_READ_RETRY:
+            printf("readFile: block at offset %ld asked for again at blockSize %ld, retry %ld",
+                   a, b, c);
+            break;
+        default:
+            printf("Unknown event %lu (%ld, %ld, %ld)", id, a, b, c);
+            break;
+    }
+}
+
+// ----------------------------------------------------------------
+// MAIN
+// ----------------------------------------------------------------
+
+int main()
+{
+    char line[256];
+    const char *trace;
+    unsigned long seq, timeUs, id;
+    long a, b, c;
+    unsigned long lastSeq = 0;
+
+    while (fgets(line, sizeof (line), stdin) != NULL) {
+        trace = strstr(line, UBLOX_TRACE_LINE_PREFIX ",");
+        if ((trace != NULL) &&
+            (sscanf(trace + strlen(UBLOX_TRACE_LINE_PREFIX ","), "%lu,%lu,%lu,%ld,%ld,%ld",
+                    &seq, &timeUs, &id, &a, &b, &c) == 6)) {
+            if ((lastSeq != 0) && (seq != lastSeq + 1)) {
+                printf("[%lu event(s) lost]\n", seq - lastSeq - 1);
+            }
+            lastSeq = seq;
+            printf("%10lu.%06lu ", timeUs / 1000000, timeUs % 1000000);
+            printEvent(id, a, b, c);
+            printf("\n");
+        } else {
+            fputs(line, stdout);
+        }
+    }
+
+    return 0;
+}
+
+// End of file
@@ -0,0 +1,598 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Replays a transcript recorded by the driver (transcriptStart() and
+// printTranscript(), see UbloxTranscript.h) to the driver running on a
+// PC, playing the part of the module on a pty as mock_modem does.  The
+// driver must send exactly what it sent when the transcript was
+// recorded; each thing the module sent goes back at the same time
+// after the driver's last command as it did then, or sooner with -x,
+// so that a session with a real module and network can be run again
+// and again without either, and driver versions compared on the
+// same timing.  At the end it reports how quickly the driver turned
+// responses into its next command, against the recording, and the
+// CPU time the command took.
+// Build with "make", run with "./transcript_replay -h" for the options.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <termios.h>
+#include <pty.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <string>
+#include <vector>
+
+// ----------------------------------------------------------------
+// COMPILE-TIME MACROS
+// ----------------------------------------------------------------
+
+// The path the pty is linked to if -p is not given; the same as
+// HOST_SERIAL_DEFAULT in shim/mbed.h.
+#define DEFAULT_PORT "/tmp/ublox-mock-modem"
+
+// The environment variable that tells the host shim where the pty
+// is, set for the command run after "--".
+#define HOST_SERIAL_ENV "UBLOX_HOST_SERIAL"
+
+// The prefix of the lines of a transcript, as in UbloxTranscript.h.
+#define UBLOX_TRANSCRIPT_LINE_PREFIX "UBXTS"
+
+// How much of a record is shown with -v and when the driver
+// departs from the transcript.
+#define SHOW_SIZE 60
+
+// ----------------------------------------------------------------
+// PRIVATE TYPES
+// ----------------------------------------------------------------
+
+// A record of the transcript.
+typedef struct {
+    bool tx;          // true if it went to the module.
+    int64_t startUs;  // When the first character went, from the start.
+    int64_t endUs;    // When the last character went.
+    std::string data;
+} Record;
+
+// Turnaround times: from the last character of a response to the
+// first character of the driver's next command.
+typedef struct {
+    int count;
+    int64_t totalUs;
+    int64_t maxUs;
+} Turnaround;
+
+// ----------------------------------------------------------------
+// PRIVATE VARIABLES
+// ----------------------------------------------------------------
+
+// Settings.
+static const char *port = DEFAULT_PORT;
+static double speed = 1.0;
+static bool verbose = false;
+
+// The transcript.
+static std::vector<Record> records;
+static unsigned long numLost = 0;
+
+// The pty.
+static int masterFd = -1;
+static int slaveFd = -1;
+
+// Where the replay is: the record and how far into it, and the
+// times, real and recorded, from which the records still to come
+// are timed, which is the end of the last command.
+static size_t next = 0;
+static size_t offset = 0;
+static uint64_t anchorUs = 0;
+static int64_t anchorRecordedUs = 0;
+
+// Characters waiting to go to the driver.
+static std::string out;
+
+// When the last character of the last response went.
+static uint64_t lastRxUs = 0;
+
+// What happened.
+static Turnaround replayed = {0, 0, 0};
+static Turnaround recorded = {0, 0, 0};
+static unsigned long numRxChars = 0;
+static unsigned long numTxChars = 0;
+static bool diverged = false;
+
+// Set on SIGINT/SIGTERM.
+static volatile bool stopRequested = false;
+
+// ----------------------------------------------------------------
+// PRIVATE FUNCTIONS: GENERAL
+// ----------------------------------------------------------------
+
+// Return a monotonic time in microseconds.
+static uint64_t nowUs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec * 1000000ULL) + (ts.tv_nsec / 1000);
+}
+
+// Return some characters with what isn't printable escaped.
+static std::string show(const std::string &data, size_t start = 0)
+{
+    std::string text;
+    char buf[8];
+
+    for (size_t x = start; (x < data.size()) && (x < start + SHOW_SIZE); x++) {
+        unsigned char c = data[x];
+        if (c == '\r') {
+            text += "\\r";
+        } else if (c == '\n') {
+            text += "\\n";
+        } else if ((c < 0x20) || (c >= 0x7F)) {
+            snprintf(buf, sizeof (buf), "\\x%02x", c);
+            text += buf;
+        } else {
+            text += (char) c;
+        }
+    }
+    if (data.size() > start + SHOW_SIZE) {
+        text += "...";
+    }
+
+    return text;
+}
+
+// Add a time to a set of turnaround times.
+static void turnaroundAdd(Turnaround *turnaround, int64_t us)
+{
+    turnaround->count++;
+    turnaround->totalUs += us;
+    if (us > turnaround->maxUs) {
+        turnaround->maxUs = us;
+    }
+}
+
+// Return the real time at which a point in the recording is due.
+static uint64_t dueUs(int64_t recordedUs)
+{
+    if ((speed <= 0) || (recordedUs <= anchorRecordedUs)) {
+        return anchorUs;
+    }
+
+    return anchorUs + (uint64_t) ((recordedUs - anchorRecordedUs) / speed);
+}
+
+// ----------------------------------------------------------------
+// PRIVATE FUNCTIONS: TRANSCRIPT
+// ----------------------------------------------------------------
+
+// Convert a string of hex digits to characters.
+static bool unhex(const char *hex, std::string *data)
+{
+    unsigned int c;
+
+    while ((hex[0] != 0) && (hex[0] != '\r') && (hex[0] != '\n')) {
+        if (sscanf(hex, "%2x", &c) != 1) {
+            return false;
+        }
+        *data += (char) c;
+        hex += 2;
+    }
+
+    return true;
+}
+
+// Read the given transcript, counting from 1, from a file in which
+// its lines may be among others, e.g. a capture of the console.
+static bool readTranscript(const char *path, int which)
+{
+    FILE *fp;
+    char line[256];
+    char *p;
+    char dir;
+    unsigned long startUs;
+    unsigned long endUs;
+    int numRecords;
+    int count = 0;
+    int consumed;
+    bool inTranscript = false;
+    bool complete = false;
+    Record record;
+
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "transcript_replay: unable to open %s (%s)\n", path, strerror(errno));
+        return false;
+    }
+
+    while (!complete && (fgets(line, sizeof (line), fp) != NULL)) {
+        p = strstr(line, UBLOX_TRANSCRIPT_LINE_PREFIX ",");
+        if (p == NULL) {
+            continue;
+        }
+        p += strlen(UBLOX_TRANSCRIPT_LINE_PREFIX ",");
+        if (sscanf(p, "S,%d,%lu", &numRecords, &numLost) == 2) {
+            count++;
+            inTranscript = (count == which);
+        } else if (inTranscript && (*p == 'E')) {
+            complete = true;
+        } else if (inTranscript &&
+                   (sscanf(p, "%c,%lu,%lu,%n", &dir, &startUs, &endUs, &consumed) == 3) &&
+                   ((dir == 'T') || (dir == 'R'))) {
+            record.tx = (dir == 'T');
+            record.startUs = startUs;
+            record.endUs = endUs;
+            record.data.clear();
+            if (!unhex(p + consumed, &record.data)) {
+                fprintf(stderr, "transcript_replay: bad line in %s: %s", path, line);
+                fclose(fp);
+                return false;
+            }
+            // A long record is printed over several lines, each
+            // starting where the last ended
+            if (!records.empty() && (records.back().tx == record.tx) &&
+                (records.back().endUs == record.startUs)) {
+                records.back().endUs = record.endUs;
+                records.back().data += record.data;
+            } else {
+                records.push_back(record);
+            }
+        }
+    }
+    fclose(fp);
+
+    if (!complete) {
+        fprintf(stderr, "transcript_replay: transcript %d not found complete in %s\n", which, path);
+        return false;
+    }
+    if (numLost > 0) {
+        fprintf(stderr, "transcript_replay: the recording lost %lu characters when its buffer filled;"
+                " only what was recorded before that can be replayed\n", numLost);
+    }
+    if (verbose) {
+        fprintf(stderr, "transcript_replay: %d records\n", (int) records.size());
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------
+// PRIVATE FUNCTIONS: REPLAY
+// ----------------------------------------------------------------
+
+// Move the characters from the module that are due, or all of them
+// up to the next command if now is 0, to the output, returning the
+// number moved.
+static size_t rxDue(uint64_t now)
+{
+    size_t moved = 0;
+
+    while ((next < records.size()) && !records[next].tx) {
+        Record *record = &records[next];
+        size_t size = record->data.size();
+        size_t due = size;
+
+        if (now > 0) {
+            int64_t spanUs = record->endUs - record->startUs;
+            if (now < dueUs(record->startUs)) {
+                due = 0;
+            } else if ((spanUs > 0) && (now < dueUs(record->endUs))) {
+                // Spread over the time it took
+                due = 1 + (size_t) (((now - dueUs(record->startUs)) * speed * size) / spanUs);
+                if (due > size) {
+                    due = size;
+                }
+            }
+        }
+        if (due <= offset) {
+            break;
+        }
+        if (verbose && (offset == 0)) {
+            fprintf(stderr, "-> %s\n", show(record->data).c_str());
+        }
+        out.append(record->data, offset, due - offset);
+        numRxChars += due - offset;
+        moved += due - offset;
+        offset = due;
+        if (offset < size) {
+            break;
+        }
+        next++;
+        offset = 0;
+    }
+
+    return moved;
+}
+
+// Send what there is to send to the driver.
+static void transmit()
+{
+    ssize_t len;
+
+    if (!out.empty()) {
+        len = write(masterFd, out.data(), out.size());
+        if (len > 0) {
+            out.erase(0, len);
+            if (out.empty()) {
+                lastRxUs = nowUs();
+            }
+        }
+    }
+}
+
+// Stop replaying because the driver has done something else.
+static void diverge(char c)
+{
+    std::string got(1, c);
+
+    diverged = true;
+    if (next >= records.size()) {
+        fprintf(stderr, "transcript_replay: the driver sent \"%s\" after the end of the transcript\n",
+                show(got).c_str());
+    } else {
+        fprintf(stderr, "transcript_replay: at record %d, character %d, the driver sent \"%s\""
+                " where the transcript has \"%s\"\n", (int) next + 1, (int) offset + 1,
+                show(got).c_str(), show(records[next].data, offset).c_str());
+    }
+}
+
+// Handle a character from the driver.
+static void rx(char c, uint64_t now)
+{
+    Record *record;
+    bool early;
+
+    // Whatever the module sent before this command goes now, the
+    // driver being ahead of the recording
+    early = (rxDue(0) > 0);
+    transmit();
+    if ((next >= records.size()) || (records[next].data[offset] != c)) {
+        diverge(c);
+        return;
+    }
+
+    record = &records[next];
+    if (offset == 0) {
+        if (verbose) {
+            fprintf(stderr, "<- %s\n", show(record->data).c_str());
+        }
+        if ((next > 0) && !records[next - 1].tx && !early && out.empty()) {
+            turnaroundAdd(&replayed, now - lastRxUs);
+            turnaroundAdd(&recorded, record->startUs - records[next - 1].endUs);
+        }
+    }
+    numTxChars++;
+    offset++;
+    if (offset >= record->data.size()) {
+        // What follows is timed from here
+        anchorUs = now;
+        anchorRecordedUs = record->endUs;
+        next++;
+        offset = 0;
+    }
+}
+
+// ----------------------------------------------------------------
+// PRIVATE FUNCTIONS: SET-UP
+// ----------------------------------------------------------------
+
+// Create the pty and link it to the port path.
+static bool openPty()
+{
+    struct termios tio;
+    char name[256];
+    int flags;
+
+    if (openpty(&masterFd, &slaveFd, name, NULL, NULL) < 0) {
+        fprintf(stderr, "transcript_replay: unable to open a pty (%s)\n", strerror(errno));
+        return false;
+    }
+    if (tcgetattr(slaveFd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(slaveFd, TCSANOW, &tio);
+    }
+    flags = fcntl(masterFd, F_GETFL);
+    fcntl(masterFd, F_SETFL, flags | O_NONBLOCK);
+
+    unlink(port);
+    if (symlink(name, port) < 0) {
+        fprintf(stderr, "transcript_replay: unable to link %s to %s (%s)\n", port, name, strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+// Stop on SIGINT or SIGTERM.
+static void stopHandler(int signal)
+{
+    (void) signal;
+    stopRequested = true;
+}
+
+// Print the usage.
+static void usage(const char *name)
+{
+    printf("Usage: %s [options] -t file -- command [args]\n"
+           "Replays a transcript recorded by the driver to the driver on a pty,\n"
+           "playing the part of the module.  The command is run with " HOST_SERIAL_ENV "\n"
+           "set to the pty; the replay stops when it exits, with its exit status, or\n"
+           "3 if the driver sent something other than what is in the transcript.\n"
+           "  -t file  the file holding the transcript, e.g. a capture of the\n"
+           "           console of a test that called printTranscript()\n"
+           "  -n num   which transcript in the file, counting from 1 (default 1)\n"
+           "  -x speed how many times faster than the recording (default 1);\n"
+           "           0 to answer each command as soon as it arrives\n"
+           "  -p path  link the pty to path (default " DEFAULT_PORT ")\n"
+           "  -v       print what goes back and forth on stderr\n"
+           "  -h       print this\n", name);
+}
+
+// ----------------------------------------------------------------
+// MAIN
+// ----------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+    const char *path = NULL;
+    int which = 1;
+    char **command = NULL;
+    pid_t child = -1;
+    int status = 0;
+    int opt;
+    char buf[256];
+    ssize_t len;
+    struct pollfd pfd;
+    struct timespec ts;
+    struct rusage childUsage;
+    uint64_t startUs;
+    uint64_t now;
+    uint64_t waitUs;
+    bool exited = false;
+
+    while ((opt = getopt(argc, argv, "t:n:x:p:vh")) != -1) {
+        switch (opt) {
+            case 't':
+                path = optarg;
+                break;
+            case 'n':
+                which = atoi(optarg);
+                break;
+            case 'x':
+                speed = atof(optarg);
+                break;
+            case 'p':
+                port = optarg;
+                break;
+            case 'v':
+                verbose = true;
+                break;
+            default:
+                usage(argv[0]);
+                return (opt == 'h') ? 0 : 2;
+        }
+    }
+    if (optind < argc) {
+        command = argv + optind;
+    }
+    if ((path == NULL) || (command == NULL)) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (!readTranscript(path, which) || !openPty()) {
+        return 2;
+    }
+
+    signal(SIGINT, stopHandler);
+    signal(SIGTERM, stopHandler);
+    signal(SIGPIPE, SIG_IGN);
+
+    memset(&childUsage, 0, sizeof (childUsage));
+    startUs = nowUs();
+    anchorUs = startUs;
+    child = fork();
+    if (child == 0) {
+        close(masterFd);
+        close(slaveFd);
+        setenv(HOST_SERIAL_ENV, port, 1);
+        execvp(command[0], command);
+        fprintf(stderr, "transcript_replay: unable to run %s (%s)\n", command[0], strerror(errno));
+        _exit(127);
+    } else if (child < 0) {
+        fprintf(stderr, "transcript_replay: unable to fork (%s)\n", strerror(errno));
+        return 2;
+    }
+
+    while (!stopRequested && !diverged) {
+        if (wait4(child, &status, WNOHANG, &childUsage) == child) {
+            exited = true;
+            break;
+        }
+
+        rxDue(nowUs());
+        transmit();
+
+        // Wait for characters or until the next are due
+        now = nowUs();
+        waitUs = 100000;
+        if ((next < records.size()) && !records[next].tx && out.empty()) {
+            uint64_t due = dueUs(records[next].startUs);
+            if (offset > 0) {
+                // Part way through: a character at a time
+                due = now + 1000;
+            }
+            waitUs = (due <= now) ? 0 : ((due - now < waitUs) ? due - now : waitUs);
+        }
+        ts.tv_sec = waitUs / 1000000;
+        ts.tv_nsec = (waitUs % 1000000) * 1000;
+        pfd.fd = masterFd;
+        pfd.events = POLLIN | (out.empty() ? 0 : POLLOUT);
+        pfd.revents = 0;
+        if ((ppoll(&pfd, 1, &ts, NULL) > 0) && (pfd.revents & POLLIN)) {
+            len = read(masterFd, buf, sizeof (buf));
+            now = nowUs();
+            for (ssize_t x = 0; (x < len) && !diverged; x++) {
+                rx(buf[x], now);
+            }
+        }
+    }
+
+    if (!exited) {
+        kill(child, SIGTERM);
+        wait4(child, &status, 0, &childUsage);
+    }
+    now = nowUs();
+    unlink(port);
+    close(masterFd);
+    close(slaveFd);
+
+    fprintf(stderr, "transcript_replay: replayed %d of %d records at %gx, %lu characters to the"
+            " driver and %lu from it\n", (int) next, (int) records.size(), speed,
+            numRxChars, numTxChars);
+    if (replayed.count > 0) {
+        fprintf(stderr, "transcript_replay: driver turnaround over %d responses: average %.3f ms,"
+                " max %.3f ms; recorded average %.3f ms, max %.3f ms\n", replayed.count,
+                replayed.totalUs / 1000.0 / replayed.count, replayed.maxUs / 1000.0,
+                recorded.totalUs / 1000.0 / recorded.count, recorded.maxUs / 1000.0);
+    }
+    fprintf(stderr, "transcript_replay: %.3f s elapsed, %.3f s user and %.3f s system CPU\n",
+            (now - startUs) / 1000000.0,
+            childUsage.ru_utime.tv_sec + (childUsage.ru_utime.tv_usec / 1000000.0),
+            childUsage.ru_stime.tv_sec + (childUsage.ru_stime.tv_usec / 1000000.0));
+
+    if (diverged) {
+        return 3;
+    }
+    // Only what the module sent may be left over
+    for (size_t x = next; x < records.size(); x++) {
+        if (records[x].tx && exited && WIFEXITED(status) && (WEXITSTATUS(status) == 0)) {
+            fprintf(stderr, "transcript_replay: the command finished before the transcript\n");
+            return 1;
+        }
+    }
+
+    return (exited && WIFEXITED(status)) ? WEXITSTATUS(status) : 1;
+}
+
+// End of file
@@ -0,0 +1,347 @@
+/* Copyright (c) 2017 ublox Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host-side benchmark comparing the sscanf() URC parsing that the
+// driver used to do with UbloxUrcScanner.  Each URC is parsed both
+// ways, the results are checked against each other and then each
+// parser is timed over many iterations.  Build and run with "make".
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "UbloxUrcScanner.h"
+
+// ----------------------------------------------------------------
+// COMPILE-TIME MACROS
+// ----------------------------------------------------------------
+
+// The number of times to parse each URC.
+#ifndef ITERATIONS
+# define ITERATIONS 200000
+#endif
+
+// ----------------------------------------------------------------
+// PRIVATE TYPES
+// ----------------------------------------------------------------
+
+// The values of a URC, enough to compare the two parsers.
+typedef struct {
+    int numValues;
+    int i[20];
+    float f[2];
+    char s[33];
+} Values;
+
+// A URC, its parsers and a name.
+typedef struct {
+    const char *name;
+    const char *line;
+    bool (*parseSscanf)(const char *line, Values *values);
+    bool (*parseScanner)(const char *line, Values *values);
+} Urc;
+
+// ----------------------------------------------------------------
+// PRIVATE FUNCTIONS: SSCANF
+// ----------------------------------------------------------------
+
+// Copy a line into a buffer, as the URC handlers did with
+// read_at_to_char() before calling sscanf().
+static const char *copyLine(const char *line, char *buf, int size)
+{
+    int count = 0;
+
+    while ((count < size - 1) && (*(line + count) != 0) && (*(line + count) != '\n')) {
+        *(buf + count) = *(line + count);
+        count++;
+    }
+    if ((count > 0) && (*(buf + count - 1) == '\r')) {
+        count--;
+    }
+    *(buf + count) = 0;
+
+    return buf;
+}
+
+// +UUHTTPCR: <profile_id>,<op_code>,<param_val>
+static bool uuhttpcrSscanf(const char *line, Values *v)
+{
+    char buf[128];
+
+    v->numValues = sscanf(copyLine(line, buf, sizeof (buf)), ": %d,%d,%d", &v->i[0], &v->i[1], &v->i[2]);
+    return v->numValues == 3;
+}
+
+// +UUFTPCR: <op_code>,<ftp_result>[,<md5_sum>]
+static bool uuftpcrSscanf(const char *line, Values *v)
+{
+    char buf[128];
+
+    v->numValues = sscanf(copyLine(line, buf, sizeof (buf)), ": %d,%d,%32[^\n]\n", &v->i[0], &v->i[1], v->s);
+    return v->numValues == 3;
+}
+
+// +CCFC: <status>,<class>,"<number>"
+static bool ccfcSscanf(const char *line, Values *v)
+{
+    char buf[128];
+
+    v->numValues = sscanf(copyLine(line, buf, sizeof (buf)), ": %d,%d,\"%32[^\"][\"]", &v->i[0], &v->i[1], v->s);
+    return v->numValues == 3;
+}
+
+// +CMGL: <ix>,...
+static bool cmglSscanf(const char *line, Values *v)
+{
+    char buf[128];
+
+    v->numValues = sscanf(copyLine(line, buf, sizeof (buf)), ": %d,", &v->i[0]);
+    return v->numValues == 1;
+}
+
+// +UULOC: <date>,<time>,<lat>,<long>,<alt>,<uncertainty>,<speed>,<direction>,<vertical_acc>,<sensor_used>,<SV_used>,...
+static bool uuloc1Sscanf(const char *line, Values *v)
+{
+    char buf[128];
+
+    v->numValues = sscanf(copyLine(line, buf, sizeof (buf)), ": %d/%d/%d,%d:%d:%d.%*d,%f,%f,%d,%d,%d,%d,%d,%d,%d,%*d,%*d",
+                          &v->i[0], &v->i[1], &v->i[2], &v->i[3], &v->i[4], &v->i[5],
+                          &v->f[0], &v->f[1], &v->i[6], &v->i[7], &v->i[8], &v->i[9],
+                          &v->i[10], &v->i[11], &v->i[12]);
+    return v->numValues == 15;
+}
+
+// +UULOC: <sol>,<num>,<sensor_used>,<date>,<time>,<lat>,<long>,<alt>,<uncertainty>,<speed>,<direction>,<vertical_acc>,<SV_used>,...
+static bool uuloc2Sscanf(const char *line, Values *v)
+{
+    char buf[128];
+
+    v->numValues = sscanf(copyLine(line, buf, sizeof (buf)), ": %d,%d,%d,%d/%d/%d,%d:%d:%d.%*d,%f,%f,%d,%d,%d,%d,%d,%d,%*d,%*d",
+                          &v->i[13], &v->i[14], &v->i[11], &v->i[0], &v->i[1], &v->i[2],
+                          &v->i[3], &v->i[4], &v->i[5], &v->f[0], &v->f[1], &v->i[6],
+                          &v->i[7], &v->i[8], &v->i[9], &v->i[10], &v->i[12]);
+    return v->numValues == 17;
+}
+
+// +UULOC: <sol>,<num>,<sensor_used>,<date>,<time>,<lat>,<long>,<alt>,<lat50>,<long50>,<major50>,...
+static bool uuloc3Sscanf(const char *line, Values *v)
+{
+    char buf[128];
+
+    v->numValues = sscanf(copyLine(line, buf, sizeof (buf)), ": %d,%d,%d,%d/%d/%d,%d:%d:%d.%*d,%f,%f,%d,%*f,%*f,%d,%*d,%*d,%*d",
+                          &v->i[13], &v->i[14], &v->i[11], &v->i[0], &v->i[1], &v->i[2],
+                          &v->i[3], &v->i[4], &v->i[5], &v->f[0], &v->f[1], &v->i[6],
+                          &v->i[7]);
+    return v->numValues == 13;
+}
+
+// ----------------------------------------------------------------
+// PRIVATE FUNCTIONS: SCANNER
+// ----------------------------------------------------------------
+
+static bool uuhttpcrScanner(const char *line, Values *v)
+{
+    UbloxUrcScanner scanner(line, strlen(line));
+    bool success = scanner.getInt(&v->i[0]) && scanner.getInt(&v->i[1]) &&
+                   scanner.getInt(&v->i[2]);
+    scanner.finish();
+    return success;
+}
+
+static bool uuftpcrScanner(const char *line, Values *v)
+{
+    UbloxUrcScanner scanner(line, strlen(line));
+    bool success = scanner.getInt(&v->i[0]) && scanner.getInt(&v->i[1]) &&
+                   (scanner.getString(v->s, sizeof (v->s)) > 0);
+    scanner.finish();
+    return success;
+}
+
+static bool ccfcScanner(const char *line, Values *v)
+{
+    UbloxUrcScanner scanner(line, strlen(line));
+    bool success = scanner.getInt(&v->i[0]) && scanner.getInt(&v->i[1]) &&
+                   (scanner.getString(v->s, sizeof (v->s)) > 0);
+    scanner.finish();
+    return success;
+}
+
+static bool cmglScanner(const char *line, Values *v)
+{
+    UbloxUrcScanner scanner(line, strlen(line));
+    bool success = scanner.getInt(&v->i[0]);
+    scanner.finish();
+    return success;
+}
+
+// The common part of the three +UULOC forms, from <date> to <alt>.
+static bool uulocCommon(UbloxUrcScanner *scanner, Values *v)
+{
+    int32_t latitude;
+    int32_t longitude;
+    bool success;
+
+    success = scanner->getTime(&v->i[3], &v->i[4], &v->i[5]) &&
+              scanner->getFixed(&latitude, 7) &&
+              scanner->getFixed(&longitude, 7) &&
+              scanner->getInt(&v->i[6]);
+    v->f[0] = (float) latitude / 10000000.0f;
+    v->f[1] = (float) longitude / 10000000.0f;
+
+    return success;
+}
+
+static bool uuloc1Scanner(const char *line, Values *v)
+{
+    UbloxUrcScanner scanner(line, strlen(line));
+    bool success = scanner.getDate(&v->i[0], &v->i[1], &v->i[2]) &&
+                   uulocCommon(&scanner, v) &&
+                   scanner.getInt(&v->i[7]) && scanner.getInt(&v->i[8]) &&
+                   scanner.getInt(&v->i[9]) && scanner.getInt(&v->i[10]) &&
+                   scanner.getInt(&v->i[11]) && scanner.getInt(&v->i[12]);
+    scanner.finish();
+    return success;
+}
+
+static bool uuloc2Scanner(const char *line, Values *v)
+{
+    UbloxUrcScanner scanner(line, strlen(line));
+    bool success = scanner.getInt(&v->i[13]) && scanner.getInt(&v->i[14]) &&
+                   scanner.getInt(&v->i[11]) &&
+                   scanner.getDate(&v->i[0], &v->i[1], &v->i[2]) &&
+                   uulocCommon(&scanner, v) &&
+                   scanner.getInt(&v->i[7]) && scanner.getInt(&v->i[8]) &&
+                   scanner.getInt(&v->i[9]) && scanner.getInt(&v->i[10]) &&
+                   scanner.getInt(&v->i[12]);
+    scanner.finish();
+    return success;
+}
+
+static bool uuloc3Scanner(const char *line, Values *v)
+{
+    UbloxUrcScanner scanner(line, strlen(line));
+    bool success = scanner.getInt(&v->i[13]) && scanner.getInt(&v->i[14]) &&
+                   scanner.getInt(&v->i[11]) &&
+                   scanner.getDate(&v->i[0], &v->i[1], &v->i[2]) &&
+                   uulocCommon(&scanner, v) &&
+                   scanner.skipField() && scanner.skipField() &&
+                   scanner.getInt(&v->i[7]);
+    scanner.finish();
+    return success;
+}
+
+// ----------------------------------------------------------------
+// PRIVATE VARIABLES
+// ----------------------------------------------------------------
+
+static const Urc urcs[] = {
+    {"+UUHTTPCR", ": 0,1,1\r\n", uuhttpcrSscanf, uuhttpcrScanner},
+    {"+UUFTPCR", ": 13,1,0123456789abcdef0123456789abcdef\r\n", uuftpcrSscanf, uuftpcrScanner},
+    {"+CCFC", ": 1,1,\"+441234567890\"\r\n", ccfcSscanf, ccfcScanner},
+    {"+CMGL", ": 3,\"REC READ\",\"+441234567890\",,\"17/07/12,10:00:00+04\"\r\n", cmglSscanf, cmglScanner},
+    {"+UULOC (1)", ": 12/07/2017,10:00:00.000,52.2234567,-0.1234567,60,40,0,0,0,2,0,0,0\r\n",
+     uuloc1Sscanf, uuloc1Scanner},
+    {"+UULOC (2)", ": 1,1,1,12/07/2017,10:00:00.000,52.2234567,-0.1234567,60,40,0,0,0,7,0,0\r\n",
+     uuloc2Sscanf, uuloc2Scanner},
+    {"+UULOC (3)", ": 1,1,2,12/07/2017,10:00:00.000,52.2234567,-0.1234567,60,52.22,-0.12,400,300,45,68\r\n",
+     uuloc3Sscanf, uuloc3Scanner}
+};
+
+// ----------------------------------------------------------------
+// PRIVATE FUNCTIONS: BENCHMARK
+// ----------------------------------------------------------------
+
+// Return a monotonic time in nanoseconds.
+static long long nowNs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((long long) ts.tv_sec * 1000000000LL) + ts.tv_nsec;
+}
+
+// Check that the two parsers agree on a URC.
+static bool check(const Urc *urc)
+{
+    Values a;
+    Values b;
+    bool success = true;
+
+    memset(&a, 0, sizeof (a));
+    memset(&b, 0, sizeof (b));
+    if (!urc->parseSscanf(urc->line, &a) || !urc->parseScanner(urc->line, &b)) {
+        printf("%-12s parse failed\n", urc->name);
+        return false;
+    }
+    for (unsigned int x = 0; x < sizeof (a.i) / sizeof (a.i[0]); x++) {
+        if (a.i[x] != b.i[x]) {
+            printf("%-12s integer %d differs: %d, %d\n", urc->name, x, a.i[x], b.i[x]);
+            success = false;
+        }
+    }
+    for (unsigned int x = 0; x < sizeof (a.f) / sizeof (a.f[0]); x++) {
+        if ((a.f[x] - b.f[x] > 0.000001f) || (b.f[x] - a.f[x] > 0.000001f)) {
+            printf("%-12s number %d differs: %f, %f\n", urc->name, x, a.f[x], b.f[x]);
+            success = false;
+        }
+    }
+    if (strcmp(a.s, b.s) != 0) {
+        printf("%-12s string differs: \"%s\", \"%s\"\n", urc->name, a.s, b.s);
+        success = false;
+    }
+
+    return success;
+}
+
+// Time a parser over ITERATIONS, returning ns per parse.
+static long long timeParser(bool (*parse)(const char *, Values *), const char *line)
+{
+    Values v;
+    volatile bool result = false;
+    long long start = nowNs();
+
+    for (int x = 0; x < ITERATIONS; x++) {
+        result = parse(line, &v);
+    }
+    (void) result;
+
+    return (nowNs() - start) / ITERATIONS;
+}
+
+// ----------------------------------------------------------------
+// MAIN
+// ----------------------------------------------------------------
+
+int main()
+{
+    bool success = true;
+    long long sscanfNs;
+    long long scannerNs;
+
+    printf("%-12s %12s %12s\n", "URC", "sscanf ns", "scanner ns");
+    for (unsigned int x = 0; x < sizeof (urcs) / sizeof (urcs[0]); x++) {
+        if (check(&urcs[x])) {
+            sscanfNs = timeParser(urcs[x].parseSscanf, urcs[x].line);
+            scannerNs = timeParser(urcs[x].parseScanner, urcs[x].line);
+            printf("%-12s %12lld %12lld\n", urcs[x].name, sscanfNs, scannerNs);
+        } else {
+            success = false;
+        }
+    }
+
+    return success ? 0 : 1;
+}
+
+// End of file